@@ -568,9 +568,18 @@ class PHMAC_SHA : public PHMAC
     typedef struct env_md_st Algorithm;
 
     explicit PHMAC_SHA(Algorithm const * algo);
+  public:
+    ~PHMAC_SHA();
+  protected:
+    virtual void InitKey(const void * key, PINDEX len);
     virtual void InternalProcess(const void * data, PINDEX len, PHMAC::Result & result);
 
     Algorithm const * m_algorithm;
+    struct hmac_ctx_st * m_context; // Keyed once, so padded key digests are not recalculated for each Process()
+
+  private:
+    PHMAC_SHA(const PHMAC_SHA &) { }
+    void operator=(const PHMAC_SHA &) { }
 };
 
 
@@ -1307,6 +1307,9 @@ class PHTTPServer : public PHTTP
     /// Get time last command was read
     const PTime & GetLastCommandTime() const { return m_lastCommandTime; }
 
+    /// Get the time to wait for the next command before the connection is closed
+    PTimeInterval GetNextCommandTimeout() const { return m_transactionCount > 0 ? m_nextTimeout : GetReadTimeout(); }
+
   protected:
     void Construct();
 #if P_SSL
@@ -1332,9 +1335,14 @@ class PHTTPServer : public PHTTP
 // PHTTPListener
 
 class PTCPSocket;
+class PSocketEventLoop;
 
 /** Listener for incoming HTTP request with thread pool to handle those
     requests.
+
+    By default a worker thread from the pool is dedicated to each connection
+    for its whole lifetime, including while a keep-alive connection is idle
+    waiting for the next request. See SetEventDriven() for an alternative.
  */
 class PHTTPListener
 {
@@ -1365,6 +1373,30 @@ public:
   /// Shut down the listener socket, it's thread, and all threads in the pool.
   void ShutdownListeners();
 
+  /** Set event driven mode.
+      When enabled, a connection waiting for a request is "parked" on a
+      PSocketEventLoop rather than blocking a worker thread. Once a
+      complete request header has arrived the connection is handed back to
+      the thread pool to be processed. This allows a large number of idle
+      keep-alive connections with a small number of worker threads.
+
+      Only connections where CreateChannelForHTTP() returns the socket
+      itself are parked, e.g. TLS connections are always processed with a
+      dedicated worker.
+
+      This must be called before ListenForHTTP().
+    */
+  void SetEventDriven(
+    bool enable = true,       ///< Enable event driven mode
+    unsigned pollThreads = 1  ///< Threads waiting on idle connections
+  );
+
+  /// Indicate event driven mode is enabled.
+  bool IsEventDriven() const { return m_eventDriven; }
+
+  /// Get the number of connections currently parked waiting for a request.
+  PINDEX GetParkedCount() const;
+
   /// Indicate is currently listening and processing requests.
   bool IsListening() const { return !m_httpListeningSockets.IsEmpty() && m_httpListeningSockets.front().IsOpen(); }
 
@@ -1387,6 +1419,7 @@ public:
   struct Worker
   {
     Worker(PHTTPListener & listener, PTCPSocket * socket);
+    Worker(PHTTPListener & listener, PHTTPServer * httpServer);
     ~Worker();
     void Work();
 
@@ -1407,6 +1440,11 @@ public:
 
 protected:
   void ListenMain();
+  bool ParkConnection(PHTTPServer * httpServer);
+  void CloseParkedConnection(PHTTPServer * httpServer);
+  void CloseParkedConnections();
+  void CloseIdleConnections();
+  PDECLARE_NOTIFIER2(PSocket, PHTTPListener, OnParkedReadable, unsigned);
 
   PHTTPSpace         m_httpNameSpace;
   PString            m_listenerInterfaces;
@@ -1416,6 +1454,23 @@ protected:
   PList<PHTTPServer> m_httpServers;
   PDECLARE_MUTEX(    m_httpServersMutex);
   ThreadPool         m_threadPool;
+
+  struct Parked
+  {
+    Parked(PHTTPServer * httpServer);
+
+    PHTTPServer * m_httpServer;
+    PBYTEArray    m_header;
+    PINDEX        m_headerSize;
+    PTime         m_expiry;
+  };
+  typedef std::map<PSocket *, Parked> ParkedMap;
+
+  bool               m_eventDriven;
+  unsigned           m_pollThreads;
+  PSocketEventLoop * m_eventLoop;
+  ParkedMap          m_parked;
+  mutable PDECLARE_MUTEX(m_parkedMutex);
 };
 
 
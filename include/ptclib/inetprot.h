@@ -125,6 +125,19 @@ class PInternetProtocol : public PIndirectChannel
        const PTimeInterval & t
      );
 
+    /** Set the size of the read ahead buffer. Data is read from the
+        underlying channel in blocks of this size and then returned from
+        there by <A>Read()</A>, <A>ReadChar()</A> and <A>ReadLine()</A>.
+        A <A>Read()</A> of at least this size with nothing buffered goes
+        directly to the underlying channel. Default value is 4096 bytes.
+      */
+    void SetReadAheadSize(
+      PINDEX size   ///< New size of read ahead buffer
+    );
+
+    /// Get the size of the read ahead buffer.
+    PINDEX GetReadAheadSize() const { return m_readAheadSize; }
+
   // New functions for class.
     /** Connect a socket to a remote host for the internet protocol.
 
@@ -213,6 +226,12 @@ class PInternetProtocol : public PIndirectChannel
       PINDEX len            ///< Number of characters to be returned.
     );
 
+    /** Get the number of characters that have been read ahead, or put back
+       with <A>UnRead()</A>, and will be returned by the next <A>Read()</A>
+       without going to the underlying channel.
+     */
+    PINDEX GetUnReadCount() const { return unReadCount; }
+
     /** Write a single line for a command. The command name for the command
        number is output, then a space, the the <CODE>param</CODE> string
        followed at the end with a CR/LF pair.
@@ -380,11 +399,19 @@ class PInternetProtocol : public PIndirectChannel
     PStringArray commandNames;
     // Names of each of the command codes.
 
+    bool InternalReadAhead();
+
     PCharArray unReadBuffer;
-    // Buffer for characters put back into the data stream.
+    // Buffer for characters read ahead or put back into the data stream.
+
+    PINDEX unReadStart;
+    // Position in buffer of next character to be read.
 
     PINDEX unReadCount;
-    // Buffer count for characters put back into the data stream.
+    // Buffer count for characters read ahead or put back into the data stream.
+
+    PINDEX m_readAheadSize;
+    // Size of blocks read from underlying channel.
 
     PTimeInterval readLineTimeout;
     // Time for characters in a line to be received.
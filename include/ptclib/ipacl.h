@@ -112,6 +112,9 @@ class PIpAccessControlEntry : public PObject
           n.n.n.n/b       An IP network using b bits of mask, for example
                           10.1.0.0/14 is equivalent to 10.0.1.0/255.248.0.0
           n.n.n.n/m.m.m.m An IP network using the specified mask
+          x:x::x          Simple IPv6 number, this has an implicit prefix
+                          length of 128 bits
+          x:x::x/b        An IPv6 network using b bits of prefix
           hostname        A specific host name, this has an implicit mask of
                           255.255.255.255
           .domain.dom     Matches an IP number whose cannonical name (found
@@ -179,6 +182,16 @@ PSORTED_LIST(PIpAccessControlList_base, PIpAccessControlEntry);
    list sorted so that the most specific IP number specification is first and
    the broadest onse later. The entry with the value having a mask of zero,
    that is the match all entry, is always last.
+
+   Searches do not scan the list. The first time one is done after the list
+   is changed, the IP network entries are compiled into a longest prefix
+   match trie, IPv4 and IPv6, which retains the above first match
+   semantics. Only domain and host name entries are still tested one by
+   one. Searches from multiple threads need no locking, though changing
+   the list while searching is still not thread safe. The compiled form is
+   shared by all references to the list, and discarded by any change made
+   through any of them, so changes must be made via PIpAccessControlList
+   and not via the PIpAccessControlList_base class.
  */
 class PIpAccessControlList : public PIpAccessControlList_base
 {
@@ -192,6 +205,22 @@ class PIpAccessControlList : public PIpAccessControlList_base
       PBoolean defaultAllowance = true
     );
 
+    /** Create a new reference to the same list.
+     */
+    PIpAccessControlList(
+      const PIpAccessControlList & other
+    );
+
+    /** Make this a reference to the same list as the other.
+     */
+    PIpAccessControlList & operator=(
+      const PIpAccessControlList & other
+    );
+
+    /** Destroy the list.
+     */
+    ~PIpAccessControlList();
+
     /** Load the system wide files commonly use under Linux (hosts.allow and
        hosts.deny file) for IP access. See the Linux man entries on these
        files for more information. Note, these files will be loaded regardless
@@ -302,6 +331,7 @@ class PIpAccessControlList : public PIpAccessControlList_base
     );
 
     /**Find the PIpAccessControl specification for the address.
+       This is the first entry in the list that matches the address.
       */
     PIpAccessControlEntry * Find(
       PIPSocket::Address address    ///< IP Address to find
@@ -335,10 +365,39 @@ class PIpAccessControlList : public PIpAccessControlList_base
       */
     void SetDefaultAllowance(PBoolean defAllow) { defaultAllowance = defAllow; }
 
+  /**@name Overrides from class PCollection, so the compiled form is rebuilt */
+  //@{
+    virtual PINDEX Append(PObject * obj);
+    virtual PBoolean Remove(const PObject * obj);
+    virtual PObject * RemoveAt(PINDEX index);
+    virtual void RemoveAll();
+  //@}
+
+  /**@name Hide the non-virtual removals of PSortedList, so the compiled form is rebuilt */
+  //@{
+    void erase(const iterator & it);
+    void erase(const const_iterator & it);
+    void pop_front() { erase(begin()); }
+    void pop_back() { erase(rbegin()); }
+  //@}
+
   private:
     PBoolean InternalLoadHostsAccess(const PString & daemon, const char * file, PBoolean allow);
     PBoolean InternalRemoveEntry(PIpAccessControlEntry & entry);
 
+    class Compiled;
+    const Compiled * GetCompiled() const;
+    void InvalidateCompiled();
+
+    // Shared, like the list itself, by all references to it
+    struct CompiledCache {
+      CompiledCache() : m_compiled(NULL) { }
+      ~CompiledCache();
+      atomic<const Compiled *> m_compiled;
+      PCriticalSection         m_mutex;
+    };
+    std::shared_ptr<CompiledCache> m_cache;
+
   protected:
     PBoolean defaultAllowance;
 };
@@ -52,6 +52,7 @@ class PJSON : public PObject
         virtual bool IsType(Types type) const = 0;
         virtual void ReadFrom(istream & strm) = 0;
         virtual void PrintOn(ostream & strm) const = 0;
+        virtual void AppendTo(std::string & buffer) const;
         virtual Base * DeepClone() const = 0;
       private:
         Base(const Base &) { }
@@ -72,6 +73,7 @@ class PJSON : public PObject
         virtual bool IsType(Types type) const;
         virtual void ReadFrom(istream & strm);
         virtual void PrintOn(ostream & strm) const;
+        virtual void AppendTo(std::string & buffer) const;
         virtual Base * DeepClone() const;
 
         bool IsType(const PString & name, Types type) const;
@@ -123,6 +125,7 @@ class PJSON : public PObject
         virtual bool IsType(Types type) const;
         virtual void ReadFrom(istream & strm);
         virtual void PrintOn(ostream & strm) const;
+        virtual void AppendTo(std::string & buffer) const;
         virtual Base * DeepClone() const;
 
         bool IsType(size_t index, Types type) const;
@@ -162,9 +165,11 @@ class PJSON : public PObject
     {
       public:
         String(const char * str = NULL) : PString(str) { }
+        String(const char * str, size_t len) : PString(str, len) { }
         virtual bool IsType(Types type) const;
         virtual void ReadFrom(istream & strm);
         virtual void PrintOn(ostream & strm) const;
+        virtual void AppendTo(std::string & buffer) const;
         virtual Base * DeepClone() const;
         String & operator=(const char * str) { PString::operator=(str); return *this; }
         String & operator=(const PString & str) { PString::operator=(str); return *this; }
@@ -179,6 +184,7 @@ class PJSON : public PObject
         virtual bool IsType(Types type) const;
         virtual void ReadFrom(istream & strm);
         virtual void PrintOn(ostream & strm) const;
+        virtual void AppendTo(std::string & buffer) const;
         virtual Base * DeepClone() const;
         Number & operator=(NumberType value) { m_value = value; return *this; }
         void SetValue(NumberType value) { m_value = value; }
@@ -194,6 +200,7 @@ class PJSON : public PObject
         virtual bool IsType(Types type) const;
         virtual void ReadFrom(istream & strm);
         virtual void PrintOn(ostream & strm) const;
+        virtual void AppendTo(std::string & buffer) const;
         virtual Base * DeepClone() const;
         Boolean & operator=(bool value) { m_value = value; return *this; }
         void SetValue(bool value) { m_value = value; }
@@ -206,9 +213,50 @@ class PJSON : public PObject
         virtual bool IsType(Types type) const;
         virtual void ReadFrom(istream & strm);
         virtual void PrintOn(ostream & strm) const;
+        virtual void AppendTo(std::string & buffer) const;
         virtual Base * DeepClone() const;
     };
 
+    /**Callback interface for event driven parsing of JSON.
+       This allows large documents to be processed without building the tree
+       of Base objects. Each function returns false to abort the parse.
+       Strings are not nul terminated, and are only valid for the duration of
+       the call.
+      */
+    class Handler
+    {
+      public:
+        virtual ~Handler() { }
+        virtual bool OnStartObject() { return true; }
+        virtual bool OnMemberName(const char * /*name*/, size_t /*length*/) { return true; }
+        virtual bool OnEndObject() { return true; }
+        virtual bool OnStartArray() { return true; }
+        virtual bool OnEndArray() { return true; }
+        virtual bool OnString(const char * /*str*/, size_t /*length*/) { return true; }
+        virtual bool OnNumber(NumberType /*value*/) { return true; }
+        virtual bool OnBoolean(bool /*value*/) { return true; }
+        virtual bool OnNull() { return true; }
+    };
+
+    /**Parse JSON from a memory buffer, calling the handler for each element.
+       Strings with no escape sequences are passed directly from the buffer
+       with no copy.
+      */
+    static bool Parse(
+      const char * data,
+      size_t length,
+      Handler & handler
+    );
+
+    /**Parse JSON from a stream, calling the handler for each element.
+       The stream is read in large blocks, so any data after the JSON value
+       will also be consumed.
+      */
+    static bool Parse(
+      istream & strm,
+      Handler & handler
+    );
+
     ///< Constructor
     PJSON();
     explicit PJSON(Types type);
@@ -225,6 +273,26 @@ class PJSON : public PObject
       const PString & str
     );
 
+    /**Parse JSON from a memory buffer.
+       This is much faster than ReadFrom() as it does not use istream, and
+       should be used whenever the whole document is available in memory.
+      */
+    bool FromBuffer(
+      const char * data,
+      size_t length
+    );
+    bool FromBuffer(
+      const PCharArray & data
+    ) { return FromBuffer(data, data.GetSize()); }
+
+    /**Append compact JSON to the buffer.
+       This is much faster than PrintOn() as it does not use ostream, but
+       cannot do "pretty" indented output.
+      */
+    void AppendTo(
+      std::string & buffer
+    ) const { PAssertNULL(m_root)->AppendTo(buffer); }
+
     PString AsString(
       std::streamsize initialIndent = 0,
       std::streamsize subsequentIndent = 0) const;
@@ -265,6 +265,9 @@ class PMonitoredSockets : public PSafeObject
         , m_lastCount(0)
         , m_errorCode(PChannel::NoError)
         , m_errorNumber(0)
+        , m_batch(NULL)
+        , m_batchSize(0)
+        , m_batchCount(0)
       { }
 
       void * m_buffer;              ///< Data to read/write
@@ -276,6 +279,14 @@ class PMonitoredSockets : public PSafeObject
       PTimeInterval m_timeout;      ///< Time to wait for data
       PChannel::Errors m_errorCode; ///< Error code for read/write
       int m_errorNumber;            ///< Error number (OS specific) for read/write
+
+      /* If m_batch is not NULL, then ReadFromBundle() reads up to m_batchSize
+         datagrams, all from the same socket, into m_batch and sets m_batchCount.
+         Note m_buffer/m_length are then ignored, m_addr and m_port are set
+         from the first datagram and m_lastCount is the total of all of them. */
+      PUDPSocket::Datagram * m_batch; ///< Array of datagrams for batch read
+      PINDEX m_batchSize;             ///< Number of entries in m_batch
+      PINDEX m_batchCount;            ///< Number of datagrams read into m_batch
     };
 
     /** Write to the remote address/port using the socket(s) available. If the
@@ -549,6 +549,20 @@ class PSTUNMessage : public PBYTEArray
     void AddFingerprint(PSTUNFingerprint * fp = NULL);
     bool CheckFingerprint(bool required) const;
 
+    /**Calculate FINGERPRINT value over raw message bytes, \p length is the
+       offset of the FINGERPRINT attribute.
+      */
+    static DWORD CalculateFingerprint(const BYTE * data, PINDEX length);
+
+#if P_SSL
+    /**Calculate MESSAGE-INTEGRITY value over raw message bytes, \p length is
+       the offset of the MESSAGE-INTEGRITY attribute. The \p hmac is already
+       keyed, so a busy server can keep one per credential. The header length
+       is temporarily adjusted, as required by RFC 5389.
+      */
+    static void CalculateMessageIntegrity(PHMAC & hmac, BYTE * data, PINDEX length, BYTE * hmacPtr, PINDEX hmacSize);
+#endif // P_SSL
+
   protected:
     PSTUNAttribute * GetFirstAttribute() const;
 #if P_SSL
@@ -44,10 +44,58 @@ class PSTUNServer : public PObject, public PSTUN
   PCLASSINFO(PSTUNServer, PObject)
   public:
     PSTUNServer();
+    ~PSTUNServer();
     
     bool Open(WORD port = DefaultPort);
     bool Open(PUDPSocket * socket1, PUDPSocket * socket2 = NULL);
 
+    /**Open a multi-threaded server, for high request rates.
+       Each worker thread has its own socket bound to the same address and
+       port using PSocket::CanReusePort, so the operating system distributes
+       incoming requests across them. Requests are received, and responses
+       sent, in batches.
+
+       Plain binding requests are answered directly from the received
+       datagram, without creating PSTUNMessage objects, and without calling
+       OnBindingResponse(). Anything else, including requests that fail
+       authentication, is passed to OnReceiveMessage() as usual, one at a
+       time.
+
+       No alternate address/port are available in this mode, and Read() and
+       Process() should not be used.
+      */
+    bool OpenWorkers(
+      const PIPSocketAddressAndPort & binding,  ///< Address and port to listen on
+      unsigned workers = 0,                     ///< Number of threads, zero means one per CPU core
+      unsigned batchSize = 32                   ///< Maximum datagrams received/sent in one system call
+    );
+
+    /// Statistics for a worker thread in multi-threaded mode.
+    struct WorkerStatistics
+    {
+      WorkerStatistics();
+      WorkerStatistics & operator+=(const WorkerStatistics & other);
+      void PrintOn(ostream & strm) const;
+
+      uint64_t m_requests;      ///< Datagrams received
+      uint64_t m_fastResponses; ///< Requests answered directly
+      uint64_t m_slowResponses; ///< Requests passed to OnReceiveMessage()
+      uint64_t m_batches;       ///< Number of receive system calls
+      uint64_t m_sendErrors;    ///< Responses that could not be sent
+    };
+
+    /// Get the number of worker threads, zero if not in multi-threaded mode.
+    unsigned GetWorkerCount() const { return m_workers.size(); }
+
+    /// Get the address and port the worker threads are listening on.
+    PIPSocketAddressAndPort GetWorkerAddress() const;
+
+    /// Get statistics for one worker thread.
+    WorkerStatistics GetWorkerStatistics(unsigned worker) const;
+
+    /// Get statistics totalled across all worker threads.
+    WorkerStatistics GetWorkerStatistics() const;
+
     bool IsOpen() const;
 
     bool Close();
@@ -97,6 +145,13 @@ class PSTUNServer : public PObject, public PSTUN
 
     SocketInfo * CreateAndAddSocket(const PIPSocket::Address & addess, WORD port);
 
+    bool IsUserNameValid(const PString & userName) const;
+
+    struct Worker;
+    friend struct Worker;
+    std::vector<Worker *> m_workers;
+    PDECLARE_MUTEX(       m_workerMutex);
+
     typedef std::map<PUDPSocket *, SocketInfo> SocketToSocketInfoMap;
     SocketToSocketInfoMap m_socketToSocketInfoMap;
     PSocket::SelectList   m_sockets;
@@ -108,6 +163,14 @@ class PSTUNServer : public PObject, public PSTUN
 };
 
 
+
+inline ostream & operator<<(ostream & strm, const PSTUNServer::WorkerStatistics & stats)
+{
+  stats.PrintOn(strm);
+  return strm;
+}
+
+
 #endif // P_STUNSRVR
 
 #endif // PTLIB_PSTUNSRVR_H
@@ -42,6 +42,7 @@
 #include <ptlib/pfactory.h>
 
 class PWAVFile;
+class PPCMResampler;
 
 namespace PWAV {
 
@@ -455,6 +456,7 @@ protected:
   PShortArray  m_readBuffer;
   PINDEX       m_readBufCount;
   PINDEX       m_readBufPos;
+  PPCMResampler * m_resampler;
 };
 
 #endif // P_WAVFILE
@@ -46,6 +46,15 @@ P_PUSH_MSVC_WARNINGS(4250)
     bytes, so you must check the GetLastReadCount() to determine the actual
     number of bytes read and not rely on the count being passed into the read
     function.
+
+    By default a mutex protects the queue, and any number of threads may
+    read or write. If there is only one reader thread, the SingleProducer
+    or MultiProducer modes may be used. These do not lock at all on the
+    read side, and in SingleProducer mode not on the write side either.
+    The other side is only woken when the queue goes from empty, or full,
+    and that side is actually waiting. These modes also allow data to be
+    written and read directly in the queue buffer, without copying, via
+    WriteReserve()/WriteCommit() and ReadPeek()/ReadConsume().
   */
 class PQueueChannel : public PChannel
 {
@@ -53,10 +62,18 @@ class PQueueChannel : public PChannel
   public:
   /**@name Construction */
   //@{
+    /// Concurrency mode for queue
+    enum Modes {
+      LockedMode,         ///< Any number of readers and writers, mutex protected
+      SingleProducerMode, ///< One reader and one writer thread, lock free
+      MultiProducerMode   ///< One reader and many writer threads, writers are serialised
+    };
+
     /** Create a new queue channel with the specified maximum size.
       */
     PQueueChannel(
-      PINDEX queueSize = 0   ///< Queue size
+      PINDEX queueSize = 0,     ///< Queue size
+      Modes mode = LockedMode   ///< Concurrency mode
     );
 
     /**Delete queue and release memory used.
@@ -119,19 +136,86 @@ class PQueueChannel : public PChannel
       PINDEX queueSize   ///< Queue size
     );
 
+    /**Open a queue, allocating the queueSize bytes, with concurrency mode.
+      */
+    bool Open(
+      PINDEX queueSize,  ///< Queue size
+      Modes mode         ///< Concurrency mode
+    );
+
     /// Get the queue size.
     PINDEX GetSize() const { return queueSize; }
 
     /// Get the current queue length.
-    PINDEX GetLength() const { return queueLength; }
+    PINDEX GetLength() const { return m_mode == LockedMode ? queueLength : (PINDEX)(m_writeCount - m_readCount); }
+
+    /// Get the concurrency mode.
+    Modes GetMode() const { return m_mode; }
+  //@}
+
+  /**@name Zero copy functions, not available in LockedMode */
+  //@{
+    /**Reserve space in the queue for writing directly.
+       This blocks for the write timeout if the queue is full. On entry
+       \p len is the maximum space wanted, zero for any, on exit it is the
+       amount of contiguous space available, which may be less than asked for
+       when the queue wraps around.
+
+       In MultiProducerMode, the other writers are blocked until WriteCommit()
+       is called.
+
+       @return pointer to space in queue, or NULL if timed out or closed.
+      */
+    BYTE * WriteReserve(
+      PINDEX & len    ///< Maximum space wanted, and space available
+    );
+
+    /**Make data written to the space from WriteReserve() available to the
+       reader. This must be called after every successful WriteReserve().
+      */
+    void WriteCommit(
+      PINDEX len      ///< Amount written, no more than that reserved
+    );
+
+    /**Get data in the queue for reading directly.
+       This blocks for the read timeout if the queue is empty. On entry
+       \p len is the maximum data wanted, zero for any, on exit it is the
+       amount of contiguous data available, which may be less than is in the
+       queue when it wraps around.
+
+       @return pointer to data in queue, or NULL if timed out or closed.
+      */
+    const BYTE * ReadPeek(
+      PINDEX & len    ///< Maximum data wanted, and data available
+    );
+
+    /**Remove data obtained with ReadPeek() from the queue, making space for
+       the writer.
+      */
+    void ReadConsume(
+      PINDEX len      ///< Amount to consume, no more than that peeked
+    );
   //@}
 
   protected:
+    BYTE * InternalWriteReserve(PINDEX & len);
+    void InternalWriteCommit(PINDEX len);
+    bool InternalWaitReadable();
+    bool InternalWaitWritable();
+
     PDECLARE_MUTEX(mutex);
     BYTE     * queueBuffer;
     PINDEX     queueSize, queueLength, enqueuePos, dequeuePos;
     PSyncPoint unempty;
     PSyncPoint unfull;
+
+    // Lock free modes, counters are total bytes ever written/read, 64 bit so never wrap
+    Modes            m_mode;
+    atomic<PUInt64>  m_writeCount;
+    atomic<PUInt64>  m_readCount;
+    atomic<bool>     m_readerWaiting;
+    atomic<bool>     m_writerWaiting;
+    PCriticalSection m_producerMutex;
 };
 
 
@@ -0,0 +1,181 @@
+/*
+ * sockevent.h
+ *
+ * Persistent socket readiness event loop
+ *
+ * Portable Windows Library
+ *
+ * Copyright (C) 2024 Vox Lucida Pty. Ltd.
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is Portable Windows Library.
+ *
+ * The Initial Developer of the Original Code is Vox Lucida Pty. Ltd.
+ *
+ * Contributor(s): ______________________________________.
+ */
+
+#ifndef PTLIB_SOCKEVENT_H
+#define PTLIB_SOCKEVENT_H
+
+#ifdef P_USE_PRAGMA
+#pragma interface
+#endif
+
+
+#include <ptlib.h>
+#include <ptlib/sockets.h>
+#include <map>
+#include <vector>
+
+
+/** Event loop for a large number of sockets.
+    Unlike PSocket::Select(), where the whole socket list is passed to the
+    operating system on every call, sockets are registered once with this
+    object and a small number of internal threads wait for any of them to
+    become ready. When a socket is ready the notifier given on registration
+    is called from one of those threads.
+
+    On Linux this uses epoll, and a given socket never has its notifier
+    called from two threads at the same time. On other platforms a single
+    thread uses poll(), or PSocket::Select() if that is not available.
+
+    The notifier is called once per readiness indication, it should read
+    all it can (e.g. a single datagram) and return. It will be called again
+    if there is still more data.
+  */
+class PSocketEventLoop : public PObject
+{
+    PCLASSINFO(PSocketEventLoop, PObject);
+  public:
+    /// Events that may be waited for, or reported to the notifier
+    enum Events {
+      ReadEvent   = 1,
+      WriteEvent  = 2,
+      ErrorEvent  = 4
+    };
+
+    /**Notifier for socket readiness, the INT parameter is a bit mask of
+       the Events that occurred. */
+    typedef PNotifierTemplate<unsigned> Notifier;
+    #define PDECLARE_SocketEventNotifier(cls, fn) PDECLARE_NOTIFIER2(PSocket, cls, fn, unsigned)
+
+  /**@name Construction */
+  //@{
+    /**Create a new event loop.
+       The \p threads parameter indicates how many threads will wait for and
+       dispatch socket events. This is ignored on platforms without epoll,
+       where a single thread is always used.
+      */
+    PSocketEventLoop(
+      unsigned threads = 1,
+      const PString & threadName = "SocketEvent"
+    );
+
+    /**Destroy the event loop, stopping all threads.
+       Any sockets still registered are removed, but not closed.
+      */
+    ~PSocketEventLoop();
+  //@}
+
+  /**@name Operations */
+  //@{
+    /**Register a socket with the loop.
+       The socket must be open, and must remain so until Remove() is called.
+
+       @return false if socket already registered or not open.
+      */
+    bool Add(
+      PSocket & socket,           ///< Socket to wait on
+      const Notifier & notifier,  ///< Notifier to call when ready
+      unsigned events = ReadEvent ///< Events to wait for
+    );
+
+    /**Remove a socket from the loop.
+       On return the notifier for the socket is not executing, and will never
+       be called again. The exception is if this is called from within the
+       notifier itself, in which case it will not be called again once it
+       returns.
+
+       @return false if socket was not registered.
+      */
+    bool Remove(
+      PSocket & socket   ///< Socket to stop waiting on
+    );
+
+    /**Stop all threads.
+       This is called automatically on destruction.
+      */
+    void Stop();
+
+    /// Get number of sockets currently registered.
+    PINDEX GetSize() const;
+
+    /// Indicate if platform has scalable event mechanism, e.g. epoll.
+    static bool IsScalable();
+  //@}
+
+  protected:
+    struct Registration
+    {
+      Registration(PSocket & socket, const Notifier & notifier, unsigned events, PUInt64 id)
+        : m_socket(socket)
+        , m_handle(socket.GetHandle())
+        , m_notifier(notifier)
+        , m_events(events)
+        , m_id(id)
+        , m_busyThread(PNullThreadIdentifier)
+        , m_removed(false)
+        , m_deleteOnReturn(false)
+      { }
+
+      PSocket          & m_socket;
+      P_INT_PTR          m_handle;
+      Notifier           m_notifier;
+      unsigned           m_events;
+      PUInt64            m_id;
+      PThreadIdentifier  m_busyThread;
+      bool               m_removed;
+      bool               m_deleteOnReturn;
+    };
+
+    void ThreadMain();
+    void Dispatch(PUInt64 id, unsigned events);
+    bool InternalAdd(Registration & reg);
+    void InternalRemove(Registration & reg);
+    bool InternalRearm(Registration & reg);
+    void InternalWait();
+
+    typedef std::map<PUInt64, Registration *> RegistrationsById;
+    typedef std::map<PSocket *, Registration *> RegistrationsBySocket;
+
+    PString               m_threadName;
+    mutable PDECLARE_MUTEX(m_mutex);
+    RegistrationsById     m_byId;
+    RegistrationsBySocket m_bySocket;
+    PUInt64               m_nextId;
+    bool                  m_changed;
+    atomic<bool>          m_running;
+    std::vector<PThread *> m_threads;
+
+    int                   m_epoll;
+    int                   m_wakeup;
+
+    struct PollState;
+    PollState           * m_pollState;
+};
+
+
+#endif // PTLIB_SOCKEVENT_H
+
+
+// End Of File ///////////////////////////////////////////////////////////////
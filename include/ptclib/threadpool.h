@@ -40,6 +40,8 @@
 #include <ptlib/safecoll.h>
 #include <map>
 #include <queue>
+#include <deque>
+#include <vector>
 
 
 #define PThreadPoolTraceModule "ThreadPool"
@@ -562,6 +564,181 @@ class PQueuedThreadPool : public PThreadPool<Work_T>
 };
 
 
+/** Base class for work stealing thread pools.
+    Each worker thread has its own queue of work. New work is added to a
+    worker's lock free inbox, and idle workers take work from the queues of
+    busy workers, so there is no pool wide lock or map on the AddWork() path.
+
+    Work with a group is serialised, so only one item for a group executes
+    at a time, and in the order added. Unlike PThreadPool, the group is not
+    pinned to a single worker thread. While a group has work it tends to
+    stay on the same worker, but can be taken by an idle worker.
+  */
+class PWorkStealingThreadPoolBase : public PObject
+{
+    PCLASSINFO(PWorkStealingThreadPoolBase, PObject);
+  public:
+    ~PWorkStealingThreadPoolBase();
+
+    /**Stop all worker threads.
+       Any work not yet executed is deleted.
+      */
+    void Shutdown();
+
+    unsigned GetMaxWorkers() const { return m_maxWorkerCount; }
+
+    /**Set the maximum number of worker threads.
+       This cannot exceed GetWorkerIncreaseLimit(), the larger of the
+       maxWorkers and workerIncreaseLimit given to the constructor, as the
+       workers are looked up without a lock.
+      */
+    void SetMaxWorkers(unsigned count);
+
+    const PTimeInterval & GetWorkerIncreaseLatency() const { return m_workerIncreaseLatency; }
+    void SetWorkerIncreaseLatency(const PTimeInterval & time) { m_workerIncreaseLatency = time; }
+    unsigned GetWorkerIncreaseLimit() const { return (unsigned)m_workers.size(); }
+
+    /// Get the number of worker threads currently running.
+    unsigned GetWorkerCount() const { return m_workerCount; }
+
+  protected:
+    PWorkStealingThreadPoolBase(
+      unsigned maxWorkers,
+      const char * threadName,
+      PThread::Priority priority,
+      const PTimeInterval & workerIncreaseLatency,
+      unsigned workerIncreaseLimit
+    );
+
+    class Worker;
+
+    struct Link
+    {
+      Link() : m_next(NULL) { }
+      atomic<Link *> m_next;
+    };
+
+    struct Item : Link
+    {
+      Item() { }
+      virtual ~Item() { }
+      /// Execute the work, this is responsible for deleting the item.
+      virtual void Execute(Worker & worker) = 0;
+      PTimeInterval m_queuedTick;
+    };
+
+    class Worker : public PThread
+    {
+        PCLASSINFO(Worker, PThread);
+      public:
+        Worker(PWorkStealingThreadPoolBase & pool, unsigned index);
+        ~Worker();
+
+        virtual void Main();
+
+        void Push(Item * item);
+        Item * Pop();
+        Item * Steal(std::vector<Item *> & stolen);
+        void PushLocal(std::vector<Item *> & items);
+        void Discard();
+
+        PWorkStealingThreadPoolBase & m_pool;
+        unsigned                      m_index;
+
+      protected:
+        Item * InternalPopInbox();
+        void InternalDrainInbox();
+
+        // Multiple producer, single consumer, intrusive queue
+        atomic<Link *> m_inboxHead;
+        Link         * m_inboxTail;
+        Link           m_inboxStub;
+
+        // Only accessed by the consumer, which is whoever holds m_mutex
+        std::deque<Item *> m_queue;
+        PDECLARE_MUTEX(m_mutex);
+    };
+
+    bool InternalAddWork(Item * item, const char * group);
+    void Submit(Item * item, Worker * preferred);
+    Item * FindWork(Worker & worker);
+    void StartWorker();
+    void CheckLatency(const Item & item);
+
+    struct GroupQueue;
+    struct GroupShard;
+    struct GroupRunner;
+    enum { NumGroupShards = 16 };
+    GroupShard * m_groupShards;
+
+    std::vector<Worker *> m_workers; // Sized to the increase limit on construction
+    atomic<unsigned>      m_workerCount;
+    atomic<unsigned>      m_nextWorker;
+    atomic<unsigned>      m_sleeping;
+    atomic<unsigned>      m_submitting; // Threads in InternalAddWork()/Submit(), Shutdown() waits for none
+    atomic<bool>          m_shutdown;
+    PSemaphore            m_wakeUp;
+    PDECLARE_MUTEX(       m_mutex);
+
+    unsigned          m_maxWorkerCount;
+    PTimeInterval     m_workerIncreaseLatency;
+    PTime             m_nextWorkerIncreaseTime;
+    PString           m_threadName;
+    PThread::Priority m_priority;
+};
+
+
+/** High Level (queued work item) work stealing thread pool.
+    This has the same constructor and AddWork() as PQueuedThreadPool, so may
+    be used in its place, e.g. as the Pool_T for PPoolTimer. The maxWorkUnits
+    parameter is ignored.
+  */
+template <class Work_T>
+class PWorkStealingThreadPool : public PWorkStealingThreadPoolBase
+{
+    PCLASSINFO(PWorkStealingThreadPool, PWorkStealingThreadPoolBase);
+  public:
+    PWorkStealingThreadPool(
+      unsigned maxWorkers = std::max(PThread::GetNumProcessors(), 10U),
+      unsigned /*maxWorkUnits*/ = 0,
+      const char * threadName = NULL,
+      PThread::Priority priority = PThread::NormalPriority,
+      const PTimeInterval & workerIncreaseLatency = PMaxTimeInterval,
+      unsigned workerIncreaseLimit = 0
+    ) : PWorkStealingThreadPoolBase(maxWorkers, threadName, priority, workerIncreaseLatency, workerIncreaseLimit)
+    { }
+
+    ~PWorkStealingThreadPool()
+    {
+      // Must be done here, as items need this class to be deleted
+      this->Shutdown();
+    }
+
+    /**Add a unit of work to the pool.
+       The pool takes ownership of \p work, and deletes it after execution.
+      */
+    bool AddWork(Work_T * work, const char * group = NULL)
+    {
+      if (PAssertNULL(work) == NULL)
+        return false;
+      return this->InternalAddWork(new WorkItem(work), group);
+    }
+
+  protected:
+    struct WorkItem : Item
+    {
+      WorkItem(Work_T * work) : m_work(work) { }
+      ~WorkItem() { delete m_work; }
+      virtual void Execute(Worker &)
+      {
+        m_work->Work();
+        delete this;
+      }
+      Work_T * m_work;
+    };
+};
+
+
 /**A PThreadPool work item template that uses PSafePtr to execute callback
    function.
   */
@@ -45,6 +45,7 @@
 #include <ptclib/script.h>
 
 #include <queue>
+#include <list>
 
 
 class PVXMLSession;
@@ -251,16 +252,113 @@ class PVXMLCache : public PSafeObject
     const PDirectory & GetDirectory() const
     { return m_directory; }
 
+  /**@name In-memory tier
+     Decoded PCM audio may also be held in memory, keyed by the same
+     prefix/key/suffix as the files, plus the sample rate and channels. The audio is shared
+     read only by all sessions using the cache, so a frequently played prompt
+     costs no file I/O at all. The least recently used entries are evicted
+     when the byte limit is exceeded.
+
+     Note entries for local files played via PVXMLSession::PlayFile() are not
+     checked against the file on disk, call FlushMemory() if they change.
+    */
+  //@{
+    /**Get decoded audio from the in-memory tier.
+       @return false if not present, or in-memory tier disabled.
+      */
+    virtual bool GetAudio(
+      const PString & prefix,
+      const PString & key,
+      const PString & suffix,
+      unsigned        sampleRate,
+      unsigned        channels,
+      PBYTEArray    & audio
+    );
+
+    /**Put decoded audio into the in-memory tier, evicting older entries as
+       required to stay within the memory limit.
+      */
+    virtual void PutAudio(
+      const PString    & prefix,
+      const PString    & key,
+      const PString    & suffix,
+      unsigned           sampleRate,
+      unsigned           channels,
+      const PBYTEArray & audio
+    );
+
+    /**Decode a WAV file to 16 bit PCM.
+       The file must be of the indicated sample rate and channels, but may be
+       any format that can be auto-converted to PCM.
+      */
+    static bool LoadAudio(
+      const PFilePath & filename,
+      unsigned          sampleRate,
+      unsigned          channels,
+      PBYTEArray      & audio
+    );
+
+    /**Load all the WAV files in the directory into the in-memory tier, as if
+       they had been played via PVXMLSession::PlayFile() on a channel of the
+       sample rate and channels.
+       @return number of files loaded.
+      */
+    PINDEX Prewarm(
+      const PDirectory & directory,
+      unsigned sampleRate = 8000,
+      unsigned channels = 1
+    );
+
+    /**Set maximum number of bytes of audio held in memory.
+       Default is zero, which disables the in-memory tier.
+      */
+    void SetMemoryLimit(PINDEX bytes);
+    PINDEX GetMemoryLimit() const { return m_memoryLimit; }
+
+    /// Remove all entries from the in-memory tier.
+    void FlushMemory();
+
+    struct MemoryStatistics
+    {
+      MemoryStatistics();
+      void PrintOn(ostream & strm) const;
+      friend ostream & operator<<(ostream & strm, const MemoryStatistics & stats) { stats.PrintOn(strm); return strm; }
+
+      uint64_t m_hits;
+      uint64_t m_misses;
+      uint64_t m_evictions;
+      PINDEX   m_entries;
+      PINDEX   m_bytes;
+    };
+    MemoryStatistics GetMemoryStatistics() const;
+  //@}
+
   protected:
     virtual PFilePath CreateFilename(
       const PString & prefix,
       const PString & key,
       const PString & suffix
     );
+    void InternalEvictMemory();
 
     PDirectory m_directory;
+
+    struct MemoryEntry
+    {
+      PString    m_key;
+      PBYTEArray m_audio;
+    };
+    typedef std::list<MemoryEntry> MemoryList;
+    typedef std::map<PString, MemoryList::iterator> MemoryIndex;
+
+    PINDEX           m_memoryLimit;
+    MemoryList       m_memoryList; // Most recently used at front
+    MemoryIndex      m_memoryIndex;
+    MemoryStatistics m_memoryStatistics;
+    mutable PDECLARE_MUTEX(m_memoryMutex);
 };
 
+
 //////////////////////////////////////////////////////////////////
 
 class PVXMLChannel;
@@ -292,6 +390,30 @@ class PVXMLSession : public PIndirectChannel
     virtual bool Open(const PString & mediaFormat, unsigned sampleRate = 8000, unsigned channels = 1);
     virtual PBoolean Close();
 
+    /// How the VoiceXML script for the session is executed.
+    enum ExecutionModes {
+      ThreadPerSession, ///< Dedicated "VXML" thread per session, blocking while awaiting events
+      EventDriven       ///< Session is a state machine, stepped on each event by a shared thread pool
+    };
+
+    /**Set the execution mode for the session.
+       This must be called before the session is started via Open() and
+       Load(). Default is ThreadPerSession.
+
+       In EventDriven mode no thread is dedicated to the session, Trigger()
+       queues a step of the script onto a thread pool shared by all sessions.
+       Steps for a session are grouped so they are executed in order, and never
+       concurrently. Note that OnEndDialog() and OnEndSession() are then
+       called from a thread pool thread.
+      */
+    void SetExecutionMode(ExecutionModes mode) { m_executionMode = mode; }
+    ExecutionModes GetExecutionMode() const { return m_executionMode; }
+
+    /**Set the maximum number of threads in the pool shared by all EventDriven
+       sessions. Default is the larger of the number of processors and 10.
+      */
+    static void SetExecutionPoolSize(unsigned maxWorkers);
+
     PVXMLChannel * GetAndLockVXMLChannel();
     void UnLockVXMLChannel() { m_sessionMutex.Signal(); }
     PMutex & GetSessionMutex() { return m_sessionMutex; }
@@ -391,10 +513,16 @@ class PVXMLSession : public PIndirectChannel
     virtual bool InternalLoadVXML(const PString & xml, const PString & firstForm);
     virtual void InternalStartThread();
     virtual void InternalThreadMain();
+    virtual void InternalStartSession();
     virtual void InternalStartVXML();
+    virtual bool InternalExecuteStep();
+    void InternalExecute();
+    void InternalWaitExecution();
 
     virtual bool ProcessNode();
     virtual bool ProcessEvents();
+    bool InternalProcessEvents();
+    bool InternalEventReceived();
     virtual bool NextNode(bool processChildren);
     bool ExecuteCondition(PXMLElement & element);
     void ClearBargeIn();
@@ -404,6 +532,7 @@ class PVXMLSession : public PIndirectChannel
     void SayAs(const PString & className, const PString & text, const PString & voice);
 
     PURL NormaliseResourceName(const PString & src);
+    bool PlayCachedAudio(const PString & prefix, const PString & key, const PString & suffix, const PFilePath & filename, PINDEX repeat, PINDEX delay);
 
     PDECLARE_MUTEX(m_sessionMutex);
 
@@ -457,6 +586,28 @@ class PVXMLSession : public PIndirectChannel
     PThread     *    m_vxmlThread;
     bool             m_abortVXML;
     PSyncPoint       m_waitForEvent;
+
+    ExecutionModes   m_executionMode;
+    enum ExecutionStates {
+      ExecutionIdle,
+      ExecutionStarting,
+      ExecutionProcessNode,
+      ExecutionNodeEvents,
+      ExecutionNodeAwaitingEvent,
+      ExecutionNodeDone,
+      ExecutionEndDialogEvents,
+      ExecutionEndDialogAwaitingEvent,
+      ExecutionEndDialogDone,
+      ExecutionEnded
+    }                 m_executionState;
+    bool              m_processChildren;
+    PString           m_executionGroup;
+    atomic<bool>      m_executionQueued;
+    atomic<unsigned>  m_executionPending;
+    PThreadIdentifier m_executionThreadId;
+    PSyncPoint        m_executionIdle;
+    friend struct PVXMLExecutionWork;
+
     auto_ptr<PXML>   m_newXML;
     PString          m_lastXMLError;
     PString          m_newFormName;
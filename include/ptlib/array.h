@@ -295,6 +295,13 @@ template <class T> class PBaseArray : public PAbstractArray
       PINDEX length,      ///< Number of elements pointed to by \p buffer.
       PBoolean dynamic = true ///< Buffer is copied and dynamically allocated.
     ) : PAbstractArray(sizeof(T), buffer, length, dynamic) { }
+
+#if P_HAS_MOVE_SEMANTICS
+    PBaseArray(const PBaseArray & other) : PAbstractArray(other) { }
+    PBaseArray(PBaseArray && other) noexcept : PAbstractArray(std::move(other)) { }
+    PBaseArray & operator=(const PBaseArray & other) { PAbstractArray::operator=(other); return *this; }
+    PBaseArray & operator=(PBaseArray && other) { PAbstractArray::operator=(std::move(other)); return *this; }
+#endif
   //@}
 
   /**@name Overrides from class PObject */
@@ -937,6 +944,13 @@ template <class T> class PArray : public PArrayObjects
     PArray(
       PINDEX initialSize = 0  ///< Initial number of objects in the array.
     ) : PArrayObjects(initialSize) { }
+
+#if P_HAS_MOVE_SEMANTICS
+    PArray(const PArray & other) : PArrayObjects(other) { }
+    PArray(PArray && other) noexcept : PArrayObjects(std::move(other)) { }
+    PArray & operator=(const PArray & other) { PArrayObjects::operator=(other); return *this; }
+    PArray & operator=(PArray && other) { PArrayObjects::operator=(std::move(other)); return *this; }
+#endif
   //@}
 
   /**@name Overrides from class PObject */
@@ -128,6 +128,29 @@ class PContainer : public PObject
       const PContainer & cont  ///< Container to create a new reference from.
     );
 
+#if P_HAS_MOVE_SEMANTICS
+    /**Move a container reference.
+       The contents of \p cont are taken over by the new container, without
+       any change to the reference count. The container \p cont is left
+       without contents and may only be destroyed or assigned to.
+
+       If the contents of \p cont are a constant object, e.g. a
+       <code>PConstString</code>, then they are copied as for the copy
+       constructor.
+     */
+    PContainer(
+      PContainer && cont  ///< Container to move from.
+    ) noexcept;
+
+    /**Move one container reference to another.
+       As for the move constructor, the container \p cont is left without
+       contents and may only be destroyed or assigned to.
+     */
+    PContainer & operator=(
+      PContainer && cont  ///< Container to move from.
+    );
+#endif
+
     /**Destroy the container class.
        This will decrement the reference count on the contents and if unique,
        will destroy it using the <code>DestroyContents()</code> function.
@@ -333,6 +356,9 @@ class PContainer : public PObject
           return false;
         }
 </code></pre>
+    If the compiler supports move semantics, a move constructor and move
+    assignment operator are also defined, see <code>PContainer</code>.
+
     Then the <code>DestroyContents()</code>, <code>CloneContents()</code> and <code>CopyContents()</code> functions
     are declared and must be implemented by the programmer. See the
     <code>PContainer</code> class for more information on these functions.
@@ -352,7 +378,19 @@ class PContainer : public PObject
     void CloneContents(const cls * c); \
     void CopyContents(const cls & c); \
     virtual void AssignContents(const PContainer & c) \
-      { par::AssignContents(c); CopyContents((const cls &)c); }
+      { par::AssignContents(c); CopyContents((const cls &)c); } \
+    PCONTAINERINFO_MOVE(cls, par)
+
+#if P_HAS_MOVE_SEMANTICS
+  #define PCONTAINERINFO_MOVE(cls, par) \
+  public: \
+    cls(cls && c) noexcept : par(std::move(c)) { CopyContents(c); } \
+    cls & operator=(cls && c) \
+      { PContainer::operator=(std::move(c)); return *this; } \
+  protected:
+#else
+  #define PCONTAINERINFO_MOVE(cls, par)
+#endif
 
 
 ///////////////////////////////////////////////////////////////////////////////
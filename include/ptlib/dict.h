@@ -94,19 +94,15 @@ class PKey : public PObject
       return EqualTo;
     }
 
-    /**This function calculates a hash table index value for the implementation
-       of <code>PSet</code> and <code>PDictionary</code> classes.
+    /**This function calculates a hash value for the implementation of
+       <code>PSet</code> and <code>PDictionary</code> classes.
 
        @return
-       hash table bucket number.
+       the key value itself.
      */
     virtual PINDEX HashFunction() const
     {
-#if PINDEX_SIGNED
-      return std::abs((PINDEX)this->m_key)%23;
-#else
-      return ((PINDEX)this->m_key)%23;
-#endif
+      return (PINDEX)this->m_key;
     }
 
     /**Output the ordinal index to the specified stream. This is identical to
@@ -166,6 +162,7 @@ struct PHashTableElement
     PHashTableElement * m_next;
     PHashTableElement * m_prev;
     PINDEX              m_bucket;
+    PINDEX              m_hash;   // Full HashFunction() value, avoids recalculating on rehash
 
     PDECLARE_POOL_ALLOCATOR(PHashTableElement);
 };
@@ -190,9 +187,9 @@ class PHashTableInfo : public PBaseArray<PHashTableList>
     PCLASSINFO(PCharArray, ParentClass);
   public:
     PHashTableInfo(PINDEX initialSize = 0)
-      : ParentClass(initialSize) { }
+      : ParentClass(initialSize) { InitialiseBuckets(); }
     PHashTableInfo(PHashTableList const * buffer, PINDEX length, PBoolean dynamic = true)
-      : ParentClass(buffer, length, dynamic) { }
+      : ParentClass(buffer, length, dynamic) { InitialiseBuckets(); }
     virtual PObject * Clone() const { return PNEW PHashTableInfo(*this, GetSize()); }
     virtual ~PHashTableInfo() { Destruct(); }
     virtual void DestroyContents();
@@ -208,6 +205,19 @@ class PHashTableInfo : public PBaseArray<PHashTableList>
     bool deleteKeys;
     PTRACE_THROTTLE(m_throttlePoorHashFunction, 1);
 
+  protected:
+    /* The bucket array is always a power of two in size and is doubled when
+       the number of elements exceeds MaxLoadPercent of it. The full width
+       hash value is scrambled so that HashFunction() implementations that
+       only return a small range of values still use all the buckets. */
+    enum { MinimumBuckets = 16, MaxLoadPercent = 75 };
+    void InitialiseBuckets();
+    PINDEX GetBucket(PINDEX hash) const;
+    void Rehash(PINDEX newSize);
+
+    PINDEX   m_elementCount;
+    unsigned m_bucketShift;
+
   friend class PHashTable;
   friend class PAbstractSet;
 };
@@ -217,11 +227,13 @@ class PHashTableInfo : public PBaseArray<PHashTableList>
    <code>PDictionary</code> classes.
 
    The hash table allows for very fast searches for an object based on a "hash
-   function". This function yields an index into an array which is directly
-   looked up to locate the object. When two key values have the same hash
-   function value, then a linear search of a linked list is made to locate
-   the object. Thus the efficiency of the hash table is highly dependent on the
-   quality of the hash function for the data being used as keys.
+   function". This function yields a value which is used to select an index
+   into an array which is directly looked up to locate the object. When two
+   key values select the same index, then a linear search of a linked list is
+   made to locate the object. The array grows as elements are added so the
+   lists stay short. Thus the efficiency of the hash table is highly dependent
+   on the quality, and range, of the hash function for the data being used as
+   keys.
  */
 class PHashTable : public PCollection
 {
@@ -996,6 +1008,13 @@ template <class K, class D> class PDictionary : public PAbstractDictionary
      */
     PDictionary()
       : PAbstractDictionary() { }
+
+#if P_HAS_MOVE_SEMANTICS
+    PDictionary(const PDictionary & other) : PAbstractDictionary(other) { }
+    PDictionary(PDictionary && other) noexcept : PAbstractDictionary(std::move(other)) { }
+    PDictionary & operator=(const PDictionary & other) { PAbstractDictionary::operator=(other); return *this; }
+    PDictionary & operator=(PDictionary && other) { PAbstractDictionary::operator=(std::move(other)); return *this; }
+#endif
   //@}
 
   /**@name Overrides from class PObject */
@@ -106,6 +106,52 @@ class PIPDatagramSocket : public PIPSocket
       const PIPSocketAddressAndPort & ipAndPort
     );
 
+    /// Description of a single datagram for ReadFromBatch() and WriteToBatch()
+    struct Datagram
+    {
+      Datagram(void * buffer = NULL, PINDEX length = 0)
+        : m_buffer(buffer)
+        , m_length(length)
+        , m_lastCount(0)
+        , m_truncated(false)
+      { }
+
+      void *                  m_buffer;     ///< Data to read into or write from
+      PINDEX                  m_length;     ///< Size of m_buffer
+      PIPSocketAddressAndPort m_ipAndPort;  ///< Address datagram came from, or is to be sent to
+      PINDEX                  m_lastCount;  ///< Actual number of bytes read or written
+      bool                    m_truncated;  ///< Datagram was larger than m_buffer, and was truncated
+    };
+
+    /**Read multiple datagrams from remote computers.
+       This blocks, subject to the read timeout, until at least one datagram
+       is available, then returns as many as are available at that time, up
+       to \p maxCount, without further blocking. Where the platform allows
+       (e.g. recvmmsg() on Linux) this is a single system call.
+
+       @return true if at least one datagram was read, \p count is set to
+               the number of entries in \p datagrams that were filled.
+     */
+    virtual bool ReadFromBatch(
+      Datagram * datagrams, ///< Array of datagram buffers
+      PINDEX maxCount,      ///< Number of entries in \p datagrams
+      PINDEX & count        ///< Number of datagrams actually read
+    );
+
+    /**Write multiple datagrams to remote computers.
+       Each datagram may be sent to a different address. Where the platform
+       allows (e.g. sendmmsg() on Linux) this is a single system call. Unlike
+       WriteTo(), broadcast addresses are not supported.
+
+       @return true if all the datagrams were written, \p count is set to
+               the number of datagrams actually written.
+     */
+    virtual bool WriteToBatch(
+      Datagram * datagrams, ///< Array of datagrams
+      PINDEX maxCount,      ///< Number of entries in \p datagrams
+      PINDEX & count        ///< Number of datagrams actually written
+    );
+
 
 // Include platform dependent part of class
 #ifdef _WIN32
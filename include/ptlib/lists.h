@@ -333,6 +333,13 @@ template <class T> class PList : public PAbstractList
      */
     PList()
       : PAbstractList() { }
+
+#if P_HAS_MOVE_SEMANTICS
+    PList(const PList & other) : PAbstractList(other) { }
+    PList(PList && other) noexcept : PAbstractList(std::move(other)) { }
+    PList & operator=(const PList & other) { PAbstractList::operator=(other); return *this; }
+    PList & operator=(PList && other) { PAbstractList::operator=(std::move(other)); return *this; }
+#endif
   //@}
 
   /**@name Overrides from class PObject */
@@ -90,6 +90,21 @@ using namespace std; // Not a good practice (name space polution), but will take
   #define PASSERTINDEX(idx)
 #endif
 
+// Note MSVC does not set __cplusplus correctly without /Zc:__cplusplus
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1800)
+  #define P_HAS_MOVE_SEMANTICS 1
+  #include <utility>
+#else
+  #define P_HAS_MOVE_SEMANTICS 0
+#endif
+
+// C++11 thread_local, with non-trivial constructors and destructors
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+  #define P_HAS_THREAD_LOCAL 1
+#else
+  #define P_HAS_THREAD_LOCAL 0
+#endif
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -507,6 +522,10 @@ public:
                                        application. Setting this flag will automatically
                                        execute <code>#SetStream(new PSystemLog)</code>. */
     HasFilePermissions = 0x8000000, ///< Flag indicating file permissions are to be set
+    AsynchronousOutput = 0x10000000,/**< Completed trace lines are queued in a per thread ring
+                                         buffer and written by a background thread, rather than
+                                         the caller's thread. If a thread's buffer is full, the
+                                         line is dropped, see GetDroppedCount(). */
     FilePermissionMask = 0x7ff0000, /**< Mask for setting standard file permission mask as used in
                                          open() or creat() system function calls. */
     FilePermissionShift = 16
@@ -529,6 +548,7 @@ public:
     "  hour     rotate output file hourly\r" \
     "  minute   rotate output file every minute\r" \
     "  append   append to output file, otherwise overwrites\r" \
+    "  async    output written by background thread\r" \
     "  <perm>   file permission similar to unix chmod, but starts\r" \
     "           with +/- and only has one combination at a time,\r" \
     "           e.g. +uw is user write, +or is other read, etc"
@@ -702,6 +722,17 @@ public:
   */
   static ostream * GetStream();
 
+  /** Write any trace output queued by the AsynchronousOutput option.
+      This is called automatically when the stream is changed, at process
+      shut down and on a fatal signal.
+  */
+  static void Flush();
+
+  /** Get the number of trace lines discarded by the AsynchronousOutput
+      option due to a thread's buffer being full.
+  */
+  static unsigned GetDroppedCount();
+
   /// Get the time zone being used for logging.
   static int GetTimeZone();
 
@@ -1317,6 +1348,18 @@ namespace PProfiling
   void Analyse(Analysis & analysis);
   void Analyse(ostream & strm, bool html);
 
+  /**Output the raw profile data in Chrome Trace Event format, as JSON.
+     This may be loaded into chrome://tracing or https://ui.perfetto.dev and
+     includes functions, PPROFILE_BLOCK() scopes, PPROFILE_TIMESCOPE() and
+     PInstrumentedMutex wait/held times, and thread names.
+
+     This is also output on exit if the PTLIB_PROFILING_FILENAME environment
+     variable has a ".json" extension.
+    */
+  PPROFILE_EXCLUDE(
+    void ExportTraceEvents(ostream & strm)
+  );
+
   PPROFILE_EXCLUDE(
     void Enable(bool enab)
   );
@@ -1359,7 +1402,7 @@ namespace PProfiling
       PDebugLocation m_location;
   };
 
-  #define PPROFILE_BLOCK(name) ::PProfiling::Block p_profile_block_instance(PDebugLocation(__FILE,__LINE__, name))
+  #define PPROFILE_BLOCK(name) ::PProfiling::Block p_profile_block_instance(PDebugLocation(__FILE__, __LINE__, name))
   #define PPROFILE_FUNCTION() PPROFILE_BLOCK(__PRETTY_FUNCTION__)
 
   #define PPROFILE_PRE_SYSTEM()  ::PProfiling::PreSystem()
@@ -2366,6 +2409,10 @@ class PObject {
        on the semantics of the class. For example, the <code>PString</code> class
        overrides it to provide a hash function for distinguishing text strings.
 
+       The value is not limited to a range, the hash table scrambles and
+       reduces it to the number of buckets it currently has, so the wider the
+       spread of values returned, the better large dictionaries perform.
+
        The default behaviour is to return the value zero.
 
        @return
@@ -18,6 +18,7 @@
 
 #define P_PTLIB_PLUGIN_DIR_ENV_VAR  "PTLIBPLUGINDIR"
 #define P_PWLIB_PLUGIN_DIR_ENV_VAR  "PWLIBPLUGINDIR"
+#define P_PTLIB_PLUGIN_MANIFEST_ENV_VAR "PTLIBPLUGINMANIFEST"
 
 
 //////////////////////////////////////////////////////
@@ -51,6 +52,26 @@ class PPluginManager : public PObject
     /// Load the plugins in the directory.
     void LoadDirectory(const PDirectory & dir);
 
+    /**Set the plugin manifest file.
+       The manifest caches, for each plugin file by path, size and modification
+       time, the services it registered when last loaded. A plugin found in the
+       manifest, and unchanged since, has its services registered without the
+       plugin being loaded. The load is deferred until one of those services is
+       actually used, e.g. CreatePlugin() or GetPluginDeviceNames(), at which
+       time the notifiers are called with LoadingPlugIn.
+
+       Plugins not in the manifest, or changed, are loaded as usual and the
+       manifest is updated at the end of LoadDirectories() or LoadDirectory().
+
+       An empty path, the default unless the PTLIBPLUGINMANIFEST environment
+       variable is set, disables the manifest and all plugins are loaded
+       immediately.
+      */
+    void SetManifestFile(const PFilePath & path);
+
+    /// Get the plugin manifest file.
+    const PFilePath & GetManifestFile() const { return m_manifestFile; }
+
     // functions to load/unload a dynamic plugin 
     PBoolean LoadPlugin(const PString & fileName);
 
@@ -153,6 +174,36 @@ class PPluginManager : public PObject
 
     void CallNotifier(PDynaLink & dll, NotificationCode code);
 
+    struct ManifestService {
+      PString m_type;
+      PString m_name;
+      PString m_friendlyName;
+      bool    m_device;
+    };
+    typedef std::vector<ManifestService> ManifestServices;
+
+    struct ManifestEntry {
+      enum { UnknownVersion = -2, NotPlugin = -1 };
+      ManifestEntry() : m_size(0), m_modified(0), m_version(UnknownVersion) { }
+      PUInt64          m_size;
+      PInt64           m_modified;
+      int              m_version;
+      ManifestServices m_services;
+    };
+    typedef std::map<PString, ManifestEntry> Manifest;
+
+    class DeferredPlugin;
+    class DeferredService;
+    template <class Base> class DeferredDescriptor;
+    class DeferredDevice;
+
+    void InternalLoadDirectory(const PDirectory & dir);
+    void InternalLoadPlugin(const PFilePath & fileName);
+    bool LoadPlugin(const PString & fileName, ManifestEntry * entry, DeferredPlugin * deferred);
+    bool DeferPlugin(const PFilePath & fileName, const ManifestServices & services);
+    void ReadManifest();
+    void WriteManifest();
+
     PList<PDirectory> m_directories;
     PStringList       m_suffixes;
 
@@ -163,8 +214,28 @@ class PPluginManager : public PObject
     ServiceMap     m_services;
     PDECLARE_MUTEX(m_servicesMutex);
 
+    typedef std::vector<const PPluginServiceDescriptor *> ServiceList;
+    ServiceList GetServiceList(const PString & serviceType) const;
+
     PDECLARE_MUTEX(  m_notifiersMutex);
     PList<PNotifier> m_notifiers;
+
+    PFilePath m_manifestFile;
+    Manifest  m_manifest;
+    bool      m_manifestRead;
+    bool      m_manifestChanged;
+    PDECLARE_MUTEX(m_manifestMutex);
+
+    // What a thread loading a plugin does with the services the plugin registers
+    struct LoadingContext {
+      ManifestEntry  * m_recording; // Record them into the manifest entry
+      DeferredPlugin * m_deferred;  // Bind them to the stand ins of the deferred plugin
+    };
+    typedef std::map<PThreadIdentifier, LoadingContext> LoadingThreads;
+
+    // These are protected by m_servicesMutex
+    LoadingThreads m_loadingThreads;
+    std::vector<DeferredPlugin *> m_deferredPlugins;
 };
 
 //////////////////////////////////////////////////////
@@ -684,8 +684,23 @@ class PProcess : public PThread
     bool   m_shuttingDown;
     PCriticalSection m_threadMutex;
 
+    /* Active threads are spread over shards by identifier, so look ups from
+       different threads rarely contend. Changes are made with m_threadMutex
+       held as well, which also serialises replacing the copy-on-write
+       snapshot of identifiers used for enumerating threads. */
     typedef std::map<PThreadIdentifier, PThread *> ThreadMap;
-    ThreadMap m_activeThreads;
+    struct ThreadShard {
+      PCriticalSection m_mutex;
+      ThreadMap        m_threads;
+    };
+    enum { NumThreadShards = 16 };
+    mutable ThreadShard m_threadShards[NumThreadShards];
+    ThreadShard & GetThreadShard(PThreadIdentifier id) const;
+    typedef std::vector<PThreadIdentifier> ThreadIdentifiers;
+    std::shared_ptr<const ThreadIdentifiers> m_threadSnapshot;
+    std::shared_ptr<const ThreadIdentifiers> GetThreadSnapshot() const;
+    void InternalAddThread(PThread * thread);
+    void InternalRemoveThread(PThread * thread);
     void InternalThreadStarted(PThread * thread);
     void InternalThreadEnded(PThread * thread);
     
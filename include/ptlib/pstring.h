@@ -91,6 +91,11 @@ typedef PBaseArray<wchar_t> PWCharArray;
 </code></pre>
    at the end s1 is "string" and s2 is "String" both with reference count of 1.
 
+   Short strings, of less than <code>SmallStringSize</code> characters, are
+   kept in a buffer within the PString instance itself, so need no heap
+   allocation at all. Copies of these are always made by copying the
+   characters, and never share a reference.
+
    The functions that will "break" a reference are <code>SetSize()</code>,
    <code>SetMinSize()</code>, <code>GetPointer()</code>, <code>SetAt()</code> and
    <code>operator[]</code>.
@@ -121,12 +126,21 @@ class PString : public PCharArray
     PString();
 
     /**Create a new reference to the specified string. The string memory is not
-       copied, only the pointer to the data.
+       copied, only the pointer to the data, unless it is a short string.
      */
     PString(
       const PString & str  ///< String to create new reference to.
     );
 
+#if P_HAS_MOVE_SEMANTICS
+    /**Move the specified string. The string \p str is left empty, unless
+       it is a PConstantString, which is copied and keeps its value.
+     */
+    PString(
+      PString && str  ///< String to move from.
+    ) noexcept;
+#endif
+
     /**Create a new reference to the specified buffer. The string memory is not
        copied, only the pointer to the data.
      */
@@ -367,6 +381,19 @@ class PString : public PCharArray
       const PString & str  ///< New string to assign.
     );
 
+#if P_HAS_MOVE_SEMANTICS
+    /**Move the string to the current object. The string \p str is left
+       empty, unless it is a PConstantString, which is copied and keeps its
+       value.
+
+       @return
+       reference to the current PString object.
+     */
+    PString & operator=(
+      PString && str  ///< String to move from.
+    );
+#endif
+
     /**Assign the string to the current object. The current instance then
        becomes another reference to the same string in the <code>str</code>
        parameter.
@@ -478,6 +505,9 @@ class PString : public PCharArray
     /**Return an empty string.
       */
     static const PString & Empty();
+
+    /// Destroy the string.
+    ~PString();
   //@}
 
   /**@name Overrides from class PObject */
@@ -518,13 +548,13 @@ class PString : public PCharArray
 
     /**Calculate a hash value for use in sets and dictionaries.
     
-       The hash function for strings will produce a value based on the sum of
-       the first three characters of the string. This is a fairly basic
-       function and make no assumptions about the string contents. A user may
-       descend from PString and override the hash function if they can take
-       advantage of the types of strings being used, eg if all strings start
-       with the letter 'A' followed by 'B or 'C' then the current hash function
-       will not perform very well.
+       The hash function for strings will produce a value based on up to 18
+       characters at the start and at the end of the string, case insensitive.
+       This is a fairly basic function and make no assumptions about the
+       string contents. A user may descend from PString and override the hash
+       function if they can take advantage of the types of strings being used,
+       eg if all strings only differ in the middle then the current hash
+       function will not perform very well.
 
        @return
        hash value for string.
@@ -1919,13 +1949,30 @@ class PString : public PCharArray
     PString(int dummy, const PString * str);
 
     virtual void AssignContents(const PContainer &);
+    virtual void DestroyReference();
     PString(PContainerReference & reference_, PINDEX len)
       : PCharArray(reference_)
       , m_length(len)
       { }
 
+    bool IsSmall() const { return reference == &m_small.m_reference; }
+    void InternalSetSmall(const char * data, PINDEX copySize, PINDEX newSize);
+    void InternalSetString(const char * str, PINDEX len);
+    void InternalCopy(const PString & str);
+
+  public:
+    /// Size of internal buffer for short strings, including the '\\0'.
+    enum { SmallStringSize = 24 };
+
   protected:
     mutable PINDEX m_length; // Length of the string, always at least one less than GetSize()
+
+    // Short string storage, with a constant reference so copies are not shared
+    struct SmallString {
+      SmallString() : m_reference(0, true) { }
+      PContainerReference m_reference;
+      char                m_buffer[SmallStringSize];
+    } m_small;
 };
 
 
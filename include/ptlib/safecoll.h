@@ -256,7 +256,7 @@ class PSafeObject : public PObject
        Note this returns the value outside of any mutexes, so it could change
        at any moment. Care must be exercised in its use.
       */
-    unsigned IsSafelyBeingRemoved() const { return m_safelyBeingRemoved; }
+    unsigned IsSafelyBeingRemoved() const { return (m_safeState.load()&SafeRemovedFlag) != 0; }
 
     /**Determine if the object can be safely deleted.
        This determines if the object has been flagged for deletion and all
@@ -284,7 +284,7 @@ class PSafeObject : public PObject
        Note this returns the value outside of any mutexes, so it could change
        at any moment. Care must be exercised in its use.
       */
-    unsigned GetSafeReferenceCount() const { return m_safeReferenceCount; }
+    unsigned GetSafeReferenceCount() const { return m_safeState.load()&SafeReferenceMask; }
   //@}
 
   private:
@@ -295,12 +295,19 @@ class PSafeObject : public PObject
     bool InternalLockReadWrite(const PDebugLocation * location) const;
     void InternalUnlockReadWrite(const PDebugLocation * location) const;
     PReadWriteMutex & InternalGetMutex() const;
+    void InternalClearSafelyBeingRemoved();
 
-    mutable PCriticalSection m_safetyMutex;
-    unsigned          m_safeReferenceCount;
-    bool              m_safelyBeingRemoved;
+    /* Reference count and removed flag are kept in one word so both can be
+       changed together with a single compare and exchange, no mutex needed. */
+    enum {
+      SafeRemovedFlag   = 0x80000000,
+      SafeReferenceMask = 0x7fffffff
+    };
+    atomic<unsigned>  m_safeState;
+
+    mutable PCriticalSection m_safetyMutex; // Only for creating m_safeInUseMutex
     bool              m_safeMutexCreated;
-    PReadWriteMutex * m_safeInUseMutex;
+    mutable atomic<PReadWriteMutex *> m_safeInUseMutex;
 
   friend class PSafeCollection;
   friend class PSafePtrBase;
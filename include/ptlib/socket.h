@@ -84,7 +84,8 @@ class PSocket : public PChannel
     /// Flags to reuse of port numbers in Listen() function.
     enum Reusability {
       CanReuseAddress,
-      AddressIsExclusive
+      AddressIsExclusive,
+      CanReusePort      ///< As CanReuseAddress, and incoming datagrams/connections are shared across all sockets bound to the port
     };
 
     /**Listen on a socket for a remote host on the specified port number. This
@@ -201,6 +201,147 @@ class PSound : public PBYTEArray
 };
 
 
+/** Stateful PCM sample rate and channel converter.
+   This converts a stream of 16 bit linear PCM between sample rates and
+   numbers of channels. Unlike PSound::ConvertPCM(), the filter history is
+   kept between calls to Convert() so a stream may be processed in arbitrary
+   sized blocks without any discontinuity at the block boundaries.
+
+   Rate conversion uses a polyphase windowed sinc (Kaiser) low pass filter.
+   The filter banks for a given rate ratio and quality are calculated once
+   and shared by all converters using that ratio.
+
+   Channel conversion duplicates mono to all output channels, or averages
+   all input channels to mono. Any other combination is done via mono.
+ */
+class PPCMResampler : public PObject
+{
+  PCLASSINFO(PPCMResampler, PObject);
+
+  public:
+    /// Quality of rate conversion filter, trading off against CPU use.
+    enum Quality {
+      LowQuality,     ///< Short filter, suitable for voice
+      MediumQuality,  ///< Default filter
+      HighQuality     ///< Long filter with sharp cut off
+    };
+
+  /**@name Construction */
+  //@{
+    /**Create a new converter.
+     */
+    PPCMResampler(
+      unsigned srcRate = 8000,            ///< Sample rate for source PCM
+      unsigned srcChannels = 1,           ///< Number of channels for source PCM
+      unsigned dstRate = 8000,            ///< Sample rate for destination PCM
+      unsigned dstChannels = 1,           ///< Number of channels for destination PCM
+      Quality quality = MediumQuality     ///< Quality of rate conversion
+    );
+
+    /// Destroy converter
+    ~PPCMResampler();
+  //@}
+
+  /**@name Operations */
+  //@{
+    /**Set the conversion parameters.
+       Any history from previous conversions is discarded.
+
+       @return false if a rate or number of channels is zero.
+     */
+    bool Open(
+      unsigned srcRate,                   ///< Sample rate for source PCM
+      unsigned srcChannels,               ///< Number of channels for source PCM
+      unsigned dstRate,                   ///< Sample rate for destination PCM
+      unsigned dstChannels,               ///< Number of channels for destination PCM
+      Quality quality = MediumQuality     ///< Quality of rate conversion
+    );
+
+    /**Discard the filter history, e.g. after a seek in the source stream.
+     */
+    void Reset();
+
+    /**Convert the next block of the PCM stream.
+       Source is consumed until all of it is used, or the destination is
+       full. Note that when changing sample rate, a small amount of the source
+       (half the filter length) is held back until more data is supplied, or
+       Flush() is called.
+
+       @return true if all the source was consumed.
+     */
+    bool Convert(
+      const short * srcPtr, ///< Source PCM data
+      PINDEX & srcSize,     ///< In: number of bytes of source PCM, Out: bytes consumed
+      short * dstPtr,       ///< Destination PCM data
+      PINDEX & dstSize      ///< In: size of destination buffer, Out: bytes written
+    );
+
+    /**Output any data held back by Convert(), at the end of the stream.
+       The converter is then reset ready for a new stream.
+
+       @return false if \p dstSize was not large enough for all of the data,
+               Flush() should be called again to get the remainder.
+     */
+    bool Flush(
+      short * dstPtr,       ///< Destination PCM data
+      PINDEX & dstSize      ///< In: size of destination buffer, Out: bytes written
+    );
+
+    /**Convert the number of channels in interleaved PCM data, without
+       any change in sample rate. The \p dstPtr may be the same as \p srcPtr
+       if \p dstChannels is not greater than \p srcChannels.
+     */
+    static void MixChannels(
+      const short * srcPtr, ///< Source PCM data
+      unsigned srcChannels, ///< Number of channels for source PCM
+      short * dstPtr,       ///< Destination PCM data
+      unsigned dstChannels, ///< Number of channels for destination PCM
+      PINDEX frames         ///< Number of samples per channel to convert
+    );
+  //@}
+
+  /**@name Member variable access */
+  //@{
+    /// Get sample rate for source PCM
+    unsigned GetSrcRate() const { return m_srcRate; }
+    /// Get number of channels for source PCM
+    unsigned GetSrcChannels() const { return m_srcChannels; }
+    /// Get sample rate for destination PCM
+    unsigned GetDstRate() const { return m_dstRate; }
+    /// Get number of channels for destination PCM
+    unsigned GetDstChannels() const { return m_dstChannels; }
+    /// Get quality of rate conversion
+    Quality GetQuality() const { return m_quality; }
+    /// Get number of taps in filter per output sample, zero if no rate conversion
+    unsigned GetFilterTaps() const;
+  //@}
+
+  protected:
+    void ProduceSamples(short * dstPtr, PINDEX & dstFrames, PINDEX dstMax, PINDEX limit);
+
+    struct FilterBank;
+
+    unsigned     m_srcRate;
+    unsigned     m_srcChannels;
+    unsigned     m_dstRate;
+    unsigned     m_dstChannels;
+    Quality      m_quality;
+    unsigned     m_workChannels;
+    const FilterBank * m_filter;
+
+    std::vector< std::vector<short> > m_history;
+    std::vector<short> m_mixBuffer;
+    PINDEX       m_count;
+    PINDEX       m_start;
+    unsigned     m_phase;
+    PINDEX       m_flushLimit;
+
+  private:
+    PPCMResampler(const PPCMResampler &) { }
+    void operator=(const PPCMResampler &) { }
+};
+
+
 /**
    Abstract class for a generalised sound channel, and an implementation of
    PSoundChannel for old code that is not plugin-aware.
@@ -248,9 +248,15 @@ class PIntCondMutex : public PCondMutex
    The original algorithm for this was described in 'Communications of the ACM:
    Concurrent Control with "Readers" and "Writers" P.J. Courtois,* F. H, 1971'
    http://cs.nyu.edu/~lerner/spring10/MCP-S10-Read04-ReadersWriters.pdf which
-   can be changed via #define to an alternate algorithm 'Faster Fair Solution
-   for the Reader-Writer Problem. V.Popov, O.Mazonka 2013'
-   http://arxiv.org/ftp/arxiv/papers/1309/1309.4507.pdf to improve efficiency.
+   can be selected via P_READ_WRITE_ALGO1, or an alternate algorithm 'Faster
+   Fair Solution for the Reader-Writer Problem. V.Popov, O.Mazonka 2013'
+   http://arxiv.org/ftp/arxiv/papers/1309/1309.4507.pdf via P_READ_WRITE_ALGO2.
+
+   By default, an atomic reader count is used, so an uncontended StartRead()
+   or EndRead() is a single atomic increment or decrement. Semaphores are
+   only used when a writer is pending, which takes precedence over new
+   readers. The per-thread nesting information is kept in thread local
+   storage, so no global lock is taken for nested or unnested read locks.
  */
 
 class PReadWriteMutex : public PObject, public PMutexExcessiveLockInfo
@@ -329,7 +335,7 @@ class PReadWriteMutex : public PObject, public PMutexExcessiveLockInfo
     unsigned    m_outCount;
     PSemaphore  m_writeSemaphore;
     bool        m_wait;
-#else
+#elif P_READ_WRITE_ALGO1
     PSemaphore  m_readerSemaphore;
     PTimedMutex m_readerMutex;
     unsigned    m_readerCount;
@@ -338,26 +344,35 @@ class PReadWriteMutex : public PObject, public PMutexExcessiveLockInfo
     PSemaphore  m_writerSemaphore;
     PTimedMutex m_writerMutex;
     unsigned    m_writerCount;
+#else
+    atomic<int> m_readerCount;     // Active readers, less WriterBias when a writer is pending or active
+    atomic<int> m_readersDeparting; // Readers a pending writer is still waiting on
+    PSemaphore  m_readerSemaphore;
+    PSemaphore  m_writerSemaphore;
+    PTimedMutex m_writerMutex;
+    enum { WriterBias = 1 << 30 };
 #endif
     struct Nest
     {
+      const PReadWriteMutex * m_mutex;
       unsigned m_readerCount;
       unsigned m_writerCount;
       bool     m_waiting;
       uint64_t m_startHeldCycle;
       PUniqueThreadIdentifier m_uniqueId;
+      Nest   * m_next;
 
       Nest()
-        : m_readerCount(0)
+        : m_mutex(NULL)
+        , m_readerCount(0)
         , m_writerCount(0)
         , m_waiting(false)
         , m_startHeldCycle(0)
-        , m_uniqueId(PThread::GetCurrentUniqueIdentifier())
+        , m_uniqueId(0)
+        , m_next(NULL)
       { }
     };
-    typedef std::map<PThreadIdentifier, Nest> NestMap;
-    NestMap          m_nestedThreads;
-    PCriticalSection m_nestingMutex;
+    struct NestTable;
 
     Nest * GetNest();
     Nest & StartNest();
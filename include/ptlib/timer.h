@@ -45,6 +45,8 @@
 #include <queue>
 #include <set>
 #include <map>
+#include <vector>
+#include <functional>
 
 
 // To avoid ambiguous operator error we need a one for every integer variant
@@ -365,6 +367,22 @@ class PTimer : public PTimeInterval
       private:
         bool OnTimeout(PIdGenerator::Handle handle);
 
+        /* Expiry times are kept in a min-heap so Process() only touches the
+           timers that are actually due. Stopping or restarting a timer does
+           not remove its old entry, that is discarded when it reaches the top
+           of the heap and is found to not match the timer any more. */
+        struct Deadline
+        {
+          int64_t              m_when;
+          PIdGenerator::Handle m_handle;
+          Deadline(int64_t when, PIdGenerator::Handle handle) : m_when(when), m_handle(handle) { }
+          bool operator>(const Deadline & other) const { return m_when > other.m_when; }
+        };
+        typedef std::vector<Deadline> DeadlineHeap;
+        void PushDeadline(const PTimer & timer);
+        void PopDeadline();
+        void CompactDeadlines();
+
         struct Timeout
         {
           PIdGenerator::Handle m_handle;
@@ -376,6 +394,8 @@ class PTimer : public PTimeInterval
 
         typedef std::map<PIdGenerator::Handle, PTimer *> TimerMap;
         TimerMap m_timers;
+        DeadlineHeap m_deadlines;
+        DeadlineHeap m_busy;
         PCriticalSection m_timersMutex;
 #if PTRACING
         size_t m_highWaterMark;
@@ -90,6 +90,18 @@ class PUDPSocket : public PIPDatagramSocket
     );
   //@}
 
+  /**@name Overrides from class PIPDatagramSocket */
+  //@{
+    /** Override to set the last receive address to that of the last
+        datagram in the batch.
+     */
+    virtual bool ReadFromBatch(
+      Datagram * datagrams, ///< Array of datagram buffers
+      PINDEX maxCount,      ///< Number of entries in \p datagrams
+      PINDEX & count        ///< Number of datagrams actually read
+    );
+  //@}
+
   /**@name New functions for class */
   //@{
     /** Set the address to use for connectionless Write() or Windows QoS.
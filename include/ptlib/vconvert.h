@@ -288,6 +288,40 @@ class PColourConverter : public PColourPair
       BYTE   & r, BYTE   & g, BYTE   & b
     );
 
+    /// CPU specific (SIMD) acceleration used by the standard converters.
+    P_DECLARE_STREAMABLE_ENUM(Acceleration,
+      NoAcceleration,
+      SSE2Acceleration,
+      AVX2Acceleration,
+      NEONAcceleration
+    );
+
+    /**Set the SIMD acceleration used by the standard converters.
+       By default the best level the CPU supports, as detected at run time,
+       is used. This is primarily for testing and benchmarking, setting
+       NoAcceleration uses the original scalar code only.
+
+       @return false if the CPU does not support the level.
+      */
+    static bool SetAcceleration(
+      Acceleration level
+    );
+
+    /// Get the SIMD acceleration used by the standard converters.
+    static Acceleration GetAcceleration();
+
+    /**Set the number of threads used by the smooth scaler.
+       When PVideoFrameInfo::eScaleSmooth is used, large frames are split
+       into horizontal slices which are scaled concurrently. A value of one,
+       the default, does all scaling in the calling thread.
+      */
+    static void SetScalerThreads(
+      unsigned threads
+    );
+
+    /// Get the number of threads used by the smooth scaler.
+    static unsigned GetScalerThreads();
+
     /**Copy a section of the source frame to a section of the destination
        frame with scaling/cropping as required.
       */
@@ -429,6 +463,19 @@ class PJPEGConverter : public PColourConverter
       PFile & file,                 ///< File to read JPEG from.
       PBYTEArray & dstFrameBuffer   ///< Buffer to receive converted output
     );
+
+    /**Set the number of threads used to decode a single frame.
+       When the JPEG has restart markers (DRI), the intervals between them
+       are decoded concurrently. A value of one, the default, does all
+       decoding in the calling thread. This is only available for the
+       built in decoder, libjpeg always uses the calling thread.
+      */
+    static void SetDecoderThreads(
+      unsigned threads
+    );
+
+    /// Get the number of threads used to decode a single frame.
+    static unsigned GetDecoderThreads();
 };
 
 #endif  // P_JPEG_DECODER
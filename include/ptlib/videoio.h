@@ -54,7 +54,9 @@ class PVideoFrameInfo : public PObject
       eScale,0,
       eCropCentre,
       eCropTopLeft,
-      eScaleKeepAspect
+      eScaleKeepAspect,
+      eScaleSmooth,
+      eScaleSmoothKeepAspect
     );
     friend ostream & operator<<(ostream & strm, ResizeMode mode);
 
@@ -273,6 +275,186 @@ class PVideoFrameInfo : public PObject
 };
 
 
+class PVideoFramePool;
+
+/**A video frame, with its format, held in a reference counted buffer
+   obtained from a PVideoFramePool.
+
+   Copying a PVideoFrame only adds a reference to the same pixels, so a frame
+   may be passed from a PVideoInputDevice, through queues and threads, to a
+   PVideoOutputDevice without the pixels being copied. When the last
+   reference is released the buffer is returned to its pool for reuse.
+
+   Note there is no automatic copy on write, only the holder of the sole
+   reference should change the pixels, see IsUnique() and MakeUnique().
+  */
+class PVideoFrame : public PVideoFrameInfo
+{
+    PCLASSINFO(PVideoFrame, PVideoFrameInfo);
+  public:
+    enum { MaxPlanes = 3 };
+
+    /// Construct an empty video frame, with no buffer.
+    PVideoFrame();
+
+    /// Construct a video frame referencing the same buffer as \p other.
+    PVideoFrame(
+      const PVideoFrame & other
+    );
+
+    /// Make this frame reference the same buffer as \p other.
+    PVideoFrame & operator=(
+      const PVideoFrame & other
+    );
+
+    /// Release reference to the buffer.
+    ~PVideoFrame();
+
+    virtual void PrintOn(
+      ostream & strm   // Stream to print the object into.
+    ) const;
+
+    /// Release the reference to the buffer, the frame becomes empty.
+    void SetEmpty();
+
+    /// Indicate frame has no buffer, or no valid pixel data.
+    bool IsEmpty() const { return m_buffer == NULL || m_size == 0; }
+
+    /// Indicate this is the only reference to the buffer.
+    bool IsUnique() const;
+
+    /**Make sure this is the only reference to the buffer, copying the pixels
+       to a new buffer from the same pool if necessary.
+      */
+    bool MakeUnique();
+
+    /// Get pointer to the pixels.
+    const BYTE * GetPointer() const;
+    BYTE * GetPointer();
+
+    /// Get the number of bytes of valid pixel data.
+    PINDEX GetSize() const { return m_size; }
+
+    /**Set the number of bytes of valid pixel data.
+       This cannot exceed GetCapacity(), the buffer is never reallocated.
+      */
+    bool SetSize(
+      PINDEX size
+    );
+
+    /// Get the size of the underlying buffer.
+    PINDEX GetCapacity() const;
+
+    /**Get the number of planes in the frame, as per the colour format.
+       For example, YUV420P has three, NV12 two and RGB24 one.
+      */
+    unsigned GetPlaneCount() const;
+
+    /// Get pointer to the start of the plane, NULL if no such plane.
+    const BYTE * GetPlane(
+      unsigned plane
+    ) const;
+    BYTE * GetPlane(
+      unsigned plane
+    );
+
+    /// Get bytes per scan line of the plane, zero if no such plane.
+    PINDEX GetStride(
+      unsigned plane
+    ) const;
+
+    /// Get the sampling time for the frame.
+    const PTimeInterval & GetSampleTime() const { return m_sampleTime; }
+
+    /// Set the sampling time for the frame.
+    void SetSampleTime(const PTimeInterval & sampleTime) { m_sampleTime = sampleTime; }
+
+    /// Indicate frame is a key frame.
+    bool IsKeyFrame() const { return m_keyFrame; }
+
+    /// Set indication frame is a key frame.
+    void SetKeyFrame(bool keyFrame) { m_keyFrame = keyFrame; }
+
+    struct Buffer;
+  protected:
+    unsigned CalculatePlanes(PINDEX offset[MaxPlanes], PINDEX stride[MaxPlanes]) const;
+
+    Buffer      * m_buffer;
+    PINDEX        m_size;
+    PTimeInterval m_sampleTime;
+    bool          m_keyFrame;
+
+  friend class PVideoFramePool;
+};
+
+
+/**A pool of reusable buffers for PVideoFrame.
+   Buffers are returned to the pool when the last PVideoFrame referencing
+   them is released, up to a maximum number of idle buffers. It is safe to
+   destroy the pool while frames are still outstanding, their buffers are
+   simply freed when they are released.
+  */
+class PVideoFramePool : public PObject
+{
+    PCLASSINFO(PVideoFramePool, PObject);
+  public:
+    /// Create a new pool.
+    PVideoFramePool(
+      unsigned maxIdle = 4   ///< Maximum number of idle buffers kept for reuse
+    );
+
+    /// Destroy the pool, releasing all idle buffers.
+    ~PVideoFramePool();
+
+    /**Get a frame from the pool.
+       The buffer is at least \p bytes in size, or the size calculated from
+       \p info if zero. The frame size is set to this value, and the frame
+       information, e.g. width, height and colour format, is set from \p info.
+      */
+    bool Allocate(
+      PVideoFrame & frame,            ///< Frame to receive buffer
+      const PVideoFrameInfo & info,   ///< Format of frame
+      PINDEX bytes = 0                ///< Size of buffer
+    );
+
+    /**Set the maximum number of idle buffers kept for reuse.
+      */
+    void SetMaxIdle(
+      unsigned maxIdle
+    );
+
+    /**Get the maximum number of idle buffers kept for reuse.
+      */
+    unsigned GetMaxIdle() const;
+
+    struct Statistics
+    {
+      Statistics();
+
+      uint64_t m_allocated;  ///< Number of buffers allocated from the heap
+      uint64_t m_reused;     ///< Number of buffers reused from the pool
+      uint64_t m_copied;     ///< Number of frames copied by PVideoFrame::MakeUnique()
+      unsigned m_idle;       ///< Number of idle buffers in pool
+      unsigned m_inUse;      ///< Number of buffers referenced by frames
+
+      void PrintOn(ostream & strm) const;
+    };
+
+    /// Get statistics on the buffer usage.
+    Statistics GetStatistics() const;
+
+    struct Shared;
+  protected:
+    Shared * m_shared;
+
+  private:
+    PVideoFramePool(const PVideoFramePool &) { }
+    void operator=(const PVideoFramePool &) { }
+};
+
+inline ostream & operator<<(ostream & strm, const PVideoFramePool::Statistics & stats) { stats.PrintOn(strm); return strm; }
+
+
 class PVideoControlInfo : public PObject
 {
   PCLASSINFO(PVideoControlInfo, PObject);
@@ -838,6 +1020,15 @@ class PVideoOutputDevice : public PVideoDevice
       bool & keyFrameNeeded     ///< Indicates bad video and a new key frame is required
     );
 
+    /**Output a complete frame, e.g. from PVideoInputDevice::GetFrame().
+       The default behaviour calls SetFrameData() with the pixels pointing
+       directly into the frame buffer, so no intermediate copy is made.
+      */
+    virtual bool SetFrame(
+      const PVideoFrame & frame,    ///< Frame to output
+      bool * keyFrameNeeded = NULL  ///< Indicates bad video and a new key frame is required
+    );
+
     /**Allow the outputdevice decide whether the 
         decoder should ignore decode hence not render
         any output. 
@@ -1105,6 +1296,31 @@ class PVideoInputDevice : public PVideoDevice
       unsigned & height
     );
 
+    /**Grab a frame into a reference counted buffer from a pool.
+       The device fills the pooled buffer directly, the frame may then be
+       passed on, e.g. to another thread or PVideoOutputDevice::SetFrame(),
+       without the pixels being copied.
+
+       The frame information is set to the size and colour format output by
+       the device, that is, after any converter.
+
+       If \p wait is false, and no frame is available, then the function
+       still returns true, but the frame will be empty.
+      */
+    virtual bool GetFrame(
+      PVideoFrame & frame,    ///< Frame to receive video
+      bool & keyFrame,        /**< On input, forces generation of key frame,
+                                   On return indicates key frame generated */
+      bool wait = true        ///< Wait for frame to become available
+    );
+    bool GetFrame(
+      PVideoFrame & frame     ///< Frame to receive video
+    );
+
+    /**Get the pool used by GetFrame() for PVideoFrame buffers.
+      */
+    PVideoFramePool & GetFramePool() { return m_framePool; }
+
     /// For backward compatibility
     bool GetFrameData(
       BYTE * buffer,                 ///< Buffer to receive frame
@@ -1175,6 +1391,7 @@ class PVideoInputDevice : public PVideoDevice
     ) = 0;
 
     PVideoControlInfo m_controlInfo[PVideoControlInfo::NumTypes];
+    PVideoFramePool   m_framePool;
 
   private:
     P_REMOVE_VIRTUAL(PBoolean, GetFrameData(BYTE *, PINDEX *, unsigned &), false);
@@ -196,7 +196,8 @@ ifeq ($(HAS_VIDEO),1)
              $(COMMON_SRC_DIR)/vconvert.cxx \
              $(COMMON_SRC_DIR)/pvidchan.cxx \
              $(COMMON_SRC_DIR)/tinyjpeg.c \
-             $(COMMON_SRC_DIR)/jidctflt.c
+             $(COMMON_SRC_DIR)/jidctflt.c \
+             $(COMMON_SRC_DIR)/jidctint.c
 
   ifeq ($(HAS_SHM_VIDEO),1)
     SOURCES += $(PLATFORM_SRC_DIR)/shmvideo.cxx
@@ -450,6 +451,7 @@ ifeq ($(HAS_NETWORKING),1)
   SOURCES += $(COMPONENT_SRC_DIR)/ipacl.cxx \
              $(COMPONENT_SRC_DIR)/inetprot.cxx \
              $(COMMON_SRC_DIR)/psockbun.cxx \
+             $(COMPONENT_SRC_DIR)/sockevent.cxx \
              $(COMMON_SRC_DIR)/sockets.cxx
   ifeq ($(target_os),mingw)
     SOURCES += $(PLATFORM_SRC_DIR)/icmp.cxx \
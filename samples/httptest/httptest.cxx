@@ -42,6 +42,8 @@ class HTTPTest : public PProcess
     PCLASSINFO(HTTPTest, PProcess)
   public:
     void Main();
+    void BenchIdle(PArgList & args);
+    void BenchHeaders(PArgList & args);
 
     PQueuedThreadPool<HTTPConnection> m_pool;
 };
@@ -63,6 +65,9 @@ void HTTPTest::Main()
 #endif
              "T-theads:  max number of threads in pool(default 10)\n"
              "Q-queue:   max queue size for listening sockets(default 100).\n"
+             "-bench-idle: benchmark PHTTPListener with this many idle keep-alive clients\n"
+             "-event-driven. use event driven PHTTPListener for --bench-idle\n"
+             "-bench-headers: benchmark PHTTPServer header parsing with this many requests\n"
              PTRACE_ARGLIST
        );
 
@@ -73,6 +78,16 @@ void HTTPTest::Main()
     return;
   }
 
+  if (args.HasOption("bench-idle")) {
+    BenchIdle(args);
+    return;
+  }
+
+  if (args.HasOption("bench-headers")) {
+    BenchHeaders(args);
+    return;
+  }
+
   if (args.HasOption('O')) {
     if (args.GetCount() < 1) {
       cerr << args.Usage("url");
@@ -178,6 +193,209 @@ void HTTPTest::Main()
 }
 
 
+static bool Transact(PTCPSocket & socket, const PString & request)
+{
+  if (!socket.WriteString(request))
+    return false;
+
+  PString response;
+  PINDEX headerEnd;
+  char buffer[1000];
+  while ((headerEnd = response.Find("\r\n\r\n")) == P_MAX_INDEX) {
+    if (!socket.Read(buffer, sizeof(buffer)))
+      return false;
+    response += PString(buffer, socket.GetLastReadCount());
+  }
+
+  PINDEX lengthPos = response.Find("Content-Length:");
+  if (lengthPos == P_MAX_INDEX || response.Left(12) != "HTTP/1.1 200")
+    return false;
+
+  PINDEX total = headerEnd + 4 + response.Mid(lengthPos+15).AsUnsigned();
+  while (response.GetLength() < total) {
+    if (!socket.Read(buffer, sizeof(buffer)))
+      return false;
+    response += PString(buffer, socket.GetLastReadCount());
+  }
+  return true;
+}
+
+
+void HTTPTest::BenchIdle(PArgList & args)
+{
+  unsigned clientCount = args.GetOptionString("bench-idle").AsUnsigned();
+  SetMaxHandles(clientCount*2 + 100);
+
+  PHTTPListener listener(args.GetOptionString('T', "10").AsUnsigned());
+  listener.SetEventDriven(args.HasOption("event-driven"));
+  listener.GetSpace().AddResource(new PHTTPString("index.html", "Hello", "text/plain"));
+  if (!listener.ListenForHTTP("127.0.0.1", 0, PSocket::CanReuseAddress, args.GetOptionString('Q', "1000").AsUnsigned())) {
+    cerr << "Could not listen for HTTP" << endl;
+    return;
+  }
+
+  cout << "Benchmarking " << clientCount << " keep-alive clients, "
+       << (listener.IsEventDriven() ? "event driven" : "worker per connection") << ", "
+       << listener.GetThreadPool().GetMaxWorkers() << " workers" << endl;
+
+  const PString request = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: Keep-Alive\r\n\r\n";
+
+  /* Each client connects and does one request, then goes idle. Without
+     event driven mode, the clients after the pool size stall, so give up
+     after a number of failures in a row. */
+  PList<PTCPSocket> clients;
+  unsigned served = 0, failures = 0;
+  PTime startConnect;
+  while (clients.GetSize() < (PINDEX)clientCount && failures < 10) {
+    PTCPSocket * client = new PTCPSocket(listener.GetPort());
+    client->SetReadTimeout(500);
+    if (!client->Connect("127.0.0.1")) {
+      cerr << "Connect failed after " << clients.GetSize() << " clients: " << client->GetErrorText() << endl;
+      delete client;
+      break;
+    }
+    clients.Append(client);
+    if (Transact(*client, request)) {
+      ++served;
+      failures = 0;
+    }
+    else
+      ++failures;
+  }
+  PTimeInterval connectTime = PTime() - startConnect;
+
+  cout << "  Connected " << clients.GetSize() << ", served " << served << " in " << connectTime
+       << "s, parked " << listener.GetParkedCount() << endl;
+
+  // Now a few active clients amongst all the idle ones
+  PINDEX step = std::max(clients.GetSize()/100, (PINDEX)1);
+  unsigned requests = 0, errors = 0;
+  PTimeInterval maxLatency;
+  PTime startActive;
+  for (unsigned round = 0; round < 5; ++round) {
+    for (PINDEX i = 0; i < clients.GetSize(); i += step) {
+      PTime start;
+      if (Transact(clients[i], request))
+        ++requests;
+      else
+        ++errors;
+      PTimeInterval latency = PTime() - start;
+      if (maxLatency < latency)
+        maxLatency = latency;
+    }
+  }
+  PTimeInterval activeTime = PTime() - startActive;
+
+  cout << "  Active requests " << requests << ", errors " << errors << ", "
+       << (activeTime > 0 ? requests*1000/activeTime.GetMilliSeconds() : 0) << " req/s,"
+          " max latency " << maxLatency.GetMilliSeconds() << "ms" << endl;
+
+  clients.RemoveAll();
+  listener.ShutdownListeners();
+}
+
+
+class BenchHeadersListener : public PHTTPListener
+{
+  public:
+    BenchHeadersListener() : PHTTPListener(1) { }
+
+    virtual void OnHTTPStarted(PHTTPServer & server)
+    {
+      // No limit on requests per connection, and no Nagle delays on pipelined responses
+      server.GetConnectionInfo().SetPersistenceMaximumTransations(0);
+      server.GetSocket()->SetOption(TCP_NODELAY, 1, IPPROTO_TCP);
+    }
+};
+
+
+void HTTPTest::BenchHeaders(PArgList & args)
+{
+  unsigned requestCount = args.GetOptionString("bench-headers").AsUnsigned();
+
+  BenchHeadersListener listener;
+  listener.GetSpace().AddResource(new PHTTPString("index.html", "Hello", "text/plain"));
+  if (!listener.ListenForHTTP("127.0.0.1", 0, PSocket::CanReuseAddress)) {
+    cerr << "Could not listen for HTTP" << endl;
+    return;
+  }
+
+  // Typical browser request, about 1kb of header
+  PStringStream request;
+  request << "GET /index.html?id=1234567890&session=abcdefghijklmnopqrstuvwxyz HTTP/1.1\r\n"
+             "Host: localhost\r\n"
+             "Connection: Keep-Alive\r\n"
+             "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+             "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+             "Accept-Language: en-AU,en-GB;q=0.9,en-US;q=0.8,en;q=0.7\r\n"
+             "Accept-Encoding: identity\r\n"
+             "Cache-Control: max-age=0\r\n"
+             "Referer: http://localhost/some/long/path/to/the/referring/page.html\r\n"
+             "Cookie: session=0123456789abcdef0123456789abcdef; preferences=colour%3Dblue%26size%3Dlarge;\r\n"
+             "  tracking=fedcba9876543210fedcba9876543210\r\n"
+             "Upgrade-Insecure-Requests: 1\r\n";
+  for (int i = 0; i < 10; ++i)
+    request << "X-Custom-Header-" << i << ": some value for the custom header number " << i << "\r\n";
+  request << "\r\n";
+
+  PTCPSocket client(listener.GetPort());
+  if (!client.Connect("127.0.0.1")) {
+    cerr << "Connect failed: " << client.GetErrorText() << endl;
+    return;
+  }
+  client.SetReadTimeout(5000);
+
+  cout << "Benchmarking " << requestCount << " requests with " << request.GetLength() << " byte headers" << endl;
+
+  /* Pipeline requests in batches, keeping at least one batch outstanding, so
+     measuring parsing rather than round trip time or TCP acknowledge delays. */
+  static const unsigned BatchSize = 20;
+  PString batch;
+  for (unsigned i = 0; i < BatchSize; ++i)
+    batch += request;
+
+  unsigned sent = 0, responses = 0;
+  PString pending;
+  char buffer[8192];
+  PTime start;
+  while (responses < requestCount) {
+    if (sent < requestCount && sent - responses <= BatchSize) {
+      unsigned count = std::min(BatchSize, requestCount - sent);
+      if (!client.Write((const char *)batch, count*request.GetLength())) {
+        cerr << "Write failed: " << client.GetErrorText() << endl;
+        break;
+      }
+      sent += count;
+    }
+
+    PINDEX headerEnd = pending.Find("\r\n\r\n");
+    PINDEX lengthPos = pending.Find("Content-Length:");
+    if (headerEnd != P_MAX_INDEX && lengthPos != P_MAX_INDEX) {
+      PINDEX total = headerEnd + 4 + pending.Mid(lengthPos+15).AsUnsigned();
+      if (pending.GetLength() >= total) {
+        pending.Delete(0, total);
+        ++responses;
+        continue;
+      }
+    }
+
+    if (!client.Read(buffer, sizeof(buffer))) {
+      cerr << "Read failed after " << responses << " responses: " << client.GetErrorText() << endl;
+      break;
+    }
+    pending += PString(buffer, client.GetLastReadCount());
+  }
+  PTimeInterval elapsed = PTime() - start;
+
+  cout << "  " << responses << " requests in " << elapsed << "s, "
+       << (elapsed > 0 ? responses*1000/elapsed.GetMilliSeconds() : 0) << " req/s, "
+       << (elapsed > 0 ? (PUInt64)responses*request.GetLength()/1000/elapsed.GetMilliSeconds() : 0) << " MB/s of header" << endl;
+
+  client.Close();
+  listener.ShutdownListeners();
+}
+
+
 void HTTPConnection::Work()
 {
   PTRACE(3, "HTTPTest\tStarted work on " << m_socket.GetPeerAddress());
@@ -0,0 +1,147 @@
+/*
+ * main.cxx
+ *
+ * Sample program to benchmark PIpAccessControlList with large lists.
+ *
+ * Portable Tools Library
+ *
+ * Copyright (C) 2024 Vox Lucida Pty. Ltd.
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is Portable Tools Library.
+ *
+ * The Initial Developer of the Original Code is Vox Lucida Pty. Ltd.
+ *
+ * Contributor(s): ______________________________________.
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <ptclib/ipacl.h>
+#include <ptclib/random.h>
+
+
+class IpAclTest : public PProcess
+{
+  PCLASSINFO(IpAclTest, PProcess)
+  public:
+    void Main();
+};
+
+PCREATE_PROCESS(IpAclTest);
+
+
+static PIPSocket::Address RandomIPv4(PRandom & rand)
+{
+  // Keep to a couple of /8's so lookups get a reasonable hit rate
+  return PIPSocket::Address((BYTE)(rand.Generate()%2 + 10), (BYTE)rand.Generate(), (BYTE)rand.Generate(), (BYTE)rand.Generate());
+}
+
+
+static PIPSocket::Address RandomIPv6(PRandom & rand)
+{
+  BYTE bytes[16] = { 0x20, 0x01, 0x0d, 0xb8 };
+  for (PINDEX i = 4; i < 16; ++i)
+    bytes[i] = (BYTE)(i < 6 ? rand.Generate()%4 : rand.Generate());
+  return PIPSocket::Address(16, bytes);
+}
+
+
+// The way it was done before compiling the list
+static PIpAccessControlEntry * LinearFind(const PIpAccessControlList & acl, PIPSocket::Address address)
+{
+  for (PIpAccessControlList::const_iterator it = acl.begin(); it != acl.end(); ++it) {
+    PIpAccessControlEntry & entry = const_cast<PIpAccessControlEntry &>(*it);
+    if (entry.Match(address))
+      return &entry;
+  }
+  return NULL;
+}
+
+
+void IpAclTest::Main()
+{
+  PArgList & args = GetArguments();
+  args.Parse("e-entries:  number of entries in list (100000)\n"
+             "l-lookups:  number of look ups to time (1000000)\n"
+             "c-check:    number of look ups checked against linear search (1000)\n"
+             PTRACE_ARGLIST);
+  if (!args.IsParsed()) {
+    args.Usage(cerr);
+    return;
+  }
+  PTRACE_INITIALISE(args);
+
+  unsigned entryCount = args.GetOptionAs('e', 100000U);
+  unsigned lookupCount = args.GetOptionAs('l', 1000000U);
+  unsigned checkCount = args.GetOptionAs('c', 1000U);
+
+  PRandom rand(1);
+
+  /* A blocklist style mix: mostly single hosts, some /24 and /16 networks,
+     and a smattering of IPv6. Allow a few exceptions, and deny all else. */
+  PSimpleTimer timer;
+  PIpAccessControlList acl;
+  while (acl.GetSize() < entryCount) {
+    PStringStream description;
+    unsigned kind = rand.Generate()%100;
+    bool allow = rand.Generate()%10 == 0;
+    description << (allow ? '+' : '-');
+    if (kind < 70)
+      description << RandomIPv4(rand);
+    else if (kind < 85)
+      description << RandomIPv4(rand) << "/24";
+    else if (kind < 90)
+      description << RandomIPv4(rand) << "/16";
+    else if (kind < 95)
+      description << RandomIPv6(rand);
+    else
+      description << RandomIPv6(rand) << "/48";
+    acl.Add(description);
+  }
+  acl.Add("-ALL");
+  PTimeInterval loaded = timer.GetElapsed();
+
+  timer = 0;
+  acl.Find(PIPSocket::Address(10, 0, 0, 1));
+  PTimeInterval compiled = timer.GetElapsed();
+
+  cout << "List of " << acl.GetSize() << " entries, load " << loaded << "s, compile " << compiled << 's' << endl;
+
+  std::vector<PIPSocket::Address> addresses(lookupCount);
+  for (unsigned i = 0; i < lookupCount; ++i)
+    addresses[i] = rand.Generate()%5 == 0 ? RandomIPv6(rand) : RandomIPv4(rand);
+
+  unsigned mismatches = 0;
+  timer = 0;
+  for (unsigned i = 0; i < checkCount && i < lookupCount; ++i) {
+    if (acl.Find(addresses[i]) != LinearFind(acl, addresses[i]))
+      ++mismatches;
+  }
+  PTimeInterval linear = timer.GetElapsed();
+  if (checkCount > 0)
+    cout << "Linear: " << checkCount << " look ups, " << (linear.GetMicroSeconds()/(double)checkCount) << "us each, "
+         << mismatches << " mismatches" << endl;
+
+  unsigned allowed = 0;
+  timer = 0;
+  for (unsigned i = 0; i < lookupCount; ++i) {
+    if (acl.IsAllowed(addresses[i]))
+      ++allowed;
+  }
+  PTimeInterval elapsed = timer.GetElapsed();
+  cout << "Compiled: " << lookupCount << " look ups, " << (elapsed.GetMicroSeconds()*1000.0/lookupCount) << "ns each, "
+       << allowed << " allowed" << endl;
+}
+
+
+// End of File ///////////////////////////////////////////////////////////////
@@ -9,6 +9,7 @@ class JSONTest : public PProcess
  public:
   JSONTest();
   void Main();
+  void Benchmark(const PString & filename);
 };
 
 PCREATE_PROCESS(JSONTest);
@@ -22,6 +23,11 @@ JSONTest::JSONTest()
 void JSONTest::Main()
 {
   PArgList & args = GetArguments();
+  if (args.GetCount() > 0 && args[0] == "-b") {
+    Benchmark(args.GetCount() > 1 ? args[1] : PString::Empty());
+    return;
+  }
+
   if (args.GetCount() > 0) {
     PJSON json;
     if (args[0] == "-")
@@ -88,3 +94,108 @@ void JSONTest::Main()
 #endif // P_SSL
 }
 
+
+// Counts elements, to measure the event driven parser with no tree building
+class CountingHandler : public PJSON::Handler
+{
+  public:
+    CountingHandler() : m_count(0) { }
+    virtual bool OnStartObject() { ++m_count; return true; }
+    virtual bool OnStartArray() { ++m_count; return true; }
+    virtual bool OnString(const char *, size_t) { ++m_count; return true; }
+    virtual bool OnNumber(PJSON::NumberType) { ++m_count; return true; }
+    virtual bool OnBoolean(bool) { ++m_count; return true; }
+    virtual bool OnNull() { ++m_count; return true; }
+    unsigned m_count;
+};
+
+
+static PString GenerateDocument()
+{
+  // Something like a typical REST API response
+  PStringStream strm;
+  strm << "{\n  \"results\" : [";
+  for (unsigned i = 0; i < 5000; ++i) {
+    if (i > 0)
+      strm << ',';
+    strm << "\n    {\n"
+            "      \"id\" : " << (100000 + i) << ",\n"
+            "      \"name\" : \"Subscriber number " << i << "\",\n"
+            "      \"uri\" : \"sip:user" << i << "@example.com\",\n"
+            "      \"balance\" : " << (i * 1.25) << ",\n"
+            "      \"active\" : " << (i % 3 != 0 ? "true" : "false") << ",\n"
+            "      \"notes\" : " << (i % 7 == 0 ? "\"Line one\\nLine \\\"two\\\"\"" : "null") << ",\n"
+            "      \"tags\" : [ \"alpha\", \"beta\", " << i << " ]\n"
+            "    }";
+  }
+  strm << "\n  ]\n}\n";
+  return strm;
+}
+
+
+void JSONTest::Benchmark(const PString & filename)
+{
+  PString text;
+  if (filename.IsEmpty())
+    text = GenerateDocument();
+  else {
+    PTextFile file;
+    if (!file.Open(filename, PFile::ReadOnly)) {
+      cerr << "Could not open " << filename << endl;
+      return;
+    }
+    text = file.ReadString(P_MAX_INDEX);
+  }
+
+  static const unsigned Iterations = 20;
+  cout << "Benchmark: " << text.GetLength() << " bytes, " << Iterations << " iterations" << endl;
+
+  PJSON json;
+  PTimeInterval streamParse, bufferParse, handlerParse, streamPrint, bufferPrint;
+
+  PSimpleTimer timer;
+  for (unsigned i = 0; i < Iterations; ++i) {
+    PStringStream strm(text);
+    strm >> json;
+  }
+  streamParse = timer.GetElapsed();
+  PString streamResult = json.AsString(1);
+
+  timer = 0;
+  for (unsigned i = 0; i < Iterations; ++i)
+    json.FromBuffer(text, text.GetLength());
+  bufferParse = timer.GetElapsed();
+  if (!json.IsValid()) {
+    cerr << "Could not parse JSON" << endl;
+    return;
+  }
+
+  CountingHandler counter;
+  timer = 0;
+  for (unsigned i = 0; i < Iterations; ++i)
+    PJSON::Parse(text, text.GetLength(), counter);
+  handlerParse = timer.GetElapsed();
+
+  PStringStream printed;
+  timer = 0;
+  for (unsigned i = 0; i < Iterations; ++i) {
+    printed = PString::Empty();
+    printed << json;
+  }
+  streamPrint = timer.GetElapsed();
+
+  std::string appended;
+  timer = 0;
+  for (unsigned i = 0; i < Iterations; ++i) {
+    appended.clear();
+    json.AppendTo(appended);
+  }
+  bufferPrint = timer.GetElapsed();
+
+  cout << "  istream parse : " << streamParse << "s\n"
+          "  buffer parse  : " << bufferParse << "s\n"
+          "  handler parse : " << handlerParse << "s (" << counter.m_count/Iterations << " elements)\n"
+          "  ostream print : " << streamPrint << "s\n"
+          "  buffer print  : " << bufferPrint << "s\n"
+          "  results match : " << boolalpha << (streamResult == json.AsString(1) && printed == appended) << endl;
+}
@@ -326,6 +326,7 @@ void MapDictionary::Main()
              "i-iterates:"
 	     "s-size:"
              "-preset."
+             "-scale."
 	     "h-help."
 #if PTRACING
              "o-output:"
@@ -339,6 +340,8 @@ void MapDictionary::Main()
          << "     -l --lookups #  : count of lookup to run over the map/dicts (10000)\n"
          << "     -i --iterates # : count of iterates to run over the map/dicts (1000)\n"
 	 << "     -s --size  #    : number of elements to pu in map/dict (200)\n"
+         << "     --preset        : run a range of small to medium sizes\n"
+         << "     --scale         : run large sizes, 1k, 100k and 1M elements\n"
 	 << "     -h --help       : Get this help message\n"
 	 << "     -v --version    : Get version information\n"
 #if PTRACING
@@ -377,6 +380,13 @@ void MapDictionary::Main()
     return;
   }
 
+  if (args.HasOption("scale")) {
+    m_size = 1000;    m_lookups = 100000; m_iterates = 1000; TestAll();
+    m_size = 100000;  m_lookups = 100000; m_iterates = 10;   TestAll();
+    m_size = 1000000; m_lookups = 100000; m_iterates = 1;    TestAll();
+    return;
+  }
+
   if ((m_size = args.GetOptionString('s', "200").AsInteger()) <= 0) {
     cerr << "Illegal number of size\n";
     return;
@@ -0,0 +1,74 @@
+/*
+ * dummy.cxx
+ *
+ * Dummy plugin for the plugin manager startup benchmark.
+ *
+ * Portable Tools Library
+ *
+ * Copyright (C) 2024 Vox Lucida Pty. Ltd.
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is Portable Tools Library.
+ *
+ * The Initial Developer of the Original Code is Vox Lucida Pty. Ltd.
+ *
+ * Contributor(s): ______________________________________.
+ */
+
+#include <ptlib.h>
+#include <ptlib/pluginmgr.h>
+
+#include <dlfcn.h>
+
+
+#define DUMMY_SERVICE_TYPE "PluginLoadDummy"
+
+
+/* The benchmark copies this one plugin many times, so the service name is
+   taken from the file it was loaded from, giving each copy its own service. */
+class DummyDescriptor : public PPluginDeviceDescriptor
+{
+  public:
+    DummyDescriptor(const PString & name)
+      : m_name(name)
+    { }
+
+    virtual const char * GetServiceType() const { return DUMMY_SERVICE_TYPE; }
+    virtual const char * GetServiceName() const { return m_name; }
+    virtual PObject * CreateInstance(P_INT_PTR) const { return new PString(m_name); }
+
+  protected:
+    PString m_name;
+};
+
+
+extern "C" unsigned PWLibPlugin_GetAPIVersion()
+{
+  return 0;
+}
+
+
+extern "C" void PWLibPlugin_TriggerRegister(PPluginManager * pluginMgr)
+{
+  Dl_info info;
+  if (dladdr((void *)&PWLibPlugin_TriggerRegister, &info) == 0 || info.dli_fname == NULL)
+    return;
+
+  PString name = PFilePath(info.dli_fname).GetTitle();
+  PString key = DUMMY_SERVICE_TYPE + name;
+  // Not auto-deleted, the factory outlives the plugin being unloaded
+  if (PPluginFactory::Register(key, new DummyDescriptor(name), false))
+    pluginMgr->RegisterService(key);
+}
+
+
+// End of File ///////////////////////////////////////////////////////////////
@@ -0,0 +1,167 @@
+/*
+ * main.cxx
+ *
+ * Sample program to benchmark PPluginManager startup with and without the
+ * plugin manifest.
+ *
+ * Portable Tools Library
+ *
+ * Copyright (C) 2024 Vox Lucida Pty. Ltd.
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is Portable Tools Library.
+ *
+ * The Initial Developer of the Original Code is Vox Lucida Pty. Ltd.
+ *
+ * Contributor(s): ______________________________________.
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <ptlib/pluginmgr.h>
+#include <ptlib/pipechan.h>
+
+
+class PluginLoad : public PProcess
+{
+  PCLASSINFO(PluginLoad, PProcess)
+  public:
+    void Main();
+    void Child(const PDirectory & dir, const PString & manifest);
+};
+
+PCREATE_PROCESS(PluginLoad);
+
+
+#if P_PLUGINMGR && P_PIPECHAN
+
+#define DUMMY_SERVICE_TYPE "PluginLoadDummy"
+
+
+/* Each measurement is done in a fresh process, as once loaded a plugin stays
+   loaded, and the plugin manager only ever loads directories at startup. */
+void PluginLoad::Child(const PDirectory & dir, const PString & manifest)
+{
+  PPluginManager & mgr = PPluginManager::GetPluginManager();
+  if (!mgr.GetPluginsProviding(DUMMY_SERVICE_TYPE, false).IsEmpty()) {
+    cout << "plugins already loaded at startup, move " << dir << " out of the default plugin path" << endl;
+    return;
+  }
+
+  mgr.SetManifestFile(manifest == "-" ? PString::Empty() : manifest);
+  mgr.SetDirectories(PStringArray(dir));
+
+  PSimpleTimer timer;
+  mgr.LoadDirectories();
+  PTimeInterval loaded = timer.GetElapsed();
+
+  PStringArray services = mgr.GetPluginsProviding(DUMMY_SERVICE_TYPE, false);
+
+  timer = 0;
+  PObject * instance = services.IsEmpty() ? NULL : mgr.CreatePlugin(services[0], DUMMY_SERVICE_TYPE);
+  PTimeInterval created = timer.GetElapsed();
+
+  bool ok = instance != NULL && *instance == services[0];
+  delete instance;
+
+  cout << loaded.GetMicroSeconds() << ' ' << created.GetMicroSeconds() << ' ' << services.GetSize() << ' ' << ok << endl;
+}
+
+
+void PluginLoad::Main()
+{
+  PArgList & args = GetArguments();
+  args.Parse("p-plugin:     dummy plugin to copy (from samples/pluginload/dummy)\n"
+             "n-count:      number of plugins (100)\n"
+             "r-repeat:     number of runs of each pass (5)\n"
+             "d-directory:  directory for plugin copies (temporary)\n"
+             "x-child.      internal, run measurement\n"
+             PTRACE_ARGLIST);
+  if (!args.IsParsed() || (!args.HasOption('p') && !args.HasOption('x'))) {
+    args.Usage(cerr, "-p <plugin>");
+    return;
+  }
+  PTRACE_INITIALISE(args);
+
+  if (args.HasOption('x')) {
+    if (args.GetCount() == 2)
+      Child(args[0], args[1]);
+    return;
+  }
+
+  unsigned count = std::max(1U, args.GetOptionAs('n', 100U));
+  unsigned repeat = std::max(1U, args.GetOptionAs('r', 5U));
+
+  PFilePath plugin = args.GetOptionString('p');
+  if (!PFile::Exists(plugin)) {
+    cerr << "Plugin " << plugin << " does not exist, build samples/pluginload/dummy" << endl;
+    return;
+  }
+
+  PDirectory dir = args.GetOptionString('d', PDirectory::GetTemporary() + "pluginload");
+  if (!dir.Exists() && !dir.Create()) {
+    cerr << "Could not create " << dir << endl;
+    return;
+  }
+
+  for (unsigned i = 0; i < count; ++i) {
+    PFilePath copy = dir + psprintf("dummy%04u_ptplugin", i) + PDynaLink::GetExtension();
+    if (!PFile::Exists(copy) && !PFile::Copy(plugin, copy)) {
+      cerr << "Could not copy plugin to " << copy << endl;
+      return;
+    }
+  }
+
+  PFilePath manifest = dir + "manifest.txt";
+  PFile::Remove(manifest);
+
+  cout << "Plugin manager startup: " << count << " plugins in " << dir << ", " << repeat << " runs" << endl;
+
+  static const char * const PassNames[] = { "No manifest", "Cold manifest", "Warm manifest" };
+  for (int pass = 0; pass < 3; ++pass) {
+    PInt64 totalLoad = 0, totalCreate = 0;
+    for (unsigned run = 0; run < repeat; ++run) {
+      if (pass == 1)
+        PFile::Remove(manifest);
+
+      PString output;
+      PPipeChannel::Run(PSTRSTRM(GetFile() << " --child " << dir << ' ' << (pass == 0 ? PString("-") : PString(manifest))), output, false);
+      PStringArray result = output.Trim().Tokenise(' ');
+
+      if (result.GetSize() != 4 || result[2].AsUnsigned() != count || result[3] != "1") {
+        cerr << PassNames[pass] << " run failed: " << output << endl;
+        return;
+      }
+      totalLoad += result[0].AsInteger64();
+      totalCreate += result[1].AsInteger64();
+    }
+
+    cout << setw(14) << PassNames[pass] << ":"
+            " load=" << totalLoad/repeat << "us,"
+            " first create=" << totalCreate/repeat << "us" << endl;
+  }
+}
+
+#else
+#pragma message("Cannot compile test application without plugin manager support!")
+
+void PluginLoad::Child(const PDirectory &, const PString &)
+{
+}
+
+void PluginLoad::Main()
+{
+}
+#endif
+
+
+// End of File ///////////////////////////////////////////////////////////////
@@ -214,6 +214,7 @@ protected:
   void MultiTimerTest();
   void LongOnTimeoutTest();
   void MassStopTest();
+  void BenchmarkTest(unsigned count);
   void StartStopTest();
   void PullCheck();
   void CallbackCheck();
@@ -276,6 +277,7 @@ void PTimerTest::Main()
              "r-restart.   A test which repeatedly restarts two internal timers.\n"
              "x-stress.    A test create 10 timers and change it repeatedly from 1000 threads\n"
              "g-stoptest.  Measure Stop() time for many timers.\n"
+             "b-bench:     Measure timer list tick cost and lateness with N armed timers.\n"
              PTRACE_ARGLIST
   );
   PTRACE_INITIALISE(args);
@@ -290,6 +292,11 @@ void PTimerTest::Main()
     return;
   }
 
+  if (args.HasOption('b')) {
+    BenchmarkTest(args.GetOptionAs('b', 100000U));
+    return;
+  }
+
   PullCheck();
   CallbackCheck();
   StartStopTest();
@@ -878,6 +885,84 @@ void PTimerTest::MassStopTest()
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+class BenchmarkTimer : public PTimer
+{
+  public:
+    static PAtomicInteger s_running;
+    static atomic<int64_t> s_totalLateness;
+    static atomic<int64_t> s_maxLateness;
+
+    BenchmarkTimer()
+      : m_expected(0)
+    {
+    }
+
+    void Start(const PTimeInterval & delay)
+    {
+      m_expected = PTimer::Tick() + delay;
+      SetInterval(delay.GetMilliSeconds());
+    }
+
+    virtual void OnTimeout()
+    {
+      int64_t lateness = (PTimer::Tick() - m_expected).GetMicroSeconds();
+      s_totalLateness += lateness;
+      int64_t previous = s_maxLateness;
+      while (lateness > previous && !s_maxLateness.compare_exchange_strong(previous, lateness))
+        ;
+      --s_running;
+    }
+
+  protected:
+    PTimeInterval m_expected;
+};
+
+PAtomicInteger BenchmarkTimer::s_running;
+atomic<int64_t> BenchmarkTimer::s_totalLateness;
+atomic<int64_t> BenchmarkTimer::s_maxLateness;
+
+
+void PTimerTest::BenchmarkTest(unsigned count)
+{
+  if (count == 0)
+    count = 100000;
+
+  std::vector<BenchmarkTimer> timers(count);
+
+  cout << "Arming " << count << " idle timers to measure the cost of a timer list tick." << endl;
+  for (unsigned i = 0; i < count; ++i)
+    timers[i].Start(PTimeInterval(0, PRandom::Number(600, 1200)));
+
+  static const unsigned Ticks = 1000;
+  PTimer::List & list = *PTimer::TimerList();
+  PTimeInterval start = PTimer::Tick();
+  for (unsigned i = 0; i < Ticks; ++i)
+    list.Process();
+  PTimeInterval elapsed = PTimer::Tick() - start;
+  cout << "Average tick cost: " << (elapsed.GetMicroSeconds()/(double)Ticks) << "us over " << Ticks << " ticks" << endl;
+
+  for (unsigned i = 0; i < count; ++i)
+    timers[i].Stop();
+
+  cout << "Arming " << count << " timers between 1 and 10 seconds to measure lateness." << endl;
+  BenchmarkTimer::s_running = count;
+  BenchmarkTimer::s_totalLateness = 0;
+  BenchmarkTimer::s_maxLateness = 0;
+  start = PTimer::Tick();
+  for (unsigned i = 0; i < count; ++i)
+    timers[i].Start(PTimeInterval(PRandom::Number(1000, 10000)));
+  cout << "Armed in " << (PTimer::Tick() - start) << " seconds" << endl;
+
+  while (BenchmarkTimer::s_running > 0)
+    PThread::Sleep(500);
+
+  cout << "Average lateness: " << (BenchmarkTimer::s_totalLateness/(double)count/1000) << "ms, "
+          "maximum: " << (BenchmarkTimer::s_maxLateness/1000.0) << "ms" << endl;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 
 class EarlyStopTimerTester
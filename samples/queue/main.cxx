@@ -26,7 +26,6 @@
 #include <ptlib.h>
 
 #include "main.h"
-#include "version.h"
 
 
 #define new PNEW
@@ -56,6 +55,8 @@ void QueueProcess::Main()
 	     "s-sizeread:"
 	     "S-sizewrite:"
 	     "i-iterations:"
+	     "b-benchmark."
+	     "p-producers:"
 #if PTRACING
              "o-output:"
              "t-trace."
@@ -73,6 +74,8 @@ void QueueProcess::Main()
 	  "  -s --sizeread        : number of bytes read at each read iteration (480)\n"
 	  "  -S --sizewrite       : number of bytes written at each write iteration (320)\n"
 	  "  -i --iterations #    : number of iteration of the write loop (100) \n"
+	  "  -b --benchmark       : run throughput benchmark of all queue modes, no delays\n"
+	  "  -p --producers #     : number of writer threads for multi-producer benchmark (4)\n"
 #if PTRACING
 	  "  -t --trace           : Enable trace, use multiple times for more detail.\n"
 	  "  -o --output          : File for trace output, default is stderr.\n"
@@ -117,6 +120,25 @@ void QueueProcess::Main()
   if (args.HasOption('S'))
       readSize = args.GetOptionString('S').AsInteger();
 
+  if (args.HasOption('b')) {
+    unsigned producers = args.HasOption('p') ? args.GetOptionString('p').AsUnsigned() : 4;
+    if (producers < 1)
+      producers = 1;
+    if (!args.HasOption('i'))
+      iterations = 1000000;
+    cout << "Benchmark " << iterations << " blocks of " << writeSize << " bytes,"
+            " reading " << readSize << " bytes at a time\n"
+         << left << setw(16) << "Mode" << right << setw(10) << "Writers" << setw(10) << "ZeroCopy"
+         << setw(10) << "Time(ms)" << setw(10) << "MB/s" << setw(12) << "Blocks/s" << endl;
+    Benchmark(PQueueChannel::LockedMode, 1, false);
+    Benchmark(PQueueChannel::SingleProducerMode, 1, false);
+    Benchmark(PQueueChannel::SingleProducerMode, 1, true);
+    Benchmark(PQueueChannel::LockedMode, producers, false);
+    Benchmark(PQueueChannel::MultiProducerMode, producers, false);
+    Benchmark(PQueueChannel::MultiProducerMode, producers, true);
+    return;
+  }
+
   PStringStream values;
   values << " processs " << iterations << " iterations of the write loop" << endl;
   values << " Read  " << readSize  << " bytes per loop,  delay " << readDelay  << " ms" << endl;
@@ -198,4 +220,75 @@ void QueueProcess::ConsumeBlockData(PThread &, INT)
 }
 
 
+void QueueProcess::Benchmark(PQueueChannel::Modes mode, unsigned producers, bool zeroCopy)
+{
+  static const char * const ModeNames[] = { "Locked", "SingleProducer", "MultiProducer" };
+
+  PQueueChannel channel(10000, mode);
+  benchmarkQueue = &channel;
+  benchmarkBlocks = iterations/producers;
+
+  std::vector<PThread *> writers;
+  PSimpleTimer timer;
+  for (unsigned i = 0; i < producers; ++i)
+    writers.push_back(PThread::Create(PCREATE_NOTIFIER(BenchmarkWrite), zeroCopy && mode != PQueueChannel::LockedMode,
+                                      PThread::NoAutoDeleteThread, PThread::NormalPriority, "generate"));
+
+  PINDEX expected = benchmarkBlocks*producers*writeSize;
+  PINDEX total = 0;
+  std::vector<BYTE> buffer(readSize);
+  while (total < expected) {
+    if (zeroCopy && mode != PQueueChannel::LockedMode) {
+      PINDEX len = readSize;
+      const BYTE * data = channel.ReadPeek(len);
+      if (data == NULL)
+        break;
+      total += len;
+      channel.ReadConsume(len);
+    }
+    else {
+      if (!channel.Read(buffer.data(), readSize))
+        break;
+      total += channel.GetLastReadCount();
+    }
+  }
+
+  PTimeInterval elapsed = timer.GetElapsed();
+
+  for (size_t i = 0; i < writers.size(); ++i) {
+    writers[i]->WaitForTermination();
+    delete writers[i];
+  }
+
+  int64_t ms = std::max((int64_t)1, elapsed.GetMilliSeconds());
+  cout << left << setw(16) << ModeNames[mode] << right << setw(10) << producers << setw(10) << (zeroCopy ? "yes" : "no")
+       << setw(10) << ms << setw(10) << (int64_t)(total/1000.0/ms) << setw(12) << (int64_t)(total/writeSize*1000.0/ms);
+  if (total != expected)
+    cout << "  (short by " << expected - total << " bytes)";
+  cout << endl;
+}
+
+
+void QueueProcess::BenchmarkWrite(PThread &, INT zeroCopy)
+{
+  std::vector<BYTE> buffer(writeSize);
+  for (PINDEX i = 0; i < benchmarkBlocks; i++) {
+    if (zeroCopy) {
+      PINDEX written = 0;
+      while (written < writeSize) {
+        PINDEX len = writeSize - written;
+        BYTE * space = benchmarkQueue->WriteReserve(len);
+        if (space == NULL)
+          return;
+        memcpy(space, buffer.data() + written, len);
+        benchmarkQueue->WriteCommit(len);
+        written += len;
+      }
+    }
+    else if (!benchmarkQueue->Write(buffer.data(), writeSize))
+      return;
+  }
+}
+
+
 // End of File ///////////////////////////////////////////////////////////////
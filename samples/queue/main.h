@@ -64,9 +64,26 @@ class QueueProcess : public PProcess
     PDECLARE_NOTIFIER(PThread, QueueProcess, ConsumeBlockData);
 #endif
 
+#ifdef DOC_PLUS_PLUS
+    /**Write blocks of data to the benchmark queue as fast as possible,
+       the INT parameter is non-zero to use WriteReserve()/WriteCommit() */
+    virtual void BenchmarkWrite(PThread &, INT);
+#else
+    PDECLARE_NOTIFIER(PThread, QueueProcess, BenchmarkWrite);
+#endif
+
+    /**Run a throughput benchmark of the PQueueChannel in the given mode */
+    void Benchmark(PQueueChannel::Modes mode, unsigned producers, bool zeroCopy);
+
     /**The class that acts as a queue */
     PQueueChannel queue;
 
+    /**The queue used for the benchmark */
+    PQueueChannel * benchmarkQueue;
+
+    /**Number of blocks each benchmark writer sends */
+    PINDEX benchmarkBlocks;
+
     /**The number of iterations we run for */
     PINDEX iterations;
 
@@ -57,6 +57,11 @@ void SafeTest::Main()
 	     "r-reporting."
 	     "b-banpthreadcreate."
 	     "a-alternate."
+             "-benchmark:"
+             "-bench-threads:"
+             "-bench-mode:"
+             "-rwmutex:"
+             "-rwmutex-write:"
 #if PTRACING
              "o-output:"             "-no-output."
              "t-trace."              "-no-trace."
@@ -89,6 +94,11 @@ void SafeTest::Main()
            << "-v  or --version      print version info" << endl
            << "-d  or --delay ##     where ## specifies how many milliseconds the created thread waits for" << endl
 	   << "-c  or --count ##     where ## specifies the number of active threads allowed " << endl
+           << "--benchmark ##        run PSafePtr contention benchmark over a list of ## objects" << endl
+           << "--bench-threads ##    maximum threads for benchmark, doubling from 1 (32)" << endl
+           << "--bench-mode m        benchmark safety mode: reference, readonly or readwrite (reference)" << endl
+           << "--rwmutex ##          run PReadWriteMutex reader benchmark with ## locks per thread" << endl
+           << "--rwmutex-write ##    benchmark takes a write lock every ## locks, zero is never (0)" << endl
 #if PTRACING
            << "o-output              output file name for trace" << endl
            << "t-trace.              trace level to use." << endl
@@ -98,11 +108,26 @@ void SafeTest::Main()
     return;
   }
 
+  if (args.HasOption("benchmark")) {
+    PCaselessString mode = args.GetOptionString("bench-mode", "reference");
+    Benchmark(args.GetOptionString("benchmark").AsInteger(),
+              args.GetOptionString("bench-threads", "32").AsInteger(),
+              mode == "readwrite" ? PSafeReadWrite : mode == "readonly" ? PSafeReadOnly : PSafeReference);
+    return;
+  }
+
+  if (args.HasOption("rwmutex")) {
+    RWMutexBenchmark(args.GetOptionString("rwmutex").AsInteger(),
+                     args.GetOptionString("bench-threads", "64").AsInteger(),
+                     args.GetOptionString("rwmutex-write", "0").AsInteger());
+    return;
+  }
+
   delay = 2000;
   if (args.HasOption('d'))
     delay = args.GetOptionString('d').AsInteger();
 
-  delay = PMIN(1000000, PMAX(1, delay));
+  delay = PMIN((PINDEX)1000000, PMAX((PINDEX)1, delay));
   cout << "Created thread will wait for " << delay << " milliseconds before ending" << endl;
 
   useOnThreadEnd = args.HasOption('a');
@@ -126,7 +151,7 @@ void SafeTest::Main()
   activeCount = 10;
   if (args.HasOption('c'))
     activeCount = args.GetOptionString('c').AsInteger();
-  activeCount = PMIN(100, PMAX(1, activeCount));
+  activeCount = PMIN((PINDEX)100, PMAX((PINDEX)1, activeCount));
   cout << "There will be " << activeCount << " threads in operation" << endl;
 
   delayThreadsActive.SetAutoDeleteObjects();
@@ -141,6 +166,120 @@ void SafeTest::Main()
   PThread::Sleep(delay * 2);
 }
 
+void SafeTest::Benchmark(PINDEX objects, PINDEX maxThreads, PSafetyMode mode)
+{
+  objects = PMAX((PINDEX)1, objects);
+  maxThreads = PMIN((PINDEX)256, PMAX((PINDEX)1, maxThreads));
+
+  PSafeList<BenchmarkObject> list;
+  for (PINDEX i = 0; i < objects; ++i)
+    list.Append(new BenchmarkObject);
+
+  // Aim for about 200,000 steps per thread, whatever the list size
+  PINDEX passes = PMAX((PINDEX)1, 200000/objects);
+
+  cout << "PSafePtr benchmark over " << objects << " objects, "
+       << passes << " passes per thread, mode "
+       << (mode == PSafeReference ? "reference" : mode == PSafeReadOnly ? "read only" : "read/write") << '\n'
+       << setw(8) << "Threads" << setw(12) << "Time(ms)" << setw(16) << "Steps/sec" << setw(10) << "Scaling" << endl;
+
+  double single = 0;
+  for (PINDEX count = 1; count <= maxThreads; count *= 2) {
+    std::vector<BenchmarkThread *> threads;
+    for (PINDEX i = 0; i < count; ++i)
+      threads.push_back(new BenchmarkThread(list, passes, mode));
+
+    PTime start;
+    for (PINDEX i = 0; i < count; ++i)
+      threads[i]->Resume();
+
+    PUInt64 steps = 0;
+    for (PINDEX i = 0; i < count; ++i) {
+      threads[i]->WaitForTermination();
+      steps += threads[i]->GetSteps();
+      delete threads[i];
+    }
+    PTimeInterval elapsed = PTime() - start;
+
+    double rate = (double)(int64_t)steps*1000.0/PMAX((PInt64)1, elapsed.GetMilliSeconds());
+    if (count == 1)
+      single = rate;
+    cout << setw(8) << count
+         << setw(12) << elapsed.GetMilliSeconds()
+         << setw(16) << (int64_t)rate
+         << setw(9) << setprecision(2) << fixed << rate/single << 'x' << endl;
+  }
+}
+
+
+void BenchmarkThread::Main()
+{
+  for (PINDEX pass = 0; pass < m_passes; ++pass) {
+    for (PSafePtr<BenchmarkObject> ptr(m_list, m_mode); ptr != NULL; ++ptr)
+      ++m_steps;
+  }
+}
+
+
+void SafeTest::RWMutexBenchmark(PINDEX iterations, PINDEX maxThreads, PINDEX writeInterval)
+{
+  iterations = PMAX((PINDEX)1, iterations);
+  maxThreads = PMIN((PINDEX)256, PMAX((PINDEX)1, maxThreads));
+
+  PReadWriteMutex mutex;
+
+  cout << "PReadWriteMutex benchmark, " << iterations << " locks per thread, ";
+  if (writeInterval > 0)
+    cout << "write lock every " << writeInterval;
+  else
+    cout << "read locks only";
+  cout << '\n'
+       << setw(8) << "Threads" << setw(12) << "Time(ms)" << setw(16) << "Locks/sec" << setw(10) << "Scaling" << endl;
+
+  double single = 0;
+  for (PINDEX count = 1; count <= maxThreads; count *= 2) {
+    std::vector<RWMutexBenchmarkThread *> threads;
+    for (PINDEX i = 0; i < count; ++i)
+      threads.push_back(new RWMutexBenchmarkThread(mutex, iterations, writeInterval));
+
+    PTime start;
+    for (PINDEX i = 0; i < count; ++i)
+      threads[i]->Resume();
+
+    for (PINDEX i = 0; i < count; ++i) {
+      threads[i]->WaitForTermination();
+      delete threads[i];
+    }
+    PTimeInterval elapsed = PTime() - start;
+
+    double rate = (double)iterations*count*1000.0/PMAX((PInt64)1, elapsed.GetMilliSeconds());
+    if (count == 1)
+      single = rate;
+    cout << setw(8) << count
+         << setw(12) << elapsed.GetMilliSeconds()
+         << setw(16) << (int64_t)rate
+         << setw(9) << setprecision(2) << fixed << rate/single << 'x' << endl;
+  }
+}
+
+
+void RWMutexBenchmarkThread::Main()
+{
+  for (PINDEX i = 1; i <= m_iterations; ++i) {
+    if (m_writeInterval > 0 && i%m_writeInterval == 0) {
+      m_mutex.StartWrite();
+      ++m_value;
+      m_mutex.EndWrite();
+    }
+    else {
+      m_mutex.StartRead();
+      ++m_value;
+      m_mutex.EndRead();
+    }
+  }
+}
+
+
 void SafeTest::OnReleased(DelayThread & delayThread)
 {
   PString id = delayThread.GetId();
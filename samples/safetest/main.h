@@ -290,6 +290,73 @@ public:
   PBoolean            keepGoing;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/**A trivial object placed in a PSafeList for the reference count
+   contention benchmark */
+class BenchmarkObject : public PSafeObject
+{
+  PCLASSINFO(BenchmarkObject, PSafeObject);
+};
+
+
+/**This thread repeatedly walks a shared PSafeList using PSafePtr, so every
+   step is a SafeReference()/SafeDereference() pair on a shared object. Many
+   of these running together show how the reference counting scales. */
+class BenchmarkThread : public PThread
+{
+  PCLASSINFO(BenchmarkThread, PThread);
+
+public:
+  /**Constructor */
+  BenchmarkThread(PSafeList<BenchmarkObject> & list, PINDEX passes, PSafetyMode mode)
+    : PThread(10000, NoAutoDeleteThread)
+    , m_list(list)
+    , m_passes(passes)
+    , m_mode(mode)
+    , m_steps(0)
+    { }
+
+  /**Walk the list the required number of times */
+  void Main();
+
+  /**Number of PSafePtr steps made */
+  PUInt64 GetSteps() const { return m_steps; }
+
+protected:
+  PSafeList<BenchmarkObject> & m_list;
+  PINDEX                       m_passes;
+  PSafetyMode                  m_mode;
+  PUInt64                      m_steps;
+};
+
+
+/**This thread repeatedly locks a shared PReadWriteMutex for reading, with
+   an optional write lock every so often, to show how readers scale. */
+class RWMutexBenchmarkThread : public PThread
+{
+  PCLASSINFO(RWMutexBenchmarkThread, PThread);
+
+public:
+  /**Constructor */
+  RWMutexBenchmarkThread(PReadWriteMutex & mutex, PINDEX iterations, PINDEX writeInterval)
+    : PThread(10000, NoAutoDeleteThread)
+    , m_mutex(mutex)
+    , m_iterations(iterations)
+    , m_writeInterval(writeInterval)
+    , m_value(0)
+    { }
+
+  /**Lock the mutex the required number of times */
+  void Main();
+
+protected:
+  PReadWriteMutex & m_mutex;
+  PINDEX            m_iterations;
+  PINDEX            m_writeInterval;
+  PINDEX            m_value;
+};
+
+
 ////////////////////////////////////////////////////////////////////////////////
 
 /**
@@ -308,6 +375,14 @@ class SafeTest : public PProcess
      command line processing */
     virtual void Main();
 
+  /**Run the multi-threaded PSafePtr contention benchmark, from 1 to
+     maxThreads threads doubling each time */
+    void Benchmark(PINDEX objects, PINDEX maxThreads, PSafetyMode mode);
+
+  /**Run the multi-threaded PReadWriteMutex reader scaling benchmark, from
+     1 to maxThreads threads doubling each time */
+    void RWMutexBenchmark(PINDEX iterations, PINDEX maxThreads, PINDEX writeInterval);
+
     /**Report the user specified delay, which is used in DelayThread
        instances. Units are in milliseconds */
     PINDEX Delay()    { return delay; }
@@ -10,6 +10,41 @@
 #include <ptlib.h>
 #include <ptlib/pprocess.h>
 #include <string>
+#include <vector>
+
+
+#if defined(__GLIBC__)
+// Count heap allocations by intercepting the C library functions
+extern "C" {
+  void * __libc_malloc(size_t);
+  void * __libc_calloc(size_t, size_t);
+  void * __libc_realloc(void *, size_t);
+}
+
+static atomic<unsigned> AllocationCount(0);
+
+extern "C" void * malloc(size_t size) __THROW
+{
+  ++AllocationCount;
+  return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t count, size_t size) __THROW
+{
+  ++AllocationCount;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void * realloc(void * ptr, size_t size) __THROW
+{
+  ++AllocationCount;
+  return __libc_realloc(ptr, size);
+}
+
+#define P_COUNT_ALLOCATIONS 1
+#else
+#define P_COUNT_ALLOCATIONS 0
+#endif
 
 ////////////////////////////////////////////////
 //
@@ -177,6 +212,136 @@ void Test4()
   delete thread;
 }
 
+////////////////////////////////////////////////
+//
+// test #5 - allocation and speed benchmark
+//
+
+static const char ShortText[] = "Short string";
+static const char LongText[] = "A string which is too long to fit in the small string buffer";
+
+class Benchmark
+{
+  public:
+    Benchmark(const char * name)
+      : m_name(name)
+#if P_COUNT_ALLOCATIONS
+      , m_allocations(AllocationCount)
+#endif
+    {
+    }
+
+    ~Benchmark()
+    {
+      PTimeInterval elapsed = PTime() - m_start;
+      cout << setw(28) << left << m_name << right;
+#if P_COUNT_ALLOCATIONS
+      cout << setw(10) << fixed << setprecision(2) << (double)(AllocationCount - m_allocations)/Iterations << " allocs/op";
+#endif
+      cout << setw(10) << fixed << setprecision(1) << elapsed.GetMicroSeconds()*1000.0/Iterations << " ns/op" << endl;
+    }
+
+    static const unsigned Iterations = 1000000;
+
+  private:
+    const char * m_name;
+    PTime        m_start;
+#if P_COUNT_ALLOCATIONS
+    unsigned     m_allocations;
+#endif
+};
+
+
+void Test5()
+{
+  PINDEX total = 0;
+
+  {
+    Benchmark bench("Construct short");
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i) {
+      PString str(ShortText);
+      total += str.GetLength();
+    }
+  }
+
+  {
+    Benchmark bench("Construct long");
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i) {
+      PString str(LongText);
+      total += str.GetLength();
+    }
+  }
+
+  {
+    PString original(ShortText);
+    Benchmark bench("Copy short");
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i) {
+      PString str(original);
+      total += str.GetLength();
+    }
+  }
+
+  {
+    PString original(LongText);
+    Benchmark bench("Copy long");
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i) {
+      PString str(original);
+      total += str.GetLength();
+    }
+  }
+
+  {
+    PString left("Short"), right(" string");
+    Benchmark bench("Concatenate short");
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i)
+      total += (left + right).GetLength();
+  }
+
+  {
+    Benchmark bench("Integer conversion");
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i)
+      total += PString(i).GetLength();
+  }
+
+  {
+    PString str;
+    Benchmark bench("Assign short");
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i) {
+      str = ShortText;
+      total += str.GetLength();
+    }
+  }
+
+  {
+    PString str(ShortText);
+    Benchmark bench("Modify copy of short");
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i) {
+      PString copy(str);
+      copy[0] = 's';
+      total += copy.GetLength();
+    }
+  }
+
+  {
+    Benchmark bench("Vector of long");
+    std::vector<PString> vec;
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i)
+      vec.push_back(PString(LongText));
+    total += vec.size();
+  }
+
+  {
+    Benchmark bench("String list of short");
+    PStringList list;
+    for (unsigned i = 0; i < Benchmark::Iterations; ++i)
+      list.AppendString(PString(ShortText));
+    total += list.GetSize();
+  }
+
+  cout << "Total characters: " << total << endl;
+}
+
+
 ////////////////////////////////////////////////
 //
 // main
@@ -198,4 +363,5 @@ void StringTest::Main()
   Test2(); cout << "End of test #2\n" << endl;
   Test3(); cout << "End of test #3\n" << endl;
   Test4(); cout << "End of test #4\n" << endl;
+  Test5(); cout << "End of test #5\n" << endl;
 }
@@ -0,0 +1,272 @@
+/*
+ * main.cxx
+ *
+ * Sample program to load test PSTUNServer in single and multi-threaded modes.
+ *
+ * Portable Tools Library
+ *
+ * Copyright (C) 2024 Vox Lucida Pty. Ltd.
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is Portable Tools Library.
+ *
+ * The Initial Developer of the Original Code is Vox Lucida Pty. Ltd.
+ *
+ * Contributor(s): ______________________________________.
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <ptclib/pstunsrvr.h>
+
+
+class StunLoad : public PProcess
+{
+  PCLASSINFO(StunLoad, PProcess)
+  public:
+    void Main();
+};
+
+PCREATE_PROCESS(StunLoad);
+
+
+#if P_STUNSRVR
+
+/* Each client thread keeps a window of requests outstanding to the server,
+   sending a new one as each response arrives. The PSTUNClient is used for
+   its credentials and to check the mapped address in each response. */
+class LoadClient : public PSTUNClient
+{
+  PCLASSINFO(LoadClient, PSTUNClient);
+  public:
+    LoadClient(const PIPSocketAddressAndPort & server, unsigned window)
+      : m_server(server)
+      , m_window(window)
+      , m_responses(0)
+      , m_timeouts(0)
+      , m_failures(0)
+      , m_thread(NULL)
+    {
+    }
+
+    ~LoadClient()
+    {
+      delete m_thread;
+    }
+
+    bool Start(const PTime & endTime)
+    {
+      m_endTime = endTime;
+      if (!m_socket.Listen(PIPSocket::Address::GetLoopback(), 0, 0)) {
+        cerr << "Could not open client socket: " << m_socket.GetErrorText() << endl;
+        return false;
+      }
+      m_socket.GetLocalAddress(m_localAddress);
+      m_socket.SetReadTimeout(1000);
+      m_thread = new PThreadObj<LoadClient>(*this, &LoadClient::ThreadMain, false, "LoadClient");
+      return true;
+    }
+
+    void Wait()
+    {
+      m_thread->WaitForTermination();
+    }
+
+    void ThreadMain()
+    {
+      for (unsigned i = 0; i < m_window; ++i)
+        SendRequest();
+
+      while (PTime() < m_endTime) {
+        PSTUNMessage response;
+        if (!response.Read(m_socket)) {
+          // Lost one, keep the window full
+          ++m_timeouts;
+          SendRequest();
+          continue;
+        }
+
+        PIPSocketAddressAndPort mapped;
+        if (response.GetType() != PSTUNMessage::BindingResponse ||
+            !response.CheckFingerprint(true) ||
+            !GetFromBindingResponse(response, mapped) ||
+            mapped != m_localAddress)
+          ++m_failures;
+        else
+          ++m_responses;
+
+        SendRequest();
+      }
+    }
+
+    void SendRequest()
+    {
+      PSTUNMessage request(PSTUNMessage::BindingRequest);
+      if (!m_userName.IsEmpty())
+        request.AddAttribute(PSTUNStringAttribute(PSTUNAttribute::USERNAME, m_userName));
+#if P_SSL
+      AppendMessageIntegrity(request);
+#endif
+      request.AddFingerprint();
+      request.Write(m_socket, m_server);
+    }
+
+    PIPSocketAddressAndPort m_server;
+    unsigned                m_window;
+    PTime                   m_endTime;
+    PUDPSocket              m_socket;
+    PIPSocketAddressAndPort m_localAddress;
+    unsigned                m_responses;
+    unsigned                m_timeouts;
+    unsigned                m_failures;
+    PThread               * m_thread;
+};
+
+
+// Original single threaded Select() based server
+class SingleServer : public PSTUNServer
+{
+  PCLASSINFO(SingleServer, PSTUNServer);
+  public:
+    SingleServer()
+      : m_running(true)
+    {
+    }
+
+    void ThreadMain()
+    {
+      while (m_running)
+        Process();
+    }
+
+    atomic<bool> m_running;
+};
+
+
+static bool RunLoad(const PIPSocketAddressAndPort & server, const PArgList & args)
+{
+  unsigned clientCount = std::max(1U, args.GetOptionAs('c', 4U));
+  unsigned window = std::max(1U, args.GetOptionAs('W', 16U));
+  PTime endTime = PTime() + PTimeInterval(0, std::max(1U, args.GetOptionAs('d', 5U)));
+
+  std::vector<LoadClient *> clients;
+  for (unsigned i = 0; i < clientCount; ++i) {
+    LoadClient * client = new LoadClient(server, window);
+    client->SetCredentials(args.GetOptionString('u'), args.GetOptionString('p'), PString::Empty());
+    clients.push_back(client);
+  }
+
+  PSimpleTimer timer;
+  bool ok = true;
+  for (size_t i = 0; i < clients.size(); ++i)
+    ok = clients[i]->Start(endTime) && ok;
+
+  unsigned responses = 0, timeouts = 0, failures = 0;
+  for (size_t i = 0; i < clients.size(); ++i) {
+    if (ok)
+      clients[i]->Wait();
+    responses += clients[i]->m_responses;
+    timeouts += clients[i]->m_timeouts;
+    failures += clients[i]->m_failures;
+    delete clients[i];
+  }
+
+  PTimeInterval elapsed = timer.GetElapsed();
+  cout << "  " << responses << " responses in " << elapsed << "s"
+          " = " << (unsigned)(responses*1000.0/elapsed.GetMilliSeconds()) << "/s,"
+          " timeouts=" << timeouts << ", failures=" << failures << endl;
+  return ok;
+}
+
+
+void StunLoad::Main()
+{
+  PArgList & args = GetArguments();
+  args.Parse("s-server:     remote STUN server to load, instead of a local one\n"
+             "m-mode:       local server mode, \"single\", \"workers\" or \"both\" (both)\n"
+             "w-workers:    worker threads for local server (number of CPU cores)\n"
+             "b-batch:      datagrams per system call for local server (32)\n"
+             "c-clients:    number of client threads (4)\n"
+             "W-window:     requests outstanding for each client (16)\n"
+             "d-duration:   seconds to run each test (5)\n"
+             "u-username:   short term credential username\n"
+             "p-password:   short term credential password\n"
+             PTRACE_ARGLIST);
+  if (!args.IsParsed()) {
+    args.Usage(cerr);
+    return;
+  }
+  PTRACE_INITIALISE(args);
+
+  if (args.HasOption('s')) {
+    PIPSocketAddressAndPort server(args.GetOptionString('s'), PSTUN::DefaultPort);
+    cout << "Remote server " << server << ':' << endl;
+    RunLoad(server, args);
+    return;
+  }
+
+  PCaselessString mode = args.GetOptionString('m', "both");
+
+  if (mode == "single" || mode == "both") {
+    SingleServer server;
+    server.SetCredentials(args.GetOptionString('u'), args.GetOptionString('p'), PString::Empty());
+    PUDPSocket * socket = new PUDPSocket;
+    if (!socket->Listen(PIPSocket::Address::GetLoopback(), 0, 0) || !server.Open(socket)) {
+      cerr << "Could not open single threaded server" << endl;
+      return;
+    }
+
+    PIPSocketAddressAndPort address;
+    socket->GetLocalAddress(address);
+    cout << "Single threaded server on " << address << ':' << endl;
+
+    PThread * thread = new PThreadObj<SingleServer>(server, &SingleServer::ThreadMain, false, "SingleServer");
+    RunLoad(address, args);
+
+    // Send one last request to get it out of Select()
+    server.m_running = false;
+    PUDPSocket waker;
+    waker.Listen(PIPSocket::Address::GetLoopback(), 0, 0);
+    PSTUNMessage(PSTUNMessage::BindingRequest).Write(waker, address);
+    thread->WaitForTermination();
+    delete thread;
+  }
+
+  if (mode == "workers" || mode == "both") {
+    PSTUNServer server;
+    server.SetCredentials(args.GetOptionString('u'), args.GetOptionString('p'), PString::Empty());
+    if (!server.OpenWorkers(PIPSocketAddressAndPort(PIPSocket::Address::GetLoopback(), 0),
+                            args.GetOptionAs('w', 0U), args.GetOptionAs('b', 32U))) {
+      cerr << "Could not open multi-threaded server" << endl;
+      return;
+    }
+
+    PIPSocketAddressAndPort address = server.GetWorkerAddress();
+    cout << "Multi-threaded server on " << address << " with " << server.GetWorkerCount() << " workers:" << endl;
+    RunLoad(address, args);
+
+    for (unsigned i = 0; i < server.GetWorkerCount(); ++i)
+      cout << "  worker " << i << ": " << server.GetWorkerStatistics(i) << '\n';
+    cout << "  total: " << server.GetWorkerStatistics() << endl;
+  }
+}
+
+#else
+#pragma message("Cannot compile test application without STUN server support!")
+
+void StunLoad::Main()
+{
+}
+#endif
+
+
+// End of File ///////////////////////////////////////////////////////////////
@@ -132,6 +132,75 @@ void LockBthenA(PMutex & a, PMutex & b)
 }
 
 
+/*
+ * Benchmark for the thread identity look ups done by PTRACE and friends.
+ * Every thread hammers PThread::Current(), PThread::GetThreadName() by
+ * identifier and optionally a PTRACE, all at the same time.
+ */
+class BenchmarkThread : public PThread
+{
+  PCLASSINFO(BenchmarkThread, PThread);
+  public:
+    BenchmarkThread(unsigned iterations, bool tracing, PSyncPoint & go)
+      : PThread(65536, NoAutoDeleteThread, NormalPriority, "Bench")
+      , m_iterations(iterations)
+      , m_tracing(tracing)
+      , m_go(go)
+      , m_failures(0)
+    {
+      Resume();
+    }
+
+    void Main()
+    {
+      m_go.Wait();
+      m_go.Signal(); // Pass it on to the next thread
+
+      for (unsigned i = 0; i < m_iterations; ++i) {
+        if (PThread::Current() != this)
+          ++m_failures;
+        if (PThread::GetThreadName(GetThreadId()).IsEmpty())
+          ++m_failures;
+        PTRACE_IF(4, m_tracing, "Benchmark iteration " << i);
+      }
+    }
+
+    unsigned     m_iterations;
+    bool         m_tracing;
+    PSyncPoint & m_go;
+    unsigned     m_failures;
+};
+
+
+static void Benchmark(unsigned threadCount, unsigned iterations, bool tracing)
+{
+  PSyncPoint go;
+  std::vector<BenchmarkThread *> threads;
+  for (unsigned i = 0; i < threadCount; ++i)
+    threads.push_back(new BenchmarkThread(iterations, tracing, go));
+
+  PThread::Sleep(100); // Let them all get to the start line
+
+  PSimpleTimer timer;
+  clock_t cpu = clock();
+  go.Signal();
+
+  unsigned failures = 0;
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->WaitForTermination();
+    failures += threads[i]->m_failures;
+    delete threads[i];
+  }
+
+  PTimeInterval elapsed = timer.GetElapsed();
+  cout << threadCount << " threads, " << iterations << " iterations" << (tracing ? " with trace" : "") << ": "
+       << elapsed << "s elapsed, "
+       << PTimeInterval((clock() - cpu)*1000/CLOCKS_PER_SEC) << "s CPU, "
+       << (elapsed.GetMicroSeconds()*1000.0/threadCount/iterations) << "ns per iteration, "
+       << failures << " failures" << endl;
+}
+
+
 /*
  * The main program class
  */
@@ -150,7 +219,19 @@ void ThreadTest::Main()
   cout << "Thread Test Program" << endl;
 
   PArgList & args = GetArguments();
-  args.Parse("d-deadlock. Test deadlock detection");
+  args.Parse("d-deadlock. Test deadlock detection\n"
+             "b-benchmark. Benchmark thread identity look ups\n"
+             "T-threads: Number of threads for benchmark (64)\n"
+             "i-iterations: Iterations per thread for benchmark (100000)\n"
+             "P-trace-output: Trace output file for benchmark, enables PTRACE in loop");
+
+  if (args.HasOption('b')) {
+    bool tracing = args.HasOption('P');
+    if (tracing)
+      PTRACE_INITIALISE(4, (const char *)args.GetOptionString('P'), PTrace::Blocks|PTrace::Timestamp|PTrace::Thread|PTrace::FileAndLine);
+    Benchmark(args.GetOptionAs('T', 64U), args.GetOptionAs('i', tracing ? 10000U : 100000U), tracing);
+    return;
+  }
 
   if (args.HasOption('d')) {
     cout << "Testing deadlock detection." << endl;
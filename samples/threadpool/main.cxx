@@ -0,0 +1,229 @@
+/*
+ * main.cxx
+ *
+ * Sample program to compare PQueuedThreadPool and PWorkStealingThreadPool.
+ *
+ * Portable Tools Library
+ *
+ * Copyright (C) 2024 Vox Lucida Pty. Ltd.
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is Portable Tools Library.
+ *
+ * The Initial Developer of the Original Code is Vox Lucida Pty. Ltd.
+ *
+ * Contributor(s): ______________________________________.
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <ptclib/threadpool.h>
+
+
+class ThreadPoolTest : public PProcess
+{
+  PCLASSINFO(ThreadPoolTest, PProcess)
+  public:
+    void Main();
+
+    template <class Pool_T> void Benchmark(const char * name);
+
+    unsigned m_items;
+    unsigned m_producers;
+    unsigned m_workers;
+    unsigned m_groups;
+    unsigned m_spin;
+};
+
+PCREATE_PROCESS(ThreadPoolTest);
+
+
+// Shared by all work items of a run
+struct BenchmarkState
+{
+  BenchmarkState(unsigned groups)
+    : m_done(0)
+    , m_latencySum(0)
+    , m_latencyMax(0)
+    , m_outOfOrder(0)
+    , m_lastSequence(groups)
+  { }
+
+  atomic<unsigned> m_done;
+  atomic<int64_t>  m_latencySum;
+  atomic<int64_t>  m_latencyMax;
+  atomic<unsigned> m_outOfOrder;
+  std::vector<unsigned> m_lastSequence; // Per group, only touched by serialised work
+  PSyncPoint       m_finished;
+  unsigned         m_total;
+};
+
+
+class BenchmarkWork
+{
+  public:
+    BenchmarkWork(BenchmarkState & state, unsigned group, unsigned sequence, unsigned spin)
+      : m_state(state)
+      , m_group(group)
+      , m_sequence(sequence)
+      , m_spin(spin)
+      , m_queued(PTimer::Tick())
+    { }
+
+    void Work()
+    {
+      int64_t latency = (PTimer::Tick() - m_queued).GetMicroSeconds();
+      m_state.m_latencySum += latency;
+      int64_t max = m_state.m_latencyMax;
+      while (latency > max && !m_state.m_latencyMax.compare_exchange_strong(max, latency))
+        ;
+
+      if (m_group > 0) {
+        unsigned & last = m_state.m_lastSequence[m_group-1];
+        if (m_sequence < last)
+          ++m_state.m_outOfOrder;
+        last = m_sequence;
+      }
+
+      volatile unsigned dummy = 0;
+      for (unsigned i = 0; i < m_spin; ++i)
+        dummy = dummy + i;
+
+      if (++m_state.m_done == m_state.m_total)
+        m_state.m_finished.Signal();
+    }
+
+  protected:
+    BenchmarkState & m_state;
+    unsigned         m_group;
+    unsigned         m_sequence;
+    unsigned         m_spin;
+    PTimeInterval    m_queued;
+};
+
+
+template <class Pool_T>
+class ProducerThread : public PThread
+{
+    PCLASSINFO(ProducerThread, PThread);
+  public:
+    ProducerThread(Pool_T & pool, BenchmarkState & state, unsigned index, const ThreadPoolTest & test)
+      : PThread(10000, NoAutoDeleteThread)
+      , m_pool(pool)
+      , m_state(state)
+      , m_index(index)
+      , m_test(test)
+    { }
+
+    void Main()
+    {
+      unsigned count = m_test.m_items/m_test.m_producers;
+      for (unsigned i = 0; i < count; ++i) {
+        unsigned group = 0;
+        PString groupName;
+        if (m_test.m_groups > 0) {
+          /* Each producer has its own set of groups, so the sequence number
+             within a group is always increasing. */
+          group = m_index*m_test.m_groups + i%m_test.m_groups + 1;
+          groupName.sprintf("G%u", group);
+        }
+        m_pool.AddWork(new BenchmarkWork(m_state, group, i, m_test.m_spin), group > 0 ? (const char *)groupName : NULL);
+      }
+    }
+
+  protected:
+    Pool_T               & m_pool;
+    BenchmarkState       & m_state;
+    unsigned               m_index;
+    const ThreadPoolTest & m_test;
+};
+
+
+template <class Pool_T> void ThreadPoolTest::Benchmark(const char * name)
+{
+  BenchmarkState state(m_groups*m_producers);
+  state.m_total = m_items/m_producers*m_producers;
+
+  Pool_T pool(m_workers, 0, name);
+
+  std::vector<ProducerThread<Pool_T> *> producers;
+  for (unsigned i = 0; i < m_producers; ++i)
+    producers.push_back(new ProducerThread<Pool_T>(pool, state, i, *this));
+
+  PSimpleTimer timer;
+  for (unsigned i = 0; i < m_producers; ++i)
+    producers[i]->Resume();
+  for (unsigned i = 0; i < m_producers; ++i) {
+    producers[i]->WaitForTermination();
+    delete producers[i];
+  }
+  PTimeInterval submitted = timer.GetElapsed();
+
+  state.m_finished.Wait();
+  PTimeInterval elapsed = timer.GetElapsed();
+
+  cout << left << setw(14) << name << right
+       << setw(10) << submitted.GetMilliSeconds()
+       << setw(10) << elapsed.GetMilliSeconds()
+       << setw(12) << (int64_t)(state.m_total*1000.0/PMAX((PInt64)1, elapsed.GetMilliSeconds()))
+       << setw(12) << (int64_t)state.m_latencySum/state.m_total
+       << setw(12) << (int64_t)state.m_latencyMax;
+  if (m_groups > 0)
+    cout << setw(12) << (unsigned)state.m_outOfOrder;
+  cout << endl;
+}
+
+
+void ThreadPoolTest::Main()
+{
+  PArgList & args = GetArguments();
+  args.Parse("i-items:      number of work items (1000000)\n"
+             "p-producers:  number of threads adding work (4)\n"
+             "w-workers:    maximum worker threads in pool (10)\n"
+             "g-groups:     number of work groups per producer, zero for none (0)\n"
+             "s-spin:       busy loop count in each work item (0)\n"
+             "r-repeat:     number of times to repeat (1)\n"
+             PTRACE_ARGLIST);
+  if (!args.IsParsed()) {
+    args.Usage(cerr);
+    return;
+  }
+  PTRACE_INITIALISE(args);
+
+  m_items = std::max(1U, args.GetOptionAs('i', 1000000U));
+  m_producers = std::max(1U, args.GetOptionAs('p', 4U));
+  m_workers = std::max(1U, args.GetOptionAs('w', 10U));
+  m_groups = args.GetOptionAs('g', 0U);
+  m_spin = args.GetOptionAs('s', 0U);
+
+  cout << "Thread pool benchmark: " << m_items << " items, "
+       << m_producers << " producers, " << m_workers << " workers, ";
+  if (m_groups > 0)
+    cout << m_groups << " groups per producer";
+  else
+    cout << "no groups";
+  cout << ", spin " << m_spin << "\n"
+       << left << setw(14) << "Pool" << right
+       << setw(10) << "Add(ms)" << setw(10) << "Total(ms)" << setw(12) << "Items/sec"
+       << setw(12) << "AvgLat(us)" << setw(12) << "MaxLat(us)";
+  if (m_groups > 0)
+    cout << setw(12) << "OutOfOrder";
+  cout << endl;
+
+  for (unsigned repeat = args.GetOptionAs('r', 1U); repeat > 0; --repeat) {
+    Benchmark< PQueuedThreadPool<BenchmarkWork> >("Queued");
+    Benchmark< PWorkStealingThreadPool<BenchmarkWork> >("WorkStealing");
+  }
+}
+
+
+// End of File ///////////////////////////////////////////////////////////////
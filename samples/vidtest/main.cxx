@@ -30,6 +30,9 @@
 
 #include  <ptlib/videoio.h>
 #include  <ptlib/vconvert.h>
+#include  <ptclib/random.h>
+
+#include <queue>
 
 
 PCREATE_PROCESS(VidTest);
@@ -54,6 +57,12 @@ void VidTest::Main()
              "-output-driver: video display driver to use.\n"
              "O-output-device: video display device to use.\n"
              "T-time: time in seconds to run test, no command line\n"
+             "-benchmark. benchmark colour converters, scalar vs SIMD\n"
+             "-bench-size: frame size for benchmark, default hd1080\n"
+             "-bench-frames: number of frames per converter for benchmark, default 20\n"
+             "-bench-acceleration: SIMD acceleration to compare with scalar, default is best available\n"
+             "-bench-threads: threads used by smooth scaler in benchmark, default 1\n"
+             "-frame-bench. benchmark passing frames from grabber to display, copied vs pooled\n"
 #if PTRACING
              "o-output: file name for output of log messages\n"
              "t-trace. degree of verbosity in log (more times for more detail)\n"
@@ -70,7 +79,8 @@ void VidTest::Main()
               "etc or WxH, e.g \"640x480\". The fmt string is the colour format such as\n"
               "\"RGB32\", \"YUV420P\" etc. The rate field is a simple integer from 1 to 100.\n"
               "The crop field is one of \"scale\", \"resize\" (synonym for \"scale\"), \"centre\",\n"
-              "\"center\", \"topleft\" or \"crop\" (synonym for \"topleft\"). Note no spaces are\n"
+              "\"center\", \"topleft\", \"crop\" (synonym for \"topleft\"), \"aspect\", \"smooth\"\n"
+              "(interpolating scale) or \"smoothaspect\". Note no spaces are\n"
               "allowed in the descriptor.\n"
               "\n"
               "If the physical device can do the specified formats (input device for first\n"
@@ -85,6 +95,21 @@ void VidTest::Main()
 
   PTRACE_INITIALISE(args, PTrace::Blocks|PTrace::Timestamp|PTrace::Thread|PTrace::FileAndLine);
 
+  if (args.HasOption("benchmark")) {
+    if (args.HasOption("bench-acceleration") &&
+        !PColourConverter::SetAcceleration(PColourConverter::AccelerationFromString(args.GetOptionString("bench-acceleration"), false))) {
+      cerr << "Acceleration \"" << args.GetOptionString("bench-acceleration") << "\" not supported." << endl;
+      return;
+    }
+    PColourConverter::SetScalerThreads(args.GetOptionAs("bench-threads", 1U));
+    Benchmark(args.GetOptionString("bench-size", "hd1080"), args.GetOptionAs("bench-frames", 20U));
+    return;
+  }
+
+  if (args.HasOption("frame-bench")) {
+    FrameBenchmark(args.GetOptionString("bench-size", "hd720"), args.GetOptionAs("bench-frames", 500U));
+    return;
+  }
 
   /////////////////////////////////////////////////////////////////////
 
@@ -371,6 +396,223 @@ void VidTest::Main()
 }
 
 
+void VidTest::Benchmark(const PString & size, unsigned frames)
+{
+  unsigned width, height;
+  if (!PVideoFrameInfo::ParseSize(size, width, height)) {
+    cerr << "Invalid benchmark frame size \"" << size << '"' << endl;
+    return;
+  }
+
+  static char const * const Pairs[][2] = {
+    { "YUV420P", "RGB24"   },
+    { "YUV420P", "BGR24"   },
+    { "YUV420P", "RGB32"   },
+    { "YUV420P", "BGR32"   },
+    { "RGB24",   "YUV420P" },
+    { "BGR24",   "YUV420P" },
+    { "RGB32",   "YUV420P" },
+    { "BGR32",   "YUV420P" },
+    { "YUY2",    "YUV420P" },
+    { "UYVY422", "YUV420P" },
+    { "RGB24",   "BGR24"   },
+    { "RGB32",   "BGR32"   }
+  };
+
+  PColourConverter::Acceleration acceleration = PColourConverter::GetAcceleration();
+
+  cout << "Colour converter benchmark, " << width << 'x' << height << ", "
+       << frames << " frames, acceleration " << acceleration << '\n'
+       << left << setw(20) << "Converter" << right
+       << setw(14) << "Scalar MP/s" << setw(14) << "SIMD MP/s" << setw(10) << "Speedup" << "  Result" << endl;
+
+  double megapixels = (double)width*height*frames/1000000;
+
+  for (PINDEX i = 0; i < PARRAYSIZE(Pairs); ++i) {
+    PColourConverter * converter = PColourConverter::Create(Pairs[i][0], Pairs[i][1], width, height);
+    if (converter == NULL || !converter->SetFrameSize(width, height)) {
+      delete converter;
+      cout << left << setw(20) << (PString(Pairs[i][0]) + "->" + Pairs[i][1]) << "not available" << endl;
+      continue;
+    }
+
+    PBYTEArray src = PRandom::Octets(PVideoFrameInfo::CalculateFrameBytes(width, height, Pairs[i][0]));
+    PINDEX dstSize = PVideoFrameInfo::CalculateFrameBytes(width, height, Pairs[i][1]);
+    PBYTEArray dst[2];
+    double rate[2];
+
+    for (int pass = 0; pass < 2; ++pass) {
+      PColourConverter::SetAcceleration(pass == 0 ? PColourConverter::NoAcceleration : acceleration);
+      dst[pass].SetSize(dstSize);
+      PTime start;
+      for (unsigned frame = 0; frame < frames; ++frame)
+        if (!converter->Convert(src, dst[pass].GetPointer()))
+          break;
+      rate[pass] = megapixels/(PTime() - start).GetSecondsAsDouble();
+    }
+
+    PINDEX differences = 0;
+    int maxError = 0;
+    for (PINDEX b = 0; b < dstSize; ++b) {
+      int error = abs((int)dst[0][b] - (int)dst[1][b]);
+      if (error != 0) {
+        ++differences;
+        if (error > maxError)
+          maxError = error;
+      }
+    }
+
+    cout << left << setw(20) << (PString(Pairs[i][0]) + "->" + Pairs[i][1]) << right << fixed << setprecision(1)
+         << setw(14) << rate[0] << setw(14) << rate[1] << setw(9) << rate[1]/rate[0] << "x  ";
+    if (differences == 0)
+      cout << "bit-exact";
+    else
+      cout << differences << " bytes differ, max error " << maxError;
+    cout << endl;
+
+    delete converter;
+  }
+
+  static struct {
+    unsigned m_width;
+    unsigned m_height;
+  } const ScaleSizes[] = {
+    { PVideoFrameInfo::CIFWidth,    PVideoFrameInfo::CIFHeight    },
+    { PVideoFrameInfo::HD720Width,  PVideoFrameInfo::HD720Height  },
+    { PVideoFrameInfo::HD1080Width, PVideoFrameInfo::HD1080Height },
+    { PVideoFrameInfo::CIF4Width,   PVideoFrameInfo::HD1080Height }
+  };
+
+  cout << "\nScaler benchmark, " << width << 'x' << height << ", "
+       << frames << " frames, smooth scaler threads " << PColourConverter::GetScalerThreads() << '\n'
+       << left << setw(20) << "Scaling" << right
+       << setw(14) << "Scaled MP/s" << setw(14) << "Smooth MP/s" << setw(14) << "SIMD MP/s" << "  Result" << endl;
+
+  PBYTEArray src = PRandom::Octets(PVideoFrameInfo::CalculateFrameBytes(width, height));
+
+  for (PINDEX i = 0; i < PARRAYSIZE(ScaleSizes); ++i) {
+    unsigned dstWidth = ScaleSizes[i].m_width;
+    unsigned dstHeight = ScaleSizes[i].m_height;
+    PINDEX dstSize = PVideoFrameInfo::CalculateFrameBytes(dstWidth, dstHeight);
+    double megapixels = (double)dstWidth*dstHeight*frames/1000000;
+    PBYTEArray dst[3];
+    double rate[3];
+
+    for (int pass = 0; pass < 3; ++pass) {
+      PColourConverter::SetAcceleration(pass < 2 ? PColourConverter::NoAcceleration : acceleration);
+      PVideoFrameInfo::ResizeMode mode = pass == 0 ? PVideoFrameInfo::eScale : PVideoFrameInfo::eScaleSmooth;
+      BYTE * dstPtr = dst[pass].GetPointer(dstSize);
+      PTime start;
+      for (unsigned frame = 0; frame < frames; ++frame)
+        if (!PColourConverter::CopyYUV420P(0, 0, width, height, width, height, src,
+                                           0, 0, dstWidth, dstHeight, dstWidth, dstHeight, dstPtr, mode))
+          break;
+      rate[pass] = megapixels/(PTime() - start).GetSecondsAsDouble();
+    }
+
+    cout << left << setw(20) << psprintf("%ux%u", dstWidth, dstHeight) << right << fixed << setprecision(1)
+         << setw(14) << rate[0] << setw(14) << rate[1] << setw(14) << rate[2] << "  "
+         << (dst[1] == dst[2] ? "bit-exact" : "differ") << endl;
+  }
+
+  PColourConverter::SetAcceleration(acceleration);
+}
+
+
+void VidTest::FrameBenchmark(const PString & size, unsigned frames)
+{
+  unsigned width, height;
+  if (!PVideoFrameInfo::ParseSize(size, width, height)) {
+    cerr << "Invalid benchmark frame size \"" << size << '"' << endl;
+    return;
+  }
+
+  static const char * const Formats[] = { "YUV420P", "RGB24" };
+  static const unsigned QueueDepth = 3; // Typical jitter buffer between grab and display threads
+
+  cout << "Frame passing benchmark, " << width << 'x' << height << ", " << frames << " frames, queue depth " << QueueDepth << '\n'
+       << left << setw(20) << "Path" << right
+       << setw(10) << "fps" << setw(14) << "CPU ms/frame" << setw(14) << "copies/frame" << setw(14) << "allocs/frame" << endl;
+
+  for (PINDEX format = 0; format < PARRAYSIZE(Formats); ++format) {
+    for (int pass = 0; pass < 2; ++pass) {
+      PVideoInputDevice * grabber = PVideoInputDevice::CreateOpenedDevice("FakeVideo", P_FAKE_VIDEO_MOVING_BLOCKS, false);
+      PVideoOutputDevice * display = PVideoOutputDevice::CreateOpenedDevice("NULLOutput", P_NULL_VIDEO_DEVICE, false);
+      if (grabber == NULL || display == NULL ||
+          !grabber->SetColourFormatConverter(Formats[format]) ||
+          !grabber->SetFrameSizeConverter(width, height) ||
+          !grabber->Start()) {
+        cerr << "Could not open fake video devices" << endl;
+        delete grabber;
+        delete display;
+        return;
+      }
+
+      std::queue<PBYTEArray> copiedQueue;
+      std::queue<PVideoFrame> pooledQueue;
+      PBYTEArray grabBuffer;
+      unsigned copies = 0, allocations = 0;
+      bool keyFrame = true;
+
+      PThread::Times startTimes;
+      PThread::Current()->GetTimes(startTimes);
+      PTime start;
+
+      for (unsigned frame = 0; frame < frames; ++frame) {
+        PVideoOutputDevice::FrameData frameData;
+        grabber->GetFrameSize(frameData.width, frameData.height);
+
+        if (pass == 0) {
+          // Traditional: grab into a reused buffer, copy it to pass on to the display thread
+          PINDEX bytes;
+          if (!grabber->GetFrame(grabBuffer.GetPointer(grabber->GetMaxFrameBytes()), bytes, keyFrame, false))
+            break;
+          copiedQueue.push(PBYTEArray(grabBuffer, bytes));
+          ++copies;
+          ++allocations;
+          if (copiedQueue.size() >= QueueDepth) {
+            frameData.pixels = copiedQueue.front();
+            display->SetFrameData(frameData);
+            copiedQueue.pop();
+          }
+        }
+        else {
+          // Pooled: the grabber fills a pooled frame, which is passed on by reference
+          PVideoFrame pooled;
+          if (!grabber->GetFrame(pooled, keyFrame, false))
+            break;
+          pooledQueue.push(pooled);
+          if (pooledQueue.size() >= QueueDepth) {
+            display->SetFrame(pooledQueue.front());
+            pooledQueue.pop();
+          }
+        }
+      }
+
+      PTimeInterval elapsed = PTime() - start;
+      PThread::Times endTimes;
+      PThread::Current()->GetTimes(endTimes);
+      PTimeInterval cpu = (endTimes.m_user + endTimes.m_kernel) - (startTimes.m_user + startTimes.m_kernel);
+
+      if (pass > 0) {
+        PVideoFramePool::Statistics stats = grabber->GetFramePool().GetStatistics();
+        copies = (unsigned)stats.m_copied;
+        allocations = (unsigned)stats.m_allocated;
+      }
+
+      cout << left << setw(20) << (PString(Formats[format]) + (pass == 0 ? " copied" : " pooled")) << right << fixed << setprecision(1)
+           << setw(10) << frames/elapsed.GetSecondsAsDouble()
+           << setw(14) << setprecision(3) << (double)cpu.GetMilliSeconds()/frames
+           << setw(14) << (double)copies/frames
+           << setw(14) << (double)allocations/frames << endl;
+
+      delete display;
+      delete grabber;
+    }
+  }
+}
+
+
 void VidTest::GrabAndDisplay(PThread &, P_INT_PTR)
 {
   std::vector<PBYTEArray> frames;
@@ -36,6 +36,8 @@ class VidTest : public PProcess
   public:
     VidTest();
     virtual void Main();
+    void Benchmark(const PString & size, unsigned frames);
+    void FrameBenchmark(const PString & size, unsigned frames);
 
  protected:
    PDECLARE_NOTIFIER(PThread, VidTest, GrabAndDisplay);
@@ -0,0 +1,240 @@
+/*
+ * main.cxx
+ *
+ * Sample program to load test PVXMLSession in threaded and event driven modes.
+ *
+ * Portable Tools Library
+ *
+ * Copyright (C) 2024 Vox Lucida Pty. Ltd.
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is Portable Tools Library.
+ *
+ * The Initial Developer of the Original Code is Vox Lucida Pty. Ltd.
+ *
+ * Contributor(s): ______________________________________.
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <ptclib/vxml.h>
+
+
+class VxmlLoad : public PProcess
+{
+  PCLASSINFO(VxmlLoad, PProcess)
+  public:
+    void Main();
+};
+
+PCREATE_PROCESS(VxmlLoad);
+
+
+#if P_VXML
+
+#define STUB_MEDIA_FORMAT "Stub-PCM"
+
+/* Script loops on the menu while it gets a '1', and exits on a '2'. The
+   prompt makes sure the session awaits end of playback events as well as
+   user input. */
+static const char Script[] =
+  "<?xml version=\"1.0\"?>"
+  "<vxml version=\"2.1\">"
+    "<property name=\"timeout\" value=\"5s\"/>"
+    "<menu id=\"main\" dtmf=\"true\">"
+      "<prompt>%s</prompt>"
+      "<choice next=\"#main\"/>"
+      "<choice next=\"#done\"/>"
+    "</menu>"
+    "<form id=\"done\">"
+      "<block><break time=\"50ms\"/><exit/></block>"
+    "</form>"
+  "</vxml>";
+
+
+/* A PCM channel that does not do the real time delay, all sessions are read
+   from a single pump thread which does the pacing for them all. */
+class StubChannel : public PVXMLChannel
+{
+  PCLASSINFO(StubChannel, PVXMLChannel);
+  public:
+    StubChannel()
+      : PVXMLChannel(10, 160)
+    { }
+
+    virtual PString GetAudioFormat() const { return VXML_PCM16; }
+    virtual unsigned GetSampleRate() const { return 8000; }
+    virtual bool SetSampleRate(unsigned rate) { return rate == 8000; }
+    virtual unsigned GetChannels() const { return 1; }
+    virtual bool SetChannels(unsigned channels) { return channels == 1; }
+    virtual PBoolean WriteFrame(const void *, PINDEX) { return true; }
+    virtual PBoolean IsSilenceFrame(const void *, PINDEX) const { return true; }
+
+    virtual PBoolean ReadFrame(void * buffer, PINDEX amount)
+    {
+      PINDEX len = 0;
+      while (len < amount)  {
+        if (!PDelayChannel::Read(len + (char *)buffer, amount-len))
+          return false;
+        len += GetLastReadCount();
+      }
+
+      SetLastReadCount(len);
+      return true;
+    }
+
+    virtual PINDEX CreateSilenceFrame(void * buffer, PINDEX amount)
+    {
+      memset(buffer, 0, amount);
+      return amount;
+    }
+
+  protected:
+    virtual void Wait(PINDEX, PTimeInterval &) { }
+};
+
+PFACTORY_CREATE(PFactory<PVXMLChannel>, StubChannel, STUB_MEDIA_FORMAT);
+
+
+class LoadSession : public PVXMLSession
+{
+  PCLASSINFO(LoadSession, PVXMLSession);
+  public:
+    LoadSession(atomic<unsigned> & ended, PSyncPoint & allEnded, unsigned total)
+      : m_ended(ended)
+      , m_allEnded(allEnded)
+      , m_total(total)
+      , m_digit(0)
+      , m_finished(false)
+    { }
+
+    virtual void OnEndSession()
+    {
+      PVXMLSession::OnEndSession();
+      if (++m_ended == m_total)
+        m_allEnded.Signal();
+    }
+
+    atomic<unsigned> & m_ended;
+    PSyncPoint       & m_allEnded;
+    unsigned           m_total;
+    PINDEX             m_digit;
+    bool               m_finished;
+};
+
+
+void VxmlLoad::Main()
+{
+  PArgList & args = GetArguments();
+  args.Parse("n-sessions:   number of concurrent sessions (100)\n"
+             "m-mode:       execution mode, \"thread\", \"event\" or \"both\" (both)\n"
+             "w-workers:    maximum threads in event driven pool (10)\n"
+             "d-digits:     scripted DTMF sent to each session (1112)\n"
+             "i-interval:   milliseconds between each digit (200)\n"
+             "a-audio:      WAV file (8kHz PCM) to play as the menu prompt\n"
+             "c-cache:      in-memory prompt cache size in bytes (0)\n"
+             PTRACE_ARGLIST);
+  if (!args.IsParsed()) {
+    args.Usage(cerr);
+    return;
+  }
+  PTRACE_INITIALISE(args);
+
+  unsigned sessionCount = std::max(1U, args.GetOptionAs('n', 100U));
+  PString digits = args.GetOptionString('d', "1112");
+  unsigned interval = std::max(10U, args.GetOptionAs('i', 200U));
+  PCaselessString mode = args.GetOptionString('m', "both");
+
+  PVXMLSession::SetExecutionPoolSize(args.GetOptionAs('w', 10U));
+
+  PString prompt = "<break time=\"100ms\"/>";
+  if (args.HasOption('a'))
+    prompt = "<audio src=\"" + PURL(PFilePath(args.GetOptionString('a'))).AsString() + "\"/>";
+  PString script(PString::Printf, Script, (const char *)prompt);
+
+  PVXMLCache cache;
+  cache.SetMemoryLimit(args.GetOptionAs('c', 0U));
+
+  cout << "VXML load test: " << sessionCount << " sessions, digits \"" << digits << "\" every " << interval << "ms" << endl;
+
+  for (int pass = 0; pass < 2; ++pass) {
+    PVXMLSession::ExecutionModes executionMode = pass == 0 ? PVXMLSession::ThreadPerSession : PVXMLSession::EventDriven;
+    if (mode != "both" && mode != (pass == 0 ? "thread" : "event"))
+      continue;
+
+    atomic<unsigned> ended(0);
+    PSyncPoint allEnded;
+
+    PSimpleTimer timer;
+
+    std::vector<LoadSession *> sessions;
+    for (unsigned i = 0; i < sessionCount; ++i) {
+      LoadSession * session = new LoadSession(ended, allEnded, sessionCount);
+      session->SetExecutionMode(executionMode);
+      session->SetCache(cache);
+      if (!session->LoadVXML(script) || !session->Open(STUB_MEDIA_FORMAT)) {
+        cerr << "Could not start session " << i << ": " << session->GetXMLError() << endl;
+        delete session;
+        return;
+      }
+      sessions.push_back(session);
+    }
+    PTimeInterval started = timer.GetElapsed();
+
+    // Single pump thread (this one) reads 10ms of audio from every session and sends the DTMF
+    BYTE frame[160];
+    PAdaptiveDelay delay;
+    unsigned frames = 0;
+    unsigned framesPerDigit = interval/10;
+    while (ended < sessionCount) {
+      for (size_t i = 0; i < sessions.size(); ++i) {
+        LoadSession & session = *sessions[i];
+        if (session.m_finished)
+          continue;
+        if (!session.Read(frame, sizeof(frame))) {
+          session.m_finished = true;
+          continue;
+        }
+        if (frames > 0 && frames%framesPerDigit == 0 && session.m_digit < digits.GetLength())
+          session.OnUserInput(digits[session.m_digit++]);
+      }
+      ++frames;
+      delay.Delay(10);
+    }
+    allEnded.Wait();
+    PTimeInterval elapsed = timer.GetElapsed();
+
+    for (size_t i = 0; i < sessions.size(); ++i)
+      delete sessions[i];
+    PTimeInterval destroyed = timer.GetElapsed();
+
+    cout << setw(10) << (pass == 0 ? "Threaded" : "Event") << ":"
+            " start=" << started.GetMilliSeconds() << "ms,"
+            " complete=" << elapsed.GetMilliSeconds() << "ms,"
+            " destroy=" << (destroyed - elapsed).GetMilliSeconds() << "ms,"
+            " ended=" << (unsigned)ended << endl;
+  }
+
+  if (cache.GetMemoryLimit() > 0)
+    cout << "Prompt cache: " << cache.GetMemoryStatistics() << endl;
+}
+
+#else
+#pragma message("Cannot compile test application without VXML support!")
+
+void VxmlLoad::Main()
+{
+}
+#endif
+
+
+// End of File ///////////////////////////////////////////////////////////////
@@ -33,6 +33,8 @@
 #include <ptlib/sound.h>
 #include <ptlib/pprocess.h>
 
+#include <math.h>
+
 
 class WAVFileTest : public PProcess
 {
@@ -43,6 +45,7 @@ class WAVFileTest : public PProcess
     void Create(PArgList & args);
     void Play(PArgList & args);
     void Record(PArgList & args);
+    void Resample(PArgList & args);
 };
 
 PCREATE_PROCESS(WAVFileTest)
@@ -60,14 +63,18 @@ void WAVFileTest::Main()
                   "D: Driver name for sound channel record/playback\n"
                   "v: Set sound device to vol (0..100)\n"
                   "B: Set sound device buffer size (10000)\n"
-                  PTRACE_ARGLIST)) {
+                  "-resample-test. Test quality and speed of sample rate conversion\n"
+                  "-resample-quality: Quality for rate conversion test, 0..2 (default 1)\n"
+                  PTRACE_ARGLIST) && !args.HasOption("resample-test")) {
     args.Usage(cerr, "[ options ] filename");
     return;
   }
 
   PTRACE_INITIALISE(args);
 
-  if (args.HasOption('c'))
+  if (args.HasOption("resample-test"))
+    Resample(args);
+  else if (args.HasOption('c'))
     Create(args);
   else if (args.HasOption('r'))
     Record(args);
@@ -220,3 +227,164 @@ void WAVFileTest::Record(PArgList & args)
 
   delete sound;
 }
+
+
+static void GenerateTones(std::vector<short> & pcm, unsigned rate, unsigned channels, unsigned frames,
+                          double freq1, double freq2, double offset = 0)
+{
+  pcm.resize(frames*channels);
+  for (unsigned i = 0; i < frames; ++i) {
+    double t = (i + offset)/rate;
+    short value = (short)floor(12000*sin(2*M_PI*freq1*t) + 12000*sin(2*M_PI*freq2*t) + 0.5);
+    for (unsigned c = 0; c < channels; ++c)
+      pcm[i*channels + c] = value;
+  }
+}
+
+
+/* Square wave swept up to maxFreq, at some point its signs line up with the
+   filter taps giving the largest possible sum in the resampler. */
+static void GenerateSquareSweep(std::vector<short> & pcm, unsigned rate, unsigned channels, unsigned frames,
+                                double maxFreq, short amplitude)
+{
+  pcm.resize(frames*channels);
+  for (unsigned i = 0; i < frames; ++i) {
+    double t = (double)i/rate;
+    double duration = (double)frames/rate;
+    short value = sin(M_PI*maxFreq*t*t/duration) < 0 ? -amplitude : amplitude;
+    for (unsigned c = 0; c < channels; ++c)
+      pcm[i*channels + c] = value;
+  }
+}
+
+
+static bool ResampleBlocks(PPCMResampler & resampler, const std::vector<short> & src, unsigned srcBlock, std::vector<short> & dst)
+{
+  dst.resize(src.size()*resampler.GetDstRate()/resampler.GetSrcRate()*resampler.GetDstChannels()/resampler.GetSrcChannels() + 1000);
+
+  PINDEX srcPos = 0, dstPos = 0;
+  while (srcPos < src.size()) {
+    PINDEX srcSize = std::min((PINDEX)src.size() - srcPos, (PINDEX)srcBlock)*sizeof(short);
+    PINDEX dstSize = (dst.size() - dstPos)*sizeof(short);
+    if (!resampler.Convert(&src[srcPos], srcSize, &dst[dstPos], dstSize))
+      return false;
+    srcPos += srcSize/sizeof(short);
+    dstPos += dstSize/sizeof(short);
+  }
+
+  PINDEX dstSize = (dst.size() - dstPos)*sizeof(short);
+  if (!resampler.Flush(&dst[dstPos], dstSize))
+    return false;
+  dst.resize(dstPos + dstSize/sizeof(short));
+  return true;
+}
+
+
+void WAVFileTest::Resample(PArgList & args)
+{
+  static const unsigned Rates[] = { 8000, 16000, 44100, 48000 };
+  static const unsigned Seconds = 2;
+  PPCMResampler::Quality quality = (PPCMResampler::Quality)args.GetOptionString("resample-quality", "1").AsUnsigned();
+
+  cout << "Conversion         Taps  In band SNR  Alias level  Seamless  Full scale  Streaming  ConvertPCM 20ms\n"
+          "                                                                     (Msamples/s of source)\n";
+  for (PINDEX s = 0; s < PARRAYSIZE(Rates); ++s) {
+    for (PINDEX d = 0; d < PARRAYSIZE(Rates); ++d) {
+      for (unsigned channels = 1; channels <= 2; ++channels) {
+        unsigned srcRate = Rates[s];
+        unsigned dstRate = Rates[d];
+        unsigned srcChannels = channels;
+        unsigned dstChannels = srcRate == dstRate ? 3 - channels : 1;
+        if (srcRate == dstRate && channels == 2)
+          continue;
+
+        PPCMResampler resampler(srcRate, srcChannels, dstRate, dstChannels, quality);
+
+        // In band tones, compared against ideal tones generated at output rate
+        unsigned minRate = std::min(srcRate, dstRate);
+        double freq1 = 440, freq2 = minRate*0.35;
+        std::vector<short> src, dst, ref;
+        GenerateTones(src, srcRate, srcChannels, srcRate*Seconds, freq1, freq2);
+        if (!ResampleBlocks(resampler, src, 160*srcChannels, dst)) {
+          cout << "Conversion failed" << endl;
+          return;
+        }
+        GenerateTones(ref, dstRate, dstChannels, dst.size()/dstChannels, freq1, freq2);
+
+        double signal = 0, noise = 0;
+        for (size_t i = dstRate/20*dstChannels; i < dst.size() - dstRate/20*dstChannels; ++i) {
+          signal += (double)ref[i]*ref[i];
+          noise += ((double)dst[i] - ref[i])*((double)dst[i] - ref[i]);
+        }
+
+        // Same again but one single block, must be identical
+        std::vector<short> single;
+        ResampleBlocks(resampler, src, src.size(), single);
+        bool seamless = single == dst;
+
+        /* Full scale square wave, must be the half scale one doubled, give
+           or take rounding, and clipped, if the filter sum did not overflow */
+        std::vector<short> full, half;
+        GenerateSquareSweep(src, srcRate, srcChannels, srcRate*Seconds, minRate/2.0, SHRT_MAX);
+        ResampleBlocks(resampler, src, 160*srcChannels, full);
+        GenerateSquareSweep(src, srcRate, srcChannels, srcRate*Seconds, minRate/2.0, (SHRT_MAX+1)/2);
+        ResampleBlocks(resampler, src, 160*srcChannels, half);
+        bool fullScale = full.size() == half.size();
+        for (size_t i = 0; fullScale && i < full.size(); ++i) {
+          int expected = std::max(SHRT_MIN, std::min(SHRT_MAX, 2*half[i]));
+          if (abs(full[i] - expected) > 8)
+            fullScale = false;
+        }
+
+        // Tone above output Nyquist, should be removed
+        double alias = 0;
+        if (dstRate < srcRate) {
+          GenerateTones(src, srcRate, srcChannels, srcRate*Seconds, dstRate*0.55, dstRate*0.55);
+          ResampleBlocks(resampler, src, 160*srcChannels, dst);
+          double inEnergy = 0, outEnergy = 0;
+          for (size_t i = 0; i < src.size(); ++i)
+            inEnergy += (double)src[i]*src[i];
+          size_t skip = dstRate/20*dstChannels;
+          for (size_t i = skip; i < dst.size() - skip; ++i)
+            outEnergy += (double)dst[i]*dst[i];
+          alias = 10*log10((outEnergy + 1)/(dst.size() - 2*skip)/(inEnergy/src.size()));
+        }
+
+        // Speed of streaming conversion
+        GenerateTones(src, srcRate, srcChannels, srcRate*10, freq1, freq2);
+        PTimeInterval start = PTimer::Tick();
+        unsigned loops = 0;
+        do {
+          ResampleBlocks(resampler, src, srcRate/50*srcChannels, dst);
+          ++loops;
+        } while (PTimer::Tick() - start < 250);
+        double rate = (double)loops*src.size()/srcChannels/(PTimer::Tick() - start).GetMilliSeconds()/1000;
+
+        // Speed of previous style, stateless conversion of 20ms blocks
+        start = PTimer::Tick();
+        loops = 0;
+        do {
+          for (size_t pos = 0; pos + srcRate/50*srcChannels <= src.size(); pos += srcRate/50*srcChannels) {
+            PINDEX srcSize = srcRate/50*srcChannels*sizeof(short);
+            PINDEX dstSize = dst.size()*sizeof(short);
+            PSound::ConvertPCM(&src[pos], srcSize, srcRate, srcChannels, &dst[0], dstSize, dstRate, dstChannels);
+          }
+          ++loops;
+        } while (PTimer::Tick() - start < 250);
+        double oldRate = (double)loops*src.size()/srcChannels/(PTimer::Tick() - start).GetMilliSeconds()/1000;
+
+        cout << setw(5) << srcRate << 'x' << srcChannels << " -> " << setw(5) << dstRate << 'x' << dstChannels
+             << setw(7) << resampler.GetFilterTaps()
+             << setw(10) << fixed << setprecision(1) << 10*log10(signal/(noise + 1)) << "dB";
+        if (dstRate < srcRate)
+          cout << setw(11) << alias << "dB";
+        else
+          cout << setw(13) << "-";
+        cout << setw(10) << (seamless ? "yes" : "NO")
+             << setw(12) << (fullScale ? "yes" : "NO")
+             << setw(11) << rate
+             << setw(17) << oldRate << endl;
+      }
+    }
+  }
+}
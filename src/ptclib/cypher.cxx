@@ -1268,22 +1268,67 @@ void PHMAC_MD5::InternalProcess(const void * data, PINDEX len, PHMAC::Result & r
 
 #include <openssl/hmac.h>
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+static HMAC_CTX * HMAC_CTX_new()
+{
+  HMAC_CTX * ctx = (HMAC_CTX *)OPENSSL_malloc(sizeof(HMAC_CTX));
+  if (ctx != NULL)
+    HMAC_CTX_init(ctx);
+  return ctx;
+}
+
+static void HMAC_CTX_free(HMAC_CTX * ctx)
+{
+  HMAC_CTX_cleanup(ctx);
+  OPENSSL_free(ctx);
+}
+#endif
+
+
 PHMAC_SHA::PHMAC_SHA(Algorithm const * algo)
   : m_algorithm(algo)
+  , m_context(NULL)
+{
+}
+
+
+PHMAC_SHA::~PHMAC_SHA()
 {
+  if (m_context != NULL)
+    HMAC_CTX_free(m_context);
+}
+
+
+void PHMAC_SHA::InitKey(const void * key, PINDEX len)
+{
+  PHMAC::InitKey(key, len);
+
+  if (m_context == NULL && (m_context = HMAC_CTX_new()) == NULL)
+    return;
+
+  if (!HMAC_Init_ex(m_context, key, len, m_algorithm, NULL)) {
+    HMAC_CTX_free(m_context);
+    m_context = NULL;
+  }
 }
 
 
 void PHMAC_SHA::InternalProcess(const void * data, PINDEX len, PHMAC::Result & result)
 {
-  HMAC_CTX hmac;
+  if (m_context == NULL) {
+    InitKey(m_key, m_key.GetSize());
+    if (m_context == NULL) {
+      result.SetSize(0);
+      return;
+    }
+  }
+
+  // A NULL key and algorithm re-uses those from InitKey()
   unsigned int signatureSize;
-  HMAC_CTX_init(&hmac);
-  HMAC_Init_ex(&hmac, m_key, m_key.GetSize(), m_algorithm, NULL);
-  HMAC_Update(&hmac, (const unsigned char *)data, len);
-  HMAC_Final(&hmac, result.GetPointer(256), &signatureSize);
+  HMAC_Init_ex(m_context, NULL, 0, NULL, NULL);
+  HMAC_Update(m_context, (const unsigned char *)data, len);
+  HMAC_Final(m_context, result.GetPointer(256), &signatureSize);
   result.SetSize(signatureSize);
-  HMAC_CTX_cleanup(&hmac);
 }
 
 
@@ -31,6 +31,7 @@
 #include <ptlib/sockets.h>
 #include <ptclib/http.h>
 #include <ptclib/random.h>
+#include <ptclib/sockevent.h>
 #include <ctype.h>
 
 #define new PNEW
@@ -47,6 +48,9 @@ static const PTimeInterval ReadLineTimeout(0, 30);
 #define DEFAULT_PERSIST_TIMEOUT 30
 #define DEFAULT_PERSIST_TRANSATIONS 10
 
+// Largest request header collected while connection is parked
+#define MAX_PARKED_HEADER_SIZE 65536
+
 //  filename to use for directory access directives
 static const char * accessFilename = "_access";
 
@@ -794,6 +798,9 @@ PHTTPListener::PHTTPListener(unsigned maxWorkers)
   : m_listenerPort(80)
   , m_listenerThread(NULL)
   , m_threadPool(maxWorkers, 0, "HTTP-Service")
+  , m_eventDriven(false)
+  , m_pollThreads(1)
+  , m_eventLoop(NULL)
 {
 }
 
@@ -804,6 +811,21 @@ PHTTPListener::~PHTTPListener()
 }
 
 
+void PHTTPListener::SetEventDriven(bool enable, unsigned pollThreads)
+{
+  PAssert(m_listenerThread == NULL, PLogicError);
+  m_eventDriven = enable;
+  m_pollThreads = std::max(pollThreads, 1U);
+}
+
+
+PINDEX PHTTPListener::GetParkedCount() const
+{
+  PWaitAndSignal lock(m_parkedMutex);
+  return m_parked.size();
+}
+
+
 bool PHTTPListener::ListenForHTTP(WORD port, PSocket::Reusability reuse, unsigned queueSize)
 {
   return ListenForHTTP(PString::Empty(), port, reuse, queueSize);
@@ -848,8 +870,11 @@ bool PHTTPListener::ListenForHTTP(const PString & interfaces, WORD port, PSocket
     }
   }
 
-  if (atLeastOne)
+  if (atLeastOne) {
+    if (m_eventDriven)
+      m_eventLoop = new PSocketEventLoop(m_pollThreads, "HTTP-Idle");
     m_listenerThread = new PThreadObj<PHTTPListener>(*this, &PHTTPListener::ListenMain, false, "HTTP-Listen");
+  }
 
   return atLeastOne;
 }
@@ -871,12 +896,25 @@ void PHTTPListener::ShutdownListeners()
 
   m_httpListeningSockets.RemoveAll();
 
+  // No more dispatching of parked connections to workers
+  if (m_eventLoop != NULL) {
+    m_eventLoop->Stop();
+    CloseParkedConnections();
+  }
+
   m_httpServersMutex.Wait();
   for (PList<PHTTPServer>::iterator it = m_httpServers.begin(); it != m_httpServers.end(); ++it)
     it->Close();
   m_httpServersMutex.Signal();
 
   m_threadPool.Shutdown();
+
+  // Workers are all finished, so clean up any that got parked while shutting down
+  if (m_eventLoop != NULL) {
+    CloseParkedConnections();
+    delete m_eventLoop;
+    m_eventLoop = NULL;
+  }
 }
 
 
@@ -887,7 +925,15 @@ void PHTTPListener::ListenMain()
     for (PSocketList::iterator it = m_httpListeningSockets.begin(); it != m_httpListeningSockets.end(); ++it)
       listeners += *it;
 
-    PChannel::Errors error = PSocket::Select(listeners);
+    // Wake up periodically to close parked connections that have been idle too long
+    PChannel::Errors error;
+    if (m_eventLoop != NULL) {
+      error = PSocket::Select(listeners, PTimeInterval(0, 1));
+      CloseIdleConnections();
+    }
+    else
+      error = PSocket::Select(listeners);
+
     if (error == PChannel::NoError) {
       // get a socket(s) when a client connects
       for (PSocket::SelectList::iterator it = listeners.begin(); it != listeners.end(); ++it) {
@@ -933,6 +979,168 @@ void PHTTPListener::OnHTTPEnded(PHTTPServer & /*server*/)
 }
 
 
+PHTTPListener::Parked::Parked(PHTTPServer * httpServer)
+  : m_httpServer(httpServer)
+  , m_headerSize(0)
+  , m_expiry(PTime() + httpServer->GetNextCommandTimeout())
+{
+}
+
+
+bool PHTTPListener::ParkConnection(PHTTPServer * httpServer)
+{
+  if (m_eventLoop == NULL)
+    return false;
+
+  // Can only look for the request header if there is nothing between us and the socket
+  PTCPSocket * socket = dynamic_cast<PTCPSocket *>(httpServer->GetReadChannel());
+  if (socket == NULL)
+    return false;
+
+  m_parkedMutex.Wait();
+  m_parked.insert(ParkedMap::value_type(socket, Parked(httpServer)));
+  m_parkedMutex.Signal();
+
+  if (m_eventLoop->Add(*socket, PCREATE_NOTIFIER(OnParkedReadable)))
+    return true;
+
+  m_parkedMutex.Wait();
+  m_parked.erase(socket);
+  m_parkedMutex.Signal();
+  return false;
+}
+
+
+static bool HasCompleteHeader(const BYTE * data, PINDEX start, PINDEX size)
+{
+  // Look for blank line, allowing for bare LF line endings
+  for (PINDEX i = std::max(start, (PINDEX)1); i < size; ++i) {
+    if (data[i] == '\n' && (data[i-1] == '\n' || (i > 1 && data[i-1] == '\r' && data[i-2] == '\n')))
+      return true;
+  }
+  return false;
+}
+
+
+void PHTTPListener::OnParkedReadable(PSocket & socket, unsigned events)
+{
+  m_parkedMutex.Wait();
+
+  ParkedMap::iterator it = m_parked.find(&socket);
+  if (it == m_parked.end()) {
+    m_parkedMutex.Signal();
+    return;
+  }
+
+  Parked & parked = it->second;
+
+  // Any error or end of file is passed on to the worker to clean up
+  bool dispatch = (events & PSocketEventLoop::ErrorEvent) != 0;
+  if (!dispatch) {
+    PINDEX start = parked.m_headerSize > 3 ? parked.m_headerSize-3 : 0;
+    socket.SetReadTimeout(0);
+    for (;;) {
+      static const PINDEX ChunkSize = 2048;
+      if (!socket.Read(parked.m_header.GetPointer(parked.m_headerSize+ChunkSize)+parked.m_headerSize, ChunkSize)) {
+        dispatch = socket.GetErrorCode(PChannel::LastReadError) != PChannel::Timeout;
+        break;
+      }
+      parked.m_headerSize += socket.GetLastReadCount();
+      if (socket.GetLastReadCount() < ChunkSize)
+        break;
+    }
+
+    if (HasCompleteHeader(parked.m_header, start, parked.m_headerSize))
+      dispatch = true;
+    else if (parked.m_headerSize > MAX_PARKED_HEADER_SIZE) {
+      PTRACE(2, "Request header too large from " << socket.GetName());
+      dispatch = true;
+    }
+  }
+
+  if (!dispatch) {
+    m_parkedMutex.Signal();
+    return;
+  }
+
+  PHTTPServer * httpServer = parked.m_httpServer;
+  httpServer->UnRead(parked.m_header, parked.m_headerSize);
+  m_parked.erase(it);
+
+  m_parkedMutex.Signal();
+
+  m_eventLoop->Remove(socket);
+  m_threadPool.AddWork(new Worker(*this, httpServer));
+}
+
+
+void PHTTPListener::CloseParkedConnection(PHTTPServer * httpServer)
+{
+  OnHTTPEnded(*httpServer);
+
+  m_httpServersMutex.Wait();
+  m_httpServers.Remove(httpServer); // And deletes it
+  m_httpServersMutex.Signal();
+}
+
+
+void PHTTPListener::CloseParkedConnections()
+{
+  // Only called with event loop stopped, and the socket may already be closed and deleted
+  ParkedMap parked;
+  m_parkedMutex.Wait();
+  parked.swap(m_parked);
+  m_parkedMutex.Signal();
+
+  PTRACE_IF(4, !parked.empty(), "Shut down of " << parked.size() << " parked connections");
+  for (ParkedMap::iterator it = parked.begin(); it != parked.end(); ++it)
+    CloseParkedConnection(it->second.m_httpServer);
+}
+
+
+void PHTTPListener::CloseIdleConnections()
+{
+  std::vector<PSocket *> expired;
+  PTime now;
+
+  m_parkedMutex.Wait();
+  for (ParkedMap::iterator it = m_parked.begin(); it != m_parked.end(); ++it) {
+    if (it->second.m_expiry <= now)
+      expired.push_back(it->first);
+  }
+  m_parkedMutex.Signal();
+
+  for (std::vector<PSocket *>::iterator it = expired.begin(); it != expired.end(); ++it) {
+    // Must not hold m_parkedMutex here, as notifier may be waiting for it
+    m_eventLoop->Remove(**it);
+
+    m_parkedMutex.Wait();
+
+    /* Between deciding to close and getting here, the connection may have been
+       dispatched to a worker, and even parked again, so check again. */
+    ParkedMap::iterator parked = m_parked.find(*it);
+    if (parked == m_parked.end()) {
+      m_parkedMutex.Signal();
+      continue;
+    }
+
+    if (parked->second.m_expiry > now) {
+      m_parkedMutex.Signal();
+      m_eventLoop->Add(**it, PCREATE_NOTIFIER(OnParkedReadable));
+      continue;
+    }
+
+    PHTTPServer * httpServer = parked->second.m_httpServer;
+    m_parked.erase(parked);
+
+    m_parkedMutex.Signal();
+
+    PTRACE(4, "Idle timeout of parked connection: " << (*it)->GetName());
+    CloseParkedConnection(httpServer);
+  }
+}
+
+
 PHTTPListener::Worker::Worker(PHTTPListener & listener, PTCPSocket * socket)
   : m_listener(listener)
   , m_socket(socket)
@@ -941,6 +1149,14 @@ PHTTPListener::Worker::Worker(PHTTPListener & listener, PTCPSocket * socket)
 }
 
 
+PHTTPListener::Worker::Worker(PHTTPListener & listener, PHTTPServer * httpServer)
+  : m_listener(listener)
+  , m_socket(NULL)
+  , m_httpServer(httpServer)
+{
+}
+
+
 PHTTPListener::Worker::~Worker()
 {
   if (m_httpServer != NULL) {
@@ -955,54 +1171,70 @@ PHTTPListener::Worker::~Worker()
 
 void PHTTPListener::Worker::Work()
 {
-  if (PAssertNULL(m_socket) == NULL)
-    return;
+  if (m_httpServer == NULL) {
+    if (PAssertNULL(m_socket) == NULL)
+      return;
 
 #ifdef SO_LINGER
-  const linger ling = { 1, 5 };
-  m_socket->SetOption(SO_LINGER, &ling, sizeof(ling));
+    const linger ling = { 1, 5 };
+    m_socket->SetOption(SO_LINGER, &ling, sizeof(ling));
 #endif
+  }
 
 #if PTRACING
+  PIPSocket * socket = m_socket != NULL ? m_socket : m_httpServer->GetSocket();
   PStringStream socketInfo;
-  socketInfo << ": local=" << m_socket->GetLocalAddress() << ", peer=" << m_socket->GetPeerAddress();
+  if (socket != NULL)
+    socketInfo << ": local=" << socket->GetLocalAddress() << ", peer=" << socket->GetPeerAddress();
 #endif
   PTRACE(5, "Processing thread pool work for" << socketInfo << ", delay=" << m_queuedTime.GetElapsed());
 
-  m_httpServer = m_listener.CreateServerForHTTP();
   if (m_httpServer == NULL) {
-    PTRACE(2, "Creation failed" << socketInfo);
-    return;
-  }
-  m_httpServer->SetServiceStartTime(m_queuedTime);
+    m_httpServer = m_listener.CreateServerForHTTP();
+    if (m_httpServer == NULL) {
+      PTRACE(2, "Creation failed" << socketInfo);
+      return;
+    }
+    m_httpServer->SetServiceStartTime(m_queuedTime);
 
-  m_listener.m_httpServersMutex.Wait();
-  m_listener.m_httpServers.Append(m_httpServer); // Deleted in this list
-  m_listener.m_httpServersMutex.Signal();
+    m_listener.m_httpServersMutex.Wait();
+    m_listener.m_httpServers.Append(m_httpServer); // Deleted in this list
+    m_listener.m_httpServersMutex.Signal();
 
-  PChannel * channel = m_listener.CreateChannelForHTTP(m_socket);
-  if (channel == NULL) {
-    PTRACE(2, "Indirect channel creation failed" << socketInfo);
-    return;
-  }
-  m_socket = NULL; // Will be deleted via PIndirectChannel now
+    PChannel * channel = m_listener.CreateChannelForHTTP(m_socket);
+    if (channel == NULL) {
+      PTRACE(2, "Indirect channel creation failed" << socketInfo);
+      return;
+    }
+    m_socket = NULL; // Will be deleted via PIndirectChannel now
 
-  if (!m_httpServer->Open(channel)) {
-    PTRACE(2, "Open failed" << socketInfo);
-    delete channel;
-    return;
-  }
+    if (!m_httpServer->Open(channel)) {
+      PTRACE(2, "Open failed" << socketInfo);
+      delete channel;
+      return;
+    }
 
-  PTRACE(5, "Started" << socketInfo);
-  m_listener.OnHTTPStarted(*m_httpServer);
+    PTRACE(5, "Started" << socketInfo);
+    m_listener.OnHTTPStarted(*m_httpServer);
+  }
 
   // process requests
-  while (m_httpServer->ProcessCommand()) {
+  for (;;) {
+    // If in event driven mode, and nothing left over from the last request, wait for next without a thread
+    if (m_httpServer->GetUnReadCount() == 0 && m_listener.ParkConnection(m_httpServer)) {
+      PTRACE(5, "Parked" << socketInfo);
+      m_httpServer = NULL; // May already be running in another worker
+      return;
+    }
+
+    if (!m_httpServer->ProcessCommand())
+      break;
+
     PTRACE(5, "Processed" << socketInfo << ", duration=" << m_httpServer->GetLastCommandTime().GetElapsed());
   }
 
   m_listener.OnHTTPEnded(*m_httpServer);
-  PTRACE(5, "Ended" << socketInfo << ", duration=" << m_queuedTime.GetElapsed());
+  PTRACE(5, "Ended" << socketInfo << ", duration=" << m_httpServer->GetServiceStartTime().GetElapsed());
 }
 
 
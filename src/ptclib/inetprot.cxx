@@ -55,7 +55,9 @@ PInternetProtocol::PInternetProtocol(const char * svcName,
   SetReadTimeout(PTimeInterval(0, 0, 10));  // 10 minutes
   stuffingState = DontStuff;
   newLineToCRLF = true;
+  unReadStart = 0;
   unReadCount = 0;
+  m_readAheadSize = 4096;
 }
 
 
@@ -65,29 +67,43 @@ void PInternetProtocol::SetReadLineTimeout(const PTimeInterval & t)
 }
 
 
+void PInternetProtocol::SetReadAheadSize(PINDEX size)
+{
+  m_readAheadSize = std::max(size, (PINDEX)16);
+}
+
+
+bool PInternetProtocol::InternalReadAhead()
+{
+  // Only called when buffer empty, so can always start at the beginning
+  unReadStart = 0;
+  if (!PIndirectChannel::Read(unReadBuffer.GetPointer(m_readAheadSize), m_readAheadSize))
+    return false;
+
+  unReadCount = GetLastReadCount();
+  return unReadCount > 0;
+}
+
+
 PBoolean PInternetProtocol::Read(void * buf, PINDEX len)
 {
   if (unReadCount == 0) {
-    char readAhead[1000];
-    if (!PIndirectChannel::Read(readAhead, sizeof(readAhead)))
-      return false;
+    if (len >= m_readAheadSize)
+      return PIndirectChannel::Read(buf, len);
 
-    UnRead(readAhead, GetLastReadCount());
+    if (!InternalReadAhead())
+      return false;
   }
 
-  SetLastReadCount(PMIN(unReadCount, len));
-  const char * unReadPtr = ((const char *)unReadBuffer)+unReadCount;
-  char * bufptr = (char *)buf;
-  while (unReadCount > 0 && len > 0) {
-    *bufptr++ = *--unReadPtr;
-    unReadCount--;
-    len--;
-  }
+  PINDEX count = PMIN(unReadCount, len);
+  memcpy(buf, (const char *)unReadBuffer + unReadStart, count);
+  unReadStart += count;
+  unReadCount -= count;
+  SetLastReadCount(count);
 
-  if (len > 0) {
-    PINDEX saveCount = GetLastReadCount();
-    PIndirectChannel::Read(bufptr, len);
-    SetLastReadCount(GetLastReadCount() + saveCount);
+  if (len > count) {
+    PIndirectChannel::Read((char *)buf + count, len - count);
+    SetLastReadCount(GetLastReadCount() + count);
   }
 
   return GetLastReadCount() > 0;
@@ -96,18 +112,12 @@ PBoolean PInternetProtocol::Read(void * buf, PINDEX len)
 
 int PInternetProtocol::ReadChar()
 {
-  if (unReadCount == 0) {
-    char readAhead[1000];
-    if (!PIndirectChannel::Read(readAhead, sizeof(readAhead)))
-      return -1;
-
-    UnRead(readAhead, GetLastReadCount());
-    if (unReadCount == 0)
-      return -1;
-  }
+  if (unReadCount == 0 && !InternalReadAhead())
+    return -1;
 
   SetLastReadCount(1);
-  return (unReadBuffer[--unReadCount]&0xff);
+  --unReadCount;
+  return unReadBuffer[unReadStart++]&0xff;
 }
 
 
@@ -265,63 +275,74 @@ PBoolean PInternetProtocol::WriteLine(const PString & line)
 
 PBoolean PInternetProtocol::ReadLine(PString & line, PBoolean allowContinuation)
 {
-  if (!line.SetMinSize(1000))
+  // First character uses normal read timeout
+  if (unReadCount == 0 && !InternalReadAhead())
     return false;
 
+  PTimeInterval oldTimeout = GetReadTimeout();
+  SetReadTimeout(readLineTimeout);
+
   PINDEX count = 0;
-  PBoolean gotEndOfLine = false;
+  bool gotEndOfLine = false;
 
-  int c = ReadChar();
-  if (c < 0)
-    return false;
+  while (!gotEndOfLine) {
+    if (unReadCount == 0 && !InternalReadAhead())
+      break;
 
-  PTimeInterval oldTimeout = GetReadTimeout();
-  SetReadTimeout(readLineTimeout);
+    // Scan for end of line in what has been read so far, and copy in bulk
+    const char * ptr = (const char *)unReadBuffer + unReadStart;
+    const char * eol = (const char *)memchr(ptr, '\n', unReadCount);
+    PINDEX len = eol != NULL ? eol - ptr : unReadCount;
+    const char * cr = (const char *)memchr(ptr, '\r', len);
+    if (cr != NULL) {
+      eol = cr;
+      len = cr - ptr;
+    }
 
-  while (c >= 0 && !gotEndOfLine) {
-    switch (c) {
-      case '\b' :
-      case '\177' :
-        if (count > 0)
+    char * linePtr = line.GetPointerAndSetLength(count + len + 1);
+    if (memchr(ptr, '\b', len) == NULL && memchr(ptr, '\177', len) == NULL) {
+      memcpy(linePtr + count, ptr, len);
+      count += len;
+    }
+    else {
+      for (PINDEX i = 0; i < len; ++i) {
+        if (ptr[i] != '\b' && ptr[i] != '\177')
+          linePtr[count++] = ptr[i];
+        else if (count > 0)
           count--;
-        c = ReadChar();
-        break;
-
-      case '\r' :
-        c = ReadChar();
-        switch (c) {
-          case -1 :
-          case '\n' :
-            break;
+      }
+    }
 
-          case '\r' :
-            c = ReadChar();
-            if (c == '\n')
-              break;
-            UnRead(c);
-            c = '\r';
-            // Then do default case
+    unReadStart += len;
+    unReadCount -= len;
+    if (eol == NULL)
+      continue;
 
-          default :
+    // Consume the CR, LF, CR/LF or CR/CR/LF
+    --unReadCount;
+    if (unReadBuffer[unReadStart++] == '\r') {
+      int c = ReadChar();
+      if (c == '\r') {
+        c = ReadChar();
+        if (c != '\n') {
+          if (c >= 0)
             UnRead(c);
+          UnRead('\r');
         }
-        // Then do line feed case
-
-      case '\n' :
-        if (count == 0 || !allowContinuation || (c = ReadChar()) < 0)
-          gotEndOfLine = true;
-        else if (c != ' ' && c != '\t') {
-          UnRead(c);
-          gotEndOfLine = true;
-        }
-        break;
+      }
+      else if (c >= 0 && c != '\n')
+        UnRead(c);
+    }
 
-      default :
-        if (count >= line.GetSize())
-          line.SetSize(count + 100);
-        line[count++] = (char)c;
-        c = ReadChar();
+    int c;
+    if (count == 0 || !allowContinuation || (c = ReadChar()) < 0)
+      gotEndOfLine = true;
+    else if (c != ' ' && c != '\t') {
+      UnRead(c);
+      gotEndOfLine = true;
     }
+    else
+      linePtr[count++] = (char)c;
   }
 
   SetReadTimeout(oldTimeout);
@@ -337,8 +358,8 @@ PBoolean PInternetProtocol::ReadLine(PString & line, PBoolean allowContinuation)
 
 void PInternetProtocol::UnRead(int ch)
 {
-  unReadBuffer.SetSize((unReadCount+256)&~255);
-  unReadBuffer[unReadCount++] = (char)ch;
+  char c = (char)ch;
+  UnRead(&c, 1);
 }
 
 
@@ -350,12 +371,22 @@ void PInternetProtocol::UnRead(const PString & str)
 
 void PInternetProtocol::UnRead(const void * buffer, PINDEX len)
 {
-  char * unreadptr =
-               unReadBuffer.GetPointer((unReadCount+len+255)&~255)+unReadCount;
-  const char * bufptr = ((const char *)buffer)+len;
+  if (len == 0)
+    return;
+
+  if (unReadCount == 0)
+    unReadStart = 0;
+
+  if (len > unReadStart) {
+    // Not enough room before unread data, move it up to make space
+    char * ptr = unReadBuffer.GetPointer(std::max(len + unReadCount, m_readAheadSize));
+    memmove(ptr + len, ptr + unReadStart, unReadCount);
+    unReadStart = len;
+  }
+
+  unReadStart -= len;
   unReadCount += len;
-  while (len-- > 0)
-    *unreadptr++ = *--bufptr;
+  memcpy(unReadBuffer.GetPointer() + unReadStart, buffer, len);
 }
 
 
@@ -30,6 +30,65 @@
 #define new PNEW
 
 
+// Number of leading one bits in the mask, or P_MAX_INDEX if not contiguous
+static PINDEX GetPrefixLength(const PIPSocket::Address & mask)
+{
+  const BYTE * bytes = (const BYTE *)mask.GetPointer();
+  PINDEX size = mask.GetSize();
+  PINDEX length = 0;
+  PINDEX i = 0;
+
+  while (i < size && bytes[i] == 0xff) {
+    length += 8;
+    ++i;
+  }
+
+  if (i < size) {
+    BYTE partial = bytes[i++];
+    while ((partial & 0x80) != 0) {
+      ++length;
+      partial <<= 1;
+    }
+    if (partial != 0)
+      return P_MAX_INDEX;
+
+    while (i < size) {
+      if (bytes[i++] != 0)
+        return P_MAX_INDEX;
+    }
+  }
+
+  return length;
+}
+
+
+static bool MatchNetwork(const PIPSocket::Address & addr, const PIPSocket::Address & network, const PIPSocket::Address & mask)
+{
+  PIPSocket::Address test = addr;
+  if (network.GetVersion() == 4 && addr.IsV4Mapped())
+    test = PIPSocket::Address((in_addr)addr);
+
+  if (test.GetVersion() != network.GetVersion())
+    return false;
+
+  const BYTE * testBytes = (const BYTE *)test.GetPointer();
+  const BYTE * networkBytes = (const BYTE *)network.GetPointer();
+  PINDEX size = network.GetSize();
+
+  // A host name can resolve to an IPv6 address, with the IPv4 full mask
+  if (mask.GetVersion() != network.GetVersion())
+    return memcmp(testBytes, networkBytes, size) == 0;
+
+  const BYTE * maskBytes = (const BYTE *)mask.GetPointer();
+  for (PINDEX i = 0; i < size; ++i) {
+    if (((testBytes[i] ^ networkBytes[i]) & maskBytes[i]) != 0)
+      return false;
+  }
+
+  return true;
+}
+
+
 PIpAccessControlEntry::PIpAccessControlEntry(PIPSocket::Address addr,
                                              PIPSocket::Address msk,
                                              PBoolean allow)
@@ -101,7 +160,12 @@ void PIpAccessControlEntry::PrintOn(ostream & strm) const
     return;
   }
 
-  if (mask != 0 && mask != static_cast<DWORD>(0xffffffff))
+  if (mask.GetVersion() == 6) {
+    PINDEX bits = GetPrefixLength(mask);
+    if (bits < 128)
+      strm << '/' << bits;
+  }
+  else if (mask != 0 && mask != static_cast<DWORD>(0xffffffff))
     strm << '/' << mask;
 }
 
@@ -155,6 +219,30 @@ PBoolean PIpAccessControlEntry::Parse(const PString & description)
     return true;
   }
 
+  if (preSlash.Find(':') != P_MAX_INDEX) {
+    // Must be an IPv6 number, with optional prefix length
+    PIPSocket::Address ip6(preSlash);
+    unsigned bits = 128;
+    if (ip6.GetVersion() != 6 ||
+          (slash != P_MAX_INDEX && (description.Mid(slash+1).FindSpan("0123456789") != P_MAX_INDEX ||
+                                    (bits = description.Mid(slash+1).AsUnsigned()) > 128))) {
+      address = 0;
+      return false;
+    }
+
+    BYTE maskBytes[16], addressBytes[16];
+    for (unsigned i = 0; i < 16; ++i) {
+      maskBytes[i] = (BYTE)(0xff00 >> (bits > i*8 ? std::min(bits - i*8, 8U) : 0));
+      addressBytes[i] = ip6[i] & maskBytes[i];
+    }
+    mask = PIPSocket::Address(16, maskBytes);
+    address = PIPSocket::Address(16, addressBytes);
+
+    if (bits == 0)
+      domain = "\xff";
+    return true;
+  }
+
   if (preSlash.FindSpan("0123456789.") != P_MAX_INDEX) {
     // If is not all numbers and dots can't be an IP number so assume hostname
     domain = preSlash;
@@ -253,18 +341,335 @@ PBoolean PIpAccessControlEntry::Match(PIPSocket::Address & addr)
         return false;
   }
 
-  return (address & mask) == (addr & mask);
+  return MatchNetwork(addr, address, mask);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+/* Compiled form of the list. Entries that are a simple IP network are put
+   into a path compressed binary trie, one for IPv4 and one for IPv6, where
+   each node knows the index in the list of the entry for that prefix. A
+   search follows the address bits down the trie, and the lowest index seen
+   is the first matching entry, which given the sort order is also the
+   longest prefix. Everything else, domains, host names and non-contiguous
+   masks, is kept in list order and only tested if it precedes that.
+
+   For a big list, the walk down the top of the IPv4 trie is done in advance
+   for every value of the first 16 bits, saving a dozen or so cache misses.
+ */
+class PIpAccessControlList::Compiled
+{
+  public:
+    Compiled(const PIpAccessControlList & list);
+
+    PIpAccessControlEntry * Find(const PIPSocket::Address & address) const;
+
+  private:
+    struct Key
+    {
+      Key() : m_high(0), m_low(0) { }
+      Key(const PIPSocket::Address & address);
+
+      unsigned GetBit(unsigned bit) const
+      {
+        return bit < 64 ? (unsigned)(m_high >> (63 - bit)) & 1 : (unsigned)(m_low >> (127 - bit)) & 1;
+      }
+
+      Key Truncate(unsigned length) const;
+      bool IsPrefix(const Key & key, unsigned length) const;
+      unsigned CommonLength(const Key & key, unsigned start, unsigned maxLength) const;
+
+      uint64_t m_high;
+      uint64_t m_low;
+    };
+
+    enum { NoIndex = UINT_MAX };
+
+    class Trie
+    {
+      public:
+        Trie();
+        void Add(const Key & key, unsigned length, unsigned index);
+        void BuildJumpTable(unsigned bits);
+        unsigned Find(const Key & key, unsigned maxLength) const;
+
+      private:
+        struct Node
+        {
+          Key      m_key;
+          unsigned m_length;
+          int      m_child[2];
+          unsigned m_index;
+        };
+        int NewNode(const Key & key, unsigned length, unsigned index);
+
+        std::vector<Node> m_nodes;
+
+        struct Jump
+        {
+          unsigned m_index; // Best so far
+          int      m_node;  // Where to continue
+        };
+        std::vector<Jump> m_jumps;
+        unsigned          m_jumpBits;
+    };
+
+    Trie m_trie4;
+    Trie m_trie6;
+    std::vector<PIpAccessControlEntry *> m_entries;
+    std::vector<unsigned>                m_others;
+};
+
+
+PIpAccessControlList::Compiled::Key::Key(const PIPSocket::Address & address)
+  : m_high(0)
+  , m_low(0)
+{
+  const BYTE * bytes = (const BYTE *)address.GetPointer();
+  PINDEX size = address.GetSize();
+  for (PINDEX i = 0; i < size; ++i) {
+    if (i < 8)
+      m_high |= (uint64_t)bytes[i] << (56 - i*8);
+    else
+      m_low |= (uint64_t)bytes[i] << (120 - i*8);
+  }
+}
+
+
+PIpAccessControlList::Compiled::Key PIpAccessControlList::Compiled::Key::Truncate(unsigned length) const
+{
+  Key key;
+  if (length >= 128) {
+    key.m_high = m_high;
+    key.m_low = m_low;
+  }
+  else if (length > 64) {
+    key.m_high = m_high;
+    key.m_low = m_low & ~(~(uint64_t)0 >> (length - 64));
+  }
+  else if (length > 0)
+    key.m_high = m_high & ~(length == 64 ? 0 : ~(uint64_t)0 >> length);
+  return key;
+}
+
+
+bool PIpAccessControlList::Compiled::Key::IsPrefix(const Key & key, unsigned length) const
+{
+  Key diff;
+  diff.m_high = m_high ^ key.m_high;
+  diff.m_low = m_low ^ key.m_low;
+  diff = diff.Truncate(length);
+  return diff.m_high == 0 && diff.m_low == 0;
+}
+
+
+unsigned PIpAccessControlList::Compiled::Key::CommonLength(const Key & key, unsigned start, unsigned maxLength) const
+{
+  unsigned length = start;
+  while (length < maxLength && GetBit(length) == key.GetBit(length))
+    ++length;
+  return length;
+}
+
+
+PIpAccessControlList::Compiled::Trie::Trie()
+  : m_jumpBits(0)
+{
+  NewNode(Key(), 0, NoIndex); // Root, always present
+}
+
+
+int PIpAccessControlList::Compiled::Trie::NewNode(const Key & key, unsigned length, unsigned index)
+{
+  Node node;
+  node.m_key = key.Truncate(length);
+  node.m_length = length;
+  node.m_child[0] = node.m_child[1] = -1;
+  node.m_index = index;
+  m_nodes.push_back(node);
+  return (int)m_nodes.size()-1;
+}
+
+
+void PIpAccessControlList::Compiled::Trie::Add(const Key & key, unsigned length, unsigned index)
+{
+  int current = 0;
+  for (;;) {
+    if (m_nodes[current].m_length == length) {
+      if (index < m_nodes[current].m_index)
+        m_nodes[current].m_index = index;
+      return;
+    }
+
+    unsigned bit = key.GetBit(m_nodes[current].m_length);
+    int child = m_nodes[current].m_child[bit];
+    if (child < 0) {
+      int leaf = NewNode(key, length, index);
+      m_nodes[current].m_child[bit] = leaf;
+      return;
+    }
+
+    // Bits up to and including the one used to get to the child are known to be equal
+    unsigned common = key.CommonLength(m_nodes[child].m_key, m_nodes[current].m_length+1, std::min(length, m_nodes[child].m_length));
+    if (common == m_nodes[child].m_length) {
+      current = child;
+      continue;
+    }
+
+    // Need to split the path compressed edge to the child
+    int split = NewNode(key, common, common == length ? index : NoIndex);
+    m_nodes[split].m_child[m_nodes[child].m_key.GetBit(common)] = child;
+    if (common < length) {
+      int leaf = NewNode(key, length, index);
+      m_nodes[split].m_child[key.GetBit(common)] = leaf;
+    }
+    m_nodes[current].m_child[bit] = split;
+    return;
+  }
+}
+
+
+void PIpAccessControlList::Compiled::Trie::BuildJumpTable(unsigned bits)
+{
+  m_jumpBits = bits;
+  m_jumps.resize((size_t)1 << bits);
+
+  for (size_t value = 0; value < m_jumps.size(); ++value) {
+    Key key;
+    key.m_high = (uint64_t)value << (64 - bits);
+
+    // Same as Find() but stop at any node that needs more bits than we have
+    Jump & jump = m_jumps[value];
+    jump.m_index = NoIndex;
+    jump.m_node = 0;
+    while (jump.m_node >= 0) {
+      const Node & node = m_nodes[jump.m_node];
+      if (node.m_length >= bits)
+        break;
+      if (!key.IsPrefix(node.m_key, node.m_length)) {
+        jump.m_node = -1;
+        break;
+      }
+      if (node.m_index < jump.m_index)
+        jump.m_index = node.m_index;
+      jump.m_node = node.m_child[key.GetBit(node.m_length)];
+    }
+  }
+}
+
+
+unsigned PIpAccessControlList::Compiled::Trie::Find(const Key & key, unsigned maxLength) const
+{
+  unsigned best = NoIndex;
+
+  int current = 0;
+  if (m_jumpBits > 0) {
+    const Jump & jump = m_jumps[(size_t)(key.m_high >> (64 - m_jumpBits))];
+    best = jump.m_index;
+    current = jump.m_node;
+  }
+
+  while (current >= 0) {
+    const Node & node = m_nodes[current];
+    if (!key.IsPrefix(node.m_key, node.m_length))
+      break;
+    if (node.m_index < best)
+      best = node.m_index;
+    if (node.m_length >= maxLength)
+      break;
+    current = node.m_child[key.GetBit(node.m_length)];
+  }
+
+  return best;
+}
+
+
+PIpAccessControlList::Compiled::Compiled(const PIpAccessControlList & list)
+{
+  m_entries.reserve(list.GetSize());
+
+  for (PIpAccessControlList::const_iterator it = list.begin(); it != list.end(); ++it) {
+    unsigned index = (unsigned)m_entries.size();
+    PIpAccessControlEntry & entry = const_cast<PIpAccessControlEntry &>(*it);
+    m_entries.push_back(&entry);
+
+    const PIPSocket::Address & address = entry.GetAddress();
+    const PIPSocket::Address & mask = entry.GetMask();
+    PINDEX length;
+    if (!entry.GetDomain().IsEmpty() ||
+         address.GetVersion() != mask.GetVersion() ||
+         (length = GetPrefixLength(mask)) == P_MAX_INDEX)
+      m_others.push_back(index);
+    else if (address.GetVersion() == 4)
+      m_trie4.Add(Key(address), length, index);
+    else
+      m_trie6.Add(Key(address), length, index);
+  }
+
+  if (m_entries.size() > 10000)
+    m_trie4.BuildJumpTable(16);
+}
+
+
+PIpAccessControlEntry * PIpAccessControlList::Compiled::Find(const PIPSocket::Address & address) const
+{
+  unsigned best;
+  if (address.GetVersion() == 4)
+    best = m_trie4.Find(Key(address), 32);
+  else if (address.IsV4Mapped())
+    best = m_trie4.Find(Key(PIPSocket::Address((in_addr)address)), 32);
+  else
+    best = m_trie6.Find(Key(address), 128);
+
+  // Match() is not const, as a host name entry caches its address
+  PIPSocket::Address addr = address;
+  for (std::vector<unsigned>::const_iterator it = m_others.begin(); it != m_others.end() && *it < best; ++it) {
+    if (m_entries[*it]->Match(addr))
+      return m_entries[*it];
+  }
+
+  return best != NoIndex ? m_entries[best] : NULL;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
 
 PIpAccessControlList::PIpAccessControlList(PBoolean defAllow)
-  : defaultAllowance(defAllow)
+  : m_cache(std::make_shared<CompiledCache>())
+  , defaultAllowance(defAllow)
 {
 }
 
 
+PIpAccessControlList::PIpAccessControlList(const PIpAccessControlList & other)
+  : PIpAccessControlList_base(other)
+  , m_cache(other.m_cache)
+  , defaultAllowance(other.defaultAllowance)
+{
+}
+
+
+PIpAccessControlList & PIpAccessControlList::operator=(const PIpAccessControlList & other)
+{
+  PIpAccessControlList_base::operator=(other);
+  m_cache = other.m_cache;
+  defaultAllowance = other.defaultAllowance;
+  return *this;
+}
+
+
+PIpAccessControlList::~PIpAccessControlList()
+{
+}
+
+
+PIpAccessControlList::CompiledCache::~CompiledCache()
+{
+  delete m_compiled.load();
+}
+
+
 static PBoolean ReadConfigFileLine(PTextFile & file, PString & line)
 {
   line = PString();
@@ -523,17 +928,79 @@ PIpAccessControlEntry * PIpAccessControlList::CreateControlEntry(const PString &
 
 PIpAccessControlEntry * PIpAccessControlList::Find(PIPSocket::Address address) const
 {
-  PINDEX size = GetSize();
-  if (size == 0)
+  if (IsEmpty())
     return NULL;
 
-  for (PINDEX i = 0; i < GetSize(); i++) {
-    PIpAccessControlEntry & entry = operator[](i);
-    if (entry.Match(address))
-      return &entry;
+  return GetCompiled()->Find(address);
+}
+
+
+const PIpAccessControlList::Compiled * PIpAccessControlList::GetCompiled() const
+{
+  const Compiled * compiled = m_cache->m_compiled.load(std::memory_order_acquire);
+  if (compiled != NULL)
+    return compiled;
+
+  PWaitAndSignal lock(m_cache->m_mutex);
+
+  compiled = m_cache->m_compiled.load(std::memory_order_acquire);
+  if (compiled == NULL) {
+    compiled = new Compiled(*this);
+    m_cache->m_compiled.store(compiled, std::memory_order_release);
+    PTRACE(4, "Compiled IP access control list of " << GetSize() << " entries");
   }
 
-  return NULL;
+  return compiled;
+}
+
+
+// Must not be searching the list while it is being changed, so safe to delete
+void PIpAccessControlList::InvalidateCompiled()
+{
+  PWaitAndSignal lock(m_cache->m_mutex);
+  delete m_cache->m_compiled.exchange(NULL);
+}
+
+
+PINDEX PIpAccessControlList::Append(PObject * obj)
+{
+  InvalidateCompiled();
+  return PIpAccessControlList_base::Append(obj);
+}
+
+
+PBoolean PIpAccessControlList::Remove(const PObject * obj)
+{
+  InvalidateCompiled();
+  return PIpAccessControlList_base::Remove(obj);
+}
+
+
+PObject * PIpAccessControlList::RemoveAt(PINDEX index)
+{
+  InvalidateCompiled();
+  return PIpAccessControlList_base::RemoveAt(index);
+}
+
+
+void PIpAccessControlList::RemoveAll()
+{
+  InvalidateCompiled();
+  PIpAccessControlList_base::RemoveAll();
+}
+
+
+void PIpAccessControlList::erase(const iterator & it)
+{
+  InvalidateCompiled();
+  PIpAccessControlList_base::erase(it);
+}
+
+
+void PIpAccessControlList::erase(const const_iterator & it)
+{
+  InvalidateCompiled();
+  PIpAccessControlList_base::erase(it);
 }
 
 
@@ -105,14 +105,18 @@ PJSON & PJSON::operator=(const PJSON & other)
 
 bool PJSON::FromString(const PString & str)
 {
-  PStringStream strm(str);
-  ReadFrom(strm);
-  return m_valid;
+  return FromBuffer(str, str.GetLength());
 }
 
 
 PString PJSON::AsString(std::streamsize initialIndent, std::streamsize subsequentIndent) const
 {
+  if (initialIndent == 0 && subsequentIndent == 0) {
+    std::string buffer;
+    AppendTo(buffer);
+    return buffer;
+  }
+
   PStringStream strm;
   strm.width(initialIndent);
   strm.precision(subsequentIndent != 0 ? subsequentIndent : (initialIndent != 0 ? 2 : 6));
@@ -302,7 +306,7 @@ static void PrintString(ostream & strm, const PString & str)
           strm << str[i];
         else {
           char oldFill = strm.fill('0');
-          ios_base::fmtflags oldFlags = strm.setf(ios_base::hex, ios_base::dec);
+          ios_base::fmtflags oldFlags = strm.setf(ios_base::hex, ios_base::basefield);
 
           strm << "\\u" << setw(4) << c;
 
@@ -315,6 +319,661 @@ static void PrintString(ostream & strm, const PString & str)
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Buffer based parser, avoids istream and is driven by PJSON::Handler
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define P_JSON_SSE2 1
+  #include <emmintrin.h>
+#endif
+
+#if P_JSON_SSE2
+static __inline unsigned FirstBitSet(unsigned mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+
+static __inline bool IsWhiteSpace(char c)
+{
+  return c == ' ' || (unsigned)(c - '\t') <= (unsigned)('\r' - '\t');
+}
+
+
+// Locate the first character after any white space, sixteen at a time for long runs of indentation
+static const char * SkipWhiteSpaceRun(const char * ptr, const char * end)
+{
+#if P_JSON_SSE2
+  // Most of the time there is none, or just one, so do not bother with SIMD
+  for (int i = 0; i < 2; ++i) {
+    if (ptr >= end || !IsWhiteSpace(*ptr))
+      return ptr;
+    ++ptr;
+  }
+
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i range = _mm_set1_epi8('\r' - '\t');
+  while (ptr + 16 <= end) {
+    __m128i chars = _mm_loadu_si128((const __m128i *)ptr);
+    __m128i control = _mm_sub_epi8(chars, tab);
+    __m128i isSpace = _mm_or_si128(_mm_cmpeq_epi8(chars, space),
+                                   _mm_cmpeq_epi8(_mm_max_epu8(control, range), range));
+    unsigned mask = ~_mm_movemask_epi8(isSpace) & 0xffff;
+    if (mask != 0)
+      return ptr + FirstBitSet(mask);
+    ptr += 16;
+  }
+#endif
+
+  while (ptr < end && IsWhiteSpace(*ptr))
+    ++ptr;
+  return ptr;
+}
+
+
+/* Locate the first character in a string that needs special handling, that
+   is a quote, a backslash or a control character. */
+static const char * ScanStringRun(const char * ptr, const char * end)
+{
+#if P_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(' ' - 1);
+  while (ptr + 16 <= end) {
+    __m128i chars = _mm_loadu_si128((const __m128i *)ptr);
+    __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, quote),
+                                                _mm_cmpeq_epi8(chars, backslash)),
+                                   _mm_cmpeq_epi8(_mm_max_epu8(chars, control), control));
+    unsigned mask = _mm_movemask_epi8(special);
+    if (mask != 0)
+      return ptr + FirstBitSet(mask);
+    ptr += 16;
+  }
+#endif
+
+  while (ptr < end && (unsigned char)*ptr >= ' ' && *ptr != '"' && *ptr != '\\')
+    ++ptr;
+  return ptr;
+}
+
+
+static void AppendUTF8(std::string & str, unsigned code)
+{
+  if (code < 0x80)
+    str += (char)code;
+  else if (code < 0x800) {
+    str += (char)(0xc0 | (code >> 6));
+    str += (char)(0x80 | (code & 0x3f));
+  }
+  else if (code < 0x10000) {
+    str += (char)(0xe0 | (code >> 12));
+    str += (char)(0x80 | ((code >> 6) & 0x3f));
+    str += (char)(0x80 | (code & 0x3f));
+  }
+  else {
+    str += (char)(0xf0 | (code >> 18));
+    str += (char)(0x80 | ((code >> 12) & 0x3f));
+    str += (char)(0x80 | ((code >> 6) & 0x3f));
+    str += (char)(0x80 | (code & 0x3f));
+  }
+}
+
+
+class PJSONParser
+{
+  public:
+    PJSONParser(PJSON::Handler & handler, const char * data, size_t length)
+      : m_handler(handler)
+      , m_stream(NULL)
+      , m_start(data)
+      , m_ptr(data)
+      , m_end(data + length)
+    {
+    }
+
+
+    PJSONParser(PJSON::Handler & handler, istream & strm)
+      : m_handler(handler)
+      , m_stream(&strm)
+      , m_block(65536)
+      , m_start(NULL)
+      , m_ptr(NULL)
+      , m_end(NULL)
+    {
+    }
+
+
+    bool Parse()
+    {
+      // Nested objects and arrays are kept on our own stack, not the CPU one
+      bool ok = ParseValue();
+      while (ok && !m_nesting.empty())
+        ok = ParseNext();
+
+      PTRACE_IF(4, !ok, NULL, PTraceModule(), "Parse error"
+                << (m_stream != NULL ? PString::Empty() : psprintf(" at offset %u", (unsigned)(m_ptr - m_start))));
+      return ok;
+    }
+
+
+  protected:
+    bool Fill()
+    {
+      if (m_ptr < m_end)
+        return true;
+
+      if (m_stream == NULL || !m_stream->good())
+        return false;
+
+      m_stream->read(m_block.data(), m_block.size());
+      std::streamsize count = m_stream->gcount();
+      if (count <= 0)
+        return false;
+
+      m_ptr = m_block.data();
+      m_end = m_ptr + count;
+      return true;
+    }
+
+
+    bool GetChar(char & c)
+    {
+      if (!Fill())
+        return false;
+      c = *m_ptr++;
+      return true;
+    }
+
+
+    bool SkipWhiteSpace()
+    {
+      for (;;) {
+        if (!Fill())
+          return false;
+        m_ptr = SkipWhiteSpaceRun(m_ptr, m_end);
+        if (m_ptr < m_end)
+          return true;
+      }
+    }
+
+
+    bool ParseValue()
+    {
+      if (!SkipWhiteSpace())
+        return false;
+
+      switch (*m_ptr) {
+        case '{' :
+          ++m_ptr;
+          m_nesting.push_back(Nesting('}'));
+          return m_handler.OnStartObject();
+
+        case '[' :
+          ++m_ptr;
+          m_nesting.push_back(Nesting(']'));
+          return m_handler.OnStartArray();
+
+        case '"' :
+          ++m_ptr;
+          return ParseString(false);
+
+        case '0' :
+        case '1' :
+        case '2' :
+        case '3' :
+        case '4' :
+        case '5' :
+        case '6' :
+        case '7' :
+        case '8' :
+        case '9' :
+        case '-' :
+        case '.' :
+          return ParseNumber();
+
+        case 'T' :
+        case 't' :
+          return ParseLiteral("true") && m_handler.OnBoolean(true);
+
+        case 'F' :
+        case 'f' :
+          return ParseLiteral("false") && m_handler.OnBoolean(false);
+
+        case 'N' :
+        case 'n' :
+          return ParseLiteral("null") && m_handler.OnNull();
+      }
+
+      return false;
+    }
+
+
+    // Called after an object/array is opened, or after each value within it
+    bool ParseNext()
+    {
+      if (!SkipWhiteSpace())
+        return false;
+
+      Nesting & nesting = m_nesting.back();
+      char terminator = nesting.m_terminator;
+
+      if (*m_ptr == terminator) {
+        ++m_ptr;
+        m_nesting.pop_back();
+        return terminator == '}' ? m_handler.OnEndObject() : m_handler.OnEndArray();
+      }
+
+      if (nesting.m_first)
+        nesting.m_first = false;
+      else {
+        if (*m_ptr != ',')
+          return false;
+        ++m_ptr;
+        if (!SkipWhiteSpace())
+          return false;
+      }
+
+      if (terminator == '}') {
+        if (*m_ptr != '"')
+          return false;
+        ++m_ptr;
+        if (!ParseString(true) || !SkipWhiteSpace() || *m_ptr != ':')
+          return false;
+        ++m_ptr;
+      }
+
+      return ParseValue();
+    }
+
+
+    bool OnString(bool name, const char * str, size_t length)
+    {
+      return name ? m_handler.OnMemberName(str, length) : m_handler.OnString(str, length);
+    }
+
+
+    bool ParseString(bool name)
+    {
+      m_scratch.clear();
+      bool copied = false;
+
+      for (;;) {
+        if (!Fill())
+          return false;
+
+        const char * run = m_ptr;
+        m_ptr = ScanStringRun(m_ptr, m_end);
+        if (!copied && m_ptr < m_end && *m_ptr == '"') {
+          // Common case, no escapes and all in buffer, so no copy needed
+          ++m_ptr;
+          return OnString(name, run, m_ptr - run - 1);
+        }
+
+        m_scratch.append(run, m_ptr);
+        copied = true;
+
+        char c;
+        if (!GetChar(c))
+          return false;
+
+        if (c == '"')
+          return OnString(name, m_scratch.data(), m_scratch.size());
+
+        if (c != '\\') {
+          m_scratch += c; // Control characters allowed, as in the istream parser
+          continue;
+        }
+
+        if (!GetChar(c))
+          return false;
+
+        switch (c) {
+          default :
+            return false;
+          case '"' :
+          case '\\' :
+          case '/' :
+            m_scratch += c;
+            break;
+          case 'b' :
+            m_scratch += '\b';
+            break;
+          case 'f' :
+            m_scratch += '\f';
+            break;
+          case 'n' :
+            m_scratch += '\n';
+            break;
+          case 'r' :
+            m_scratch += '\r';
+            break;
+          case 't' :
+            m_scratch += '\t';
+            break;
+          case 'u' :
+            if (!ParseUnicode())
+              return false;
+        }
+      }
+    }
+
+
+    bool ParseHex(unsigned & code)
+    {
+      code = 0;
+      for (int i = 0; i < 4; ++i) {
+        char c;
+        if (!GetChar(c) || !isxdigit((unsigned char)c))
+          return false;
+        code = (code << 4) | (isdigit((unsigned char)c) ? (c - '0') : ((c | 0x20) - 'a' + 10));
+      }
+      return true;
+    }
+
+
+    bool ParseUnicode()
+    {
+      unsigned code;
+      if (!ParseHex(code))
+        return false;
+
+      // Combine UTF-16 surrogate pair, if present
+      if (code >= 0xd800 && code < 0xdc00 && Fill() && *m_ptr == '\\') {
+        char c;
+        ++m_ptr;
+        if (!GetChar(c) || c != 'u')
+          return false;
+        unsigned low;
+        if (!ParseHex(low))
+          return false;
+        if (low >= 0xdc00 && low < 0xe000)
+          code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        else {
+          AppendUTF8(m_scratch, code);
+          code = low;
+        }
+      }
+
+      AppendUTF8(m_scratch, code);
+      return true;
+    }
+
+
+    bool ParseNumber()
+    {
+      char digits[64];
+      size_t length = 0;
+      while (Fill() && length < sizeof(digits)-1) {
+        char c = *m_ptr;
+        if (!isdigit((unsigned char)c) && c != '-' && c != '+' && c != '.' && c != 'e' && c != 'E')
+          break;
+        digits[length++] = c;
+        ++m_ptr;
+      }
+      digits[length] = '\0';
+
+      char * endptr;
+      PJSON::NumberType value = strtold(digits, &endptr);
+      return endptr == digits + length && length > 0 && m_handler.OnNumber(value);
+    }
+
+
+    // Case insensitive, as in the istream parser
+    bool ParseLiteral(const char * literal)
+    {
+      while (*literal != '\0') {
+        char c;
+        if (!GetChar(c) || tolower((unsigned char)c) != *literal++)
+          return false;
+      }
+      return true;
+    }
+
+
+    struct Nesting
+    {
+      Nesting(char terminator) : m_terminator(terminator), m_first(true) { }
+      char m_terminator;
+      bool m_first;
+    };
+
+    PJSON::Handler     & m_handler;
+    istream            * m_stream;
+    std::vector<char>    m_block;
+    const char         * m_start;
+    const char         * m_ptr;
+    const char         * m_end;
+    std::string          m_scratch;
+    std::vector<Nesting> m_nesting;
+};
+
+
+bool PJSON::Parse(const char * data, size_t length, Handler & handler)
+{
+  return PJSONParser(handler, data, length).Parse();
+}
+
+
+bool PJSON::Parse(istream & strm, Handler & handler)
+{
+  return PJSONParser(handler, strm).Parse();
+}
+
+
+// Handler that constructs the tree of PJSON::Base objects
+class PJSONTreeBuilder : public PJSON::Handler
+{
+  public:
+    PJSONTreeBuilder()
+      : m_root(NULL)
+    {
+    }
+
+
+    ~PJSONTreeBuilder()
+    {
+      // If parse failed, there may be duplicate members not in the tree
+      while (!m_nesting.empty())
+        PopNesting();
+      delete m_root;
+    }
+
+
+    PJSON::Base * Detach()
+    {
+      PJSON::Base * root = m_root;
+      m_root = NULL;
+      return root;
+    }
+
+
+    virtual bool OnStartObject()
+    {
+      PJSON::Object * obj = new PJSON::Object;
+      m_nesting.push_back(Nesting(obj, NULL, !Insert(obj)));
+      return true;
+    }
+
+
+    virtual bool OnMemberName(const char * name, size_t length)
+    {
+      m_name = PString(name, length);
+      return true;
+    }
+
+
+    virtual bool OnEndObject()
+    {
+      PopNesting();
+      return true;
+    }
+
+
+    virtual bool OnStartArray()
+    {
+      PJSON::Array * arr = new PJSON::Array;
+      m_nesting.push_back(Nesting(NULL, arr, !Insert(arr)));
+      return true;
+    }
+
+
+    virtual bool OnEndArray()
+    {
+      PopNesting();
+      return true;
+    }
+
+
+    virtual bool OnString(const char * str, size_t length)
+    {
+      return AddValue(new PJSON::String(str, length));
+    }
+
+
+    virtual bool OnNumber(PJSON::NumberType value)
+    {
+      return AddValue(new PJSON::Number(value));
+    }
+
+
+    virtual bool OnBoolean(bool value)
+    {
+      return AddValue(new PJSON::Boolean(value));
+    }
+
+
+    virtual bool OnNull()
+    {
+      return AddValue(new PJSON::Null);
+    }
+
+
+  protected:
+    /* Returns false if value was not added due to a duplicate member name,
+       the first instance is kept, as in the istream parser. */
+    bool Insert(PJSON::Base * value)
+    {
+      if (m_nesting.empty()) {
+        delete m_root;
+        m_root = value;
+        return true;
+      }
+
+      Nesting & nesting = m_nesting.back();
+      if (nesting.m_array != NULL) {
+        nesting.m_array->push_back(value);
+        return true;
+      }
+
+      return nesting.m_object->insert(make_pair(m_name, value)).second;
+    }
+
+
+    bool AddValue(PJSON::Base * value)
+    {
+      if (!Insert(value))
+        delete value;
+      return true;
+    }
+
+
+    void PopNesting()
+    {
+      Nesting & nesting = m_nesting.back();
+      if (nesting.m_orphan) {
+        delete nesting.m_object;
+        delete nesting.m_array;
+      }
+      m_nesting.pop_back();
+    }
+
+
+    struct Nesting
+    {
+      Nesting(PJSON::Object * obj, PJSON::Array * arr, bool orphan)
+        : m_object(obj), m_array(arr), m_orphan(orphan) { }
+      PJSON::Object * m_object;
+      PJSON::Array  * m_array;
+      bool            m_orphan;
+    };
+
+    PJSON::Base        * m_root;
+    PString              m_name;
+    std::vector<Nesting> m_nesting;
+};
+
+
+bool PJSON::FromBuffer(const char * data, size_t length)
+{
+  PJSONTreeBuilder builder;
+  m_valid = Parse(data, length, builder);
+
+  delete m_root;
+  m_root = builder.Detach();
+  if (m_root == NULL) {
+    m_root = new Null;
+    m_valid = false;
+  }
+
+  return m_valid;
+}
+
+
+static void AppendString(std::string & buffer, const char * str, size_t length)
+{
+  static const char Hex[] = "0123456789abcdef";
+
+  const char * end = str + length;
+  buffer += '"';
+  for (;;) {
+    const char * run = str;
+    str = ScanStringRun(str, end);
+    buffer.append(run, str);
+    if (str >= end)
+      break;
+
+    unsigned c = *str++ & 0xff;
+    switch (c) {
+      case '"' :
+        buffer += "\\\"";
+        break;
+      case '\\' :
+        buffer += "\\\\";
+        break;
+      case '\t' :
+        buffer += "\\t";
+        break;
+      case '\r' :
+        buffer += "\\r";
+        break;
+      case '\n' :
+        buffer += "\\n";
+        break;
+      default :
+        char escape[] = { '\\', 'u', '0', '0', Hex[c >> 4], Hex[c & 15] };
+        buffer.append(escape, sizeof(escape));
+    }
+  }
+  buffer += '"';
+}
+
+
+void PJSON::Base::AppendTo(std::string & buffer) const
+{
+  std::ostringstream strm;
+  PrintOn(strm);
+  buffer += strm.str();
+}
+
+
 PJSON::Object::~Object()
 {
   for (iterator it = begin(); it != end(); ++it)
@@ -394,6 +1053,20 @@ void PJSON::Object::PrintOn(ostream & strm) const
 }
 
 
+void PJSON::Object::AppendTo(std::string & buffer) const
+{
+  buffer += '{';
+  for (const_iterator it = begin(); it != end(); ++it) {
+    if (it != begin())
+      buffer += ',';
+    AppendString(buffer, it->first, it->first.GetLength());
+    buffer += ':';
+    it->second->AppendTo(buffer);
+  }
+  buffer += '}';
+}
+
+
 PJSON::Base * PJSON::Object::DeepClone() const
 {
   PJSON::Object * obj = new Object();
@@ -611,6 +1284,18 @@ void PJSON::Array::PrintOn(ostream & strm) const
 }
 
 
+void PJSON::Array::AppendTo(std::string & buffer) const
+{
+  buffer += '[';
+  for (const_iterator it = begin(); it != end(); ++it) {
+    if (it != begin())
+      buffer += ',';
+    (*it)->AppendTo(buffer);
+  }
+  buffer += ']';
+}
+
+
 PJSON::Base * PJSON::Array::DeepClone() const
 {
   PJSON::Array * arr = new Array();
@@ -768,6 +1453,12 @@ void PJSON::String::PrintOn(ostream & strm) const
 }
 
 
+void PJSON::String::AppendTo(std::string & buffer) const
+{
+  AppendString(buffer, *this, GetLength());
+}
+
+
 PJSON::Base * PJSON::String::DeepClone() const
 {
   return new String(GetPointer());
@@ -813,6 +1504,32 @@ void PJSON::Number::PrintOn(ostream & strm) const
 }
 
 
+void PJSON::Number::AppendTo(std::string & buffer) const
+{
+  // Same output as PrintOn() with default ostream precision
+  char str[50];
+  if (m_value < 0) {
+    int64_t intval = (int64_t)m_value;
+    if (intval == m_value) {
+      snprintf(str, sizeof(str), "%lld", (long long)intval);
+      buffer += str;
+      return;
+    }
+  }
+  else {
+    uint64_t uintval = (uint64_t)m_value;
+    if (uintval == m_value) {
+      snprintf(str, sizeof(str), "%llu", (unsigned long long)uintval);
+      buffer += str;
+      return;
+    }
+  }
+
+  snprintf(str, sizeof(str), "%.6Lg", (long double)m_value);
+  buffer += str;
+}
+
+
 PJSON::Base * PJSON::Number::DeepClone() const
 {
   return new Number(m_value);
@@ -864,6 +1581,12 @@ void PJSON::Boolean::PrintOn(ostream & strm) const
 }
 
 
+void PJSON::Boolean::AppendTo(std::string & buffer) const
+{
+  buffer += m_value ? "true" : "false";
+}
+
+
 PJSON::Base * PJSON::Boolean::DeepClone() const
 {
   return new Boolean(m_value);
@@ -894,6 +1617,12 @@ void PJSON::Null::PrintOn(ostream & strm) const
 }
 
 
+void PJSON::Null::AppendTo(std::string & buffer) const
+{
+  buffer += "null";
+}
+
+
 PJSON::Base * PJSON::Null::DeepClone() const
 {
   return new Null();
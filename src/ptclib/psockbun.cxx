@@ -558,6 +558,7 @@ void PMonitoredSockets::ReadFromSocketList(PSocket::SelectList & readers,
 
   socket = NULL;
   param.m_lastCount = 0;
+  param.m_batchCount = 0;
 
   UnlockReadWrite();
 
@@ -596,7 +597,18 @@ void PMonitoredSockets::ReadFromSocketList(PSocket::SelectList & readers,
 
   socket = (PUDPSocket *)&readers.front();
 
-  bool ok = socket->ReadFrom(param.m_buffer, param.m_length, param.m_addr, param.m_port);
+  bool ok;
+  if (param.m_batch == NULL)
+    ok = socket->ReadFrom(param.m_buffer, param.m_length, param.m_addr, param.m_port);
+  else {
+    /* Socket is known to be readable, so this does not block, and drains as
+       much as is waiting in one go where the platform allows. */
+    ok = socket->ReadFromBatch(param.m_batch, param.m_batchSize, param.m_batchCount);
+    if (ok) {
+      param.m_addr = param.m_batch[0].m_ipAndPort.GetAddress();
+      param.m_port = param.m_batch[0].m_ipAndPort.GetPort();
+    }
+  }
   param.m_lastCount = socket->GetLastReadCount();
   param.m_errorCode = socket->GetErrorCode(PChannel::LastReadError);
   param.m_errorNumber = socket->GetErrorNumber(PChannel::LastReadError);
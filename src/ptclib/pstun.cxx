@@ -59,8 +59,6 @@
 #define IS_SUCCESS_RESP(msg_type)  (((msg_type) & 0x0110) == 0x0100)
 #define IS_ERR_RESP(msg_type)      (((msg_type) & 0x0110) == 0x0110)
 
-static atomic<bool> Crc32Table_initialised;
-
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -773,19 +771,24 @@ unsigned PSTUNMessage::CheckMessageIntegrity(const BYTE * credentialsHashPtr, PI
 
 void PSTUNMessage::CalculateMessageIntegrity(const BYTE * credentialsHashPtr, PINDEX credentialsHashLen,
                                              PSTUNMessageIntegrity * mi, BYTE * hmacPtr, PINDEX hmacSize) const
+{
+  PHMAC_SHA1 hmac;
+  hmac.SetKey(credentialsHashPtr, credentialsHashLen);
+  CalculateMessageIntegrity(hmac, (BYTE *)theArray, (PINDEX)((char *)mi - theArray), hmacPtr, hmacSize);
+}
+
+
+void PSTUNMessage::CalculateMessageIntegrity(PHMAC & hmac, BYTE * data, PINDEX length, BYTE * hmacPtr, PINDEX hmacSize)
 {
   // calculate hash up to, but not including, MESSAGE_INTEGRITY attribute itself
   // Note the value used for msgLength is prior to things like FINGERPRINT, so need to
   // change it back temporarily.
-  WORD checkLength = (WORD)((char *)mi - theArray);
-  PSTUNMessageHeader * hdr = (PSTUNMessageHeader *)theArray;
+  PSTUNMessageHeader * hdr = (PSTUNMessageHeader *)data;
   WORD oldLength = hdr->msgLength;
-  hdr->msgLength = checkLength - sizeof(PSTUNMessageHeader) + sizeof(PSTUNMessageIntegrity);
+  hdr->msgLength = (WORD)(length - sizeof(PSTUNMessageHeader) + sizeof(PSTUNMessageIntegrity));
 
-  PHMAC_SHA1 hmac;
-  hmac.SetKey(credentialsHashPtr, credentialsHashLen);
-  PHMAC_SHA1::Result result;
-  hmac.Process((BYTE *)theArray, checkLength, result);
+  PHMAC::Result result;
+  hmac.Process(data, length, result);
 
   hdr->msgLength = oldLength;
 
@@ -813,10 +816,18 @@ bool PSTUNMessage::CheckFingerprint(bool required) const
 
 DWORD PSTUNMessage::CalculateFingerprint(PSTUNFingerprint * fp) const
 {
-  static DWORD Crc32Table[256];
+  return CalculateFingerprint((const BYTE *)theArray, (PINDEX)((const BYTE *)fp - (const BYTE *)theArray));
+}
+
+
+// Static initialisation, so table is complete before any thread can use it
+static struct PSTUNCrc32Table
+{
+  DWORD m_table[256];
 
-  if (!Crc32Table_initialised.exchange(true)) {
-    for (PINDEX i = 0; i < PARRAYSIZE(Crc32Table); ++i) {
+  PSTUNCrc32Table()
+  {
+    for (PINDEX i = 0; i < PARRAYSIZE(m_table); ++i) {
       DWORD c = i;
       for (PINDEX j = 0; j < 8; ++j) {
         if (c & 1)
@@ -824,15 +835,19 @@ DWORD PSTUNMessage::CalculateFingerprint(PSTUNFingerprint * fp) const
         else
           c >>= 1;
       }
-      Crc32Table[i] = c;
+      m_table[i] = c;
     }
   }
+} const Crc32Table;
 
+
+DWORD PSTUNMessage::CalculateFingerprint(const BYTE * ptr, PINDEX length)
+{
   // calculate hash up to, but not including, FINGERPRINT attribute
   DWORD c = 0xFFFFFFFF;
-  const BYTE * ptr = (BYTE *)theArray;
-  while (ptr < (BYTE *)fp)
-    c = Crc32Table[(c ^ *ptr++) & 0xFF] ^ (c >> 8);
+  const BYTE * end = ptr + length;
+  while (ptr < end)
+    c = Crc32Table.m_table[(c ^ *ptr++) & 0xFF] ^ (c >> 8);
 
   return c ^ 0xffffffff ^ 0x5354554e;
 }
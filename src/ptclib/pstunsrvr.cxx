@@ -18,6 +18,8 @@
 #define new PNEW
 #define PTraceModule() "STUNSrvr"
 
+#define RFC5389_MAGIC_COOKIE  0x2112A442  // As in pstun.cxx
+
 
 //////////////////////////////////////////////////
 
@@ -43,6 +45,282 @@ ostream & operator<<(ostream & strm, const PSTUNServer::SocketInfo & info)
 }
 
 
+//////////////////////////////////////////////////
+// Multi-threaded mode
+
+struct PSTUNServer::Worker
+{
+  enum {
+    MaxRequestSize = 1500,
+    MaxResponseSize = 128,
+    IntegrityLength = 20 // SHA-1
+  };
+
+  Worker(PSTUNServer & server, unsigned batchSize)
+    : m_server(server)
+    , m_thread(NULL)
+    , m_running(true)
+    , m_buffers(batchSize * (MaxRequestSize + MaxResponseSize))
+    , m_requests(batchSize)
+    , m_responses(batchSize)
+    , m_requestCount(0)
+    , m_fastCount(0)
+    , m_slowCount(0)
+    , m_batchCount(0)
+    , m_sendErrorCount(0)
+  {
+    for (unsigned i = 0; i < batchSize; ++i) {
+      m_requests[i].m_buffer = &m_buffers[i * MaxRequestSize];
+      m_requests[i].m_length = MaxRequestSize;
+      m_responses[i].m_buffer = &m_buffers[batchSize * MaxRequestSize + i * MaxResponseSize];
+    }
+  }
+
+
+  ~Worker()
+  {
+    delete m_thread;
+#if P_SSL
+    for (HMACCache::iterator it = m_hmacCache.begin(); it != m_hmacCache.end(); ++it)
+      delete it->second;
+#endif
+  }
+
+
+  bool Open(const PIPSocketAddressAndPort & binding)
+  {
+    if (!m_socket.Listen(binding.GetAddress(), 0, binding.GetPort(), PSocket::CanReusePort))
+      return false;
+
+    // Timeout so thread can notice it is being stopped
+    m_socket.SetReadTimeout(500);
+    m_socketInfo = SocketInfo(&m_socket);
+    return true;
+  }
+
+
+  void Start(unsigned index)
+  {
+    m_thread = new PThreadObj<Worker>(*this, &Worker::ThreadMain, false, psprintf("STUN:%u", index));
+  }
+
+
+  void Stop()
+  {
+    m_running = false;
+    if (m_thread != NULL)
+      m_thread->WaitForTermination();
+  }
+
+
+  void ThreadMain()
+  {
+    PTRACE(4, &m_server, PTraceModule(), "Worker started on " << m_socketInfo);
+
+    while (m_running) {
+      PINDEX requestCount;
+      if (!m_socket.ReadFromBatch(m_requests.data(), m_requests.size(), requestCount)) {
+        if (m_socket.GetErrorCode(PChannel::LastReadError) == PChannel::Timeout)
+          continue;
+        // ignore read errors - they are likely to be connection
+        // refused ICMP messages from symmetric NATs
+        if (m_socket.IsOpen())
+          continue;
+        PTRACE(2, &m_server, PTraceModule(), "Worker socket closed: " << m_socket.GetErrorText(PChannel::LastReadError));
+        break;
+      }
+
+      ++m_batchCount;
+      m_requestCount += requestCount;
+
+      PINDEX responseCount = 0;
+      for (PINDEX i = 0; i < requestCount; ++i) {
+        if (ProcessFast(m_requests[i], m_responses[responseCount]))
+          ++responseCount;
+        else
+          ProcessSlow(m_requests[i]);
+      }
+
+      if (responseCount > 0) {
+        PINDEX sent;
+        if (!m_socket.WriteToBatch(m_responses.data(), responseCount, sent))
+          sent = 0;
+        m_fastCount += sent;
+        m_sendErrorCount += responseCount - sent;
+      }
+    }
+
+    PTRACE(4, &m_server, PTraceModule(), "Worker ended on " << m_socketInfo);
+  }
+
+
+  // Answer a plain binding request directly from/to the raw datagram buffers
+  bool ProcessFast(const PIPDatagramSocket::Datagram & request, PIPDatagramSocket::Datagram & response)
+  {
+    if (request.m_truncated ||
+        request.m_lastCount < (PINDEX)sizeof(PSTUNMessageHeader) ||
+        request.m_ipAndPort.GetAddress().GetVersion() != 4)
+      return false;
+
+    BYTE * data = (BYTE *)request.m_buffer;
+    const PSTUNMessageHeader * header = (const PSTUNMessageHeader *)data;
+    PINDEX length = request.m_lastCount;
+    if (header->msgType != PSTUNMessage::BindingRequest ||
+        *(const PUInt32b *)header->transactionId != RFC5389_MAGIC_COOKIE ||
+        header->msgLength + sizeof(PSTUNMessageHeader) != (size_t)length)
+      return false;
+
+    const char * userName = NULL;
+    PINDEX userNameLength = 0;
+    PINDEX integrityOffset = 0;
+
+    PINDEX offset = sizeof(PSTUNMessageHeader);
+    while (offset < length) {
+      if (offset + (PINDEX)sizeof(PSTUNAttribute) > length)
+        return false;
+
+      const PSTUNAttribute & attr = *(const PSTUNAttribute *)(data + offset);
+      PINDEX next = offset + 4 * ((sizeof(PSTUNAttribute) + attr.length + 3) / 4);
+      if (next > length)
+        return false;
+
+      switch (attr.type) {
+        case PSTUNAttribute::USERNAME :
+          userName = (const char *)(data + offset + sizeof(PSTUNAttribute));
+          userNameLength = attr.length;
+          break;
+
+        case PSTUNAttribute::MESSAGE_INTEGRITY :
+          if (attr.length != IntegrityLength)
+            return false;
+          if (integrityOffset == 0)
+            integrityOffset = offset;
+          break;
+
+        case PSTUNAttribute::FINGERPRINT :
+          if (next != length ||
+              attr.length != sizeof(PSTUNFingerprintCRC) ||
+              ((const PSTUNFingerprint &)attr).m_crc != PSTUNMessage::CalculateFingerprint(data, offset))
+            return false;
+          break;
+
+        case PSTUNAttribute::ICE_CONTROLLED :
+        case PSTUNAttribute::ICE_CONTROLLING :
+          // Role conflict resolution changes server state, so do it the slow way
+          if (m_server.m_iceRole != PSTUN::NoIceRole)
+            return false;
+          break;
+
+        case PSTUNAttribute::PRIORITY :
+        case PSTUNAttribute::USE_CANDIDATE :
+        case PSTUNAttribute::ICE_NETWORK_COST :
+          break;
+
+        default :
+          return false;
+      }
+
+      offset = next;
+    }
+
+    // Any authentication failure goes the slow way, to get the correct error response
+    if (!m_server.m_password.IsEmpty()) {
+      if (userName == NULL || !m_server.IsUserNameValid(PString(userName, userNameLength)))
+        return false;
+
+#if P_SSL
+      if (integrityOffset == 0)
+        return false;
+
+      BYTE hmac[IntegrityLength];
+      PSTUNMessage::CalculateMessageIntegrity(GetHMAC(), data, integrityOffset, hmac, sizeof(hmac));
+      if (memcmp(hmac, data + integrityOffset + sizeof(PSTUNAttribute), sizeof(hmac)) != 0)
+        return false;
+#endif // P_SSL
+    }
+
+    // Build the response
+    BYTE * out = (BYTE *)response.m_buffer;
+    PSTUNMessageHeader * responseHeader = (PSTUNMessageHeader *)out;
+    responseHeader->msgType = PSTUNMessage::BindingResponse;
+    memcpy(responseHeader->transactionId, header->transactionId, sizeof(header->transactionId));
+    length = sizeof(PSTUNMessageHeader);
+
+    PSTUNAddressAttribute mappedAddress(PSTUNAttribute::XOR_MAPPED_ADDRESS, request.m_ipAndPort);
+    memcpy(out + length, &mappedAddress, sizeof(mappedAddress));
+    length += sizeof(mappedAddress);
+
+    PSTUNFingerprint fingerprint;
+
+#if P_SSL
+    if (!m_server.m_password.IsEmpty()) {
+      PSTUNMessageIntegrity integrity;
+      responseHeader->msgLength = (WORD)(length + sizeof(integrity) + sizeof(fingerprint) - sizeof(PSTUNMessageHeader));
+      PSTUNMessage::CalculateMessageIntegrity(GetHMAC(), out, length, integrity.m_hmac, sizeof(integrity.m_hmac));
+      memcpy(out + length, &integrity, sizeof(integrity));
+      length += sizeof(integrity);
+    }
+#endif // P_SSL
+
+    responseHeader->msgLength = (WORD)(length + sizeof(fingerprint) - sizeof(PSTUNMessageHeader));
+    fingerprint.m_crc = PSTUNMessage::CalculateFingerprint(out, length);
+    memcpy(out + length, &fingerprint, sizeof(fingerprint));
+    length += sizeof(fingerprint);
+
+    response.m_length = length;
+    response.m_ipAndPort = request.m_ipAndPort;
+    return true;
+  }
+
+
+  void ProcessSlow(const PIPDatagramSocket::Datagram & request)
+  {
+    ++m_slowCount;
+
+    PSTUNMessage message((const BYTE *)request.m_buffer, request.m_lastCount, request.m_ipAndPort);
+
+    // The usual handling of requests was not written to be multi-threaded
+    PWaitAndSignal lock(m_server.m_workerMutex);
+    m_server.OnReceiveMessage(message, m_socketInfo);
+  }
+
+
+#if P_SSL
+  // Keyed HMAC per credential, so the key schedule is not recalculated for every message
+  PHMAC & GetHMAC()
+  {
+    HMACCache::iterator it = m_hmacCache.find(m_server.m_password);
+    if (it != m_hmacCache.end())
+      return *it->second;
+
+    PHMAC_SHA1 * hmac = new PHMAC_SHA1;
+    hmac->SetKey(m_server.m_password);
+    m_hmacCache[m_server.m_password] = hmac;
+    return *hmac;
+  }
+
+  typedef std::map<PBYTEArray, PHMAC_SHA1 *> HMACCache;
+  HMACCache m_hmacCache;
+#endif // P_SSL
+
+  PSTUNServer                            & m_server;
+  PUDPSocket                               m_socket;
+  SocketInfo                               m_socketInfo;
+  PThread                                * m_thread;
+  atomic<bool>                             m_running;
+  std::vector<BYTE>                        m_buffers;
+  std::vector<PIPDatagramSocket::Datagram> m_requests;
+  std::vector<PIPDatagramSocket::Datagram> m_responses;
+
+  // Only written by the worker thread, so no contention
+  atomic<uint64_t> m_requestCount;
+  atomic<uint64_t> m_fastCount;
+  atomic<uint64_t> m_slowCount;
+  atomic<uint64_t> m_batchCount;
+  atomic<uint64_t> m_sendErrorCount;
+};
+
+
 //////////////////////////////////////////////////
 
 PSTUNServer::PSTUNServer()
@@ -50,6 +328,12 @@ PSTUNServer::PSTUNServer()
 {
 }
 
+
+PSTUNServer::~PSTUNServer()
+{
+  Close();
+}
+
 bool PSTUNServer::Open(WORD port)
 {
   Close();
@@ -199,11 +483,17 @@ PSTUNServer::SocketInfo * PSTUNServer::CreateAndAddSocket(const PIPSocket::Addre
 
 bool PSTUNServer::IsOpen() const 
 { 
-  return m_sockets.GetSize() > 0; 
+  return m_sockets.GetSize() > 0 || !m_workers.empty();
 }
 
 bool PSTUNServer::Close()
 {
+  for (size_t i = 0; i < m_workers.size(); ++i)
+    m_workers[i]->Stop();
+  for (size_t i = 0; i < m_workers.size(); ++i)
+    delete m_workers[i];
+  m_workers.clear();
+
   m_sockets.AllowDeleteObjects(m_autoDelete);
   m_sockets.SetSize(0);
   m_selectList.SetSize(0);
@@ -303,20 +593,11 @@ bool PSTUNServer::OnBindingRequest(const PSTUNMessage & request, const PSTUNServ
       goto sendResponse;
     }
 
-    if (userAttr->GetString() != m_userName) {
-      /* If not a pure match, then we make some assumptions for ICE operation, as per
-         https://tools.ietf.org/html/rfc5245#section-7.2 */
-      PString theirLeft, theirRight, ourLeft, ourRight;
-      if (!userAttr->GetString().Split(':', theirLeft, theirRight) ||
-          !m_userName.Split(':', ourLeft, ourRight) ||
-          theirLeft != ourLeft ||
-          (!ourRight.IsEmpty() && theirRight != ourRight))
-      {
-        PTRACE(2, "Incorrect USERNAME attribute in " << request << " on interface " << socketInfo.m_socketAddress
-               << ", got \"" << userAttr->GetString() << "\", expected \"" << m_userName << '"');
-        response.SetErrorType(436, request.GetTransactionID());
-        goto sendResponse;
-      }
+    if (!IsUserNameValid(userAttr->GetString())) {
+      PTRACE(2, "Incorrect USERNAME attribute in " << request << " on interface " << socketInfo.m_socketAddress
+             << ", got \"" << userAttr->GetString() << "\", expected \"" << m_userName << '"');
+      response.SetErrorType(436, request.GetTransactionID());
+      goto sendResponse;
     }
 
 #if P_SSL
@@ -452,4 +733,112 @@ void PSTUNServer::OnBindingResponse(const PSTUNMessage &, PSTUNMessage &)
 }
 
 
+bool PSTUNServer::IsUserNameValid(const PString & userName) const
+{
+  if (userName == m_userName)
+    return true;
+
+  /* If not a pure match, then we make some assumptions for ICE operation, as per
+     https://tools.ietf.org/html/rfc5245#section-7.2 */
+  PString theirLeft, theirRight, ourLeft, ourRight;
+  return userName.Split(':', theirLeft, theirRight) &&
+         m_userName.Split(':', ourLeft, ourRight) &&
+         theirLeft == ourLeft &&
+         (ourRight.IsEmpty() || theirRight == ourRight);
+}
+
+
+bool PSTUNServer::OpenWorkers(const PIPSocketAddressAndPort & binding, unsigned workers, unsigned batchSize)
+{
+  Close();
+
+  if (workers == 0)
+    workers = PThread::GetNumProcessors();
+  if (batchSize == 0)
+    batchSize = 1;
+
+  PIPSocketAddressAndPort actualBinding = binding;
+  for (unsigned i = 0; i < workers; ++i) {
+    Worker * worker = new Worker(*this, batchSize);
+    if (!worker->Open(actualBinding)) {
+      PTRACE(2, "Cannot open worker socket on " << actualBinding << ": " << worker->m_socket.GetErrorText());
+      delete worker;
+      Close();
+      return false;
+    }
+
+    // If binding to port zero, the rest use the port allocated to the first.
+    actualBinding = worker->m_socketInfo.m_socketAddress;
+    m_workers.push_back(worker);
+  }
+
+  for (unsigned i = 0; i < workers; ++i)
+    m_workers[i]->Start(i);
+
+  PTRACE(3, "Listening on " << actualBinding << " with " << workers << " workers, batch size " << batchSize);
+  return true;
+}
+
+
+PIPSocketAddressAndPort PSTUNServer::GetWorkerAddress() const
+{
+  return m_workers.empty() ? PIPSocketAddressAndPort() : m_workers.front()->m_socketInfo.m_socketAddress;
+}
+
+
+PSTUNServer::WorkerStatistics::WorkerStatistics()
+  : m_requests(0)
+  , m_fastResponses(0)
+  , m_slowResponses(0)
+  , m_batches(0)
+  , m_sendErrors(0)
+{
+}
+
+
+PSTUNServer::WorkerStatistics & PSTUNServer::WorkerStatistics::operator+=(const WorkerStatistics & other)
+{
+  m_requests      += other.m_requests;
+  m_fastResponses += other.m_fastResponses;
+  m_slowResponses += other.m_slowResponses;
+  m_batches       += other.m_batches;
+  m_sendErrors    += other.m_sendErrors;
+  return *this;
+}
+
+
+void PSTUNServer::WorkerStatistics::PrintOn(ostream & strm) const
+{
+  strm << "requests=" << m_requests
+       << " fast=" << m_fastResponses
+       << " slow=" << m_slowResponses
+       << " batches=" << m_batches
+       << " errors=" << m_sendErrors;
+}
+
+
+PSTUNServer::WorkerStatistics PSTUNServer::GetWorkerStatistics(unsigned index) const
+{
+  WorkerStatistics stats;
+  if (index < m_workers.size()) {
+    const Worker & worker = *m_workers[index];
+    stats.m_requests      = worker.m_requestCount;
+    stats.m_fastResponses = worker.m_fastCount;
+    stats.m_slowResponses = worker.m_slowCount;
+    stats.m_batches       = worker.m_batchCount;
+    stats.m_sendErrors    = worker.m_sendErrorCount;
+  }
+  return stats;
+}
+
+
+PSTUNServer::WorkerStatistics PSTUNServer::GetWorkerStatistics() const
+{
+  WorkerStatistics stats;
+  for (unsigned i = 0; i < m_workers.size(); ++i)
+    stats += GetWorkerStatistics(i);
+  return stats;
+}
+
+
 #endif // P_STUNSRVR
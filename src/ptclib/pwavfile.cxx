@@ -118,6 +118,7 @@ PWAVFile::~PWAVFile()
   Close();
   delete m_autoConverter;
   delete m_formatHandler;
+  delete m_resampler;
   PTRACE(4, "Destroyed " << this);
 }
 
@@ -137,6 +138,7 @@ void PWAVFile::Construct(OpenMode mode)
 
   m_readSampleRate = m_readChannels = 0;  // Zero means automatically set in ProcessHeader
   m_readBufCount = m_readBufPos = 0;
+  m_resampler = NULL;
 }
 
 
@@ -232,20 +234,35 @@ PBoolean PWAVFile::Read(void * buf, PINDEX len)
     return false;
   }
 
+  if (m_resampler == NULL)
+    m_resampler = new PPCMResampler(m_wavFmtChunk.sampleRate, m_wavFmtChunk.numChannels, m_readSampleRate, m_readChannels);
+  else if (m_resampler->GetSrcRate() != m_wavFmtChunk.sampleRate ||
+           m_resampler->GetSrcChannels() != m_wavFmtChunk.numChannels ||
+           m_resampler->GetDstRate() != m_readSampleRate ||
+           m_resampler->GetDstChannels() != m_readChannels)
+    m_resampler->Open(m_wavFmtChunk.sampleRate, m_wavFmtChunk.numChannels, m_readSampleRate, m_readChannels);
+
   if (m_readBufPos >= m_readBufCount) {
     if (!m_readBuffer.SetSize(10 * m_wavFmtChunk.sampleRate*m_wavFmtChunk.numChannels)) // 10 seconds worth
       return false;
     void * ptr = m_readBuffer.GetPointer();
     PINDEX sz = m_readBuffer.GetSize()*sizeof(short);
-    if (!(m_autoConverter != NULL ? m_autoConverter->Read(*this, ptr, sz) : RawRead(ptr, sz)))
-      return false;
+    if (!(m_autoConverter != NULL ? m_autoConverter->Read(*this, ptr, sz) : RawRead(ptr, sz))) {
+      // End of file, get the last of the samples held in the filter
+      if (GetErrorCode(LastReadError) != NoError)
+        return false;
+      m_resampler->Flush((short *)buf, len);
+      if (len == 0)
+        return false;
+      SetLastReadCount(len);
+      return true;
+    }
     m_readBufCount = GetLastReadCount()/sizeof(short);
     m_readBufPos = 0;
   }
 
   PINDEX srcSize = (m_readBufCount - m_readBufPos)*sizeof(short);
-  PSound::ConvertPCM(&m_readBuffer[m_readBufPos], srcSize, m_wavFmtChunk.sampleRate, m_wavFmtChunk.numChannels,
-                     (short *)buf, len, m_readSampleRate, m_readChannels);
+  m_resampler->Convert(&m_readBuffer[m_readBufPos], srcSize, (short *)buf, len);
   SetLastReadCount(len);
   m_readBufPos += srcSize / sizeof(short);
   return true;
@@ -334,6 +351,11 @@ PBoolean PWAVFile::SetLength(off_t)
 
 PBoolean PWAVFile::SetPosition(off_t pos, FilePositionOrigin origin)
 {
+  // Discard any rate/channel conversion state for old position
+  m_readBufCount = m_readBufPos = 0;
+  if (m_resampler != NULL)
+    m_resampler->Reset();
+
   if (m_autoConverter != NULL)
     return m_autoConverter->SetPosition(*this, pos, origin);
 
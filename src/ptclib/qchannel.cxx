@@ -37,7 +37,12 @@
 
 /////////////////////////////////////////////////////////
 
-PQueueChannel::PQueueChannel(PINDEX size)
+PQueueChannel::PQueueChannel(PINDEX size, Modes mode)
+  : m_mode(mode)
+  , m_writeCount(0)
+  , m_readCount(0)
+  , m_readerWaiting(false)
+  , m_writerWaiting(false)
 {
   if (size > 0) {
     queueBuffer = new BYTE[size];
@@ -55,10 +60,17 @@ PQueueChannel::PQueueChannel(PINDEX size)
 PQueueChannel::~PQueueChannel()
 {
   Close();
+  delete [] queueBuffer;
 }
 
 
 PBoolean PQueueChannel::Open(PINDEX size)
+{
+  return Open(size, m_mode);
+}
+
+
+bool PQueueChannel::Open(PINDEX size, Modes mode)
 {
   Close();
 
@@ -67,11 +79,15 @@ PBoolean PQueueChannel::Open(PINDEX size)
 
   mutex.Wait();
 
+  delete [] queueBuffer;
   if ((queueBuffer = new BYTE[size]) == NULL)
     return false;
 
   queueSize = size;
   queueLength = enqueuePos = dequeuePos = 0;
+  m_mode = mode;
+  m_writeCount = 0;
+  m_readCount = 0;
   os_handle = 1;
 
   mutex.Signal();
@@ -86,9 +102,11 @@ PBoolean PQueueChannel::Close()
     return false;
 
   mutex.Wait();
-  if (queueBuffer != NULL)
+  // Lock free modes may still be using the buffer, it is released on destruction or re-open
+  if (m_mode == LockedMode) {
     delete [] queueBuffer;
-  queueBuffer = NULL;
+    queueBuffer = NULL;
+  }
   os_handle = -1;
   mutex.Signal();
   unempty.Signal();
@@ -99,6 +117,33 @@ PBoolean PQueueChannel::Close()
 
 PBoolean PQueueChannel::Read(void * buf, PINDEX count)
 {
+  if (m_mode != LockedMode) {
+    SetLastReadCount(0);
+    if (count == 0)
+      return IsOpen();
+
+    PINDEX len = count;
+    const BYTE * data = ReadPeek(len);
+    if (data == NULL)
+      return false;
+
+    memcpy(buf, data, len);
+    ReadConsume(len);
+    PINDEX total = len;
+
+    // Get any more after the queue wrapped around, without blocking
+    if (total < count && m_writeCount != m_readCount) {
+      len = count - total;
+      data = ReadPeek(len);
+      memcpy((BYTE *)buf + total, data, len);
+      ReadConsume(len);
+      total += len;
+    }
+
+    SetLastReadCount(total);
+    return true;
+  }
+
   mutex.Wait();
 
   SetLastReadCount(0);
@@ -113,7 +158,9 @@ PBoolean PQueueChannel::Read(void * buf, PINDEX count)
   /* If queue is empty then we should block for the time specifed in the
       read timeout.
     */
+  bool waited = false;
   while (queueLength == 0) {
+    waited = true;
 
     // unlock the data
     mutex.Signal();
@@ -131,6 +178,7 @@ PBoolean PQueueChannel::Read(void * buf, PINDEX count)
     // check if the channel is still open
     if (CheckNotOpen()) {
       mutex.Signal();
+      unempty.Signal(); // Pass on to any other blocked readers
       return SetErrorValues(NotOpen, EBADF, LastReadError);
     }
   }
@@ -176,6 +224,11 @@ PBoolean PQueueChannel::Read(void * buf, PINDEX count)
     queueLength -= copyLen;
   }
 
+  // There is only one signal when the queue becomes unempty, so if we were
+  // woken by it, pass it on to any other blocked reader if data remains.
+  if (waited && queueLength > 0)
+    unempty.Signal();
+
   // unlock the buffer
   mutex.Signal();
 
@@ -185,6 +238,31 @@ PBoolean PQueueChannel::Read(void * buf, PINDEX count)
 
 PBoolean PQueueChannel::Write(const void * buf, PINDEX count)
 {
+  if (m_mode != LockedMode) {
+    SetLastWriteCount(0);
+
+    if (m_mode == MultiProducerMode)
+      m_producerMutex.Wait();
+
+    const BYTE * buffer = (const BYTE *)buf;
+    PINDEX written = 0;
+    while (written < count) {
+      PINDEX len = count - written;
+      BYTE * space = InternalWriteReserve(len);
+      if (space == NULL)
+        break;
+      memcpy(space, buffer + written, len);
+      InternalWriteCommit(len);
+      written += len;
+    }
+
+    if (m_mode == MultiProducerMode)
+      m_producerMutex.Signal();
+
+    SetLastWriteCount(written);
+    return written == count;
+  }
+
   mutex.Wait();
 
   SetLastWriteCount(0);
@@ -196,11 +274,13 @@ PBoolean PQueueChannel::Write(const void * buf, PINDEX count)
 
   const BYTE * buffer = (BYTE *)buf;
   PINDEX written = 0;
+  bool waited = false;
   while (count > 0) {
     /* If queue is full then we should block for the time specifed in the
         write timeout.
       */
     while (queueLength == queueSize) {
+      waited = true;
       mutex.Signal();
 
       PTRACE_IF(6, writeTimeout > 0, "QChan\tBlocking on full queue");
@@ -213,6 +293,7 @@ PBoolean PQueueChannel::Write(const void * buf, PINDEX count)
 
       if (!IsOpen()) {
         mutex.Signal();
+        unfull.Signal(); // Pass on to any other blocked writers
         return SetErrorValues(NotOpen, EBADF, LastWriteError);
       }
     }
@@ -257,6 +338,10 @@ PBoolean PQueueChannel::Write(const void * buf, PINDEX count)
     }
   }
 
+  // As for Read(), pass on the single unfull signal to other blocked writers
+  if (waited && queueLength < queueSize)
+    unfull.Signal();
+
   mutex.Signal();
 
   SetLastWriteCount(written);
@@ -264,4 +349,145 @@ PBoolean PQueueChannel::Write(const void * buf, PINDEX count)
 }
 
 
+BYTE * PQueueChannel::WriteReserve(PINDEX & len)
+{
+  if (!PAssert(m_mode != LockedMode, PUnsupportedFeature))
+    return NULL;
+
+  if (m_mode == MultiProducerMode)
+    m_producerMutex.Wait();
+
+  BYTE * space = InternalWriteReserve(len);
+
+  if (space == NULL && m_mode == MultiProducerMode)
+    m_producerMutex.Signal();
+
+  return space;
+}
+
+
+void PQueueChannel::WriteCommit(PINDEX len)
+{
+  if (!PAssert(m_mode != LockedMode, PUnsupportedFeature))
+    return;
+
+  InternalWriteCommit(len);
+
+  if (m_mode == MultiProducerMode)
+    m_producerMutex.Signal();
+}
+
+
+BYTE * PQueueChannel::InternalWriteReserve(PINDEX & len)
+{
+  for (;;) {
+    if (CheckNotOpen())
+      return NULL;
+
+    PUInt64 head = m_writeCount;
+    PINDEX space = queueSize - (PINDEX)(head - m_readCount);
+    if (space > 0) {
+      // Limit to the linear part of memory
+      PINDEX pos = (PINDEX)(head % queueSize);
+      if (space > queueSize - pos)
+        space = queueSize - pos;
+      if (len == 0 || len > space)
+        len = space;
+      return queueBuffer + pos;
+    }
+
+    if (!InternalWaitWritable())
+      return NULL;
+  }
+}
+
+
+void PQueueChannel::InternalWriteCommit(PINDEX len)
+{
+  m_writeCount += len;
+
+  // Only wake reader if it is blocked on an empty queue
+  if (m_readerWaiting) {
+    PTRACE(6, "QChan\tSignalling queue no longer empty");
+    unempty.Signal();
+  }
+}
+
+
+const BYTE * PQueueChannel::ReadPeek(PINDEX & len)
+{
+  if (!PAssert(m_mode != LockedMode, PUnsupportedFeature))
+    return NULL;
+
+  for (;;) {
+    if (CheckNotOpen())
+      return NULL;
+
+    PUInt64 tail = m_readCount;
+    PINDEX available = (PINDEX)(m_writeCount - tail);
+    if (available > 0) {
+      // Limit to the linear part of memory
+      PINDEX pos = (PINDEX)(tail % queueSize);
+      if (available > queueSize - pos)
+        available = queueSize - pos;
+      if (len == 0 || len > available)
+        len = available;
+      return queueBuffer + pos;
+    }
+
+    if (!InternalWaitReadable())
+      return NULL;
+  }
+}
+
+
+void PQueueChannel::ReadConsume(PINDEX len)
+{
+  if (!PAssert(m_mode != LockedMode, PUnsupportedFeature))
+    return;
+
+  m_readCount += len;
+
+  // Only wake writer if it is blocked on a full queue
+  if (m_writerWaiting) {
+    PTRACE(6, "QChan\tSignalling queue no longer full");
+    unfull.Signal();
+  }
+}
+
+
+bool PQueueChannel::InternalWaitReadable()
+{
+  /* Flag we are waiting, then check again, so a writer committing after our
+     first look is sure to see the flag and signal us. */
+  bool ok = true;
+  m_readerWaiting = true;
+  if (m_writeCount == m_readCount && IsOpen()) {
+    PTRACE_IF(6, readTimeout > 0, "QChan\tBlocking on empty queue");
+    if (!unempty.Wait(readTimeout)) {
+      PTRACE(6, "QChan\tRead timeout on empty queue");
+      ok = SetErrorValues(Timeout, ETIMEDOUT, LastReadError);
+    }
+  }
+  m_readerWaiting = false;
+  return ok;
+}
+
+
+bool PQueueChannel::InternalWaitWritable()
+{
+  bool ok = true;
+  m_writerWaiting = true;
+  if ((PINDEX)(m_writeCount - m_readCount) == queueSize && IsOpen()) {
+    PTRACE_IF(6, writeTimeout > 0, "QChan\tBlocking on full queue");
+    if (!unfull.Wait(writeTimeout)) {
+      PTRACE(6, "QChan\tWrite timeout on full queue");
+      ok = SetErrorValues(Timeout, ETIMEDOUT, LastWriteError);
+    }
+  }
+  m_writerWaiting = false;
+  return ok;
+}
+
+
 // End of File ///////////////////////////////////////////////////////////////
@@ -0,0 +1,439 @@
+/*
+ * sockevent.cxx
+ *
+ * Persistent socket readiness event loop
+ *
+ * Portable Windows Library
+ *
+ * Copyright (C) 2024 Vox Lucida Pty. Ltd.
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is Portable Windows Library.
+ *
+ * The Initial Developer of the Original Code is Vox Lucida Pty. Ltd.
+ *
+ * Contributor(s): ______________________________________.
+ */
+
+#ifdef __GNUC__
+#pragma implementation "sockevent.h"
+#endif
+
+#include <ptlib.h>
+#include <ptclib/sockevent.h>
+
+#if defined(P_LINUX)
+  #define P_HAS_EPOLL 1
+  #include <sys/epoll.h>
+  #include <sys/eventfd.h>
+#elif P_HAS_POLL
+  #include <poll.h>
+#endif
+
+
+#define PTraceModule() "SockEvent"
+#define new PNEW
+
+// Without epoll, this is how long it takes to notice Add() and Remove()
+static const int PollInterval = 100;
+
+#if !P_HAS_EPOLL
+struct PSocketEventLoop::PollState
+{
+#if P_HAS_POLL
+  std::vector<pollfd>  m_fds;
+  std::vector<PUInt64> m_ids;
+#endif
+};
+#endif
+
+
+PSocketEventLoop::PSocketEventLoop(unsigned threads, const PString & threadName)
+  : m_threadName(threadName)
+  , m_nextId(1)
+  , m_changed(true)
+  , m_running(true)
+  , m_epoll(-1)
+  , m_wakeup(-1)
+  , m_pollState(NULL)
+{
+#if P_HAS_EPOLL
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  m_wakeup = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+  if (m_epoll < 0 || m_wakeup < 0) {
+    PTRACE(1, "Could not create epoll: " << strerror(errno));
+    return;
+  }
+
+  // Level triggered, and never read, so all threads see it on Stop()
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.u64 = 0;
+  epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wakeup, &ev);
+#else
+  m_pollState = new PollState;
+  threads = 1;
+#endif
+
+  for (unsigned i = 0; i < std::max(threads, 1U); ++i)
+    m_threads.push_back(new PThreadObj<PSocketEventLoop>(*this, &PSocketEventLoop::ThreadMain, false, m_threadName));
+
+  PTRACE(4, "Started " << m_threads.size() << " threads, " << (IsScalable() ? "epoll" : "polled"));
+}
+
+
+PSocketEventLoop::~PSocketEventLoop()
+{
+  Stop();
+
+  for (RegistrationsById::iterator it = m_byId.begin(); it != m_byId.end(); ++it)
+    delete it->second;
+
+#if P_HAS_EPOLL
+  if (m_wakeup >= 0)
+    ::close(m_wakeup);
+  if (m_epoll >= 0)
+    ::close(m_epoll);
+#else
+  delete m_pollState;
+#endif
+}
+
+
+bool PSocketEventLoop::IsScalable()
+{
+#if P_HAS_EPOLL
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+bool PSocketEventLoop::Add(PSocket & socket, const Notifier & notifier, unsigned events)
+{
+  if (!socket.IsOpen()) {
+    PTRACE(2, "Cannot add closed socket");
+    return false;
+  }
+
+  PWaitAndSignal lock(m_mutex);
+
+  if (m_bySocket.find(&socket) != m_bySocket.end()) {
+    PTRACE(2, "Socket " << socket.GetHandle() << " already added");
+    return false;
+  }
+
+  Registration * reg = new Registration(socket, notifier, events, m_nextId++);
+  if (!InternalAdd(*reg)) {
+    delete reg;
+    return false;
+  }
+
+  m_byId[reg->m_id] = reg;
+  m_bySocket[&socket] = reg;
+  m_changed = true;
+  PTRACE(5, "Added socket " << reg->m_handle << ", total " << m_bySocket.size());
+  return true;
+}
+
+
+bool PSocketEventLoop::Remove(PSocket & socket)
+{
+  PWaitAndSignal lock(m_mutex);
+
+  RegistrationsBySocket::iterator it = m_bySocket.find(&socket);
+  if (it == m_bySocket.end())
+    return false;
+
+  Registration * reg = it->second;
+  m_bySocket.erase(it);
+  m_byId.erase(reg->m_id);
+  m_changed = true;
+
+  InternalRemove(*reg);
+  reg->m_removed = true;
+
+  // Wait for notifier to return, unless we are inside it
+  PThreadIdentifier us = PThread::GetCurrentThreadId();
+  while (reg->m_busyThread != PNullThreadIdentifier && reg->m_busyThread != us) {
+    m_mutex.Signal();
+    PThread::Sleep(1);
+    m_mutex.Wait();
+  }
+
+  // If inside notifier, Dispatch() will delete it when done
+  if (reg->m_busyThread == PNullThreadIdentifier)
+    delete reg;
+  else
+    reg->m_deleteOnReturn = true;
+
+  PTRACE(5, "Removed socket " << socket.GetHandle() << ", total " << m_bySocket.size());
+  return true;
+}
+
+
+void PSocketEventLoop::Stop()
+{
+  if (!m_running.exchange(false))
+    return;
+
+#if P_HAS_EPOLL
+  if (m_wakeup >= 0) {
+    eventfd_t one = 1;
+    if (eventfd_write(m_wakeup, one) < 0)
+      PTRACE(1, "Could not signal eventfd: " << strerror(errno));
+  }
+#endif
+
+  for (std::vector<PThread *>::iterator it = m_threads.begin(); it != m_threads.end(); ++it) {
+    PAssert((*it)->GetThreadId() != PThread::GetCurrentThreadId(), "Cannot stop socket event loop from its own thread");
+    delete *it; // PThreadObj waits for termination
+  }
+  m_threads.clear();
+
+  PTRACE(4, "Stopped");
+}
+
+
+PINDEX PSocketEventLoop::GetSize() const
+{
+  PWaitAndSignal lock(m_mutex);
+  return m_bySocket.size();
+}
+
+
+void PSocketEventLoop::ThreadMain()
+{
+  while (m_running)
+    InternalWait();
+}
+
+
+void PSocketEventLoop::Dispatch(PUInt64 id, unsigned events)
+{
+  m_mutex.Wait();
+
+  RegistrationsById::iterator it = m_byId.find(id);
+  if (it == m_byId.end()) {
+    // Removed between being signalled and getting here
+    m_mutex.Signal();
+    return;
+  }
+
+  Registration & reg = *it->second;
+  reg.m_busyThread = PThread::GetCurrentThreadId();
+  m_mutex.Signal();
+
+  reg.m_notifier(reg.m_socket, events);
+
+  /* If removed from another thread, that thread is waiting on m_busyThread
+     and deletes it. If removed from within the notifier, nobody is waiting
+     so we clean up here. */
+  m_mutex.Wait();
+  reg.m_busyThread = PNullThreadIdentifier;
+  if (reg.m_deleteOnReturn)
+    delete &reg;
+  else if (!reg.m_removed)
+    InternalRearm(reg);
+  m_mutex.Signal();
+}
+
+
+#if P_HAS_EPOLL
+
+static uint32_t EpollEvents(unsigned events)
+{
+  uint32_t ev = EPOLLONESHOT;
+  if (events & PSocketEventLoop::ReadEvent)
+    ev |= EPOLLIN;
+  if (events & PSocketEventLoop::WriteEvent)
+    ev |= EPOLLOUT;
+  return ev;
+}
+
+
+bool PSocketEventLoop::InternalAdd(Registration & reg)
+{
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EpollEvents(reg.m_events);
+  ev.data.u64 = reg.m_id;
+  if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, (int)reg.m_handle, &ev) == 0)
+    return true;
+
+  PTRACE(2, "Could not add socket " << reg.m_handle << " to epoll: " << strerror(errno));
+  return false;
+}
+
+
+void PSocketEventLoop::InternalRemove(Registration & reg)
+{
+  // Fails harmlessly if socket was already closed, as that removes it anyway
+  epoll_event ev;
+  epoll_ctl(m_epoll, EPOLL_CTL_DEL, (int)reg.m_handle, &ev);
+}
+
+
+bool PSocketEventLoop::InternalRearm(Registration & reg)
+{
+  epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EpollEvents(reg.m_events);
+  ev.data.u64 = reg.m_id;
+  if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, (int)reg.m_handle, &ev) == 0)
+    return true;
+
+  PTRACE(2, "Could not re-arm socket " << reg.m_handle << " in epoll: " << strerror(errno));
+  return false;
+}
+
+
+void PSocketEventLoop::InternalWait()
+{
+  static const int MaxEvents = 64;
+  epoll_event events[MaxEvents];
+
+  int count;
+  PPROFILE_SYSTEM(
+    count = epoll_wait(m_epoll, events, MaxEvents, -1);
+  );
+  if (count < 0) {
+    if (errno != EINTR) {
+      PTRACE(1, "epoll_wait failed: " << strerror(errno));
+      PThread::Sleep(PollInterval);
+    }
+    return;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    if (events[i].data.u64 == 0)
+      return; // Stopping
+
+    unsigned mask = 0;
+    if (events[i].events & EPOLLIN)
+      mask |= ReadEvent;
+    if (events[i].events & EPOLLOUT)
+      mask |= WriteEvent;
+    if (events[i].events & (EPOLLERR|EPOLLHUP))
+      mask |= ErrorEvent;
+    Dispatch(events[i].data.u64, mask);
+  }
+}
+
+#else // P_HAS_EPOLL
+
+bool PSocketEventLoop::InternalAdd(Registration &)
+{
+  return true;
+}
+
+
+void PSocketEventLoop::InternalRemove(Registration &)
+{
+}
+
+
+bool PSocketEventLoop::InternalRearm(Registration &)
+{
+  return true;
+}
+
+
+#if P_HAS_POLL
+
+void PSocketEventLoop::InternalWait()
+{
+  // Only one thread, so the poll list persists until registrations change
+  std::vector<pollfd>  & fds = m_pollState->m_fds;
+  std::vector<PUInt64> & ids = m_pollState->m_ids;
+
+  m_mutex.Wait();
+  if (m_changed) {
+    fds.resize(m_byId.size());
+    ids.resize(m_byId.size());
+    size_t i = 0;
+    for (RegistrationsById::iterator it = m_byId.begin(); it != m_byId.end(); ++it, ++i) {
+      fds[i].fd = (int)it->second->m_handle;
+      fds[i].events = 0;
+      if (it->second->m_events & ReadEvent)
+        fds[i].events |= POLLIN;
+      if (it->second->m_events & WriteEvent)
+        fds[i].events |= POLLOUT;
+      ids[i] = it->first;
+    }
+    m_changed = false;
+  }
+  m_mutex.Signal();
+
+  int count;
+  PPROFILE_SYSTEM(
+    count = ::poll(fds.empty() ? NULL : &fds[0], fds.size(), PollInterval);
+  );
+  if (count <= 0)
+    return;
+
+  for (size_t i = 0; i < fds.size() && m_running; ++i) {
+    short revents = fds[i].revents;
+    if (revents == 0)
+      continue;
+
+    unsigned mask = 0;
+    if (revents & POLLIN)
+      mask |= ReadEvent;
+    if (revents & POLLOUT)
+      mask |= WriteEvent;
+    if (revents & (POLLERR|POLLHUP|POLLNVAL))
+      mask |= ErrorEvent;
+    Dispatch(ids[i], mask);
+  }
+}
+
+#else // P_HAS_POLL
+
+void PSocketEventLoop::InternalWait()
+{
+  PSocket::SelectList readers, writers;
+  std::map<PSocket *, PUInt64> ids;
+
+  m_mutex.Wait();
+  for (RegistrationsById::iterator it = m_byId.begin(); it != m_byId.end(); ++it) {
+    if (it->second->m_events & ReadEvent)
+      readers += it->second->m_socket;
+    if (it->second->m_events & WriteEvent)
+      writers += it->second->m_socket;
+    ids[&it->second->m_socket] = it->first;
+  }
+  m_changed = false;
+  m_mutex.Signal();
+
+  if (ids.empty()) {
+    PThread::Sleep(PollInterval);
+    return;
+  }
+
+  if (PSocket::Select(readers, writers, PollInterval) != PChannel::NoError)
+    return;
+
+  for (PSocket::SelectList::iterator it = readers.begin(); it != readers.end() && m_running; ++it)
+    Dispatch(ids[&*it], ReadEvent);
+  for (PSocket::SelectList::iterator it = writers.begin(); it != writers.end() && m_running; ++it)
+    Dispatch(ids[&*it], WriteEvent);
+}
+
+#endif // P_HAS_POLL
+
+#endif // P_HAS_EPOLL
+
+
+// End Of File ///////////////////////////////////////////////////////////////
@@ -197,3 +197,437 @@ void PThreadPoolBase::WorkerThreadBase::Main()
   }
   PTRACE(2, PThreadPoolTraceModule, "Finished pool thread.");
 }
+
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct PWorkStealingThreadPoolBase::GroupQueue
+{
+  std::queue<Item *> m_items;
+};
+
+
+struct PWorkStealingThreadPoolBase::GroupShard
+{
+  typedef std::map<std::string, GroupQueue> Groups;
+  Groups           m_groups;
+  PCriticalSection m_mutex;
+};
+
+
+/* There is one of these for each group that has work outstanding. It is
+   queued like any other item and executes one of the groups items at a
+   time, then requeues itself on the same worker until the group is empty. */
+struct PWorkStealingThreadPoolBase::GroupRunner : PWorkStealingThreadPoolBase::Item
+{
+  PWorkStealingThreadPoolBase & m_pool;
+  GroupShard                  & m_shard;
+  std::string                   m_group;
+
+  GroupRunner(PWorkStealingThreadPoolBase & pool, GroupShard & shard, const std::string & group)
+    : m_pool(pool)
+    , m_shard(shard)
+    , m_group(group)
+  { }
+
+  virtual void Execute(Worker & worker)
+  {
+    Item * item;
+    m_shard.m_mutex.Wait();
+    GroupQueue & queue = m_shard.m_groups[m_group];
+    item = queue.m_items.front();
+    queue.m_items.pop();
+    m_shard.m_mutex.Signal();
+
+    m_pool.CheckLatency(*item);
+    item->Execute(worker);
+
+    m_shard.m_mutex.Wait();
+    GroupShard::Groups::iterator it = m_shard.m_groups.find(m_group);
+    bool finished = it->second.m_items.empty();
+    if (finished)
+      m_shard.m_groups.erase(it);
+    m_shard.m_mutex.Signal();
+
+    if (finished)
+      delete this;
+    else
+      m_pool.Submit(this, &worker);
+  }
+};
+
+
+PWorkStealingThreadPoolBase::PWorkStealingThreadPoolBase(unsigned maxWorkers,
+                                                         const char * threadName,
+                                                         PThread::Priority priority,
+                                                         const PTimeInterval & workerIncreaseLatency,
+                                                         unsigned workerIncreaseLimit)
+  : m_groupShards(new GroupShard[NumGroupShards])
+  , m_workers(std::max(std::max(maxWorkers, workerIncreaseLimit), 1U))
+  , m_workerCount(0)
+  , m_nextWorker(0)
+  , m_sleeping(0)
+  , m_submitting(0)
+  , m_shutdown(false)
+  , m_maxWorkerCount(std::max(maxWorkers, 1U))
+  , m_workerIncreaseLatency(workerIncreaseLatency)
+  , m_threadName(threadName != NULL ? threadName : "Pool")
+  , m_priority(priority)
+{
+  PTRACE(4, PThreadPoolTraceModule, "Work stealing thread pool created:"
+                                    " maxWorkers=" << maxWorkers << ","
+                                    " threadName=" << m_threadName << ","
+                                    " priority=" << priority << ","
+                                    " workerIncreaseLatency=" << workerIncreaseLatency << ","
+                                    " workerIncreaseLimit=" << m_workers.size());
+}
+
+
+PWorkStealingThreadPoolBase::~PWorkStealingThreadPoolBase()
+{
+  Shutdown();
+  delete [] m_groupShards;
+}
+
+
+void PWorkStealingThreadPoolBase::Shutdown()
+{
+  // Once set, no more workers will be started
+  m_mutex.Wait();
+  bool alreadyShutdown = m_shutdown.exchange(true);
+  m_mutex.Signal();
+  if (alreadyShutdown)
+    return;
+
+  PTRACE(3, PThreadPoolTraceModule, "Shutting down thread pool \"" << m_threadName << '"');
+
+  unsigned count = m_workerCount;
+  for (unsigned i = 0; i < count; ++i)
+    m_wakeUp.Signal();
+
+  for (unsigned i = 0; i < count; ++i)
+    PAssert(m_workers[i]->WaitForTermination(10000), "Worker did not terminate promptly");
+
+  /* Anyone adding work from another thread, who got past the m_shutdown
+     check before it was set, is still using m_workers and m_groupShards. */
+  while (m_submitting > 0)
+    PThread::Yield();
+
+  for (unsigned i = 0; i < count; ++i)
+    m_workers[i]->Discard();
+
+  for (unsigned i = 0; i < count; ++i) {
+    delete m_workers[i];
+    m_workers[i] = NULL;
+  }
+  m_workerCount = 0;
+
+  for (PINDEX i = 0; i < NumGroupShards; ++i) {
+    GroupShard & shard = m_groupShards[i];
+    PWaitAndSignal lock(shard.m_mutex);
+    for (GroupShard::Groups::iterator it = shard.m_groups.begin(); it != shard.m_groups.end(); ++it) {
+      while (!it->second.m_items.empty()) {
+        delete it->second.m_items.front();
+        it->second.m_items.pop();
+      }
+    }
+    shard.m_groups.clear();
+  }
+}
+
+
+void PWorkStealingThreadPoolBase::SetMaxWorkers(unsigned count)
+{
+  PWaitAndSignal lock(m_mutex);
+  m_maxWorkerCount = std::min(std::max(count, 1U), (unsigned)m_workers.size());
+  PTRACE_IF(2, m_maxWorkerCount < count, PThreadPoolTraceModule,
+            "Thread pool \"" << m_threadName << "\" max workers limited to " << m_maxWorkerCount);
+}
+
+
+bool PWorkStealingThreadPoolBase::InternalAddWork(Item * item, const char * group)
+{
+  // Count ourselves in before checking, so Shutdown() either sees us or we see it
+  ++m_submitting;
+  if (m_shutdown) {
+    --m_submitting;
+    delete item;
+    return false;
+  }
+
+  if (group == NULL || *group == '\0') {
+    Submit(item, NULL);
+    --m_submitting;
+    return true;
+  }
+
+  std::string groupId(group);
+  unsigned hash = 0;
+  for (std::string::const_iterator it = groupId.begin(); it != groupId.end(); ++it)
+    hash = hash*31 + (unsigned char)*it;
+  GroupShard & shard = m_groupShards[hash % NumGroupShards];
+
+  item->m_queuedTick = PTimer::Tick();
+
+  shard.m_mutex.Wait();
+  GroupShard::Groups::iterator it = shard.m_groups.find(groupId);
+  bool newGroup = it == shard.m_groups.end();
+  if (newGroup)
+    it = shard.m_groups.insert(GroupShard::Groups::value_type(groupId, GroupQueue())).first;
+  it->second.m_items.push(item);
+  shard.m_mutex.Signal();
+
+  if (newGroup)
+    Submit(new GroupRunner(*this, shard, groupId), NULL);
+
+  --m_submitting;
+  return true;
+}
+
+
+void PWorkStealingThreadPoolBase::Submit(Item * item, Worker * preferred)
+{
+  ++m_submitting;
+  if (m_shutdown) {
+    --m_submitting;
+    delete item;
+    return;
+  }
+
+  item->m_queuedTick = PTimer::Tick();
+
+  // Get another thread going if all the existing ones are busy
+  if (m_workerCount < m_maxWorkerCount && m_sleeping == 0)
+    StartWorker();
+
+  if (preferred == NULL) {
+    unsigned count = m_workerCount;
+    if (count == 0) {
+      // Could not start a worker
+      --m_submitting;
+      delete item;
+      return;
+    }
+    preferred = m_workers[m_nextWorker++ % count];
+  }
+
+  preferred->Push(item);
+
+  if (m_sleeping > 0)
+    m_wakeUp.Signal();
+
+  --m_submitting;
+}
+
+
+PWorkStealingThreadPoolBase::Item * PWorkStealingThreadPoolBase::FindWork(Worker & worker)
+{
+  Item * item = worker.Pop();
+  if (item != NULL)
+    return item;
+
+  std::vector<Item *> stolen;
+  unsigned count = m_workerCount;
+  for (unsigned i = 1; i < count; ++i) {
+    item = m_workers[(worker.m_index + i) % count]->Steal(stolen);
+    if (item != NULL) {
+      worker.PushLocal(stolen);
+      return item;
+    }
+  }
+
+  return NULL;
+}
+
+
+void PWorkStealingThreadPoolBase::StartWorker()
+{
+  PWaitAndSignal lock(m_mutex);
+
+  unsigned index = m_workerCount;
+  if (m_shutdown || index >= m_maxWorkerCount)
+    return;
+
+  Worker * worker = new Worker(*this, index);
+  m_workers[index] = worker;
+  m_workerCount = index + 1;  // After it is in the vector
+  worker->Resume();
+
+  PTRACE(index+1 > m_maxWorkerCount/2 ? 3 : 4, PThreadPoolTraceModule,
+         "Started new pool thread \"" << *worker << "\", count=" << index+1);
+}
+
+
+void PWorkStealingThreadPoolBase::CheckLatency(const Item & item)
+{
+  if (m_workerIncreaseLatency == PMaxTimeInterval)
+    return;
+
+  PTimeInterval latency = PTimer::Tick() - item.m_queuedTick;
+  if (latency <= m_workerIncreaseLatency)
+    return;
+
+  PWaitAndSignal lock(m_mutex);
+
+  PTime now;
+  if (m_nextWorkerIncreaseTime > now)
+    return;
+
+  m_nextWorkerIncreaseTime = now + m_workerIncreaseLatency; // Don't increase again until had some time to clear backlog.
+
+  unsigned newMaxWorkers = std::min((m_maxWorkerCount*11+9)/10, (unsigned)m_workers.size());
+  PTRACE(2, PThreadPoolTraceModule, "Thread pool latency excessive (" << latency << "s > " << m_workerIncreaseLatency << "s), "
+         << (newMaxWorkers == m_maxWorkerCount ? "cannot increase" : "increasing") << " threads from " << m_maxWorkerCount
+         << " to " << newMaxWorkers << ", limit=" << m_workers.size());
+  m_maxWorkerCount = newMaxWorkers;
+}
+
+
+PWorkStealingThreadPoolBase::Worker::Worker(PWorkStealingThreadPoolBase & pool, unsigned index)
+  : PThread(100, NoAutoDeleteThread, pool.m_priority, PSTRSTRM(pool.m_threadName << ':' << index))
+  , m_pool(pool)
+  , m_index(index)
+  , m_inboxHead(&m_inboxStub)
+  , m_inboxTail(&m_inboxStub)
+{
+}
+
+
+PWorkStealingThreadPoolBase::Worker::~Worker()
+{
+  WaitForTermination();
+}
+
+
+void PWorkStealingThreadPoolBase::Worker::Main()
+{
+  PTRACE(4, PThreadPoolTraceModule, "Started pool thread.");
+
+  while (!m_pool.m_shutdown) {
+    Item * item = m_pool.FindWork(*this);
+    if (item == NULL) {
+      /* Announce we are going to sleep, then look again, so anyone adding
+         work after our first look is sure to see us and wake us up. */
+      ++m_pool.m_sleeping;
+      item = m_pool.FindWork(*this);
+      if (item == NULL && !m_pool.m_shutdown)
+        m_pool.m_wakeUp.Wait();
+      --m_pool.m_sleeping;
+      if (item == NULL)
+        continue;
+    }
+
+    m_pool.CheckLatency(*item);
+    item->Execute(*this);
+  }
+
+  PTRACE(4, PThreadPoolTraceModule, "Finished pool thread.");
+}
+
+
+void PWorkStealingThreadPoolBase::Worker::Push(Item * item)
+{
+  // Lock free push for multiple producers
+  item->m_next = NULL;
+  Link * previous = m_inboxHead.exchange(item);
+  previous->m_next = item;
+}
+
+
+PWorkStealingThreadPoolBase::Item * PWorkStealingThreadPoolBase::Worker::InternalPopInbox()
+{
+  // Must have m_mutex locked, so there is only one consumer
+  Link * tail = m_inboxTail;
+  Link * next = tail->m_next;
+
+  if (tail == &m_inboxStub) {
+    if (next == NULL)
+      return NULL;
+    m_inboxTail = tail = next;
+    next = next->m_next;
+  }
+
+  if (next != NULL) {
+    m_inboxTail = next;
+    return static_cast<Item *>(tail);
+  }
+
+  // Either the last item, or a producer is part way through a Push()
+  if (tail != m_inboxHead.load())
+    return NULL;
+
+  m_inboxStub.m_next = NULL;
+  Link * previous = m_inboxHead.exchange(&m_inboxStub);
+  previous->m_next = &m_inboxStub;
+
+  next = tail->m_next;
+  if (next == NULL)
+    return NULL;
+
+  m_inboxTail = next;
+  return static_cast<Item *>(tail);
+}
+
+
+void PWorkStealingThreadPoolBase::Worker::InternalDrainInbox()
+{
+  Item * item;
+  while ((item = InternalPopInbox()) != NULL)
+    m_queue.push_back(item);
+}
+
+
+PWorkStealingThreadPoolBase::Item * PWorkStealingThreadPoolBase::Worker::Pop()
+{
+  PWaitAndSignal lock(m_mutex);
+
+  if (m_queue.empty())
+    return InternalPopInbox();
+
+  InternalDrainInbox();
+  Item * item = m_queue.front();
+  m_queue.pop_front();
+  return item;
+}
+
+
+PWorkStealingThreadPoolBase::Item * PWorkStealingThreadPoolBase::Worker::Steal(std::vector<Item *> & stolen)
+{
+  PWaitAndSignal lock(m_mutex);
+
+  InternalDrainInbox();
+  if (m_queue.empty())
+    return NULL;
+
+  // Take half of the newest work, leaving the oldest for the owner
+  size_t count = (m_queue.size()+1)/2;
+  stolen.assign(m_queue.end() - count, m_queue.end());
+  m_queue.erase(m_queue.end() - count, m_queue.end());
+
+  Item * item = stolen.front();
+  stolen.erase(stolen.begin());
+  return item;
+}
+
+
+void PWorkStealingThreadPoolBase::Worker::PushLocal(std::vector<Item *> & items)
+{
+  if (items.empty())
+    return;
+
+  PWaitAndSignal lock(m_mutex);
+  m_queue.insert(m_queue.end(), items.begin(), items.end());
+  items.clear();
+}
+
+
+void PWorkStealingThreadPoolBase::Worker::Discard()
+{
+  PWaitAndSignal lock(m_mutex);
+
+  InternalDrainInbox();
+  while (!m_queue.empty()) {
+    delete m_queue.front();
+    m_queue.pop_front();
+  }
+}
@@ -40,6 +40,7 @@
 #include <ptclib/random.h>
 #include <ptclib/http.h>
 #include <ptclib/mediafile.h>
+#include <ptclib/threadpool.h>
 #include <ptclib/SignLanguageAnalyser.h>
 
 
@@ -954,6 +955,7 @@ static const PConstString KeyFileType(".key");
 
 PVXMLCache::PVXMLCache()
   : m_directory("cache")
+  , m_memoryLimit(0)
 {
 }
 
@@ -1062,6 +1064,196 @@ bool PVXMLCache::PutWithLock(const PString & prefix,
 }
 
 
+static PString MakeMemoryKey(const PString & prefix, const PString & key, const PString & suffix, unsigned sampleRate, unsigned channels)
+{
+  return PSTRSTRM(prefix << '\n' << suffix << '\n' << sampleRate << '\n' << channels << '\n' << key);
+}
+
+
+bool PVXMLCache::GetAudio(const PString & prefix,
+                          const PString & key,
+                          const PString & suffix,
+                          unsigned sampleRate,
+                          unsigned channels,
+                          PBYTEArray & audio)
+{
+  PWaitAndSignal mutex(m_memoryMutex);
+
+  if (m_memoryLimit == 0)
+    return false;
+
+  MemoryIndex::iterator it = m_memoryIndex.find(MakeMemoryKey(prefix, key, suffix, sampleRate, channels));
+  if (it == m_memoryIndex.end()) {
+    ++m_memoryStatistics.m_misses;
+    return false;
+  }
+
+  // Move to front as most recently used, this does not invalidate the iterator in the index
+  m_memoryList.splice(m_memoryList.begin(), m_memoryList, it->second);
+
+  audio = it->second->m_audio; // Reference counted, no copy of the data
+  ++m_memoryStatistics.m_hits;
+  PTRACE(5, "Cache memory hit for \"" << key << '"');
+  return true;
+}
+
+
+void PVXMLCache::PutAudio(const PString & prefix,
+                          const PString & key,
+                          const PString & suffix,
+                          unsigned sampleRate,
+                          unsigned channels,
+                          const PBYTEArray & audio)
+{
+  PWaitAndSignal mutex(m_memoryMutex);
+
+  if (m_memoryLimit == 0 || audio.GetSize() > m_memoryLimit)
+    return;
+
+  PString memoryKey = MakeMemoryKey(prefix, key, suffix, sampleRate, channels);
+  MemoryIndex::iterator it = m_memoryIndex.find(memoryKey);
+  if (it != m_memoryIndex.end()) {
+    // Another session got in first, just replace it
+    m_memoryStatistics.m_bytes -= it->second->m_audio.GetSize();
+    it->second->m_audio = audio;
+    m_memoryList.splice(m_memoryList.begin(), m_memoryList, it->second);
+  }
+  else {
+    MemoryEntry entry;
+    entry.m_key = memoryKey;
+    entry.m_audio = audio;
+    m_memoryList.push_front(entry);
+    m_memoryIndex[memoryKey] = m_memoryList.begin();
+    ++m_memoryStatistics.m_entries;
+  }
+
+  m_memoryStatistics.m_bytes += audio.GetSize();
+  PTRACE(5, "Cache memory added " << audio.GetSize() << " bytes for \"" << key << '"');
+
+  InternalEvictMemory();
+}
+
+
+void PVXMLCache::InternalEvictMemory()
+{
+  // m_memoryMutex already locked
+  while (m_memoryStatistics.m_bytes > m_memoryLimit && !m_memoryList.empty()) {
+    MemoryEntry & entry = m_memoryList.back();
+    m_memoryStatistics.m_bytes -= entry.m_audio.GetSize();
+    --m_memoryStatistics.m_entries;
+    ++m_memoryStatistics.m_evictions;
+    m_memoryIndex.erase(entry.m_key);
+    m_memoryList.pop_back();
+  }
+}
+
+
+void PVXMLCache::SetMemoryLimit(PINDEX bytes)
+{
+  PWaitAndSignal mutex(m_memoryMutex);
+  m_memoryLimit = bytes;
+  InternalEvictMemory();
+}
+
+
+void PVXMLCache::FlushMemory()
+{
+  PWaitAndSignal mutex(m_memoryMutex);
+  m_memoryList.clear();
+  m_memoryIndex.clear();
+  m_memoryStatistics.m_entries = 0;
+  m_memoryStatistics.m_bytes = 0;
+}
+
+
+PVXMLCache::MemoryStatistics PVXMLCache::GetMemoryStatistics() const
+{
+  PWaitAndSignal mutex(m_memoryMutex);
+  return m_memoryStatistics;
+}
+
+
+PVXMLCache::MemoryStatistics::MemoryStatistics()
+  : m_hits(0)
+  , m_misses(0)
+  , m_evictions(0)
+  , m_entries(0)
+  , m_bytes(0)
+{
+}
+
+
+void PVXMLCache::MemoryStatistics::PrintOn(ostream & strm) const
+{
+  strm << "hits=" << m_hits
+       << " misses=" << m_misses
+       << " evictions=" << m_evictions
+       << " entries=" << m_entries
+       << " bytes=" << m_bytes;
+}
+
+
+bool PVXMLCache::LoadAudio(const PFilePath & filename, unsigned sampleRate, unsigned channels, PBYTEArray & audio)
+{
+#if P_WAVFILE
+  if (filename.GetType() != ".wav")
+    return false;
+
+  PWAVFile wav;
+  if (!wav.Open(filename, PFile::ReadOnly)) {
+    PTRACE(2, NULL, PTraceModule(), "Could not open WAV file \"" << wav.GetName() << "\" - " << wav.GetErrorText());
+    return false;
+  }
+
+  if (wav.GetFormatString() != VXML_PCM16 && !wav.SetAutoconvert()) {
+    PTRACE(2, NULL, PTraceModule(), "WAV file cannot convert from " << wav.GetFormatString());
+    return false;
+  }
+
+  if (wav.GetChannels() != channels || wav.GetSampleSize() != 16 || wav.GetSampleRate() != sampleRate) {
+    PTRACE(4, NULL, PTraceModule(), "WAV file \"" << filename << "\" not " << sampleRate << "Hz, " << channels << " channel, 16 bit PCM");
+    return false;
+  }
+
+  static const PINDEX ChunkSize = 8192;
+  PINDEX total = 0;
+  while (wav.Read(audio.GetPointer(total + ChunkSize) + total, ChunkSize) && wav.GetLastReadCount() > 0)
+    total += wav.GetLastReadCount();
+  audio.SetSize(total);
+
+  PTRACE(4, NULL, PTraceModule(), "Loaded " << total << " bytes of audio from \"" << filename << '"');
+  return total > 0;
+#else
+  return false;
+#endif // P_WAVFILE
+}
+
+
+PINDEX PVXMLCache::Prewarm(const PDirectory & directory, unsigned sampleRate, unsigned channels)
+{
+  PDirectory dir = directory;
+  if (!dir.Open()) {
+    PTRACE(2, "Cannot open prewarm directory " << dir);
+    return 0;
+  }
+
+  PINDEX count = 0;
+  do {
+    PFilePath filename = dir + dir.GetEntryName();
+    if (!dir.IsSubDir() && filename.GetType() == ".wav") {
+      PBYTEArray audio;
+      if (LoadAudio(filename, sampleRate, channels, audio)) {
+        PutAudio("file", filename, filename.GetType(), sampleRate, channels, audio);
+        ++count;
+      }
+    }
+  } while (dir.Next());
+
+  PTRACE(3, "Prewarmed " << count << " files from " << dir << ", " << GetMemoryStatistics());
+  return count;
+}
+
+
 //////////////////////////////////////////////////////////
 
 PVXMLSession::PVXMLSession(PTextToSpeech * tts, PBoolean autoDelete)
@@ -1073,6 +1265,13 @@ PVXMLSession::PVXMLSession(PTextToSpeech * tts, PBoolean autoDelete)
 #endif
   , m_vxmlThread(NULL)
   , m_abortVXML(false)
+  , m_executionMode(ThreadPerSession)
+  , m_executionState(ExecutionIdle)
+  , m_processChildren(false)
+  , m_executionGroup(PSTRSTRM("VXML-" << this))
+  , m_executionQueued(false)
+  , m_executionPending(0)
+  , m_executionThreadId(PNullThreadIdentifier)
   , m_currentNode(NULL)
   , m_speakNodeData(true)
   , m_bargeIn(true)
@@ -1429,12 +1628,103 @@ bool PVXMLSession::Open(const PString & mediaFormat, unsigned sampleRate, unsign
 }
 
 
+//////////////////////////////////////////////////////////
+
+struct PVXMLExecutionWork
+{
+  PVXMLExecutionWork(PVXMLSession & session)
+    : m_session(session)
+  { }
+
+  void Work()
+  {
+    m_session.InternalExecute();
+  }
+
+  PVXMLSession & m_session;
+};
+
+
+class PVXMLExecutionPool : public PProcessStartup
+{
+    PCLASSINFO(PVXMLExecutionPool, PProcessStartup)
+  public:
+    PVXMLExecutionPool()
+      : m_pool(NULL)
+      , m_maxWorkers(std::max(PThread::GetNumProcessors(), 10U))
+      , m_shutdown(false)
+    { }
+
+    ~PVXMLExecutionPool()
+    {
+      delete m_pool;
+    }
+
+    PFACTORY_GET_SINGLETON(PProcessStartupFactory, PVXMLExecutionPool);
+
+    virtual void OnShutdown()
+    {
+      PQueuedThreadPool<PVXMLExecutionWork> * pool;
+      {
+        PWaitAndSignal lock(m_mutex);
+        m_shutdown = true;
+        pool = m_pool;
+        m_pool = NULL;
+      }
+
+      // Outside the lock, as the destructor waits for steps that may call AddWork()
+      delete pool;
+    }
+
+    void SetMaxWorkers(unsigned maxWorkers)
+    {
+      PWaitAndSignal lock(m_mutex);
+      m_maxWorkers = std::max(1U, maxWorkers);
+      if (m_pool != NULL)
+        m_pool->SetMaxWorkers(m_maxWorkers);
+    }
+
+    /* Queue a step for a session, if the pool is no longer available, e.g.
+       during shut down, then false is returned and the work is not deleted. */
+    bool AddWork(PVXMLExecutionWork * work, const char * group)
+    {
+      PWaitAndSignal lock(m_mutex);
+      if (m_shutdown)
+        return false;
+
+      if (m_pool == NULL)
+        m_pool = new PQueuedThreadPool<PVXMLExecutionWork>(m_maxWorkers, 0, "VXML-Pool");
+
+      return m_pool->AddWork(work, group);
+    }
+
+  protected:
+    PDECLARE_MUTEX(m_mutex);
+    PQueuedThreadPool<PVXMLExecutionWork> * m_pool;
+    unsigned m_maxWorkers;
+    bool m_shutdown;
+};
+
+PFACTORY_CREATE_SINGLETON(PProcessStartupFactory, PVXMLExecutionPool);
+
+
+void PVXMLSession::SetExecutionPoolSize(unsigned maxWorkers)
+{
+  PVXMLExecutionPool::GetInstance().SetMaxWorkers(maxWorkers);
+}
+
+
 void PVXMLSession::InternalStartThread()
 {
   PWaitAndSignal mutex(m_sessionMutex);
 
   if (IsOpen() && IsLoaded()) {
-    if (m_vxmlThread == NULL)
+    if (m_executionMode == EventDriven) {
+      if (m_executionState == ExecutionIdle)
+        m_executionState = ExecutionStarting;
+      Trigger();
+    }
+    else if (m_vxmlThread == NULL)
       m_vxmlThread = new PThreadObj<PVXMLSession>(*this, &PVXMLSession::InternalThreadMain, false, "VXML");
     else
       Trigger();
@@ -1451,31 +1741,180 @@ PBoolean PVXMLSession::Close()
   // Stop condition for thread
   m_abortVXML = true;
   Trigger();
-  PThread::WaitAndDelete(m_vxmlThread, 10000, &m_sessionMutex, false);
+  if (m_executionMode == EventDriven) {
+    InternalWaitExecution();
+    m_sessionMutex.Signal();
+  }
+  else
+    PThread::WaitAndDelete(m_vxmlThread, 10000, &m_sessionMutex, false);
 
 #if P_VXML_VIDEO
   m_videoReceiver.Close();
   m_videoSender.Close();
 #endif // P_VXML_VIDEO
 
-  return PIndirectChannel::Close();
+  PBoolean ok = PIndirectChannel::Close();
+
+  // A final end of playback event may have raced the channel close
+  if (m_executionMode == EventDriven) {
+    PWaitAndSignal mutex(m_sessionMutex);
+    InternalWaitExecution();
+  }
+
+  return ok;
 }
 
 
-void PVXMLSession::InternalThreadMain()
+void PVXMLSession::InternalWaitExecution()
 {
-  PTRACE(4, "Execution thread started.");
+  // m_sessionMutex already locked
+
+  // Cannot wait for ourselves, e.g. Close() from OnEndSession()
+  if (m_executionThreadId == PThread::GetCurrentThreadId())
+    return;
+
+  while (m_executionPending > 0) {
+    m_sessionMutex.Signal();
+    m_executionIdle.Wait();
+    m_sessionMutex.Wait();
+  }
+}
+
+
+void PVXMLSession::InternalExecute()
+{
+  m_executionQueued = false;
 
   m_sessionMutex.Wait();
+  m_executionThreadId = PThread::GetCurrentThreadId();
+  bool ended = InternalExecuteStep();
+  m_sessionMutex.Signal();
 
-  {
-    PTime now;
-    SetVar("session.time", now.AsString());
-    SetVar("session.timeISO8601", now.AsString(PTime::ShortISO8601));
-    SetVar("session.timeEpoch", now.GetTimeInSeconds());
+  if (ended) {
+    OnEndSession();
+    PTRACE(4, "Execution ended");
+  }
+
+  /* Decrement under the mutex, so Close() cannot see zero and return,
+     possibly destroying this session, before we are finished with it. */
+  m_sessionMutex.Wait();
+  m_executionThreadId = PNullThreadIdentifier;
+  if (--m_executionPending == 0)
+    m_executionIdle.Signal();
+  m_sessionMutex.Signal();
+}
+
+
+bool PVXMLSession::InternalExecuteStep()
+{
+  // m_sessionMutex already locked
+
+  /* This is InternalThreadMain() turned inside out, each place where the
+     thread would block waiting for an event, we return and continue from the
+     same state on the next Trigger(). */
+  for (;;) {
+    switch (m_executionState) {
+      case ExecutionIdle :
+      case ExecutionEnded :
+        return false;
+
+      case ExecutionStarting :
+        PTRACE(4, "Execution started.");
+        InternalStartSession();
+        m_executionState = ExecutionProcessNode;
+        break;
+
+      case ExecutionProcessNode :
+        if (m_abortVXML) {
+          m_executionState = ExecutionEnded;
+          return true;
+        }
+        m_processChildren = ProcessNode();
+        m_executionState = ExecutionNodeEvents;
+        break;
+
+      case ExecutionNodeEvents :
+        if (InternalProcessEvents()) {
+          m_executionState = ExecutionNodeAwaitingEvent;
+          return false;
+        }
+        if (!NextNode(m_processChildren))
+          m_executionState = ExecutionNodeDone;
+        break;
+
+      case ExecutionNodeAwaitingEvent :
+        if (InternalEventReceived())
+          m_executionState = ExecutionNodeEvents;
+        else
+          m_executionState = NextNode(m_processChildren) ? ExecutionNodeEvents : ExecutionNodeDone;
+        break;
+
+      case ExecutionNodeDone :
+        if (m_newXML.get() != NULL) {
+          m_currentXML = m_newXML;
+          InternalStartVXML();
+        }
+
+        if (m_currentNode != NULL) {
+          m_executionState = ExecutionProcessNode;
+          break;
+        }
+
+        PTRACE(3, "End of VoiceXML elements.");
+
+        m_sessionMutex.Signal();
+        OnEndDialog();
+        m_sessionMutex.Wait();
+
+        m_executionState = ExecutionEndDialogEvents;
+        break;
+
+      case ExecutionEndDialogEvents :
+        if (InternalProcessEvents()) {
+          m_executionState = ExecutionEndDialogAwaitingEvent;
+          return false;
+        }
+        m_executionState = ExecutionEndDialogDone;
+        break;
+
+      case ExecutionEndDialogAwaitingEvent :
+        m_executionState = InternalEventReceived() ? ExecutionEndDialogEvents : ExecutionEndDialogDone;
+        break;
+
+      case ExecutionEndDialogDone :
+        if (m_newXML.get() != NULL) {
+          m_currentXML = m_newXML;
+          InternalStartVXML();
+        }
+
+        if (m_currentNode == NULL)
+          m_abortVXML = true;
+
+        m_executionState = ExecutionProcessNode;
+        break;
+    }
   }
+}
+
+
+void PVXMLSession::InternalStartSession()
+{
+  PTime now;
+  SetVar("session.time", now.AsString());
+  SetVar("session.timeISO8601", now.AsString(PTime::ShortISO8601));
+  SetVar("session.timeEpoch", now.GetTimeInSeconds());
 
   InternalStartVXML();
+}
+
+
+void PVXMLSession::InternalThreadMain()
+{
+  PTRACE(4, "Execution thread started.");
+
+  m_sessionMutex.Wait();
+
+  InternalStartSession();
 
   while (!m_abortVXML) {
     // process current node in the VXML script
@@ -1545,6 +1984,21 @@ bool PVXMLSession::ProcessEvents()
 {
   // m_sessionMutex already locked
 
+  if (!InternalProcessEvents())
+    return false;
+
+  m_sessionMutex.Signal();
+  m_waitForEvent.Wait();
+  m_sessionMutex.Wait();
+
+  return InternalEventReceived();
+}
+
+
+bool PVXMLSession::InternalProcessEvents()
+{
+  // m_sessionMutex already locked, returns true if need to wait for an event
+
   if (m_abortVXML || !IsOpen())
     return false;
 
@@ -1605,9 +2059,13 @@ bool PVXMLSession::ProcessEvents()
     return false;
   }
 
-  m_sessionMutex.Signal();
-  m_waitForEvent.Wait();
-  m_sessionMutex.Wait();
+  return true;
+}
+
+
+bool PVXMLSession::InternalEventReceived()
+{
+  // m_sessionMutex already locked, returns true if should keep processing events
 
   if (m_newXML.get() == NULL)
     return true;
@@ -2076,7 +2534,44 @@ void PVXMLSession::SetVar(const PString & varName, const PString & value)
 
 PBoolean PVXMLSession::PlayFile(const PString & fn, PINDEX repeat, PINDEX delay, PBoolean autoDelete)
 {
-  return IsOpen() && !m_bargingIn && GetVXMLChannel()->QueueFile(fn, repeat, delay, autoDelete);
+  if (!IsOpen() || m_bargingIn)
+    return false;
+
+  if (!autoDelete && PlayCachedAudio("file", fn, PFilePath(fn).GetType(), fn, repeat, delay))
+    return true;
+
+  return GetVXMLChannel()->QueueFile(fn, repeat, delay, autoDelete);
+}
+
+
+bool PVXMLSession::PlayCachedAudio(const PString & prefix,
+                                   const PString & key,
+                                   const PString & suffix,
+                                   const PFilePath & filename,
+                                   PINDEX repeat,
+                                   PINDEX delay)
+{
+  PVXMLCache & cache = GetCache();
+  if (cache.GetMemoryLimit() == 0)
+    return false;
+
+  PVXMLChannel * channel = GetVXMLChannel();
+  if (!channel->IsMediaPCM())
+    return false;
+
+  unsigned sampleRate = channel->GetSampleRate();
+  unsigned channels = channel->GetChannels();
+
+  PBYTEArray audio;
+  if (!cache.GetAudio(prefix, key, suffix, sampleRate, channels, audio)) {
+    PFilePath actualFilename;
+    if (!channel->AdjustMediaFilename(filename, actualFilename) ||
+        !PVXMLCache::LoadAudio(actualFilename, sampleRate, channels, audio))
+      return false;
+    cache.PutAudio(prefix, key, suffix, sampleRate, channels, audio);
+  }
+
+  return channel->QueueData(audio, repeat, delay);
 }
 
 
@@ -2218,8 +2713,34 @@ PBoolean PVXMLSession::PlayText(const PString & textToPlay,
 
   PString suffix = GetVXMLChannel()->GetMediaFileSuffix() + ".wav";
 
-  // Convert each line into it's own cached WAV file.
   PStringArray lines = textToPlay.Lines();
+
+  // If all the lines are in the in-memory tier, then can play it without any I/O
+  PVXMLChannel * channel = GetVXMLChannel();
+  bool useMemory = useCache && GetCache().GetMemoryLimit() > 0 && channel->IsMediaPCM();
+  if (useMemory) {
+    PBYTEArray audio;
+    PINDEX i;
+    for (i = 0; i < lines.GetSize(); i++) {
+      PString line = lines[i].Trim();
+      if (line.IsEmpty())
+        continue;
+
+      PBYTEArray lineAudio;
+      if (!GetCache().GetAudio(prefix, line, suffix, channel->GetSampleRate(), channel->GetChannels(), lineAudio))
+        break;
+
+      if (audio.IsEmpty())
+        audio = lineAudio; // Shared reference, usual case of one line does not copy
+      else
+        audio.Concatenate(lineAudio);
+    }
+
+    if (i >= lines.GetSize() && !audio.IsEmpty())
+      return channel->QueueData(audio, repeat, delay);
+  }
+
+  // Convert each line into it's own cached WAV file.
   for (PINDEX i = 0; i < lines.GetSize(); i++) {
     PString line = lines[i].Trim();
     if (line.IsEmpty())
@@ -2230,6 +2751,11 @@ PBoolean PVXMLSession::PlayText(const PString & textToPlay,
       PFilePath cachedFilename;
       if (GetCache().Get(prefix, line, suffix, cachedFilename)) {
         fileList.AppendString(cachedFilename);
+        if (useMemory) {
+          PBYTEArray lineAudio;
+          if (PVXMLCache::LoadAudio(cachedFilename, channel->GetSampleRate(), channel->GetChannels(), lineAudio))
+            GetCache().PutAudio(prefix, line, suffix, channel->GetSampleRate(), channel->GetChannels(), lineAudio);
+        }
         continue;
       }
     }
@@ -2250,8 +2776,14 @@ PBoolean PVXMLSession::PlayText(const PString & textToPlay,
 
     GetCache().UnlockReadWrite();
 
-    if (ok)
+    if (ok) {
       fileList.AppendString(wavFile.GetFilePath());
+      if (useMemory) {
+        PBYTEArray lineAudio;
+        if (PVXMLCache::LoadAudio(wavFile.GetFilePath(), channel->GetSampleRate(), channel->GetChannels(), lineAudio))
+          GetCache().PutAudio(prefix, line, suffix, channel->GetSampleRate(), channel->GetChannels(), lineAudio);
+      }
+    }
   }
 
   PVXMLPlayableFileList * playable = new PVXMLPlayableFileList;
@@ -3024,7 +3556,26 @@ void PVXMLSession::OnEndRecording(PINDEX bytesRecorded, bool timedOut)
 void PVXMLSession::Trigger()
 {
   PTRACE(4, "Event triggered");
-  m_waitForEvent.Signal();
+
+  if (m_executionMode != EventDriven) {
+    m_waitForEvent.Signal();
+    return;
+  }
+
+  // Already have a step queued that has not started, it will see this event
+  if (m_executionQueued.exchange(true))
+    return;
+
+  ++m_executionPending;
+  PVXMLExecutionWork * work = new PVXMLExecutionWork(*this);
+  if (PVXMLExecutionPool::GetInstance().AddWork(work, m_executionGroup))
+    return;
+
+  PTRACE(2, "Could not queue execution step");
+  delete work;
+  m_executionQueued = false;
+  if (--m_executionPending == 0)
+    m_executionIdle.Signal();
 }
 
 
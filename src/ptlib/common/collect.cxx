@@ -1119,6 +1119,73 @@ void PAbstractSortedList::DeleteSubTrees(PSortedListElement * node, PBoolean del
 
 ///////////////////////////////////////////////////////////////////////////////
 
+void PHashTableInfo::InitialiseBuckets()
+{
+  // Count the elements for when constructed from an existing bucket array
+  m_elementCount = 0;
+  for (PINDEX i = 0; i < GetSize(); i++) {
+    for (PHashTableElement * elmt = GetAt(i).m_head; elmt != NULL; elmt = elmt->m_next)
+      ++m_elementCount;
+  }
+
+  // Use the largest power of two that fits, so always get a valid bucket
+  m_bucketShift = 64;
+  while (m_bucketShift > 1 && ((PINDEX)1 << (65 - m_bucketShift)) <= GetSize())
+    --m_bucketShift;
+}
+
+
+PINDEX PHashTableInfo::GetBucket(PINDEX hash) const
+{
+  // Fibonacci hashing, multiply by 2^64/phi and take the top bits
+  if (m_bucketShift >= 64)
+    return 0;
+  return (PINDEX)(((uint64_t)hash * 0x9E3779B97F4A7C15ULL) >> m_bucketShift);
+}
+
+
+void PHashTableInfo::Rehash(PINDEX newSize)
+{
+  // Gather everything into a single list, in the current iteration order
+  PHashTableElement * head = NULL;
+  PHashTableElement * tail = NULL;
+  for (PINDEX i = 0; i < GetSize(); i++) {
+    const PHashTableList & list = GetAt(i);
+    if (list.m_head != NULL) {
+      if (tail == NULL)
+        head = list.m_head;
+      else
+        tail->m_next = list.m_head;
+      tail = list.m_tail;
+    }
+  }
+
+  // Resizing via zero size gets us all empty lists
+  SetSize(0);
+  SetSize(newSize);
+  InitialiseBuckets();
+
+  PHashTableList * lists = GetPointer();
+  while (head != NULL) {
+    PHashTableElement * element = head;
+    head = head->m_next;
+
+    PHashTableList & list = lists[element->m_bucket = GetBucket(element->m_hash)];
+    element->m_next = NULL;
+    element->m_prev = list.m_tail;
+    if (list.m_tail == NULL)
+      list.m_head = element;
+    else
+      list.m_tail->m_next = element;
+    list.m_tail = element;
+#if PTRACING
+    ++list.m_size;
+#endif
+    ++m_elementCount;
+  }
+}
+
+
 void PHashTableInfo::DestroyContents()
 {
   for (PINDEX i = 0; i < GetSize(); i++) {
@@ -1133,23 +1200,28 @@ void PHashTableInfo::DestroyContents()
       elmt = nextElmt;
     }
   }
+  m_elementCount = 0;
   PAbstractArray::DestroyContents();
 }
 
 
 void PHashTableInfo::AppendElement(PObject * key, PObject * data PTRACE_PARAM(, PHashTable * owner))
 {
-  PINDEX bucket = PAssertNULL(key)->HashFunction();
-  if (bucket >= GetSize())
-    SetSize(bucket+1);
+  PINDEX hash = PAssertNULL(key)->HashFunction();
 
+  if (m_elementCount >= GetSize()*MaxLoadPercent/100)
+    Rehash(GetSize() > 0 ? GetSize()*2 : (PINDEX)MinimumBuckets);
+
+  PINDEX bucket = GetBucket(hash);
   PHashTableList & list = operator[](bucket);
   PHashTableElement * element = new PHashTableElement;
   PAssert(element != NULL, POutOfMemory);
   element->m_key = key;
   element->m_data = data;
   element->m_bucket = bucket;
+  element->m_hash = hash;
   element->m_next = NULL;
+  ++m_elementCount;
 
   if (list.m_head == NULL) {
     element->m_prev = NULL;
@@ -1204,6 +1276,10 @@ PObject * PHashTableInfo::RemoveElement(const PObject & key)
     if (deleteKeys)
       delete element->m_key;
     delete element;
+
+    // Don't shrink while there are elements as the index order would change
+    if (--m_elementCount == 0)
+      Rehash(0);
   }
   return obj;
 }
@@ -1213,11 +1289,11 @@ PHashTableElement * PHashTableInfo::GetElementAt(PINDEX index)
 {
   PHashTableElement * element;
   PINDEX bucket = 0;
-  while ((element = GetAt(bucket).m_head) == NULL) {
+  do {
     if (bucket >= GetSize())
       return NULL;
-    bucket++;
-  }
+  } while ((element = GetAt(bucket++).m_head) == NULL);
+  --bucket;
 
   for (PINDEX i = 0; i < index; ++i) {
     if (element->m_next != NULL)
@@ -1236,9 +1312,13 @@ PHashTableElement * PHashTableInfo::GetElementAt(PINDEX index)
 
 PHashTableElement * PHashTableInfo::GetElementAt(const PObject & key)
 {
-  PHashTableElement * element = GetAt(key.HashFunction()).m_head;
+  if (GetSize() == 0)
+    return NULL;
+
+  PINDEX hash = key.HashFunction();
+  PHashTableElement * element = GetAt(GetBucket(hash)).m_head;
   while (element != NULL) {
-    if (*element->m_key == key) 
+    if (element->m_hash == hash && *element->m_key == key)
       return element;
     element = element->m_next;
   }
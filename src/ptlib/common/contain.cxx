@@ -98,6 +98,32 @@ PContainer::PContainer(PContainerReference & ref)
 }
 
 
+#if P_HAS_MOVE_SEMANTICS
+PContainer::PContainer(PContainer && cont) noexcept
+  : reference(cont.reference)
+{
+  PAssert2(reference != NULL, cont.GetClass(), "Move of deleted container");
+
+  // Static contents cannot be taken over, descendant copies them instead
+  if (reference->constObject)
+    ++reference->count;
+  else
+    cont.reference = NULL;
+}
+
+
+PContainer & PContainer::operator=(PContainer && cont)
+{
+  if (&cont != this) {
+    AssignContents(cont);
+    if (!cont.reference->constObject)
+      cont.Destruct();
+  }
+  return *this;
+}
+#endif
+
+
 void PContainer::AssignContents(const PContainer & cont)
 {
   if(cont.reference == NULL){
@@ -112,7 +138,8 @@ void PContainer::AssignContents(const PContainer & cont)
   if (reference == cont.reference)
     return;
 
-  if (--reference->count == 0) {
+  // Note reference may be NULL if the container had been moved
+  if (reference != NULL && --reference->count == 0) {
     DestroyContents();
     DestroyReference();
   }
@@ -662,17 +689,68 @@ PBoolean PBitArray::Concatenate(const PBitArray & array)
 
 ///////////////////////////////////////////////////////////////////////////////
 
+#define PSTRING_SMALL_INIT P_DISABLE_MSVC_WARNINGS(4355, PCharArray(m_small.m_reference))
+
 PString::PString()
-  : PCharArray(1)
+  : PSTRING_SMALL_INIT
   , m_length(0)
 {
+  InternalSetSmall(NULL, 0, 1);
 }
 
 
 PString::PString(const PString & str)
-  : PCharArray(str)
-  , m_length(str.GetLength())
+  : PSTRING_SMALL_INIT
+  , m_length(0)
+{
+  InternalCopy(str);
+}
+
+
+#if P_HAS_MOVE_SEMANTICS
+PString::PString(PString && str) noexcept
+  : PSTRING_SMALL_INIT
+  , m_length(0)
+{
+  // Short strings must be copied, a PConstantString is copied and left as is
+  if (str.reference->constObject) {
+    InternalCopy(str);
+    if (str.IsSmall()) {
+      str.InternalSetSmall(NULL, 0, 1);
+      str.m_length = 0;
+    }
+    return;
+  }
+
+  reference = str.reference;
+  theArray = str.theArray;
+  allocatedDynamically = str.allocatedDynamically;
+  m_length = str.GetLength();
+
+  str.reference = NULL;
+  str.InternalSetSmall(NULL, 0, 1);
+  str.m_length = 0;
+}
+
+
+PString & PString::operator=(PString && str)
+{
+  if (&str != this) {
+    AssignContents(str);
+    if (!str.reference->constObject || str.IsSmall()) {
+      str.InternalSetSmall(NULL, 0, 1);
+      str.m_length = 0;
+    }
+  }
+  return *this;
+}
+#endif
+
+
+PString::~PString()
 {
+  // Must be done here so our DestroyReference() is used
+  Destruct();
 }
 
 
@@ -684,36 +762,37 @@ PString::PString(const PCharArray & buf)
 
 
 PString::PString(const PBYTEArray & buf)
-  : m_length(0)
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
   PINDEX bufSize = buf.GetSize();
-  if (bufSize > 0) {
-    if (buf[bufSize-1] == '\0')
-      --bufSize;
-    memcpy(GetPointerAndSetLength(bufSize), buf, bufSize);
-  }
+  if (bufSize > 0 && buf[bufSize-1] == '\0')
+    --bufSize;
+  InternalSetString((const char *)(const BYTE *)buf, bufSize);
 }
 
 
 PString::PString(int, const PString * str)
-  : PCharArray(*str)
-  , m_length(str->GetLength())
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  InternalCopy(*str);
 }
 
 
 PString::PString(const std::string & str)
-  : PCharArray(str.c_str(), str.length()+1)
-  , m_length(str.length())
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  InternalSetString(str.c_str(), str.length());
 }
 
 
 PString::PString(char c)
-  : PCharArray(2)
-  , m_length(1)
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
-  *theArray = c;
+  InternalSetString(&c, 1);
 }
 
 
@@ -728,19 +807,17 @@ const PString & PString::Empty()
 
 
 PString::PString(const char * cstr)
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
-  if (cstr == NULL)
-    MakeEmpty();
-  else {
-    m_length = (PINDEX)strlen(cstr);
-    if (SetSize(m_length+1) && m_length > 0)
-      memcpy(theArray, cstr, m_length);
-  }
+  InternalSetString(cstr, cstr != NULL ? strlen(cstr) : 0);
 }
 
 #ifdef P_HAS_WCHAR
 
 PString::PString(const wchar_t * ustr)
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
   if (ustr == NULL)
     MakeEmpty();
@@ -753,12 +830,16 @@ PString::PString(const wchar_t * ustr)
 }
 
 PString::PString(const wchar_t * ustr, PINDEX len)
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
   InternalFromUCS2(ustr, len);
 }
 
 
 PString::PString(const PWCharArray & ustr)
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
   PINDEX size = ustr.GetSize();
   if (size > 0 && ustr[size-1] == 0) // Stip off trailing NULL if present
@@ -769,11 +850,10 @@ PString::PString(const PWCharArray & ustr)
 #endif // P_HAS_WCHAR
 
 PString::PString(const char * cstr, PINDEX len)
-  : PCharArray(len+1)
-  , m_length(len)
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
-  if (len > 0)
-    memcpy(theArray, PAssertNULL(cstr), len);
+  InternalSetString(len > 0 ? PAssertNULL(cstr) : cstr, len);
 }
 
 
@@ -833,9 +913,11 @@ static void TranslateEscapes(const char * & src, char * dst)
 
 
 PString::PString(ConversionType type, const char * str, ...)
-  : PCharArray(1)
+  : PSTRING_SMALL_INIT
   , m_length(0)
 {
+  InternalSetSmall(NULL, 0, 1);
+
   switch (type) {
     case Pascal :
       if (*str != '\0') {
@@ -893,61 +975,77 @@ template <typename S, typename U> PINDEX p_signed2string(S value, unsigned base,
 
 
 PString::PString(short n)
-  : PCharArray(sizeof(short)*3+2)
-  , m_length(p_signed2string<signed int, unsigned>(n, 10, theArray))
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  char digits[sizeof(short)*3+2];
+  InternalSetString(digits, p_signed2string<signed int, unsigned>(n, 10, digits));
 }
 
 
 PString::PString(unsigned short n)
-  : PCharArray(sizeof(unsigned short)*3+1)
-  , m_length(p_unsigned2string<unsigned int>(n, 10, theArray))
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  char digits[sizeof(unsigned short)*3+1];
+  InternalSetString(digits, p_unsigned2string<unsigned int>(n, 10, digits));
 }
 
 
 PString::PString(int n)
-  : PCharArray(sizeof(int)*3+2)
-  , m_length(p_signed2string<signed int, unsigned>(n, 10, theArray))
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  char digits[sizeof(int)*3+2];
+  InternalSetString(digits, p_signed2string<signed int, unsigned>(n, 10, digits));
 }
 
 
 PString::PString(unsigned int n)
-  : PCharArray(sizeof(unsigned int)*3+1)
-  , m_length(p_unsigned2string<unsigned int>(n, 10, theArray))
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  char digits[sizeof(unsigned int)*3+1];
+  InternalSetString(digits, p_unsigned2string<unsigned int>(n, 10, digits));
 }
 
 
 PString::PString(long n)
-  : PCharArray(sizeof(long)*3+2)
-  , m_length(p_signed2string<signed long, unsigned long>(n, 10, theArray))
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  char digits[sizeof(long)*3+2];
+  InternalSetString(digits, p_signed2string<signed long, unsigned long>(n, 10, digits));
 }
 
 
 PString::PString(unsigned long n)
-  : PCharArray(sizeof(unsigned long)*3+1)
-  , m_length(p_unsigned2string<unsigned long>(n, 10, theArray))
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  char digits[sizeof(unsigned long)*3+1];
+  InternalSetString(digits, p_unsigned2string<unsigned long>(n, 10, digits));
 }
 
 
 #ifdef HAVE_LONG_LONG_INT
 PString::PString(long long n)
-  : PCharArray(sizeof(long long)*3+2)
-  , m_length(p_signed2string<signed long long, unsigned long long>(n, 10, theArray))
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  char digits[sizeof(long long)*3+2];
+  InternalSetString(digits, p_signed2string<signed long long, unsigned long long>(n, 10, digits));
 }
 #endif
 
 
 #ifdef HAVE_UNSIGNED_LONG_LONG_INT
 PString::PString(unsigned long long n)
-  : PCharArray(sizeof(unsigned long long)*3+1)
-  , m_length(p_unsigned2string<unsigned long long>(n, 10, theArray))
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  char digits[sizeof(unsigned long long)*3+1];
+  InternalSetString(digits, p_unsigned2string<unsigned long long>(n, 10, digits));
 }
 #endif
 
@@ -1020,9 +1118,11 @@ template <typename S, typename U>
 
 #define PSTRING_CONV_CTOR(paramType, signedType, unsignedType) \
 PString::PString(ConversionType type, paramType value, unsigned param) \
-  : PCharArray(sizeof(paramType)*3+1) \
+  : PSTRING_SMALL_INIT \
+  , m_length(0) \
 { \
-  m_length = p_convert<signedType, unsignedType>(type, value, param, theArray); \
+  char digits[sizeof(paramType)*8+2]; \
+  InternalSetString(digits, p_convert<signedType, unsignedType>(type, value, param, digits)); \
 }
 
 PSTRING_CONV_CTOR(unsigned char,  char,   unsigned char);
@@ -1041,8 +1141,11 @@ PSTRING_CONV_CTOR(unsigned long long, long long, unsigned long long);
 
 
 PString::PString(ConversionType type, double value, unsigned places)
-  : m_length(0)
+  : PSTRING_SMALL_INIT
+  , m_length(0)
 {
+  InternalSetSmall(NULL, 0, 1);
+
   switch (type) {
     case Decimal :
       sprintf("%0.*f", (int)places, value);
@@ -1087,48 +1190,48 @@ PString::PString(ConversionType type, double value, unsigned places)
 
 PString & PString::operator=(short n)
 {
-  SetMinSize(sizeof(short)*3+1);
-  m_length = p_signed2string<signed int, unsigned int>(n, 10, theArray);
+  char digits[sizeof(short)*3+2];
+  InternalSetString(digits, p_signed2string<signed int, unsigned int>(n, 10, digits));
   return *this;
 }
 
 
 PString & PString::operator=(unsigned short n)
 {
-  SetMinSize(sizeof(unsigned short)*3+1);
-  m_length = p_unsigned2string<unsigned int>(n, 10, theArray);
+  char digits[sizeof(unsigned short)*3+2];
+  InternalSetString(digits, p_unsigned2string<unsigned int>(n, 10, digits));
   return *this;
 }
 
 
 PString & PString::operator=(int n)
 {
-  SetMinSize(sizeof(int)*3+1);
-  m_length = p_signed2string<signed int, unsigned int>(n, 10, theArray);
+  char digits[sizeof(int)*3+2];
+  InternalSetString(digits, p_signed2string<signed int, unsigned int>(n, 10, digits));
   return *this;
 }
 
 
 PString & PString::operator=(unsigned int n)
 {
-  SetMinSize(sizeof(unsigned int)*3+1);
-  m_length = p_unsigned2string<unsigned int>(n, 10, theArray);
+  char digits[sizeof(unsigned int)*3+2];
+  InternalSetString(digits, p_unsigned2string<unsigned int>(n, 10, digits));
   return *this;
 }
 
 
 PString & PString::operator=(long n)
 {
-  SetMinSize(sizeof(long)*3+1);
-  m_length = p_signed2string<signed long,  unsigned long>(n, 10, theArray);
+  char digits[sizeof(long)*3+2];
+  InternalSetString(digits, p_signed2string<signed long,  unsigned long>(n, 10, digits));
   return *this;
 }
 
 
 PString & PString::operator=(unsigned long n)
 {
-  SetMinSize(sizeof(unsigned long)*3+1);
-  m_length = p_unsigned2string<unsigned long>(n, 10, theArray);
+  char digits[sizeof(unsigned long)*3+2];
+  InternalSetString(digits, p_unsigned2string<unsigned long>(n, 10, digits));
   return *this;
 }
 
@@ -1136,8 +1239,8 @@ PString & PString::operator=(unsigned long n)
 #ifdef HAVE_LONG_LONG_INT
 PString & PString::operator=(long long n)
 {
-  SetMinSize(sizeof(long long)*3+1);
-  m_length = p_signed2string<signed long long, unsigned long long>(n, 10, theArray);
+  char digits[sizeof(long long)*3+2];
+  InternalSetString(digits, p_signed2string<signed long long, unsigned long long>(n, 10, digits));
   return *this;
 }
 #endif
@@ -1146,8 +1249,8 @@ PString & PString::operator=(long long n)
 #ifdef HAVE_UNSIGNED_LONG_LONG_INT
 PString & PString::operator=(unsigned long long n)
 {
-  SetMinSize(sizeof(unsigned long long)*3+1);
-  m_length = p_unsigned2string<unsigned long long>(n, 10, theArray);
+  char digits[sizeof(unsigned long long)*3+2];
+  InternalSetString(digits, p_unsigned2string<unsigned long long>(n, 10, digits));
   return *this;
 }
 #endif
@@ -1155,8 +1258,77 @@ PString & PString::operator=(unsigned long long n)
 
 void PString::AssignContents(const PContainer & cont)
 {
-  PCharArray::AssignContents(cont);
-  m_length = ((const PString &)cont).GetLength();
+  const PString & str = (const PString &)cont;
+  if (str.reference != reference && str.reference->constObject && str.GetSize() <= SmallStringSize)
+    InternalSetSmall(str.theArray, str.GetSize(), std::max(str.GetSize(), (PINDEX)1));
+  else
+    PCharArray::AssignContents(cont);
+  m_length = str.GetLength();
+}
+
+
+void PString::DestroyReference()
+{
+  if (IsSmall())
+    reference = NULL;
+  else
+    PCharArray::DestroyReference();
+}
+
+
+void PString::InternalSetSmall(const char * data, PINDEX copySize, PINDEX newSize)
+{
+  // Copy first, as data is probably in the array about to be released
+  if (copySize > 0 && data != m_small.m_buffer)
+    memcpy(m_small.m_buffer, data, copySize);
+  if (newSize > copySize)
+    memset(m_small.m_buffer+copySize, 0, newSize-copySize);
+
+  if (!IsSmall()) {
+    if (reference != NULL && --reference->count == 0) {
+      DestroyContents();
+      DestroyReference();
+    }
+    reference = &m_small.m_reference;
+    m_small.m_reference.count = 1;
+  }
+
+  m_small.m_reference.size = newSize;
+  theArray = m_small.m_buffer;
+  allocatedDynamically = false;
+}
+
+
+void PString::InternalSetString(const char * str, PINDEX len)
+{
+  m_length = 0;
+  if (SetSize(len+1)) {
+    if (len > 0)
+      memcpy(theArray, str, len);
+    theArray[len] = '\0';
+    m_length = len;
+  }
+}
+
+
+void PString::InternalCopy(const PString & str)
+{
+  PAssert2(str.reference != NULL, str.GetClass(), "Copy of deleted string");
+
+  PINDEX size = str.GetSize();
+  if (str.reference->constObject && size <= SmallStringSize)
+    InternalSetSmall(str.theArray, size, std::max(size, (PINDEX)1));
+  else {
+    // Reference the same contents, any unused small buffer is ignored
+    reference = str.reference;
+    ++reference->count;
+    theArray = str.theArray;
+    allocatedDynamically = str.allocatedDynamically;
+    if (reference->constObject)
+      MakeUnique();
+  }
+
+  m_length = str.GetLength();
 }
 
 
@@ -1222,7 +1394,7 @@ PINDEX PString::HashFunction() const
     case 0:
       return 0;
     case 1:
-      return tolower(theArray[0] & 0xff) % 127;
+      return tolower(theArray[0] & 0xff);
   }
 
   static const PINDEX MaxCount = 18; // Make sure big enough to cover whole PGloballyUniqueID::AsString()
@@ -1233,7 +1405,7 @@ PINDEX PString::HashFunction() const
     hash = (hash << 5) ^ tolower(theArray[i] & 0xff) ^ hash;
   for (i = m_length - count - 1; i < m_length; i++)
     hash = (hash << 5) ^ tolower(theArray[i] & 0xff) ^ hash;
-  return hash % 127;
+  return hash;
 }
 
 
@@ -1248,7 +1420,24 @@ PBoolean PString::SetSize(PINDEX newSize)
   if (newSize < 1)
     newSize = 1;
 
-  if (!InternalSetSize(newSize, !IsUnique()))
+  PINDEX oldSize = GetSize();
+  if (newSize <= SmallStringSize) {
+    // Leave a unique array alone if no change, the pointer is expected to be stable
+    if (IsSmall() || newSize != oldSize || !IsUnique())
+      InternalSetSmall(theArray, std::min(oldSize, newSize), newSize);
+  }
+  else if (IsSmall()) {
+    char * newArray = PAbstractArrayAllocate(newSize);
+    if (newArray == NULL)
+      return false;
+    if (oldSize > 0)
+      memcpy(newArray, theArray, oldSize);
+    memset(newArray+oldSize, 0, newSize-oldSize);
+    reference = new PContainerReference(newSize);
+    theArray = newArray;
+    allocatedDynamically = true;
+  }
+  else if (!InternalSetSize(newSize, !IsUnique()))
     return false;
 
   if (GetLength() >= newSize) {
@@ -1265,7 +1454,10 @@ PBoolean PString::MakeUnique()
   if (IsUnique())
     return true;
 
-  InternalSetSize(GetSize(), true);
+  if (GetSize() <= SmallStringSize)
+    InternalSetSmall(theArray, GetSize(), std::max(GetSize(), (PINDEX)1));
+  else
+    InternalSetSize(GetSize(), true);
   return false;
 }
 
@@ -0,0 +1,471 @@
+/*
+ * jidctint.c
+ *
+ * Copyright (C) 1994-1998, Thomas G. Lane.
+ * This file is part of the Independent JPEG Group's software.
+ *
+ * The authors make NO WARRANTY or representation, either express or implied,
+ * with respect to this software, its quality, accuracy, merchantability, or 
+ * fitness for a particular purpose.  This software is provided "AS IS", and you,
+ * its user, assume the entire risk as to its quality and accuracy.
+ *
+ * This software is copyright (C) 1991-1998, Thomas G. Lane.
+ * All Rights Reserved except as specified below.
+ *
+ * Permission is hereby granted to use, copy, modify, and distribute this
+ * software (or portions thereof) for any purpose, without fee, subject to these
+ * conditions:
+ * (1) If any part of the source code for this software is distributed, then this
+ * README file must be included, with this copyright and no-warranty notice
+ * unaltered; and any additions, deletions, or changes to the original files
+ * must be clearly indicated in accompanying documentation.
+ * (2) If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the work of
+ * the Independent JPEG Group".
+ * (3) Permission for use of this software is granted only if the user accepts
+ * full responsibility for any undesirable consequences; the authors accept
+ * NO LIABILITY for damages of any kind.
+ * 
+ * These conditions apply to any software derived from or based on the IJG code,
+ * not just to the unmodified library.  If you use our work, you ought to
+ * acknowledge us.
+ * 
+ * Permission is NOT granted for the use of any IJG author's name or company name
+ * in advertising or publicity relating to this software or products derived from
+ * it.  This software may be referred to only as "the Independent JPEG Group's
+ * software".
+ * 
+ * We specifically permit and encourage the use of this software as the basis of
+ * commercial products, provided that all warranty or liability claims are
+ * assumed by the product vendor.
+ *
+ *
+ *
+ * This file contains a slow-but-accurate integer implementation of the
+ * inverse DCT (Discrete Cosine Transform).  In the IJG code, this routine
+ * must also perform dequantization of the input coefficients.
+ *
+ * A 2-D IDCT can be done by 1-D IDCT on each column followed by 1-D IDCT
+ * on each row (or vice versa, but it's more convenient to emit a row at
+ * a time).  Direct algorithms are also available, but they are much more
+ * complex and seem not to be any faster when reduced to code.
+ *
+ * This implementation is based on an algorithm described in
+ *   C. Loeffler, A. Ligtenberg and G. Moschytz, "Practical Fast 1-D DCT
+ *   Algorithms with 11 Multiplications", Proc. Int'l. Conf. on Acoustics,
+ *   Speech, and Signal Processing 1989 (ICASSP '89), pp. 988-991.
+ * The primary algorithm described there uses 11 multiplies and 29 adds.
+ * We use their alternate method with 12 multiplies and 32 adds.
+ *
+ * Modified for tinyjpeg: the coefficients are dequantized with 16 bit
+ * arithmetic and the intermediate results between the passes are saturated
+ * to 16 bits. For all valid JPEG data this makes no difference, but it means
+ * the SSE2 version, which does eight columns or rows at a time, produces
+ * output identical to the scalar version for any input.
+ */
+#ifdef _MSC_VER
+#include "stdint.h"
+#else
+#include <inttypes.h>
+#endif
+
+#include "tinyjpeg-internal.h"
+
+#if TINYJPEG_SSE2
+#include <emmintrin.h>
+#endif
+
+#define DCTSIZE	   8
+#define DCTSIZE2   (DCTSIZE*DCTSIZE)
+
+#define CONST_BITS  13
+#define PASS1_BITS  2
+
+#define FIX_0_298631336  ((int32_t)  2446)
+#define FIX_0_390180644  ((int32_t)  3196)
+#define FIX_0_541196100  ((int32_t)  4433)
+#define FIX_0_765366865  ((int32_t)  6270)
+#define FIX_0_899976223  ((int32_t)  7373)
+#define FIX_1_175875602  ((int32_t)  9633)
+#define FIX_1_501321110  ((int32_t)  12299)
+#define FIX_1_847759065  ((int32_t)  15137)
+#define FIX_1_961570560  ((int32_t)  16069)
+#define FIX_2_053119869  ((int32_t)  16819)
+#define FIX_2_562915447  ((int32_t)  20995)
+#define FIX_3_072711026  ((int32_t)  25172)
+
+#define DESCALE(x,n)  (((x) + (1 << ((n)-1))) >> (n))
+
+#define DEQUANTIZE(coef,quantval)  ((int16_t)((coef) * (quantval)))
+
+
+static inline int16_t saturate16(int32_t x)
+{
+  if (x < -32768)
+    return -32768;
+  if (x > 32767)
+    return 32767;
+  return (int16_t)x;
+}
+
+static inline uint8_t range_limit(int32_t x)
+{
+  x += 128;
+  if (x < 0)
+    return 0;
+  if (x > 255)
+    return 255;
+  return (uint8_t)x;
+}
+
+
+/*
+ * Perform dequantization and inverse DCT on one block of coefficients.
+ */
+
+void
+tinyjpeg_idct_int (struct component *compptr, uint8_t *output_buf, int stride)
+{
+  int32_t tmp0, tmp1, tmp2, tmp3;
+  int32_t tmp10, tmp11, tmp12, tmp13;
+  int32_t z1, z2, z3, z4, z5;
+  const int16_t *inptr;
+  const int16_t *quantptr;
+  int16_t *wsptr;
+  uint8_t *outptr;
+  int ctr;
+  int16_t workspace[DCTSIZE2]; /* buffers data between passes */
+
+  /* Pass 1: process columns from input, store into work array. */
+  /* Note results are scaled up by sqrt(8) compared to a true IDCT; */
+  /* furthermore, we scale the results by 2**PASS1_BITS. */
+
+  inptr = compptr->DCT;
+  quantptr = compptr->IQ_table;
+  wsptr = workspace;
+  for (ctr = DCTSIZE; ctr > 0; ctr--) {
+    /* Columns of zero AC terms are very common, the result is then simply
+     * the DC term suitably scaled, which is the same as the full calculation.
+     */
+    if (inptr[DCTSIZE*1] == 0 && inptr[DCTSIZE*2] == 0 &&
+	inptr[DCTSIZE*3] == 0 && inptr[DCTSIZE*4] == 0 &&
+	inptr[DCTSIZE*5] == 0 && inptr[DCTSIZE*6] == 0 &&
+	inptr[DCTSIZE*7] == 0) {
+      /* AC terms all zero */
+      int16_t dcval = saturate16(DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]) << PASS1_BITS);
+
+      wsptr[DCTSIZE*0] = dcval;
+      wsptr[DCTSIZE*1] = dcval;
+      wsptr[DCTSIZE*2] = dcval;
+      wsptr[DCTSIZE*3] = dcval;
+      wsptr[DCTSIZE*4] = dcval;
+      wsptr[DCTSIZE*5] = dcval;
+      wsptr[DCTSIZE*6] = dcval;
+      wsptr[DCTSIZE*7] = dcval;
+
+      inptr++;			/* advance pointers to next column */
+      quantptr++;
+      wsptr++;
+      continue;
+    }
+
+    /* Even part: reverse the even part of the forward DCT. */
+    /* The rotator is sqrt(2)*c(-6). */
+
+    z2 = DEQUANTIZE(inptr[DCTSIZE*2], quantptr[DCTSIZE*2]);
+    z3 = DEQUANTIZE(inptr[DCTSIZE*6], quantptr[DCTSIZE*6]);
+
+    z1 = (z2 + z3) * FIX_0_541196100;
+    tmp2 = z1 + z3 * (- FIX_1_847759065);
+    tmp3 = z1 + z2 * FIX_0_765366865;
+
+    z2 = DEQUANTIZE(inptr[DCTSIZE*0], quantptr[DCTSIZE*0]);
+    z3 = DEQUANTIZE(inptr[DCTSIZE*4], quantptr[DCTSIZE*4]);
+
+    tmp0 = (z2 + z3) << CONST_BITS;
+    tmp1 = (z2 - z3) << CONST_BITS;
+
+    tmp10 = tmp0 + tmp3;
+    tmp13 = tmp0 - tmp3;
+    tmp11 = tmp1 + tmp2;
+    tmp12 = tmp1 - tmp2;
+
+    /* Odd part per figure 8; the matrix is unitary and hence its
+     * transpose is its inverse.  i0..i3 are y7,y5,y3,y1 respectively.
+     */
+
+    tmp0 = DEQUANTIZE(inptr[DCTSIZE*7], quantptr[DCTSIZE*7]);
+    tmp1 = DEQUANTIZE(inptr[DCTSIZE*5], quantptr[DCTSIZE*5]);
+    tmp2 = DEQUANTIZE(inptr[DCTSIZE*3], quantptr[DCTSIZE*3]);
+    tmp3 = DEQUANTIZE(inptr[DCTSIZE*1], quantptr[DCTSIZE*1]);
+
+    z1 = tmp0 + tmp3;
+    z2 = tmp1 + tmp2;
+    z3 = tmp0 + tmp2;
+    z4 = tmp1 + tmp3;
+    z5 = (z3 + z4) * FIX_1_175875602; /* sqrt(2) * c3 */
+
+    tmp0 = tmp0 * FIX_0_298631336; /* sqrt(2) * (-c1+c3+c5-c7) */
+    tmp1 = tmp1 * FIX_2_053119869; /* sqrt(2) * ( c1+c3-c5+c7) */
+    tmp2 = tmp2 * FIX_3_072711026; /* sqrt(2) * ( c1+c3+c5-c7) */
+    tmp3 = tmp3 * FIX_1_501321110; /* sqrt(2) * ( c1+c3-c5-c7) */
+    z1 = z1 * (- FIX_0_899976223); /* sqrt(2) * (c7-c3) */
+    z2 = z2 * (- FIX_2_562915447); /* sqrt(2) * (-c1-c3) */
+    z3 = z3 * (- FIX_1_961570560); /* sqrt(2) * (-c3-c5) */
+    z4 = z4 * (- FIX_0_390180644); /* sqrt(2) * (c5-c3) */
+
+    z3 += z5;
+    z4 += z5;
+
+    tmp0 += z1 + z3;
+    tmp1 += z2 + z4;
+    tmp2 += z2 + z3;
+    tmp3 += z1 + z4;
+
+    /* Final output stage: inputs are tmp10..tmp13, tmp0..tmp3 */
+
+    wsptr[DCTSIZE*0] = saturate16(DESCALE(tmp10 + tmp3, CONST_BITS-PASS1_BITS));
+    wsptr[DCTSIZE*7] = saturate16(DESCALE(tmp10 - tmp3, CONST_BITS-PASS1_BITS));
+    wsptr[DCTSIZE*1] = saturate16(DESCALE(tmp11 + tmp2, CONST_BITS-PASS1_BITS));
+    wsptr[DCTSIZE*6] = saturate16(DESCALE(tmp11 - tmp2, CONST_BITS-PASS1_BITS));
+    wsptr[DCTSIZE*2] = saturate16(DESCALE(tmp12 + tmp1, CONST_BITS-PASS1_BITS));
+    wsptr[DCTSIZE*5] = saturate16(DESCALE(tmp12 - tmp1, CONST_BITS-PASS1_BITS));
+    wsptr[DCTSIZE*3] = saturate16(DESCALE(tmp13 + tmp0, CONST_BITS-PASS1_BITS));
+    wsptr[DCTSIZE*4] = saturate16(DESCALE(tmp13 - tmp0, CONST_BITS-PASS1_BITS));
+
+    inptr++;			/* advance pointers to next column */
+    quantptr++;
+    wsptr++;
+  }
+
+  /* Pass 2: process rows from work array, store into output array. */
+  /* Note that we must descale the results by a factor of 8 == 2**3, */
+  /* and also undo the PASS1_BITS scaling. */
+
+  wsptr = workspace;
+  outptr = output_buf;
+  for (ctr = 0; ctr < DCTSIZE; ctr++) {
+    /* Rows of zeroes can be exploited in the same way as we did with columns,
+     * though the column calculation has created many nonzero AC terms, so
+     * the simplification applies less often (typically 5% to 10% of the time).
+     */
+    if (wsptr[1] == 0 && wsptr[2] == 0 && wsptr[3] == 0 && wsptr[4] == 0 &&
+	wsptr[5] == 0 && wsptr[6] == 0 && wsptr[7] == 0) {
+      /* AC terms all zero */
+      uint8_t dcval = range_limit(DESCALE((int32_t) wsptr[0], PASS1_BITS+3));
+
+      outptr[0] = dcval;
+      outptr[1] = dcval;
+      outptr[2] = dcval;
+      outptr[3] = dcval;
+      outptr[4] = dcval;
+      outptr[5] = dcval;
+      outptr[6] = dcval;
+      outptr[7] = dcval;
+
+      wsptr += DCTSIZE;		/* advance pointer to next row */
+      outptr += stride;
+      continue;
+    }
+
+    /* Even part: reverse the even part of the forward DCT. */
+    /* The rotator is sqrt(2)*c(-6). */
+
+    z2 = (int32_t) wsptr[2];
+    z3 = (int32_t) wsptr[6];
+
+    z1 = (z2 + z3) * FIX_0_541196100;
+    tmp2 = z1 + z3 * (- FIX_1_847759065);
+    tmp3 = z1 + z2 * FIX_0_765366865;
+
+    tmp0 = ((int32_t) wsptr[0] + (int32_t) wsptr[4]) << CONST_BITS;
+    tmp1 = ((int32_t) wsptr[0] - (int32_t) wsptr[4]) << CONST_BITS;
+
+    tmp10 = tmp0 + tmp3;
+    tmp13 = tmp0 - tmp3;
+    tmp11 = tmp1 + tmp2;
+    tmp12 = tmp1 - tmp2;
+
+    /* Odd part per figure 8; the matrix is unitary and hence its
+     * transpose is its inverse.  i0..i3 are y7,y5,y3,y1 respectively.
+     */
+
+    tmp0 = (int32_t) wsptr[7];
+    tmp1 = (int32_t) wsptr[5];
+    tmp2 = (int32_t) wsptr[3];
+    tmp3 = (int32_t) wsptr[1];
+
+    z1 = tmp0 + tmp3;
+    z2 = tmp1 + tmp2;
+    z3 = tmp0 + tmp2;
+    z4 = tmp1 + tmp3;
+    z5 = (z3 + z4) * FIX_1_175875602; /* sqrt(2) * c3 */
+
+    tmp0 = tmp0 * FIX_0_298631336; /* sqrt(2) * (-c1+c3+c5-c7) */
+    tmp1 = tmp1 * FIX_2_053119869; /* sqrt(2) * ( c1+c3-c5+c7) */
+    tmp2 = tmp2 * FIX_3_072711026; /* sqrt(2) * ( c1+c3+c5-c7) */
+    tmp3 = tmp3 * FIX_1_501321110; /* sqrt(2) * ( c1+c3-c5-c7) */
+    z1 = z1 * (- FIX_0_899976223); /* sqrt(2) * (c7-c3) */
+    z2 = z2 * (- FIX_2_562915447); /* sqrt(2) * (-c1-c3) */
+    z3 = z3 * (- FIX_1_961570560); /* sqrt(2) * (-c3-c5) */
+    z4 = z4 * (- FIX_0_390180644); /* sqrt(2) * (c5-c3) */
+
+    z3 += z5;
+    z4 += z5;
+
+    tmp0 += z1 + z3;
+    tmp1 += z2 + z4;
+    tmp2 += z2 + z3;
+    tmp3 += z1 + z4;
+
+    /* Final output stage: inputs are tmp10..tmp13, tmp0..tmp3 */
+
+    outptr[0] = range_limit(DESCALE(tmp10 + tmp3, CONST_BITS+PASS1_BITS+3));
+    outptr[7] = range_limit(DESCALE(tmp10 - tmp3, CONST_BITS+PASS1_BITS+3));
+    outptr[1] = range_limit(DESCALE(tmp11 + tmp2, CONST_BITS+PASS1_BITS+3));
+    outptr[6] = range_limit(DESCALE(tmp11 - tmp2, CONST_BITS+PASS1_BITS+3));
+    outptr[2] = range_limit(DESCALE(tmp12 + tmp1, CONST_BITS+PASS1_BITS+3));
+    outptr[5] = range_limit(DESCALE(tmp12 - tmp1, CONST_BITS+PASS1_BITS+3));
+    outptr[3] = range_limit(DESCALE(tmp13 + tmp0, CONST_BITS+PASS1_BITS+3));
+    outptr[4] = range_limit(DESCALE(tmp13 - tmp0, CONST_BITS+PASS1_BITS+3));
+
+    wsptr += DCTSIZE;		/* advance pointer to next row */
+    outptr += stride;
+  }
+}
+
+
+#if TINYJPEG_SSE2
+
+/*
+ * The SSE2 version does the same 1-D IDCT on eight columns, and then eight
+ * rows, at once. The multiplications are done with pmaddwd on interleaved
+ * pairs of inputs, so the constants above are folded together, e.g. for the
+ * even part tmp3 = z2 * (c0.541 + c0.765) + z3 * c0.541, which is exactly
+ * the same value as the scalar calculation.
+ */
+
+#define PAIR(a,b) _mm_set_epi16((short)(b),(short)(a),(short)(b),(short)(a),(short)(b),(short)(a),(short)(b),(short)(a))
+
+static inline void idct_1d_half_sse2(__m128i p04, __m128i p26, __m128i p13, __m128i p57,
+                                     __m128i round, int shift, __m128i out[8])
+{
+  __m128i tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+
+  /* Even part */
+  tmp2 = _mm_madd_epi16(p26, PAIR(FIX_0_541196100, FIX_0_541196100 - FIX_1_847759065));
+  tmp3 = _mm_madd_epi16(p26, PAIR(FIX_0_541196100 + FIX_0_765366865, FIX_0_541196100));
+  tmp0 = _mm_madd_epi16(p04, PAIR(1 << CONST_BITS,  1 << CONST_BITS));
+  tmp1 = _mm_madd_epi16(p04, PAIR(1 << CONST_BITS, -(1 << CONST_BITS)));
+
+  tmp10 = _mm_add_epi32(_mm_add_epi32(tmp0, tmp3), round);
+  tmp13 = _mm_add_epi32(_mm_sub_epi32(tmp0, tmp3), round);
+  tmp11 = _mm_add_epi32(_mm_add_epi32(tmp1, tmp2), round);
+  tmp12 = _mm_add_epi32(_mm_sub_epi32(tmp1, tmp2), round);
+
+  /* Odd part, with z1..z5 folded into the constants */
+  tmp0 = _mm_add_epi32(_mm_madd_epi16(p13, PAIR(FIX_1_175875602 - FIX_0_899976223,
+                                                FIX_1_175875602 - FIX_1_961570560)),
+                       _mm_madd_epi16(p57, PAIR(FIX_1_175875602,
+                                                FIX_0_298631336 - FIX_0_899976223 - FIX_1_961570560 + FIX_1_175875602)));
+  tmp1 = _mm_add_epi32(_mm_madd_epi16(p13, PAIR(FIX_1_175875602 - FIX_0_390180644,
+                                                FIX_1_175875602 - FIX_2_562915447)),
+                       _mm_madd_epi16(p57, PAIR(FIX_2_053119869 - FIX_2_562915447 - FIX_0_390180644 + FIX_1_175875602,
+                                                FIX_1_175875602)));
+  tmp2 = _mm_add_epi32(_mm_madd_epi16(p13, PAIR(FIX_1_175875602,
+                                                FIX_3_072711026 - FIX_2_562915447 - FIX_1_961570560 + FIX_1_175875602)),
+                       _mm_madd_epi16(p57, PAIR(FIX_1_175875602 - FIX_2_562915447,
+                                                FIX_1_175875602 - FIX_1_961570560)));
+  tmp3 = _mm_add_epi32(_mm_madd_epi16(p13, PAIR(FIX_1_501321110 - FIX_0_899976223 - FIX_0_390180644 + FIX_1_175875602,
+                                                FIX_1_175875602)),
+                       _mm_madd_epi16(p57, PAIR(FIX_1_175875602 - FIX_0_390180644,
+                                                FIX_1_175875602 - FIX_0_899976223)));
+
+  out[0] = _mm_srai_epi32(_mm_add_epi32(tmp10, tmp3), shift);
+  out[7] = _mm_srai_epi32(_mm_sub_epi32(tmp10, tmp3), shift);
+  out[1] = _mm_srai_epi32(_mm_add_epi32(tmp11, tmp2), shift);
+  out[6] = _mm_srai_epi32(_mm_sub_epi32(tmp11, tmp2), shift);
+  out[2] = _mm_srai_epi32(_mm_add_epi32(tmp12, tmp1), shift);
+  out[5] = _mm_srai_epi32(_mm_sub_epi32(tmp12, tmp1), shift);
+  out[3] = _mm_srai_epi32(_mm_add_epi32(tmp13, tmp0), shift);
+  out[4] = _mm_srai_epi32(_mm_sub_epi32(tmp13, tmp0), shift);
+}
+
+
+/* 1-D IDCT of eight columns of 16 bit values, result saturated to 16 bits */
+static inline void idct_1d_sse2(__m128i data[8], int shift)
+{
+  __m128i round = _mm_set1_epi32(1 << (shift-1));
+  __m128i lo[8], hi[8];
+  int i;
+
+  idct_1d_half_sse2(_mm_unpacklo_epi16(data[0], data[4]), _mm_unpacklo_epi16(data[2], data[6]),
+                    _mm_unpacklo_epi16(data[1], data[3]), _mm_unpacklo_epi16(data[5], data[7]),
+                    round, shift, lo);
+  idct_1d_half_sse2(_mm_unpackhi_epi16(data[0], data[4]), _mm_unpackhi_epi16(data[2], data[6]),
+                    _mm_unpackhi_epi16(data[1], data[3]), _mm_unpackhi_epi16(data[5], data[7]),
+                    round, shift, hi);
+
+  for (i = 0; i < DCTSIZE; i++)
+    data[i] = _mm_packs_epi32(lo[i], hi[i]);
+}
+
+
+static inline void transpose_8x8_sse2(__m128i r[8])
+{
+  __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+  __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+  __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+  __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+  __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+  __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+  __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+  __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+  __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+  __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+  __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+  __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+  __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+  __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+  __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+  __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+  r[0] = _mm_unpacklo_epi64(b0, b4);
+  r[1] = _mm_unpackhi_epi64(b0, b4);
+  r[2] = _mm_unpacklo_epi64(b1, b5);
+  r[3] = _mm_unpackhi_epi64(b1, b5);
+  r[4] = _mm_unpacklo_epi64(b2, b6);
+  r[5] = _mm_unpackhi_epi64(b2, b6);
+  r[6] = _mm_unpacklo_epi64(b3, b7);
+  r[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+
+void
+tinyjpeg_idct_int_sse2 (struct component *compptr, uint8_t *output_buf, int stride)
+{
+  const __m128i *inptr = (const __m128i *)compptr->DCT;
+  const __m128i *quantptr = (const __m128i *)compptr->IQ_table;
+  const __m128i centre = _mm_set1_epi8((char)0x80);
+  __m128i data[DCTSIZE];
+  int i;
+
+  /* Pass 1: columns, each vector is one row of coefficients */
+  for (i = 0; i < DCTSIZE; i++)
+    data[i] = _mm_mullo_epi16(_mm_loadu_si128(inptr+i), _mm_loadu_si128(quantptr+i));
+  idct_1d_sse2(data, CONST_BITS-PASS1_BITS);
+
+  /* Pass 2: rows */
+  transpose_8x8_sse2(data);
+  idct_1d_sse2(data, CONST_BITS+PASS1_BITS+3);
+  transpose_8x8_sse2(data);
+
+  /* Saturating to signed bytes then offsetting by 128 is the range limit */
+  for (i = 0; i < DCTSIZE; i++) {
+    _mm_storel_epi64((__m128i *)output_buf, _mm_xor_si128(_mm_packs_epi16(data[i], data[i]), centre));
+    output_buf += stride;
+  }
+}
+
+#endif // TINYJPEG_SSE2
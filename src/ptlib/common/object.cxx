@@ -38,6 +38,14 @@
 #include <fstream>
 #include <ctype.h>
 #include <limits>
+#if P_PROFILING
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#endif
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#endif
 #ifdef _WIN32
 #include <ptlib/msos/ptlib/debstrm.h>
 #if defined(_MSC_VER)
@@ -1454,21 +1462,82 @@ istream & istream::operator>>(PUInt64 & v)
 
 namespace PProfiling
 {
+  // GetCycles() uses the time stamp counter, the rate of which must be measured
+#if defined(P_HAS_RDTSC) || defined(__i386__) || defined(__x86_64__)
+  #define P_PROFILING_TSC 1
+
+  static uint64_t GetReferenceNanoseconds()
+  {
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0)
+      QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER li;
+    QueryPerformanceCounter(&li);
+    return (uint64_t)((long double)li.QuadPart*PTimeInterval::SecsToNano/frequency.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL+ts.tv_nsec;
+#else
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec*1000000000ULL+tv.tv_usec*1000ULL;
+#endif
+  }
+#endif // P_PROFILING_TSC
+
+
   static uint64_t InitFrequency()
   {
-#if defined(P_LINUX)
-    ifstream cpuinfo("/proc/cpuinfo", ios::in);
-    while (cpuinfo.good()) {
-      char line[100];
-      cpuinfo.getline(line, sizeof(line));
-      if (strncmp(line, "cpu MHz", 7) == 0)
-        return (uint64_t)(atof(strchr(line, ':')+1)*1000000);
+#if P_PROFILING_TSC
+  #if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    // Newer CPUs give the TSC to core crystal clock ratio, which is exact
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) >= 0x15) {
+      __cpuid(0x15, eax, ebx, ecx, edx);
+      if (eax != 0 && ebx != 0 && ecx != 0)
+        return (uint64_t)ecx*ebx/eax;
     }
-    return 2000000000; // 2GHz
-#elif defined(_M_IX86) || defined(_M_X64) || defined(_WIN32)
+  #endif
+
+    /* Otherwise, calibrate the TSC against the monotonic clock. Each sample
+       of the TSC is bracketed by reading the reference clock, and the
+       tightest bracket used, to minimise the effect of being preempted. */
+    static const uint64_t CalibrationNanoseconds = 10000000; // 10ms
+
+    uint64_t startNano = 0, startCycles = 0, endNano = 0, endCycles = 0;
+    uint64_t bestBracket = std::numeric_limits<uint64_t>::max();
+    for (int i = 0; i < 5; ++i) {
+      uint64_t before = GetReferenceNanoseconds();
+      uint64_t cycles = GetCycles();
+      uint64_t after = GetReferenceNanoseconds();
+      if (after - before < bestBracket) {
+        bestBracket = after - before;
+        startNano = before + bestBracket/2;
+        startCycles = cycles;
+      }
+    }
+
+    do {
+      bestBracket = std::numeric_limits<uint64_t>::max();
+      for (int i = 0; i < 5; ++i) {
+        uint64_t before = GetReferenceNanoseconds();
+        uint64_t cycles = GetCycles();
+        uint64_t after = GetReferenceNanoseconds();
+        if (after - before < bestBracket) {
+          bestBracket = after - before;
+          endNano = before + bestBracket/2;
+          endCycles = cycles;
+        }
+      }
+    } while (endNano - startNano < CalibrationNanoseconds);
+
+    return (uint64_t)((long double)(endCycles - startCycles)*PTimeInterval::SecsToNano/(endNano - startNano));
+#elif defined(_WIN32)
     LARGE_INTEGER li;
     QueryPerformanceFrequency(&li);
-    return li.QuadPart * 1000;
+    return li.QuadPart;
 #elif defined(CLOCK_MONOTONIC)
     return 1000000000ULL;
 #else
@@ -1476,18 +1545,25 @@ namespace PProfiling
 #endif
   }
 
-  static uint64_t gs_Frequency = InitFrequency();
+
+  // Calibrated on first use, rather than adding the calibration delay to every process start up
+  static uint64_t GetFrequency()
+  {
+    static uint64_t const frequency = InitFrequency();
+    return frequency;
+  }
+
 
   int64_t CyclesToNanoseconds(uint64_t cycles)
   {
-    static long double const gs_CyclesPerNanoseconds = (long double)gs_Frequency/PTimeInterval::SecsToNano;
+    static long double const gs_CyclesPerNanoseconds = (long double)GetFrequency()/PTimeInterval::SecsToNano;
     return (int64_t)(cycles/gs_CyclesPerNanoseconds);
   }
 
 
   float CyclesToSeconds(uint64_t cycles)
   {
-    return (float)((double)cycles/gs_Frequency);
+    return (float)((double)cycles/GetFrequency());
   }
 
 
@@ -1503,27 +1579,21 @@ namespace PProfiling
     e_ManualEntry,
     e_ManualExit,
     e_SystemEntry,
-    e_SystemExit
+    e_SystemExit,
+    e_Measured
   };
 
-  struct FunctionRawData
+  struct RawRecord
   {
-    PPROFILE_EXCLUDE(FunctionRawData(FunctionType type, void * function, void * caller));
-    PPROFILE_EXCLUDE(FunctionRawData(FunctionType type, const PDebugLocation * location));
-
-    PPROFILE_EXCLUDE(void Dump(ostream & out) const);
-
-    // Do not use memory check allocation
-    PPROFILE_EXCLUDE(void * operator new(size_t nSize));
-    PPROFILE_EXCLUDE(void operator delete(void * ptr));
+    PPROFILE_EXCLUDE(void Dump(ostream & out, PUniqueThreadIdentifier uniqueId) const);
 
     union
     {
       // Note for correct operation m_pointer must overlay m_name
       struct
       {
-        void * m_pointer;
-        void * m_caller;
+        const void * m_pointer;
+        const void * m_caller;
       };
       struct
       {
@@ -1533,15 +1603,83 @@ namespace PProfiling
       };
     } m_function;
 
-    FunctionType            m_type;
-    PThreadIdentifier       m_threadIdentifier;
-    PUniqueThreadIdentifier m_threadUniqueId;
-    uint64_t                m_when;
-    FunctionRawData       * m_link;
+    FunctionType m_type;
+    uint64_t     m_when;
+    uint64_t     m_duration; // Only for e_Measured, m_when is the end time
+  };
+
+
+  struct ThreadBuffer;
+
+  /* Fixed size block of records, written by a single thread without any
+     locking or allocation, then handed to the aggregator when full. */
+  struct RecordBlock
+  {
+    enum { Size = 1024 };
+
+    PPROFILE_EXCLUDE(RecordBlock(ThreadBuffer & thread));
+
+    // Do not use memory check allocation
+    PPROFILE_EXCLUDE(void * operator new(size_t nSize));
+    PPROFILE_EXCLUDE(void operator delete(void * ptr));
+
+    ThreadBuffer   & m_thread;
+    RecordBlock    * m_link;
+    atomic<unsigned> m_count;
+    bool             m_threadEnded;
+    RawRecord        m_records[Size];
 
   private:
-    FunctionRawData(const FunctionRawData &) { }
-    void operator=(const FunctionRawData &) { }
+    RecordBlock(const RecordBlock & other) : m_thread(other.m_thread) { }
+    void operator=(const RecordBlock &) { }
+  };
+
+
+  // Per function totals for a thread, updated by the aggregator
+  struct ThreadState
+  {
+    struct Frame
+    {
+      const void * m_key;
+      uint64_t     m_entry;
+      uint64_t     m_children;
+    };
+
+    struct Totals : Function
+    {
+      bool m_named;
+    };
+
+    PPROFILE_EXCLUDE(void Aggregate(const RawRecord * record, unsigned count));
+    PPROFILE_EXCLUDE(void Accumulate(const void * key, bool named, uint64_t cycles));
+
+    std::vector<Frame>               m_stack;
+    std::map<const void *, Totals>   m_functions;
+  };
+
+
+  struct ThreadBuffer
+  {
+    PPROFILE_EXCLUDE(ThreadBuffer(unsigned generation));
+    PPROFILE_EXCLUDE(~ThreadBuffer());
+
+    // Do not use memory check allocation
+    PPROFILE_EXCLUDE(void * operator new(size_t nSize));
+    PPROFILE_EXCLUDE(void operator delete(void * ptr));
+
+    PPROFILE_EXCLUDE(void FreeBlocks());
+
+    PThreadIdentifier       m_threadId;
+    PUniqueThreadIdentifier m_uniqueId;
+    atomic<unsigned>        m_generation;
+    atomic<RecordBlock *>   m_current;  // Being written by the thread
+    ThreadBuffer          * m_link;
+
+    // Following only accessed by aggregator, under Database::m_mutex
+    RecordBlock           * m_firstBlock;
+    RecordBlock           * m_lastBlock;
+    ThreadState             m_state;
+    bool                    m_ended;
   };
 
 
@@ -1572,62 +1710,111 @@ namespace PProfiling
     PPROFILE_EXCLUDE(Database());
     PPROFILE_EXCLUDE(~Database());
 
+    PPROFILE_EXCLUDE(ThreadBuffer * AttachThread());
+    PPROFILE_EXCLUDE(RecordBlock * Flush(ThreadBuffer & buffer, bool threadEnded));
+    PPROFILE_EXCLUDE(void AggregatorMain());
+    PPROFILE_EXCLUDE(void AggregatePending());
+    PPROFILE_EXCLUDE(void GetBlocks(std::vector< std::pair<const RecordBlock *, unsigned> > & blocks));
+
     bool     m_enabled;
-    atomic<FunctionRawData *> m_functions;
-    atomic<ThreadRawData *>   m_threads;
+    atomic<unsigned>       m_generation;
+    atomic<RecordBlock *>  m_pending;
+    atomic<ThreadBuffer *> m_buffers;
+    atomic<ThreadRawData *> m_threads;
     uint64_t m_start;
+
+    /* The aggregator is not a PThread as it is started from within the
+       instrumentation hooks, where we cannot risk taking PTLib locks. */
+    std::mutex              m_mutex;
+    std::condition_variable m_signal;
+    atomic<bool>            m_aggregatorStarted;
+    bool                    m_aggregatorRunning;
+    std::thread           * m_aggregator;
   };
   static Database s_database;
 
+  // Prevent recording of the profiler's own work, and after thread clean up
+  static thread_local bool t_inProfiler;
+  static thread_local ThreadBuffer * t_buffer;
 
-  /////////////////////////////////////////////////////////////////////
+  struct InProfiler
+  {
+    bool m_previous;
+    PPROFILE_EXCLUDE(InProfiler()) : m_previous(t_inProfiler) { t_inProfiler = true; }
+    PPROFILE_EXCLUDE(~InProfiler()) { t_inProfiler = m_previous; }
+  };
 
-  FunctionRawData::FunctionRawData(FunctionType type, void * function, void * caller)
-    : m_type(type)
-    , m_threadIdentifier(PThread::GetCurrentThreadId())
-    , m_threadUniqueId(PThread::GetCurrentUniqueIdentifier())
-    , m_when(GetCycles())
+  // Hand over the threads partial block when the thread exits
+  struct ThreadBufferRelease
   {
-    m_function.m_pointer = function;
-    m_function.m_caller = caller;
+    PPROFILE_EXCLUDE(~ThreadBufferRelease())
+    {
+      t_inProfiler = true;
+      if (t_buffer != NULL) {
+        s_database.Flush(*t_buffer, true);
+        t_buffer = NULL;
+      }
+    }
+  };
+  static thread_local ThreadBufferRelease t_bufferRelease;
 
-    m_link = s_database.m_functions.exchange(this);
-  }
 
+  /////////////////////////////////////////////////////////////////////
+
+  PPROFILE_EXCLUDE(static void AddRecord(FunctionType type, const void * pointer, const void * caller, unsigned line, uint64_t when, uint64_t duration));
 
-  FunctionRawData::FunctionRawData(FunctionType type, const PDebugLocation * location)
-    : m_type(type)
-    , m_threadIdentifier(PThread::GetCurrentThreadId())
-    , m_threadUniqueId(PThread::GetCurrentUniqueIdentifier())
-    , m_when(GetCycles())
+  static void AddRecord(FunctionType type, const void * pointer, const void * caller, unsigned line, uint64_t when, uint64_t duration)
   {
-    if (location) {
-      m_function.m_name = location->m_extra;
-      m_function.m_file = location->m_file;
-      m_function.m_line = location->m_line;
+    if (t_inProfiler)
+      return;
+
+    ThreadBuffer * buffer = t_buffer;
+    if (buffer == NULL)
+      buffer = s_database.AttachThread();
+
+    RecordBlock * block = buffer->m_current;
+
+    unsigned generation = s_database.m_generation;
+    if (buffer->m_generation != generation) {
+      // Reset() was called, discard anything from before
+      buffer->m_generation = generation;
+      block->m_count = 0;
     }
-    else {
-      m_function.m_name = NULL;
-      m_function.m_file = NULL;
-      m_function.m_line = 0;
+
+    unsigned count = block->m_count.load(std::memory_order_relaxed);
+    if (count >= RecordBlock::Size) {
+      InProfiler guard;
+      block = s_database.Flush(*buffer, false);
+      count = 0;
     }
 
-    m_link = s_database.m_functions.exchange(this);
+    RawRecord & record = block->m_records[count];
+    record.m_type = type;
+    record.m_function.m_pointer = pointer;
+    record.m_function.m_caller = caller;
+    record.m_function.m_line = line;
+    record.m_when = when;
+    record.m_duration = duration;
+    block->m_count.store(count+1, std::memory_order_release);
   }
 
 
-  void * FunctionRawData::operator new(size_t nSize)
+  __inline static void AddRecord(FunctionType type, const void * function, const void * caller)
   {
-    return runtime_malloc(nSize);
-
+    AddRecord(type, function, caller, 0, GetCycles(), 0);
   }
-  void FunctionRawData::operator delete(void * ptr)
+
+
+  __inline static void AddRecord(FunctionType type, const PDebugLocation * location)
   {
-    runtime_free(ptr);
+    if (location != NULL)
+      AddRecord(type, location->m_extra, location->m_file, location->m_line, GetCycles(), 0);
+    else
+      AddRecord(type, NULL, NULL, 0, GetCycles(), 0);
   }
 
 
-   void FunctionRawData::Dump(ostream & out) const
+  void RawRecord::Dump(ostream & out, PUniqueThreadIdentifier uniqueId) const
   {
     switch (m_type) {
       case e_AutoEntry:
@@ -1642,11 +1829,156 @@ namespace PProfiling
       case e_ManualExit:
         out << "ManualExit\t" << m_function.m_name << '\t';
         break;
+      case e_SystemEntry:
+        out << "SystemEnter\t\t";
+        break;
+      case e_SystemExit:
+        out << "SystemExit\t\t";
+        break;
+      case e_Measured:
+        out << "Measured\t" << m_function.m_name << '\t' << m_duration;
+        break;
       default :
         PAssertAlways(PLogicError);
     }
 
-    out << '\t' << m_threadUniqueId << '\t' << m_when << '\n';
+    out << '\t' << uniqueId << '\t' << m_when << '\n';
+  }
+
+
+  /////////////////////////////////////////////////////////////////////
+
+  RecordBlock::RecordBlock(ThreadBuffer & thread)
+    : m_thread(thread)
+    , m_link(NULL)
+    , m_count(0)
+    , m_threadEnded(false)
+  {
+  }
+
+
+  void * RecordBlock::operator new(size_t nSize)
+  {
+    return runtime_malloc(nSize);
+  }
+
+
+  void RecordBlock::operator delete(void * ptr)
+  {
+    runtime_free(ptr);
+  }
+
+
+  /////////////////////////////////////////////////////////////////////
+
+  void ThreadState::Accumulate(const void * key, bool named, uint64_t cycles)
+  {
+    std::map<const void *, Totals>::iterator it = m_functions.find(key);
+    if (it == m_functions.end()) {
+      it = m_functions.insert(make_pair(key, Totals())).first;
+      it->second.m_named = named;
+    }
+
+    Function & func = it->second;
+    if (func.m_minimum > cycles)
+      func.m_minimum = cycles;
+    if (func.m_maximum < cycles)
+      func.m_maximum = cycles;
+    func.m_sum += cycles;
+    ++func.m_count;
+  }
+
+
+  void ThreadState::Aggregate(const RawRecord * record, unsigned count)
+  {
+    for (; count > 0; --count, ++record) {
+      switch (record->m_type) {
+        case e_AutoEntry :
+        case e_ManualEntry :
+        case e_SystemEntry :
+        {
+          Frame frame = { record->m_function.m_pointer, record->m_when, 0 };
+          m_stack.push_back(frame);
+          break;
+        }
+
+        case e_AutoExit :
+        case e_ManualExit :
+        case e_SystemExit :
+        {
+          // Unwind to the matching entry, in case exits were missed, e.g. exceptions
+          size_t depth = m_stack.size();
+          while (depth > 0 && m_stack[depth-1].m_key != record->m_function.m_pointer)
+            --depth;
+          if (depth == 0)
+            break; // Entered before profiling was enabled or reset
+
+          m_stack.resize(depth);
+          const Frame & frame = m_stack.back();
+          uint64_t total = record->m_when - frame.m_entry;
+
+          // Time in system calls is taken off the caller, but not reported
+          if (record->m_type != e_SystemExit)
+            Accumulate(frame.m_key, record->m_type == e_ManualExit, total > frame.m_children ? total - frame.m_children : 0);
+
+          m_stack.pop_back();
+          if (!m_stack.empty())
+            m_stack.back().m_children += total;
+          break;
+        }
+
+        case e_Measured :
+          Accumulate(record->m_function.m_pointer, true, record->m_duration);
+          break;
+      }
+    }
+  }
+
+
+  /////////////////////////////////////////////////////////////////////
+
+  ThreadBuffer::ThreadBuffer(unsigned generation)
+    : m_threadId(PThread::GetCurrentThreadId())
+    , m_uniqueId(PThread::GetCurrentUniqueIdentifier())
+    , m_generation(generation)
+    , m_current(NULL)
+    , m_link(NULL)
+    , m_firstBlock(NULL)
+    , m_lastBlock(NULL)
+    , m_ended(false)
+  {
+    m_current = new RecordBlock(*this);
+  }
+
+
+  ThreadBuffer::~ThreadBuffer()
+  {
+    FreeBlocks();
+    delete m_current.load();
+  }
+
+
+  void * ThreadBuffer::operator new(size_t nSize)
+  {
+    return runtime_malloc(nSize);
+  }
+
+
+  void ThreadBuffer::operator delete(void * ptr)
+  {
+    runtime_free(ptr);
+  }
+
+
+  void ThreadBuffer::FreeBlocks()
+  {
+    while (m_firstBlock != NULL) {
+      RecordBlock * del = m_firstBlock;
+      m_firstBlock = m_firstBlock->m_link;
+      delete del;
+    }
+    m_lastBlock = NULL;
+    m_state = ThreadState();
   }
 
 
@@ -1683,6 +2015,7 @@ namespace PProfiling
   void OnThreadEnded(const PThread & thread, const PTimeInterval & realTime, const PTimeInterval & systemCPU, const PTimeInterval & userCPU)
   {
     if (s_database.m_enabled) {
+      InProfiler guard;
       ThreadRawData * info = new ThreadRawData(thread.GetThreadId(),
                                                thread.GetUniqueIdentifier(),
                                                thread.GetThreadName(),
@@ -1700,14 +2033,14 @@ namespace PProfiling
     : m_location(location)
   {
     if (s_database.m_enabled)
-      new FunctionRawData(e_ManualEntry, &location);
+      AddRecord(e_ManualEntry, &location);
   }
 
 
   Block::~Block()
   {
     if (s_database.m_enabled)
-      new FunctionRawData(e_ManualExit, &m_location);
+      AddRecord(e_ManualExit, &m_location);
   }
 
 
@@ -1715,33 +2048,157 @@ namespace PProfiling
 
   Database::Database()
     : m_enabled(getenv("PTLIB_PROFILING_ENABLED") != NULL)
-    , m_functions(NULL)
+    , m_generation(0)
+    , m_pending(NULL)
+    , m_buffers(NULL)
     , m_threads(NULL)
     , m_start(GetCycles())
+    , m_aggregatorStarted(false)
+    , m_aggregatorRunning(true)
+    , m_aggregator(NULL)
   {
   }
 
 
   Database::~Database()
   {
-    if (static_cast<FunctionRawData *>(m_functions) == NULL)
-      return;
-
-    const char * filename;
+    m_enabled = false;
+    t_inProfiler = true;
 
-    if ((filename = getenv("PTLIB_RAW_PROFILING_FILENAME")) != NULL) {
-      ofstream out(filename, ios::out | ios::trunc);
-      if (out.is_open())
-        Dump(out);
+    if (m_aggregator != NULL) {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_aggregatorRunning = false;
+      }
+      m_signal.notify_one();
+      m_aggregator->join();
+      delete m_aggregator;
     }
 
-    if ((filename = getenv("PTLIB_PROFILING_FILENAME")) != NULL) {
-      ofstream out(filename, ios::out | ios::trunc);
-      if (out.is_open())
-        Analyse(out, strstr(filename, ".html") != NULL);
+    if (m_buffers.load() != NULL) {
+      const char * filename;
+
+      if ((filename = getenv("PTLIB_RAW_PROFILING_FILENAME")) != NULL) {
+        ofstream out(filename, ios::out | ios::trunc);
+        if (out.is_open())
+          Dump(out);
+      }
+
+      if ((filename = getenv("PTLIB_PROFILING_FILENAME")) != NULL) {
+        ofstream out(filename, ios::out | ios::trunc);
+        if (out.is_open()) {
+          if (strstr(filename, ".json") != NULL)
+            ExportTraceEvents(out);
+          else
+            Analyse(out, strstr(filename, ".html") != NULL);
+        }
+      }
     }
 
     Reset();
+
+    // Any threads still running are abandoned
+  }
+
+
+  ThreadBuffer * Database::AttachThread()
+  {
+    InProfiler guard;
+
+    ThreadBuffer * buffer = new ThreadBuffer(m_generation);
+    buffer->m_link = m_buffers.load();
+    while (!m_buffers.compare_exchange_weak(buffer->m_link, buffer))
+      ;
+
+    t_buffer = buffer;
+    (void)&t_bufferRelease; // Make sure destructor is called on thread exit
+    return buffer;
+  }
+
+
+  RecordBlock * Database::Flush(ThreadBuffer & buffer, bool threadEnded)
+  {
+    RecordBlock * block = buffer.m_current;
+    block->m_threadEnded = threadEnded;
+
+    RecordBlock * next = threadEnded ? NULL : new RecordBlock(buffer);
+    buffer.m_current = next;
+
+    block->m_link = m_pending.load();
+    while (!m_pending.compare_exchange_weak(block->m_link, block))
+      ;
+
+    if (!m_aggregatorStarted.exchange(true))
+      m_aggregator = new std::thread(&Database::AggregatorMain, this);
+    m_signal.notify_one();
+
+    return next;
+  }
+
+
+  void Database::AggregatorMain()
+  {
+    t_inProfiler = true;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_aggregatorRunning) {
+      AggregatePending();
+      m_signal.wait_for(lock, std::chrono::milliseconds(100));
+    }
+  }
+
+
+  // Must have m_mutex locked
+  void Database::AggregatePending()
+  {
+    // The pending list is newest first, reverse it so aggregated in order
+    RecordBlock * fifo = NULL;
+    RecordBlock * block = m_pending.exchange(NULL);
+    while (block != NULL) {
+      RecordBlock * next = block->m_link;
+      block->m_link = fifo;
+      fifo = block;
+      block = next;
+    }
+
+    while (fifo != NULL) {
+      block = fifo;
+      fifo = fifo->m_link;
+
+      ThreadBuffer & buffer = block->m_thread;
+      if (buffer.m_generation == m_generation)
+        buffer.m_state.Aggregate(block->m_records, block->m_count);
+
+      // Retain raw data for Dump() and ExportTraceEvents()
+      block->m_link = NULL;
+      if (buffer.m_lastBlock != NULL)
+        buffer.m_lastBlock->m_link = block;
+      else
+        buffer.m_firstBlock = block;
+      buffer.m_lastBlock = block;
+
+      if (block->m_threadEnded)
+        buffer.m_ended = true;
+    }
+  }
+
+
+  // Must have m_mutex locked
+  void Database::GetBlocks(std::vector< std::pair<const RecordBlock *, unsigned> > & blocks)
+  {
+    AggregatePending();
+
+    for (ThreadBuffer * buffer = m_buffers; buffer != NULL; buffer = buffer->m_link) {
+      if (buffer->m_generation != m_generation)
+        continue;
+
+      for (const RecordBlock * block = buffer->m_firstBlock; block != NULL; block = block->m_link)
+        blocks.push_back(make_pair(block, block->m_count.load()));
+
+      const RecordBlock * current = buffer->m_current;
+      if (current != NULL)
+        blocks.push_back(make_pair(current, current->m_count.load(std::memory_order_acquire)));
+    }
   }
 
 
@@ -1759,16 +2216,29 @@ namespace PProfiling
 
   void Reset()
   {
+    InProfiler guard;
+    std::lock_guard<std::mutex> lock(s_database.m_mutex);
+
+    s_database.AggregatePending();
+    ++s_database.m_generation;
     s_database.m_start = GetCycles();
-    ThreadRawData * thrd = s_database.m_threads.exchange(NULL);
-    FunctionRawData * func = s_database.m_functions.exchange(NULL);
 
-    while (func != NULL) {
-      FunctionRawData * del = func;
-      func = func->m_link;
-      delete del;
+    // Threads still running discard their partial blocks when they next record
+    ThreadBuffer * buffer = s_database.m_buffers.exchange(NULL);
+    while (buffer != NULL) {
+      ThreadBuffer * next = buffer->m_link;
+      if (buffer->m_ended)
+        delete buffer;
+      else {
+        buffer->FreeBlocks();
+        buffer->m_link = s_database.m_buffers.load();
+        while (!s_database.m_buffers.compare_exchange_weak(buffer->m_link, buffer))
+          ;
+      }
+      buffer = next;
     }
 
+    ThreadRawData * thrd = s_database.m_threads.exchange(NULL);
     while (thrd != NULL) {
       ThreadRawData * del = thrd;
       thrd = thrd->m_link;
@@ -1780,23 +2250,31 @@ namespace PProfiling
   void PreSystem()
   {
     if (s_database.m_enabled)
-      new FunctionRawData(e_SystemEntry, NULL);
+      AddRecord(e_SystemEntry, NULL);
   }
 
 
   void PostSystem()
   {
     if (s_database.m_enabled)
-      new FunctionRawData(e_SystemExit, NULL);
+      AddRecord(e_SystemExit, NULL);
   }
 
 
   void Dump(ostream & strm)
   {
+    InProfiler guard;
+
     for (ThreadRawData * info = s_database.m_threads; info != NULL; info = info->m_link)
       info->Dump(strm);
-    for (FunctionRawData * info = s_database.m_functions; info != NULL; info = info->m_link)
-      info->Dump(strm);
+
+    std::lock_guard<std::mutex> lock(s_database.m_mutex);
+    std::vector< std::pair<const RecordBlock *, unsigned> > blocks;
+    s_database.GetBlocks(blocks);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      for (unsigned r = 0; r < blocks[i].second; ++r)
+        blocks[i].first->m_records[r].Dump(strm, blocks[i].first->m_thread.m_uniqueId);
+    }
   }
 
 
@@ -1891,7 +2369,7 @@ namespace PProfiling
             " threads="   << m_threadByID.size() << ","
             " functions=" << m_functionCount  << ","
             " cycles="    << m_durationCycles << ","
-            " frequency=" << gs_Frequency      << ","
+            " frequency=" << GetFrequency()      << ","
             " time="      << left << fixed << setprecision(3) << CyclesToSeconds(m_durationCycles) << '\n';
     for (ThreadByUsage::const_iterator thrd = m_threadByUsage.begin(); thrd != m_threadByUsage.end(); ++thrd) {
       strm << "   Thread \"" << setw(threadNameWidth) << (thrd->second.m_name+'"')
@@ -1964,7 +2442,7 @@ namespace PProfiling
             "<td align=center>" << m_threadByID.size()
          << "<td align=center>" << m_functionCount
          << "<td align=center>" << m_durationCycles
-         << "<td align=center>" << gs_Frequency
+         << "<td align=center>" << GetFrequency()
          << "<td align=center>" << fixed << setprecision(3) << CyclesToSeconds(m_durationCycles)
          << "</table>"
             "<p>"
@@ -2034,6 +2512,8 @@ namespace PProfiling
 
   void Analyse(Analysis & analysis)
   {
+    InProfiler guard;
+
     analysis.m_durationCycles = GetCycles() - s_database.m_start;
 
     std::list<PThread::Times> times;
@@ -2044,79 +2524,59 @@ namespace PProfiling
     for (ThreadRawData * thrd = s_database.m_threads; thrd != NULL; thrd = thrd->m_link)
       analysis.m_threadByID.insert(make_pair(thrd->m_uniqueId, *thrd));
 
-    for (FunctionRawData * exit = s_database.m_functions; exit != NULL; exit = exit->m_link) {
-      std::string functionName;
-      switch (exit->m_type) {
-        default :
-          continue;
-
-        case e_ManualExit:
-          functionName = exit->m_function.m_name;
-          break;
-
-        case e_AutoExit:
-          stringstream strm;
-          strm << exit->m_function.m_pointer;
-          functionName = strm.str();
-          break;
+    std::lock_guard<std::mutex> lock(s_database.m_mutex);
+    s_database.AggregatePending();
+
+    for (ThreadBuffer * buffer = s_database.m_buffers; buffer != NULL; buffer = buffer->m_link) {
+      if (buffer->m_generation != s_database.m_generation)
+        continue;
+
+      // Include what the thread has not yet handed to the aggregator
+      const ThreadState * state = &buffer->m_state;
+      ThreadState partial;
+      const RecordBlock * current = buffer->m_current;
+      unsigned count = current != NULL ? current->m_count.load(std::memory_order_acquire) : 0;
+      if (count > 0) {
+        partial = buffer->m_state;
+        partial.Aggregate(current->m_records, count);
+        state = &partial;
       }
 
-      uint64_t subFunctionAccumulator = 0;
+      if (state->m_functions.empty())
+        continue;
 
-      // Find the next entry in that thread
-      FunctionRawData * entry;
-      for (entry = exit->m_link; entry != NULL; entry = entry->m_link) {
-        if (entry->m_threadUniqueId != exit->m_threadUniqueId)
-          continue;
-
-        switch (entry->m_type) {
-          case e_ManualEntry :
-          case e_AutoEntry:
-          case e_SystemEntry :
-            if (entry->m_function.m_pointer == exit->m_function.m_pointer)
-              break;
-            continue; // Should not happen!
-
-          default :
-            // Have an exit, so look for matching entry
-            FunctionRawData * subEntry;
-            for (subEntry = entry->m_link; subEntry != NULL; subEntry = subEntry->m_link) {
-              if (subEntry->m_threadUniqueId == entry->m_threadUniqueId && subEntry->m_function.m_pointer == entry->m_function.m_pointer)
-                break;
-            }
-            if (subEntry == NULL)
-              continue; // Should not happen!
-
-            // Amount of time in sub-function, subtract it off later
-            subFunctionAccumulator += entry->m_when - subEntry->m_when;
-            entry = subEntry;
-            continue;
-        }
-
-        ThreadByID::iterator thrd = analysis.m_threadByID.find(entry->m_threadUniqueId);
-        if (thrd == analysis.m_threadByID.end()) {
-          PThread::Times threadTimes;
-          PThread::GetTimes(entry->m_threadIdentifier, threadTimes);
+      ThreadByID::iterator thrd = analysis.m_threadByID.find(buffer->m_uniqueId);
+      if (thrd == analysis.m_threadByID.end()) {
+        PThread::Times threadTimes;
+        if (PThread::GetTimes(buffer->m_threadId, threadTimes))
           thrd = AddThreadByID(analysis.m_threadByID, threadTimes);
+        else
+          thrd = analysis.m_threadByID.insert(make_pair(buffer->m_uniqueId, Thread(buffer->m_threadId, buffer->m_uniqueId))).first;
+      }
+
+      FunctionMap & functions = thrd->second.m_functions;
+      for (std::map<const void *, ThreadState::Totals>::const_iterator it = state->m_functions.begin(); it != state->m_functions.end(); ++it) {
+        std::string functionName;
+        if (it->second.m_named)
+          functionName = it->first != NULL ? (const char *)it->first : "";
+        else {
+          stringstream strm;
+          strm << it->first;
+          functionName = strm.str();
         }
 
-        FunctionMap & functions = thrd->second.m_functions;
         FunctionMap::iterator func = functions.find(functionName);
         if (func == functions.end()) {
           func = functions.insert(make_pair(functionName, Function())).first;
           ++analysis.m_functionCount;
         }
 
-        uint64_t diff = exit->m_when - entry->m_when - subFunctionAccumulator;
-
-        if (func->second.m_minimum > diff)
-          func->second.m_minimum = diff;
-        if (func->second.m_maximum < diff)
-          func->second.m_maximum = diff;
-
-        func->second.m_sum += diff;
-        ++func->second.m_count;
-        break;
+        if (func->second.m_minimum > it->second.m_minimum)
+          func->second.m_minimum = it->second.m_minimum;
+        if (func->second.m_maximum < it->second.m_maximum)
+          func->second.m_maximum = it->second.m_maximum;
+        func->second.m_sum += it->second.m_sum;
+        func->second.m_count += it->second.m_count;
       }
     }
 
@@ -2136,6 +2596,125 @@ namespace PProfiling
       analysis.ToText(strm);
   }
 
+
+  class EscapedJSON
+  {
+    private:
+      const char * m_str;
+
+    public:
+      EscapedJSON(const char * str)
+        : m_str(str != NULL ? str : "")
+      {
+      }
+
+    friend ostream & operator<<(ostream & strm, const EscapedJSON & e)
+    {
+      strm << '"';
+      for (const char * ptr = e.m_str; *ptr != '\0'; ++ptr) {
+        switch (*ptr) {
+          case '"':
+            strm << "\\\"";
+            break;
+          case '\\':
+            strm << "\\\\";
+            break;
+          default:
+            if ((unsigned char)*ptr < ' ')
+              strm << "\\u00" << hex << setfill('0') << setw(2) << (unsigned)(unsigned char)*ptr << dec << setfill(' ');
+            else
+              strm << *ptr;
+        }
+      }
+      return strm << '"';
+    }
+  };
+
+
+  void ExportTraceEvents(ostream & strm)
+  {
+    InProfiler guard;
+
+    typedef std::map<PUniqueThreadIdentifier, std::string> ThreadNames;
+    ThreadNames threadNames;
+
+    std::list<PThread::Times> times;
+    PThread::GetTimes(times);
+    for (std::list<PThread::Times>::iterator it = times.begin(); it != times.end(); ++it)
+      threadNames[it->m_uniqueId] = it->m_name.GetPointer();
+
+    for (ThreadRawData * thrd = s_database.m_threads; thrd != NULL; thrd = thrd->m_link)
+      threadNames[thrd->m_uniqueId] = thrd->m_name;
+
+    PProcessIdentifier pid = PProcess::GetCurrentProcessID();
+
+    strm << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+    if (PProcess::IsInitialised())
+      strm << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << pid
+           << ",\"args\":{\"name\":" << EscapedJSON(PProcess::Current().GetName()) << "}}";
+    else
+      strm << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << pid << ",\"args\":{\"name\":\"" << pid << "\"}}";
+
+    std::lock_guard<std::mutex> lock(s_database.m_mutex);
+
+    for (ThreadBuffer * buffer = s_database.m_buffers; buffer != NULL; buffer = buffer->m_link) {
+      if (buffer->m_generation != s_database.m_generation)
+        continue;
+      ThreadNames::iterator name = threadNames.find(buffer->m_uniqueId);
+      strm << ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << buffer->m_uniqueId << ",\"args\":{\"name\":";
+      if (name != threadNames.end())
+        strm << EscapedJSON(name->second.c_str());
+      else
+        strm << "\"Thread " << buffer->m_uniqueId << '"';
+      strm << "}}";
+    }
+
+    std::vector< std::pair<const RecordBlock *, unsigned> > blocks;
+    s_database.GetBlocks(blocks);
+
+    uint64_t start = s_database.m_start;
+    strm << fixed << setprecision(3);
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      PUniqueThreadIdentifier tid = blocks[i].first->m_thread.m_uniqueId;
+      for (unsigned r = 0; r < blocks[i].second; ++r) {
+        const RawRecord & record = blocks[i].first->m_records[r];
+        uint64_t begin = record.m_when - record.m_duration;
+        if (begin < start)
+          continue;
+
+        strm << ",\n{\"pid\":" << pid << ",\"tid\":" << tid
+             << ",\"ts\":" << CyclesToNanoseconds(begin - start)/1000.0;
+
+        switch (record.m_type) {
+          case e_AutoEntry:
+            strm << ",\"ph\":\"B\",\"cat\":\"function\",\"name\":\"" << record.m_function.m_pointer << '"';
+            break;
+          case e_ManualEntry:
+            strm << ",\"ph\":\"B\",\"cat\":\"block\",\"name\":" << EscapedJSON(record.m_function.m_name)
+                 << ",\"args\":{\"file\":" << EscapedJSON(record.m_function.m_file) << ",\"line\":" << record.m_function.m_line << '}';
+            break;
+          case e_SystemEntry:
+            strm << ",\"ph\":\"B\",\"cat\":\"system\",\"name\":\"system\"";
+            break;
+          case e_AutoExit:
+          case e_ManualExit:
+          case e_SystemExit:
+            strm << ",\"ph\":\"E\"";
+            break;
+          case e_Measured:
+            strm << ",\"ph\":\"X\",\"cat\":\"scope\",\"name\":" << EscapedJSON(record.m_function.m_name)
+                 << ",\"dur\":" << CyclesToNanoseconds(record.m_duration)/1000.0;
+            break;
+        }
+        strm << '}';
+      }
+    }
+
+    strm << "\n]}\n";
+  }
+
 #endif // P_PROFILING
 
 #if PTRACING
@@ -2310,7 +2889,14 @@ namespace PProfiling
 
   void TimeScope::EndMeasurement(const void * context, const PObject * object, const PDebugLocation * location, uint64_t startCycle)
   {
-    m_implementation->EndMeasurement(context, object, location, CyclesToNanoseconds(GetCycles() - startCycle));
+    uint64_t endCycle = GetCycles();
+#if P_PROFILING
+    // Includes the wait and held times of PInstrumentedMutex
+    if (s_database.m_enabled)
+      AddRecord(e_Measured, m_implementation->m_location.m_extra, m_implementation->m_location.m_file,
+                m_implementation->m_location.m_line, endCycle, endCycle - startCycle);
+#endif
+    m_implementation->EndMeasurement(context, object, location, CyclesToNanoseconds(endCycle - startCycle));
   }
 
   const PTimeInterval & TimeScope::GetLastDuration() const
@@ -2334,13 +2920,13 @@ extern "C"
   void __cyg_profile_func_enter(void * function, void * caller)
   {
     if (PProfiling::s_database.m_enabled)
-      new PProfiling::FunctionRawData(PProfiling::e_AutoEntry, function, caller);
+      PProfiling::AddRecord(PProfiling::e_AutoEntry, function, caller);
   }
 
   void __cyg_profile_func_exit(void * function, void * caller)
   {
     if (PProfiling::s_database.m_enabled)
-      new PProfiling::FunctionRawData(PProfiling::e_AutoExit, function, caller);
+      PProfiling::AddRecord(PProfiling::e_AutoExit, function, caller);
   }
 };
 #endif // __GNUC__
@@ -30,10 +30,14 @@
 #include <ptlib.h>
 #include <vector>
 #include <map>
+#include <set>
 #include <fstream>
 #include <algorithm>
 
 #include <ctype.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 #include <ptlib/pfactory.h>
 #include <ptlib/id_generator.h>
 #include <ptlib/pprocess.h>
@@ -56,6 +60,11 @@
 
 static const char DefaultRollOverPattern[] = "_yyyy_MM_dd_hh_mm";
 
+#if P_HAS_THREAD_LOCAL
+  // The PThread for the running operating system thread, saves a look up in PProcess
+  static thread_local PThread * t_currentThread;
+#endif
+
 class PExternalThread : public PThread
 {
   PCLASSINFO(PExternalThread, PThread);
@@ -234,17 +243,98 @@ PTHREAD_MUTEX_RECURSIVE_NP
   void Unlock()    { mutex->Signal(); }
 #endif
   
+  // Completed trace line queued for the AsynchronousOutput background writer
+  struct AsyncRecord {
+    AsyncRecord()
+      : m_sequence(0)
+      , m_level(0)
+      , m_rotateValue(0)
+    { }
+
+    bool operator<(const AsyncRecord & other) const { return m_sequence < other.m_sequence; }
+
+    uint64_t    m_sequence;
+    unsigned    m_level;
+    unsigned    m_rotateValue;
+    std::string m_text;
+  };
+
+  /* Single producer (the owning thread), single consumer (the writer, with
+     the trace lock held) ring buffer. The record strings are recycled so once
+     warmed up, queuing a trace line does not allocate. */
+  class AsyncRing {
+    public:
+      enum { Size = 1024 }; // Must be power of two
+
+      AsyncRing()
+        : m_orphaned(false)
+        , m_head(0)
+        , m_tail(0)
+      { }
+
+      AsyncRecord * Reserve()
+      {
+        unsigned tail = m_tail.load();
+        return tail - m_head.load() < Size ? &m_records[tail & (Size-1)] : NULL;
+      }
+
+      unsigned Commit()
+      {
+        unsigned tail = ++m_tail;
+        return tail - m_head.load();
+      }
+
+      AsyncRecord * Peek()
+      {
+        unsigned head = m_head.load();
+        return head != m_tail.load() ? &m_records[head & (Size-1)] : NULL;
+      }
+
+      void Consume() { ++m_head; }
+
+      atomic<bool> m_orphaned;
+
+    private:
+      AsyncRecord      m_records[Size];
+      atomic<unsigned> m_head;
+      atomic<unsigned> m_tail;
+  };
+  std::vector<AsyncRing *>  m_asyncRings;
+  std::vector<AsyncRecord>  m_asyncPending;
+  std::vector<std::string>  m_asyncSpare;
+  uint64_t                  m_asyncNextSequence;
+  unsigned                  m_asyncGapCount;
+  bool                      m_asyncFlushing;
+  atomic<uint64_t>          m_asyncSequence;
+  atomic<unsigned>          m_asyncDropped;
+  unsigned                  m_asyncDroppedReported;
+  atomic<bool>              m_asyncStarted;
+  atomic<bool>              m_asyncRunning;
+  PThread                 * m_asyncThread;
+  PSyncPoint              * m_asyncSignal;
+
   struct ThreadLocalInfo {
     ThreadLocalInfo()
       : m_traceLevel(1)
       , m_traceBlockIndentLevel(0)
       , m_prefixLength(0)
+      , m_rotateValue(0)
+      , m_asyncRing(NULL)
     { }
 
+    ~ThreadLocalInfo()
+    {
+      // Writer thread deletes it once it has been emptied
+      if (m_asyncRing != NULL)
+        m_asyncRing->m_orphaned = true;
+    }
+
     PStack<PStringStream> m_traceStreams;
     unsigned              m_traceLevel;
     unsigned              m_traceBlockIndentLevel;
     PINDEX                m_prefixLength;
+    unsigned              m_rotateValue;
+    AsyncRing           * m_asyncRing;
   };
   PThreadLocalStorage<ThreadLocalInfo> m_threadStorage;
 
@@ -261,6 +351,16 @@ PTHREAD_MUTEX_RECURSIVE_NP
     , m_rolloverPattern(DefaultRollOverPattern)
     , m_lastRotate(0)
     , m_maxLength(10000)
+    , m_asyncNextSequence(0)
+    , m_asyncGapCount(0)
+    , m_asyncFlushing(false)
+    , m_asyncSequence(0)
+    , m_asyncDropped(0)
+    , m_asyncDroppedReported(0)
+    , m_asyncStarted(false)
+    , m_asyncRunning(false)
+    , m_asyncThread(NULL)
+    , m_asyncSignal(NULL)
   {
     InitMutex();
   }
@@ -317,6 +417,9 @@ PTHREAD_MUTEX_RECURSIVE_NP
 
     Lock();
 
+    // Anything queued belongs to the old stream
+    InternalFlush(false);
+
     if (m_stream != &cerr && m_stream != &cout)
       delete m_stream;
     m_stream = newStream;
@@ -336,6 +439,9 @@ PTHREAD_MUTEX_RECURSIVE_NP
     if (m_options.exchange(newOptions) == newOptions)
       return false;
 
+    if ((newOptions&AsynchronousOutput) == 0)
+      StopAsyncWriter(false);
+
 #if P_SYSTEMLOG
     bool syslogBit = (newOptions&SystemLogStream) != 0;
     bool syslogStrm = dynamic_cast<PSystemLog *>(m_stream) != NULL;
@@ -489,6 +595,13 @@ PTHREAD_MUTEX_RECURSIVE_NP
   void InternalInitialise(unsigned level, const char * filename, const char * rolloverPattern, unsigned options);
   std::ostream & InternalBegin(bool topLevel, unsigned level, const char * fileName, int lineNum, const PObject * instance, const char * module);
   std::ostream & InternalEnd(std::ostream & stream);
+
+  void StartAsyncWriter();
+  void StopAsyncWriter(bool final);
+  void AsyncWriterMain();
+  void InternalFlush(bool force);
+  void GatherAsyncRecords();
+  void WriteAsyncRecords(size_t count);
 };
 
 
@@ -508,6 +621,21 @@ ostream * PTrace::GetStream()
 }
 
 
+void PTrace::Flush()
+{
+  PTraceInfo & info = PTraceInfo::Instance();
+  info.Lock();
+  info.InternalFlush(true);
+  info.Unlock();
+}
+
+
+unsigned PTrace::GetDroppedCount()
+{
+  return PTraceInfo::Instance().m_asyncDropped;
+}
+
+
 int PTrace::GetTimeZone()
 {
   return (GetOptions()&PTrace::GMTTime) ? PTime::GMT : PTime::Local;
@@ -566,6 +694,8 @@ ostream & PTrace::PrintInfo(ostream & strm, bool crlf)
     strm << " object";
   if (info.m_options&ContextIdentifier)
     strm << " context";
+  if (info.m_options&AsynchronousOutput)
+    strm << " async";
 
   switch (info.m_options&RotateLogMask) {
     case RotateDaily :
@@ -662,6 +792,8 @@ void PTrace::Initialise(const PArgList & args,
         operation(options, RotateMinutely);
       else if (optStr.NumCompare("append", P_MAX_INDEX, pos) == PObject::EqualTo)
         operation(options, AppendToFile);
+      else if (optStr.NumCompare("async", P_MAX_INDEX, pos) == PObject::EqualTo)
+        operation(options, AsynchronousOutput);
       else if (optStr.NumCompare("ax", P_MAX_INDEX, pos) == PObject::EqualTo)
         operation(options, (PFileInfo::WorldExecute|PFileInfo::GroupExecute|PFileInfo::UserExecute) << FilePermissionShift);
       else if (optStr.NumCompare("aw", P_MAX_INDEX, pos) == PObject::EqualTo)
@@ -812,6 +944,7 @@ ostream & PTraceInfo::InternalBegin(bool topLevel, unsigned level, const char *
   PThread * thread = NULL;
   PTraceInfo::ThreadLocalInfo * threadInfo = NULL;
   ostream * streamPtr = NULL;
+  bool locked = true;
 
   if (topLevel) {
     if (PProcess::IsInitialised()) {
@@ -825,13 +958,25 @@ ostream & PTraceInfo::InternalBegin(bool topLevel, unsigned level, const char *
       }
     }
 
-    Lock();
+    if (threadInfo != NULL && m_asyncRunning) {
+      // Background writer does the rotate, at the same point in the output
+      if (!m_filename.IsEmpty() && HasOption(RotateLogMask))
+        threadInfo->m_rotateValue = GetRotateVal(m_options);
+      locked = false;
+    }
+    else {
+      Lock();
 
-    if (!m_filename.IsEmpty() && HasOption(RotateLogMask)) {
-      unsigned rotateVal = GetRotateVal(m_options);
-      if (rotateVal != m_lastRotate || GetStream() == &cerr) {
-        m_lastRotate = rotateVal;
-        OpenTraceFile(m_filename, true);
+      // Output directly to stream, so anything queued has to go first
+      if (threadInfo == NULL)
+        InternalFlush(false);
+
+      if (!m_filename.IsEmpty() && HasOption(RotateLogMask)) {
+        unsigned rotateVal = GetRotateVal(m_options);
+        if (rotateVal != m_lastRotate || GetStream() == &cerr) {
+          m_lastRotate = rotateVal;
+          OpenTraceFile(m_filename, true);
+        }
       }
     }
   }
@@ -927,7 +1072,8 @@ ostream & PTraceInfo::InternalBegin(bool topLevel, unsigned level, const char *
   else {
     threadInfo->m_traceLevel = level;
     threadInfo->m_prefixLength = threadInfo->m_traceStreams.Top().GetLength();
-    Unlock();
+    if (locked)
+      Unlock();
   }
 
   return stream;
@@ -969,6 +1115,31 @@ ostream & PTraceInfo::InternalEnd(ostream & paramStream)
     if (stackStream->GetLength() > m_maxLength)
       stackStream->Splice("...", m_maxLength - 4, P_MAX_INDEX);
 
+    if (m_asyncRunning) {
+      if (threadInfo->m_asyncRing == NULL) {
+        threadInfo->m_asyncRing = new AsyncRing;
+        Lock();
+        m_asyncRings.push_back(threadInfo->m_asyncRing);
+        Unlock();
+      }
+
+      AsyncRecord * record = threadInfo->m_asyncRing->Reserve();
+      if (record == NULL)
+        ++m_asyncDropped;
+      else {
+        record->m_level = threadInfo->m_traceLevel;
+        record->m_rotateValue = threadInfo->m_rotateValue;
+        record->m_text = stackStream->GetPointer();
+        record->m_text += '\n';
+        record->m_sequence = m_asyncSequence++;
+        if (threadInfo->m_asyncRing->Commit() > AsyncRing::Size/2)
+          m_asyncSignal->Signal();
+      }
+
+      delete stackStream;
+      return paramStream;
+    }
+
     Lock();
 
     if (HasOption(SystemLogStream)) {
@@ -1006,10 +1177,238 @@ ostream & PTraceInfo::InternalEnd(ostream & paramStream)
   }
 
   Unlock();
+
+  if (threadInfo != NULL && HasOption(AsynchronousOutput) && !m_asyncStarted)
+    StartAsyncWriter();
+
   return paramStream;
 }
 
 
+void PTraceInfo::StartAsyncWriter()
+{
+  if (m_asyncStarted.exchange(true))
+    return;
+
+  if (m_asyncSignal == NULL)
+    m_asyncSignal = new PSyncPoint;
+
+  m_asyncRunning = true;
+  m_asyncThread = new PThreadObj<PTraceInfo>(*this, &PTraceInfo::AsyncWriterMain, false, "PTrace Writer");
+}
+
+
+void PTraceInfo::StopAsyncWriter(bool final)
+{
+  if (!m_asyncRunning.exchange(false))
+    return;
+
+  m_asyncSignal->Signal();
+  m_asyncThread->WaitForTermination();
+  delete m_asyncThread;
+  m_asyncThread = NULL;
+
+  Lock();
+  InternalFlush(true);
+  Unlock();
+
+  // Once final, cannot be restarted and all output is synchronous
+  if (!final)
+    m_asyncStarted = false;
+}
+
+
+void PTraceInfo::AsyncWriterMain()
+{
+  while (m_asyncRunning) {
+    m_asyncSignal->Wait(100);
+    Lock();
+    InternalFlush(false);
+    Unlock();
+  }
+}
+
+
+void PTraceInfo::InternalFlush(bool force)
+{
+  // Assumes Lock() is held, also prevents recursion from OpenTraceFile() on rotate
+  if (m_asyncFlushing || m_asyncRings.empty())
+    return;
+  m_asyncFlushing = true;
+
+  /* Lines are numbered as they are queued, so they are output in the same
+     order as synchronous mode would have. A gap in the numbers is a line that
+     is numbered, but not quite posted to its ring yet, so wait for it. */
+  for (unsigned attempt = 0; attempt < 100; ++attempt) {
+    GatherAsyncRecords();
+
+    size_t count = 0;
+    while (count < m_asyncPending.size() && m_asyncPending[count].m_sequence <= m_asyncNextSequence) {
+      if (m_asyncPending[count].m_sequence == m_asyncNextSequence)
+        ++m_asyncNextSequence;
+      ++count;
+    }
+    WriteAsyncRecords(count);
+
+    if (m_asyncPending.empty() || force)
+      break;
+
+    PThread::Yield();
+  }
+
+  // Flushing on shut down or crash, or the gap is never going to be filled, e.g. thread killed
+  if (!m_asyncPending.empty() && (force || ++m_asyncGapCount > 10)) {
+    m_asyncNextSequence = m_asyncPending.back().m_sequence+1;
+    m_asyncGapCount = 0;
+    WriteAsyncRecords(m_asyncPending.size());
+  }
+
+  unsigned dropped = m_asyncDropped;
+  if (dropped != m_asyncDroppedReported) {
+    PTRACE(1, NULL, "PTLib", "Trace output buffer overflow, "
+           << (dropped - m_asyncDroppedReported) << " lines dropped, " << dropped << " in total");
+    m_asyncDroppedReported = dropped;
+  }
+
+  m_asyncFlushing = false;
+}
+
+
+void PTraceInfo::GatherAsyncRecords()
+{
+  size_t alreadyPending = m_asyncPending.size();
+
+  std::vector<AsyncRing *>::iterator it = m_asyncRings.begin();
+  while (it != m_asyncRings.end()) {
+    AsyncRing * ring = *it;
+    bool orphaned = ring->m_orphaned;
+
+    AsyncRecord * record;
+    while ((record = ring->Peek()) != NULL) {
+      m_asyncPending.push_back(AsyncRecord());
+      AsyncRecord & pending = m_asyncPending.back();
+      pending.m_sequence = record->m_sequence;
+      pending.m_level = record->m_level;
+      pending.m_rotateValue = record->m_rotateValue;
+      pending.m_text.swap(record->m_text);
+      if (!m_asyncSpare.empty()) {
+        record->m_text.swap(m_asyncSpare.back());
+        m_asyncSpare.pop_back();
+      }
+      ring->Consume();
+    }
+
+    if (orphaned) {
+      delete ring;
+      it = m_asyncRings.erase(it);
+    }
+    else
+      ++it;
+  }
+
+  if (m_asyncPending.size() > alreadyPending)
+    std::sort(m_asyncPending.begin(), m_asyncPending.end());
+}
+
+
+#ifndef _WIN32
+static void WriteTraceVector(int fd, struct iovec * vec, int count)
+{
+  while (count > 0) {
+    ssize_t written = ::writev(fd, vec, count);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+
+    while (count > 0 && (size_t)written >= vec->iov_len) {
+      written -= vec->iov_len;
+      ++vec;
+      --count;
+    }
+
+    if (count > 0) {
+      vec->iov_base = (char *)vec->iov_base + written;
+      vec->iov_len -= written;
+    }
+  }
+}
+#endif
+
+
+void PTraceInfo::WriteAsyncRecords(size_t count)
+{
+  if (count == 0)
+    return;
+
+#ifndef _WIN32
+  static const int MaxVector = 64;
+  struct iovec vec[MaxVector];
+  int vecCount = 0;
+  PFile * file = dynamic_cast<PFile *>(m_stream);
+  if (file != NULL)
+    m_stream->flush();
+#endif
+
+  for (size_t i = 0; i < count; ++i) {
+    AsyncRecord & record = m_asyncPending[i];
+
+    if (!m_filename.IsEmpty() && HasOption(RotateLogMask) &&
+                (record.m_rotateValue != m_lastRotate || m_stream == &cerr)) {
+#ifndef _WIN32
+      if (vecCount > 0) {
+        WriteTraceVector(file->GetHandle(), vec, vecCount);
+        vecCount = 0;
+      }
+#endif
+      m_lastRotate = record.m_rotateValue;
+      OpenTraceFile(m_filename, true);
+#ifndef _WIN32
+      file = dynamic_cast<PFile *>(m_stream);
+#endif
+    }
+
+    if (HasOption(SystemLogStream)) {
+      record.m_text.erase(record.m_text.length()-1);
+      PSystemLog::OutputToTarget(PSystemLog::LevelFromInt(record.m_level), record.m_text.c_str());
+      continue;
+    }
+
+#ifndef _WIN32
+    if (file != NULL && file->IsOpen()) {
+      vec[vecCount].iov_base = const_cast<char *>(record.m_text.data());
+      vec[vecCount].iov_len = record.m_text.length();
+      if (++vecCount >= MaxVector) {
+        WriteTraceVector(file->GetHandle(), vec, vecCount);
+        vecCount = 0;
+      }
+      continue;
+    }
+#endif
+
+    *m_stream << record.m_text;
+  }
+
+#ifndef _WIN32
+  if (vecCount > 0)
+    WriteTraceVector(file->GetHandle(), vec, vecCount);
+#endif
+  if (!HasOption(SystemLogStream))
+    m_stream->flush();
+
+  // Keep the strings, and their allocated memory, for reuse in the rings
+  for (size_t i = 0; i < count; ++i) {
+    if (m_asyncSpare.size() < 4*AsyncRing::Size) {
+      m_asyncSpare.push_back(std::string());
+      m_asyncSpare.back().swap(m_asyncPending[i].m_text);
+      m_asyncSpare.back().clear();
+    }
+  }
+  m_asyncPending.erase(m_asyncPending.begin(), m_asyncPending.begin()+count);
+}
+
+
 PTrace::Block::Block(const char * fileName, int lineNum, const char * traceName)
   : file(fileName)
   , line(lineNum)
@@ -1524,6 +1923,7 @@ void PTimer::InternalStart(bool once, int64_t resetTime)
     m_absoluteTime = Tick() + GetResetTime();
     list->m_timersMutex.Wait();
     list->m_timers[m_handle] = this;
+    list->PushDeadline(*this);
     m_running = true;
     list->m_timersMutex.Signal();
 
@@ -1640,48 +2040,99 @@ bool PTimer::List::OnTimeout(PIdGenerator::Handle handle)
 }
 
 
+void PTimer::List::PushDeadline(const PTimer & timer)
+{
+  // Assumes m_timersMutex is locked
+  m_deadlines.push_back(Deadline(timer.m_absoluteTime.GetNanoSeconds(), timer.m_handle));
+  std::push_heap(m_deadlines.begin(), m_deadlines.end(), std::greater<Deadline>());
+
+  // Timers that are restarted frequently leave lots of stale entries behind
+  if (m_deadlines.size() > m_timers.size()*2 + 1000)
+    CompactDeadlines();
+}
+
+
+void PTimer::List::PopDeadline()
+{
+  std::pop_heap(m_deadlines.begin(), m_deadlines.end(), std::greater<Deadline>());
+  m_deadlines.pop_back();
+}
+
+
+void PTimer::List::CompactDeadlines()
+{
+  m_deadlines.clear();
+  for (TimerMap::iterator it = m_timers.begin(); it != m_timers.end(); ++it)
+    m_deadlines.push_back(Deadline(it->second->m_absoluteTime.GetNanoSeconds(), it->first));
+  std::make_heap(m_deadlines.begin(), m_deadlines.end(), std::greater<Deadline>());
+  PTRACE(5, NULL, PTraceModule(), "Timer deadlines compacted to " << m_deadlines.size() << " entries");
+}
+
+
 PTimeInterval PTimer::List::Process()
 {
   PTimeInterval now = PTimer::Tick();
+  int64_t nowNanoSeconds = now.GetNanoSeconds();
 
   // Calculate interval before next Process() call
   PTimeInterval nextInterval(0, 1);
 
   m_timersMutex.Wait();
 
-  for (TimerMap::iterator it = m_timers.begin(); it != m_timers.end(); ++it) {
+  size_t expired = 0;
+  while (!m_deadlines.empty() && m_deadlines.front().m_when <= nowNanoSeconds) {
+    Deadline deadline = m_deadlines.front();
+    PopDeadline();
+
+    TimerMap::iterator it = m_timers.find(deadline.m_handle);
+    if (it == m_timers.end())
+      continue; // Stopped
+
     PTimer & timer = *it->second;
-    if (timer.m_running) {
-      PTimeInterval delta = timer.m_absoluteTime - now;
-      if (delta > 0) {
-        if (nextInterval > delta)
-          nextInterval = delta;
-      }
-      else if (timer.m_callbackMutex.Try()) {
-        /* PTimer is stopped and completely removed from the list before it's
-           properties are changed from the external code, making this thread
-           safe without a mutex. */
-        if (timer.m_oneshot)
-          timer.m_running = false;
-        else {
-          timer.m_absoluteTime = now + timer.GetResetTime();
-          if (nextInterval > timer.GetResetTime())
-            nextInterval = timer.GetResetTime();
-        }
-        timer.m_callbackMutex.Signal();
+    if (!timer.m_running || timer.m_absoluteTime.GetNanoSeconds() != deadline.m_when)
+      continue; // Stale entry, timer was restarted since it was queued
 
-        m_threadPool.AddWork(new Timeout(it->first));
-        PTRACE(6, &timer, "Timer: " << timer << " work added, lateness=" << -delta);
-      }
+    if (!timer.m_callbackMutex.Try()) {
+      m_busy.push_back(deadline); // Still in OnTimeout(), check again next time around
+      continue;
     }
+
+    /* PTimer is stopped and completely removed from the list before it's
+       properties are changed from the external code, making this thread
+       safe without a mutex. */
+    if (timer.m_oneshot)
+      timer.m_running = false;
+    else {
+      timer.m_absoluteTime = now + timer.GetResetTime();
+      PushDeadline(timer);
+    }
+    timer.m_callbackMutex.Signal();
+
+    m_threadPool.AddWork(new Timeout(it->first));
+    PTRACE(6, &timer, "Timer: " << timer << " work added, lateness=" << PTimeInterval::NanoSeconds(nowNanoSeconds - deadline.m_when));
+    ++expired;
+  }
+
+  for (DeadlineHeap::iterator it = m_busy.begin(); it != m_busy.end(); ++it) {
+    m_deadlines.push_back(*it);
+    std::push_heap(m_deadlines.begin(), m_deadlines.end(), std::greater<Deadline>());
+  }
+  m_busy.clear();
+
+  if (!m_deadlines.empty()) {
+    PTimeInterval delta = PTimeInterval::NanoSeconds(m_deadlines.front().m_when - nowNanoSeconds);
+    if (nextInterval > delta)
+      nextInterval = delta;
   }
 
+  size_t total = m_timers.size();
+
   m_timersMutex.Signal();
 
   if (nextInterval < 10)
     nextInterval = 10;
 
-  PTRACE(6, NULL, PTraceModule(), m_timers.size() << " timers processed, next=" << nextInterval);
+  PTRACE(6, NULL, PTraceModule(), expired << " of " << total << " timers expired, next=" << nextInterval);
   return nextInterval;
 }
 
@@ -2417,7 +2868,10 @@ PProcess::PProcess(const char * manuf, const char * name,
   m_version.m_svn = 0;
   m_version.m_git = NULL;
 
-  m_activeThreads[GetThreadId()] = this;
+  InternalAddThread(this);
+#if P_HAS_THREAD_LOCAL
+  t_currentThread = this;
+#endif
 
 #if PTRACING
   // Do this before PProcessInstance is set to avoid a recursive loop with PTimedMutex
@@ -2609,6 +3063,11 @@ PProcess::~PProcess()
 #endif
   }
 
+#if PTRACING
+  // Anything traced from here on is output synchronously
+  PTraceInfo::Instance().StopAsyncWriter(true);
+#endif
+
   // Clean up factories
   PProcessStartupFactory::KeyList_T list = PProcessStartupFactory::GetKeyList();
   for (PProcessStartupFactory::KeyList_T::const_reverse_iterator it = list.rbegin(); it != list.rend(); ++it)
@@ -2619,8 +3078,14 @@ PProcess::~PProcess()
   m_threadMutex.Wait();
 
   // OK, if there are any other threads left, we get really insistent...
-  PTRACE(4, "Cleaning up " << m_activeThreads.size()-1 << " remaining threads.");
-  for (ThreadMap::iterator it = m_activeThreads.begin(); it != m_activeThreads.end(); ++it) {
+  PTRACE(4, "Cleaning up " << GetThreadSnapshot()->size()-1 << " remaining threads.");
+  ThreadMap activeThreads;
+  for (PINDEX i = 0; i < NumThreadShards; ++i) {
+    m_threadShards[i].m_mutex.Wait();
+    activeThreads.insert(m_threadShards[i].m_threads.begin(), m_threadShards[i].m_threads.end());
+    m_threadShards[i].m_mutex.Signal();
+  }
+  for (ThreadMap::iterator it = activeThreads.begin(); it != activeThreads.end(); ++it) {
     PThread & thread = *it->second;
     switch (thread.m_type) {
       case e_IsAutoDelete:
@@ -2640,7 +3105,15 @@ PProcess::~PProcess()
         break;
     }
   }
-  m_activeThreads.clear();
+  for (PINDEX i = 0; i < NumThreadShards; ++i) {
+    m_threadShards[i].m_mutex.Wait();
+    m_threadShards[i].m_threads.clear();
+    m_threadShards[i].m_mutex.Signal();
+  }
+  std::atomic_store(&m_threadSnapshot, std::shared_ptr<const ThreadIdentifiers>());
+#if P_HAS_THREAD_LOCAL
+  t_currentThread = NULL;
+#endif
 
   PTRACE(4, "Terminated all threads, destroying "
          << m_autoDeleteThreads.size() << " remaining auto-delete threads, and "
@@ -3040,13 +3513,74 @@ void PProcess::SetConfigurationPath(const PString & path)
 
 PThread * PProcess::GetThread(PThreadIdentifier threadId) const
 {
-  PWaitAndSignal mutex(m_threadMutex);
-  ThreadMap::const_iterator it = m_activeThreads.find(threadId);
-  return it != m_activeThreads.end() ? it->second : NULL;
+  ThreadShard & shard = GetThreadShard(threadId);
+  PWaitAndSignal mutex(shard.m_mutex);
+  ThreadMap::const_iterator it = shard.m_threads.find(threadId);
+  return it != shard.m_threads.end() ? it->second : NULL;
 
 }
 
 
+PProcess::ThreadShard & PProcess::GetThreadShard(PThreadIdentifier id) const
+{
+  // Thread identifiers are often aligned addresses, so mix in the high bits
+  size_t hash = (size_t)id;
+  hash ^= hash >> 7;
+  hash ^= hash >> 17;
+  return m_threadShards[hash%NumThreadShards];
+}
+
+
+std::shared_ptr<const PProcess::ThreadIdentifiers> PProcess::GetThreadSnapshot() const
+{
+  std::shared_ptr<const ThreadIdentifiers> snapshot = std::atomic_load(&m_threadSnapshot);
+  if (snapshot)
+    return snapshot;
+  return std::make_shared<const ThreadIdentifiers>();
+}
+
+
+// Must have m_threadMutex locked
+void PProcess::InternalAddThread(PThread * thread)
+{
+  PThreadIdentifier id = thread->GetThreadId();
+
+  ThreadShard & shard = GetThreadShard(id);
+  shard.m_mutex.Wait();
+  std::pair<ThreadMap::iterator, bool> result = shard.m_threads.insert(ThreadMap::value_type(id, thread));
+  if (!result.second)
+    result.first->second = thread;
+  shard.m_mutex.Signal();
+
+  if (result.second) {
+    std::shared_ptr<ThreadIdentifiers> snapshot = std::make_shared<ThreadIdentifiers>(*GetThreadSnapshot());
+    snapshot->push_back(id);
+    std::atomic_store(&m_threadSnapshot, std::shared_ptr<const ThreadIdentifiers>(snapshot));
+  }
+}
+
+
+// Must have m_threadMutex locked
+void PProcess::InternalRemoveThread(PThread * thread)
+{
+  PThreadIdentifier id = thread->GetThreadId();
+
+  ThreadShard & shard = GetThreadShard(id);
+  shard.m_mutex.Wait();
+  ThreadMap::iterator it = shard.m_threads.find(id);
+  bool removed = it != shard.m_threads.end() && it->second == thread;
+  if (removed)
+    shard.m_threads.erase(it); // Not already gone, or re-used the thread ID for new thread.
+  shard.m_mutex.Signal();
+
+  if (removed) {
+    std::shared_ptr<ThreadIdentifiers> snapshot = std::make_shared<ThreadIdentifiers>(*GetThreadSnapshot());
+    snapshot->erase(std::remove(snapshot->begin(), snapshot->end(), id), snapshot->end());
+    std::atomic_store(&m_threadSnapshot, std::shared_ptr<const ThreadIdentifiers>(snapshot));
+  }
+}
+
+
 void PProcess::InternalThreadStarted(PThread * thread)
 {
   if (PAssertNULL(thread) == NULL)
@@ -3054,13 +3588,14 @@ void PProcess::InternalThreadStarted(PThread * thread)
 
   m_threadMutex.Wait();
 
-  m_activeThreads[thread->GetThreadId()] = thread;
+  InternalAddThread(thread);
 
 #if PTRACING
   size_t newHighWaterMark = 0;
   static size_t highWaterMark = 1; // Inside m_threadMutex so simple static is OK
-  if (m_activeThreads.size() > highWaterMark+20)
-    newHighWaterMark = highWaterMark = m_activeThreads.size();
+  size_t count = GetThreadSnapshot()->size();
+  if (count > highWaterMark+20)
+    newHighWaterMark = highWaterMark = count;
 #endif
 
   m_threadMutex.Signal();
@@ -3076,14 +3611,17 @@ void PProcess::InternalThreadEnded(PThread * thread)
   if (PAssertNULL(thread) == NULL)
     return;
 
-  // Do the log before mutex and thread being removed from m_activeThreads
+  // Do the log before mutex and thread being removed from active threads
   PTRACE_IF(5, thread->IsAutoDelete(), thread, "Queuing auto-delete of thread " << *thread);
 
+#if P_HAS_THREAD_LOCAL
+  if (t_currentThread == thread)
+    t_currentThread = NULL;
+#endif
+
   PWaitAndSignal mutex(m_threadMutex);
 
-  ThreadMap::iterator it = m_activeThreads.find(thread->GetThreadId());
-  if (it != m_activeThreads.end() && it->second == thread)
-    m_activeThreads.erase(it); // Not already gone, or re-used the thread ID for new thread.
+  InternalRemoveThread(thread);
 
   // All of this is carefully constructed to avoid race condition deleting "thread"
   if (thread->IsAutoDelete()) {
@@ -3128,6 +3666,10 @@ void PThread::InternalThreadMain()
 {
   InternalPreMain();
 
+#if P_HAS_THREAD_LOCAL
+  t_currentThread = this;
+#endif
+
   PProcess & process = PProcess::Current();
 
 #if P_EXCEPTIONS
@@ -3161,16 +3703,38 @@ PThread * PThread::Current()
 
   PProcess & process = PProcess::Current();
 
-  PWaitAndSignal mutex(process.m_threadMutex);
-  PProcess::ThreadMap::iterator it = process.m_activeThreads.find(GetCurrentThreadId());
-  if (it != process.m_activeThreads.end() && !it->second->IsTerminated())
-    return it->second;
+#if P_HAS_THREAD_LOCAL
+  if (t_currentThread != NULL && !process.m_shuttingDown)
+    return t_currentThread;
+#endif
+
+  PThreadIdentifier id = GetCurrentThreadId();
+
+  {
+    PProcess::ThreadShard & shard = process.GetThreadShard(id);
+    PWaitAndSignal mutex(shard.m_mutex);
+    PProcess::ThreadMap::iterator it = shard.m_threads.find(id);
+    if (it != shard.m_threads.end() && !it->second->IsTerminated()) {
+#if P_HAS_THREAD_LOCAL
+      if (!process.m_shuttingDown)
+        t_currentThread = it->second;
+#endif
+      return it->second;
+    }
+  }
 
   if (process.m_shuttingDown)
     return NULL;
 
   PThread * thread = new PExternalThread;
+
+  process.m_threadMutex.Wait();
   process.m_externalThreads.Append(thread);
+  process.m_threadMutex.Signal();
+
+#if P_HAS_THREAD_LOCAL
+  t_currentThread = thread;
+#endif
   return thread;
 }
 
@@ -3181,10 +3745,15 @@ PString PThread::GetThreadName(PThreadIdentifier id)
     return "(null)";
 
   if (PProcess::IsInitialised()) {
-    PProcess & process = PProcess::Current();
-    PWaitAndSignal mutex(process.m_threadMutex);
-    PProcess::ThreadMap::iterator it = process.m_activeThreads.find(id);
-    if (it != process.m_activeThreads.end())
+#if P_HAS_THREAD_LOCAL
+    if (t_currentThread != NULL && id == GetCurrentThreadId())
+      return t_currentThread->GetThreadName();
+#endif
+
+    PProcess::ThreadShard & shard = PProcess::Current().GetThreadShard(id);
+    PWaitAndSignal mutex(shard.m_mutex);
+    PProcess::ThreadMap::iterator it = shard.m_threads.find(id);
+    if (it != shard.m_threads.end())
       return it->second->GetThreadName();
   }
 
@@ -3214,9 +3783,7 @@ PString PThread::GetIdentifiersAsString(PThreadIdentifier tid, PUniqueThreadIden
 
 PINDEX PThread::GetTotalCount()
 {
-    PProcess & process = PProcess::Current();
-    PWaitAndSignal mutex(process.m_threadMutex);
-    return process.m_activeThreads.size();
+  return PProcess::Current().GetThreadSnapshot()->size();
 }
 
 
@@ -3228,11 +3795,10 @@ bool PThread::GetTimes(PThreadIdentifier id, Times & times)
   if (id == PNullThreadIdentifier)
     return Current()->GetTimes(times);
 
-  PProcess & process = PProcess::Current();
-
-  PWaitAndSignal mutex(process.m_threadMutex);
-  PProcess::ThreadMap::iterator it = process.m_activeThreads.find(id);
-  return it != process.m_activeThreads.end() && it->second->GetTimes(times);
+  PProcess::ThreadShard & shard = PProcess::Current().GetThreadShard(id);
+  PWaitAndSignal mutex(shard.m_mutex);
+  PProcess::ThreadMap::iterator it = shard.m_threads.find(id);
+  return it != shard.m_threads.end() && it->second->GetTimes(times);
 }
 
 
@@ -3241,10 +3807,8 @@ bool PProcess::GetAllThreadIdentifiers(std::vector<PThreadIdentifier> & identifi
   if (!PProcess::IsInitialised())
     return false;
 
-  PWaitAndSignal mutex(m_threadMutex);
-  identifiers.reserve(m_activeThreads.size());
-  for (PProcess::ThreadMap::iterator it = m_activeThreads.begin(); it != m_activeThreads.end(); ++it)
-    identifiers.push_back(it->first);
+  std::shared_ptr<const ThreadIdentifiers> snapshot = GetThreadSnapshot();
+  identifiers.insert(identifiers.end(), snapshot->begin(), snapshot->end());
   return !identifiers.empty();
 }
 
@@ -4097,6 +4661,132 @@ PIntCondMutex & PIntCondMutex::operator-=(int dec)
 
 /////////////////////////////////////////////////////////////////////////////
 
+/* All the Nest records for a single thread. The list only ever grows while
+   the thread exists, a record being reused when its mutex is fully unlocked,
+   so a thread only ever looks at its own memory for StartRead() etc. The
+   registry of all tables is only locked for a new record, which is when a
+   thread holds more mutexes simultaneously than it has before, and to dump
+   diagnostics for a possible deadlock.
+ */
+struct PReadWriteMutex::NestTable
+{
+  PThreadIdentifier       m_threadId;
+  PUniqueThreadIdentifier m_uniqueId;
+  Nest                  * m_nests;
+
+  NestTable()
+    : m_threadId(PThread::GetCurrentThreadId())
+    , m_uniqueId(PThread::GetCurrentUniqueIdentifier())
+    , m_nests(NULL)
+  {
+    PWaitAndSignal lock(GetRegistryMutex());
+    GetRegistry().insert(this);
+  }
+
+  ~NestTable()
+  {
+    PWaitAndSignal lock(GetRegistryMutex());
+    GetRegistry().erase(this);
+    while (m_nests != NULL) {
+      Nest * next = m_nests->m_next;
+      delete m_nests;
+      m_nests = next;
+    }
+  }
+
+  Nest * Find(const PReadWriteMutex * mutex) const
+  {
+    for (Nest * nest = m_nests; nest != NULL; nest = nest->m_next) {
+      if (nest->m_mutex == mutex)
+        return nest;
+    }
+    return NULL;
+  }
+
+  Nest & Start(const PReadWriteMutex * mutex)
+  {
+    Nest * unused = NULL;
+    for (Nest * nest = m_nests; nest != NULL; nest = nest->m_next) {
+      if (nest->m_mutex == mutex)
+        return *nest;
+      if (unused == NULL && nest->m_mutex == NULL)
+        unused = nest;
+    }
+
+    if (unused == NULL) {
+      unused = new Nest;
+      PWaitAndSignal lock(GetRegistryMutex());
+      unused->m_next = m_nests;
+      m_nests = unused;
+    }
+
+    unused->m_uniqueId = m_uniqueId;
+    unused->m_mutex = mutex;
+    return *unused;
+  }
+
+  static void End(Nest & nest)
+  {
+    nest.m_readerCount = 0;
+    nest.m_writerCount = 0;
+    nest.m_waiting = false;
+    nest.m_mutex = NULL;
+  }
+
+  typedef std::set<NestTable *> Registry;
+
+  // These are never deleted, as threads may still be exiting during static destruction
+  static PCriticalSection & GetRegistryMutex()
+  {
+    static PCriticalSection * mutex = new PCriticalSection;
+    return *mutex;
+  }
+
+  static Registry & GetRegistry()
+  {
+    static Registry * registry = new Registry;
+    return *registry;
+  }
+
+  static NestTable & Current()
+  {
+#if P_HAS_THREAD_LOCAL
+    static thread_local NestTable table;
+    return table;
+#else
+    typedef std::map<PThreadIdentifier, NestTable *> ByThread;
+    static ByThread * byThread = new ByThread;
+
+    PThreadIdentifier id = PThread::GetCurrentThreadId();
+    {
+      PWaitAndSignal lock(GetRegistryMutex());
+      ByThread::iterator it = byThread->find(id);
+      if (it != byThread->end()) {
+        // Thread identifiers can be reused, and we have no thread exit hook
+        it->second->m_uniqueId = PThread::GetCurrentUniqueIdentifier();
+        return *it->second;
+      }
+    }
+
+    NestTable * table = new NestTable;
+    PWaitAndSignal lock(GetRegistryMutex());
+    (*byThread)[id] = table;
+    return *table;
+#endif
+  }
+
+  static bool IsInUse(const PReadWriteMutex * mutex)
+  {
+    PWaitAndSignal lock(GetRegistryMutex());
+    for (Registry::const_iterator it = GetRegistry().begin(); it != GetRegistry().end(); ++it) {
+      if ((*it)->Find(mutex) != NULL)
+        return true;
+    }
+    return false;
+  }
+};
+
+
 PReadWriteMutex::PReadWriteMutex()
   : PMutexExcessiveLockInfo()
 #if P_READ_WRITE_ALGO2
@@ -4106,7 +4796,7 @@ PReadWriteMutex::PReadWriteMutex()
   , m_outCount(0)
   , m_writeSemaphore(0, 1)
   , m_wait(false)
-#else
+#elif P_READ_WRITE_ALGO1
   , m_readerSemaphore(1, 1)
   , m_readerMutex()
   , m_readerCount(0)
@@ -4114,6 +4804,12 @@ PReadWriteMutex::PReadWriteMutex()
   , m_writerSemaphore(1, 1)
   , m_writerMutex()
   , m_writerCount(0)
+#else
+  , m_readerCount(0)
+  , m_readersDeparting(0)
+  , m_readerSemaphore(0, WriterBias)
+  , m_writerSemaphore(0, 1)
+  , m_writerMutex()
 #endif
 {
   PMUTEX_CONSTRUCTED();
@@ -4128,7 +4824,7 @@ PReadWriteMutex::PReadWriteMutex(const PDebugLocation & location, unsigned timeo
   , m_outCount(0)
   , m_writeSemaphore(0, 1)
   , m_wait(false)
-#else
+#elif P_READ_WRITE_ALGO1
   , m_readerSemaphore(1, 1)
   , m_readerMutex(location, timeout)
   , m_readerCount(0)
@@ -4136,6 +4832,12 @@ PReadWriteMutex::PReadWriteMutex(const PDebugLocation & location, unsigned timeo
   , m_writerSemaphore(1, 1)
   , m_writerMutex(location, timeout)
   , m_writerCount(0)
+#else
+  , m_readerCount(0)
+  , m_readersDeparting(0)
+  , m_readerSemaphore(0, WriterBias)
+  , m_writerSemaphore(0, 1)
+  , m_writerMutex(location, timeout)
 #endif
 {
   PMUTEX_CONSTRUCTED();
@@ -4144,7 +4846,15 @@ PReadWriteMutex::PReadWriteMutex(const PDebugLocation & location, unsigned timeo
 
 PReadWriteMutex::~PReadWriteMutex()
 {
-  EndNest(); // Destruction while current thread has a lock is OK
+  // Destruction while current thread has a lock is OK
+  Nest * nest = GetNest();
+  if (nest != NULL) {
+    if (nest->m_writerCount > 0)
+      InternalEndWriteWithNest(*nest, P_DEBUG_LOCATION);
+    else if (nest->m_readerCount > 0)
+      InternalEndReadWithNest(*nest, P_DEBUG_LOCATION);
+    EndNest();
+  }
 
   /* There is a small window during destruction where another thread is on the
      way out of EndRead() or EndWrite() where it checks for nested locks.
@@ -4159,8 +4869,18 @@ PReadWriteMutex::~PReadWriteMutex()
      done by the user of the class too, but it is easier to fix here than
      there so practicality wins out!
    */
-  while (!m_nestedThreads.empty())
+#if P_READ_WRITE_ALGO1 || P_READ_WRITE_ALGO2
+  while (NestTable::IsInUse(this))
+    PThread::Sleep(10);
+#else
+  /* With the atomic algorithm a thread does not touch the object after the
+     final decrement of the reader count, except to signal a pending writer,
+     which then holds m_writerMutex until its EndWrite() is complete. */
+  while (m_readerCount != 0)
     PThread::Sleep(10);
+  m_writerMutex.Wait();
+  m_writerMutex.Signal();
+#endif
 
   PMUTEX_DESTROYED();
 }
@@ -4168,25 +4888,21 @@ PReadWriteMutex::~PReadWriteMutex()
 
 PReadWriteMutex::Nest * PReadWriteMutex::GetNest()
 {
-  PWaitAndSignal mutex(m_nestingMutex);
-  NestMap::iterator it = m_nestedThreads.find(PThread::GetCurrentThreadId());
-  return it != m_nestedThreads.end() ? &it->second : NULL;
+  return NestTable::Current().Find(this);
 }
 
 
 void PReadWriteMutex::EndNest()
 {
-  m_nestingMutex.Wait();
-  m_nestedThreads.erase(PThread::GetCurrentThreadId());
-  m_nestingMutex.Signal();
+  Nest * nest = GetNest();
+  if (nest != NULL)
+    NestTable::End(*nest);
 }
 
 
 PReadWriteMutex::Nest & PReadWriteMutex::StartNest()
 {
-  PWaitAndSignal mutex(m_nestingMutex);
-  // The std::map will create the entry if it doesn't exist
-  return m_nestedThreads[PThread::GetCurrentThreadId()];
+  return NestTable::Current().Start(this);
 }
 
 
@@ -4223,10 +4939,16 @@ void PReadWriteMutex::InternalWait(Nest & nest, PSync & sync, const PDebugLocati
 
   m_excessiveLockActive = true;
 
+  typedef std::map<PThreadIdentifier, Nest> NestMap;
   NestMap nestedThreadsToDump;
   {
-    PWaitAndSignal mutex(m_nestingMutex);
-    nestedThreadsToDump = m_nestedThreads;
+    PWaitAndSignal mutex(NestTable::GetRegistryMutex());
+    const NestTable::Registry & registry = NestTable::GetRegistry();
+    for (NestTable::Registry::const_iterator it = registry.begin(); it != registry.end(); ++it) {
+      Nest * other = (*it)->Find(this);
+      if (other != NULL)
+        nestedThreadsToDump[(*it)->m_threadId] = *other;
+    }
   }
 
 #if PTRACING
@@ -4368,10 +5090,10 @@ void PReadWriteMutex::InternalEndWrite(const PDebugLocation * location)
 void PReadWriteMutex::InternalStartReadWithNest(Nest & nest, const PDebugLocation & location)
 {
 #if P_READ_WRITE_ALGO2
-  InternalWait(nest, m_inSemaphore);
+  InternalWait(nest, m_inSemaphore, location);
   ++m_inCount;
   m_inSemaphore.Signal();
-#else
+#elif P_READ_WRITE_ALGO1
   InternalWait(nest, m_starvationPreventer, location);
    InternalWait(nest, m_readerSemaphore, location);
     InternalWait(nest, m_readerMutex, location);
@@ -4383,6 +5105,10 @@ void PReadWriteMutex::InternalStartReadWithNest(Nest & nest, const PDebugLocatio
     m_readerMutex.InstrumentedSignal(location);
    m_readerSemaphore.InstrumentedSignal(location);
   m_starvationPreventer.InstrumentedSignal(location);
+#else
+  // Negative count means a writer is pending or active, it will wake us
+  if (++m_readerCount < 0)
+    InternalWait(nest, m_readerSemaphore, location);
 #endif
 }
 
@@ -4390,12 +5116,12 @@ void PReadWriteMutex::InternalStartReadWithNest(Nest & nest, const PDebugLocatio
 void PReadWriteMutex::InternalEndReadWithNest(Nest & nest, const PDebugLocation & location)
 {
 #if P_READ_WRITE_ALGO2
-  InternalWait(nest, m_outSemaphore);
+  InternalWait(nest, m_outSemaphore, location);
   ++m_outCount;
   if (m_wait && m_inCount == m_outCount)
     m_writeSemaphore.Signal();
   m_outSemaphore.Signal();
-#else
+#elif P_READ_WRITE_ALGO1
   InternalWait(nest, m_readerMutex, location);
 
   m_readerCount--;
@@ -4403,6 +5129,10 @@ void PReadWriteMutex::InternalEndReadWithNest(Nest & nest, const PDebugLocation
     m_writerSemaphore.InstrumentedSignal(location);
 
   m_readerMutex.InstrumentedSignal(location);
+#else
+  // If a writer is pending, the last reader it was waiting on wakes it
+  if (--m_readerCount < 0 && --m_readersDeparting == 0)
+    m_writerSemaphore.InstrumentedSignal(location);
 #endif
 }
 
@@ -4410,17 +5140,17 @@ void PReadWriteMutex::InternalEndReadWithNest(Nest & nest, const PDebugLocation
 void PReadWriteMutex::InternalStartWriteWithNest(Nest & nest, const PDebugLocation & location)
 {
 #if P_READ_WRITE_ALGO2
-  InternalWait(nest, m_inSemaphore);
-  InternalWait(nest, m_outSemaphore);
+  InternalWait(nest, m_inSemaphore, location);
+  InternalWait(nest, m_outSemaphore, location);
   if (m_inCount == m_outCount)
     m_outSemaphore.Signal();
   else {
     m_wait = true;
     m_outSemaphore.Signal();
-    InternalWait(nest, m_writeSemaphore);
+    InternalWait(nest, m_writeSemaphore, location);
     m_wait = false;
   }
-#else
+#elif P_READ_WRITE_ALGO1
   InternalWait(nest, m_writerMutex, location);
 
   m_writerCount++;
@@ -4430,6 +5160,13 @@ void PReadWriteMutex::InternalStartWriteWithNest(Nest & nest, const PDebugLocati
   m_writerMutex.InstrumentedSignal(location);
 
   InternalWait(nest, m_writerSemaphore, location);
+#else
+  // Exclude other writers, then announce ourselves so no new readers enter
+  InternalWait(nest, m_writerMutex, location);
+
+  int readers = (m_readerCount -= WriterBias) + WriterBias;
+  if (readers != 0 && (m_readersDeparting += readers) != 0)
+    InternalWait(nest, m_writerSemaphore, location);
 #endif
 }
 
@@ -4438,7 +5175,7 @@ void PReadWriteMutex::InternalEndWriteWithNest(Nest & nest, const PDebugLocation
 {
 #if P_READ_WRITE_ALGO2
   m_inSemaphore.Signal();
-#else
+#elif P_READ_WRITE_ALGO1
   m_writerSemaphore.InstrumentedSignal(location);
 
   InternalWait(nest, m_writerMutex, location);
@@ -4447,6 +5184,13 @@ void PReadWriteMutex::InternalEndWriteWithNest(Nest & nest, const PDebugLocation
   if (m_writerCount == 0)
     m_readerSemaphore.InstrumentedSignal(location);
 
+  m_writerMutex.InstrumentedSignal(location);
+#else
+  // Release any readers that arrived while we were writing
+  int readers = (m_readerCount += WriterBias);
+  while (readers-- > 0)
+    m_readerSemaphore.InstrumentedSignal(location);
+
   m_writerMutex.InstrumentedSignal(location);
 #endif
 }
@@ -20,6 +20,10 @@
  * level 2 = list plugin that are not compatible (old version, not a PWLIB plugin etc).
  * level 4 = list directories.
  * level 5 = list plugin before checking suffix .
+ *
+ * If a manifest file is set, via SetManifestFile() or the environment variable
+ * "PTLIBPLUGINMANIFEST", plugins whose services are already known from it are
+ * not loaded until one of those services is used.
  *  * Portable Windows Library
  *
  * Contributor(s): Snark at GnomeMeeting
@@ -51,6 +55,8 @@
 #define PTPLUGIN_SUFFIX       "_ptplugin"
 #define PWPLUGIN_SUFFIX       "_pwplugin"
 
+static const char ManifestHeader[] = "PTLib Plugin Manifest 1";
+
 const char PPluginServiceDescriptor::SeparatorChar = '\t';
 
 
@@ -107,9 +113,173 @@ bool PPluginDeviceDescriptor::GetDeviceCapabilities(const PString & /*deviceName
 }
 
 
+//////////////////////////////////////////////////////
+
+/* A plugin whose services are known from the manifest, but which has not been
+   loaded yet. It owns the stand in descriptors registered for its services,
+   the first of those which needs more than the names will load the plugin.
+   The load is done without m_servicesMutex, as the plugin registration and the
+   notifiers call back into the manager, concurrent first uses wait on the
+   plugin's own mutex for the one load to complete.
+ */
+class PPluginManager::DeferredPlugin
+{
+  public:
+    DeferredPlugin(PPluginManager & manager, const PFilePath & fileName)
+      : m_manager(manager)
+      , m_fileName(fileName)
+      , m_state(Deferred)
+    { }
+
+    ~DeferredPlugin();
+
+    void Load();
+
+    PPluginManager & m_manager;
+    PFilePath        m_fileName;
+    PDECLARE_MUTEX(  m_loadMutex);
+    enum { Deferred, Loading, Loaded, Failed } m_state; // Protected by m_loadMutex
+    std::vector<DeferredService *> m_services;
+};
+
+
+class PPluginManager::DeferredService
+{
+  public:
+    DeferredService(DeferredPlugin & plugin, const ManifestService & info)
+      : m_plugin(plugin)
+      , m_info(info)
+      , m_real(NULL)
+    { }
+
+    virtual ~DeferredService() { }
+
+    const PPluginServiceDescriptor * GetReal() const
+    {
+      m_plugin.Load();
+      return m_real;
+    }
+
+    DeferredPlugin & m_plugin;
+    ManifestService  m_info;
+    mutable const PPluginServiceDescriptor * m_real; // Set by RegisterService() while plugin loading
+};
+
+
+template <class Base>
+class PPluginManager::DeferredDescriptor : public Base, public DeferredService
+{
+  public:
+    DeferredDescriptor(DeferredPlugin & plugin, const ManifestService & info)
+      : DeferredService(plugin, info)
+    { }
+
+    virtual const char * GetServiceType() const { return m_info.m_type; }
+    virtual const char * GetServiceName() const { return m_info.m_name; }
+    virtual const char * GetFriendlyName() const { return m_info.m_friendlyName; }
+
+    virtual bool ValidateServiceName(const PString & name, P_INT_PTR userData) const
+    {
+      const PPluginServiceDescriptor * real = GetReal();
+      return real != NULL && real->ValidateServiceName(name, userData);
+    }
+
+    virtual PObject * CreateInstance(P_INT_PTR userData) const
+    {
+      const PPluginServiceDescriptor * real = GetReal();
+      return real != NULL ? real->CreateInstance(userData) : NULL;
+    }
+};
+
+
+class PPluginManager::DeferredDevice : public DeferredDescriptor<PPluginDeviceDescriptor>
+{
+  public:
+    DeferredDevice(DeferredPlugin & plugin, const ManifestService & info)
+      : DeferredDescriptor<PPluginDeviceDescriptor>(plugin, info)
+    { }
+
+    const PPluginDeviceDescriptor * GetRealDevice() const { return dynamic_cast<const PPluginDeviceDescriptor *>(GetReal()); }
+
+    virtual PStringArray GetDeviceNames(P_INT_PTR userData) const
+    {
+      const PPluginDeviceDescriptor * real = GetRealDevice();
+      return real != NULL ? real->GetDeviceNames(userData) : PStringArray();
+    }
+
+    virtual bool ValidateDeviceName(const PString & deviceName, P_INT_PTR userData) const
+    {
+      const PPluginDeviceDescriptor * real = GetRealDevice();
+      return real != NULL && real->ValidateDeviceName(deviceName, userData);
+    }
+
+    virtual bool GetDeviceCapabilities(const PString & deviceName, void * capabilities) const
+    {
+      const PPluginDeviceDescriptor * real = GetRealDevice();
+      return real != NULL && real->GetDeviceCapabilities(deviceName, capabilities);
+    }
+};
+
+
+PPluginManager::DeferredPlugin::~DeferredPlugin()
+{
+  for (size_t i = 0; i < m_services.size(); ++i)
+    delete m_services[i];
+}
+
+
+void PPluginManager::DeferredPlugin::Load()
+{
+  PWaitAndSignal lock(m_loadMutex);
+
+  // Already done, or re-entered from the plugin's own registration or notifiers
+  if (m_state != Deferred)
+    return;
+
+  PTRACE(3, &m_manager, "PLUGIN", "Loading deferred plugin " << m_fileName);
+  m_state = Loading;
+
+  PTRACE_PARAM(bool loaded =) m_manager.LoadPlugin(m_fileName, NULL, this);
+
+  {
+    // Swap the real descriptors, bound by RegisterService(), in for the stand ins
+    PWaitAndSignal mutex(m_manager.m_servicesMutex);
+    m_state = Loaded;
+    for (size_t i = 0; i < m_services.size(); ++i) {
+      const DeferredService & service = *m_services[i];
+      if (service.m_real == NULL) {
+        m_state = Failed;
+        continue;
+      }
+
+      const PPluginServiceDescriptor * standIn = dynamic_cast<const PPluginServiceDescriptor *>(&service);
+      for (ServiceMap::iterator it = m_manager.m_services.find(service.m_info.m_type);
+                 it != m_manager.m_services.end() && it->first == service.m_info.m_type; ++it) {
+        if (it->second == standIn) {
+          it->second = service.m_real;
+          break;
+        }
+      }
+    }
+  }
+
+  if (m_state == Loaded)
+    return;
+
+  // Manifest was wrong about this one, make sure it is loaded normally next time
+  PTRACE(2, &m_manager, "PLUGIN", "Deferred plugin " << m_fileName << (loaded ? " did not register expected services" : " failed to load"));
+  PWaitAndSignal mutex(m_manager.m_manifestMutex);
+  m_manager.m_manifest.erase(m_fileName);
+  m_manager.m_manifestChanged = true;
+  m_manager.WriteManifest();
+}
+
+
 //////////////////////////////////////////////////////
 
 PPluginManager::PPluginManager()
+  : m_manifestRead(false)
+  , m_manifestChanged(false)
 {
   m_suffixes.AppendString(PTPLUGIN_SUFFIX);
   m_suffixes.AppendString(PWPLUGIN_SUFFIX);
@@ -150,11 +320,23 @@ void PPluginManager::LoadDirectories()
 {
   PTRACE(4, "PLUGIN\tEnumerating plugin directories " << setfill(PPATH_SEPARATOR) << m_directories);
   for (PList<PDirectory>::iterator it = m_directories.begin(); it != m_directories.end(); ++it)
-    LoadDirectory(*it);
+    InternalLoadDirectory(*it);
+
+  PWaitAndSignal mutex(m_manifestMutex);
+  WriteManifest();
 }
 
 
 void PPluginManager::LoadDirectory(const PDirectory & directory)
+{
+  InternalLoadDirectory(directory);
+
+  PWaitAndSignal mutex(m_manifestMutex);
+  WriteManifest();
+}
+
+
+void PPluginManager::InternalLoadDirectory(const PDirectory & directory)
 {
   PDirectory dir = directory;
   if (!dir.Open()) {
@@ -170,7 +352,7 @@ void PPluginManager::LoadDirectory(const PDirectory & directory)
     PDirectory subdir = entry;
     if (subdir.Open()) {
       if (!directory.IsRoot())
-        LoadDirectory(entry);
+        InternalLoadDirectory(entry);
     }
     else {
       PFilePath fn(entry);
@@ -178,14 +360,102 @@ void PPluginManager::LoadDirectory(const PDirectory & directory)
         PString suffix = *it;
         PTRACE(5, "PLUGIN\tChecking " << fn << " against suffix " << suffix);
         if ((fn.GetType() *= PDynaLink::GetExtension()) && (fn.GetTitle().Right(strlen(suffix)) *= suffix)) 
-          LoadPlugin(entry);
+          InternalLoadPlugin(fn);
       }
     }
   } while (dir.Next());
 }
 
 
+void PPluginManager::InternalLoadPlugin(const PFilePath & fileName)
+{
+  PFileInfo info;
+  ManifestServices services;
+
+  {
+    PWaitAndSignal mutex(m_manifestMutex);
+
+    if (m_manifestFile.IsEmpty() || !PFile::GetInfo(fileName, info))
+      info.size = 0;
+    else {
+      ReadManifest();
+
+      Manifest::const_iterator it = m_manifest.find(fileName);
+      if (it != m_manifest.end() && it->second.m_size == info.size && it->second.m_modified == info.modified.GetTimestamp()) {
+        if (it->second.m_version == ManifestEntry::NotPlugin) {
+          PTRACE(4, "PLUGIN\t" << fileName << " is not a PWLib plugin, from manifest");
+          return;
+        }
+        if (it->second.m_version == 0)
+          services = it->second.m_services;
+      }
+    }
+  }
+
+  // Not using manifest, or could not get file info, so just load it
+  if (info.size == 0) {
+    LoadPlugin(fileName);
+    return;
+  }
+
+  if (!services.empty() && DeferPlugin(fileName, services))
+    return;
+
+  ManifestEntry entry;
+  entry.m_size = info.size;
+  entry.m_modified = info.modified.GetTimestamp();
+
+  LoadPlugin(fileName, &entry, NULL);
+
+  if (entry.m_version != ManifestEntry::UnknownVersion) {
+    PWaitAndSignal mutex(m_manifestMutex);
+    m_manifest[fileName] = entry;
+    m_manifestChanged = true;
+  }
+}
+
+
+bool PPluginManager::DeferPlugin(const PFilePath & fileName, const ManifestServices & services)
+{
+  PWaitAndSignal mutex(m_servicesMutex);
+
+  // If any clash, load it for real so it behaves exactly as it would have
+  for (ManifestServices::const_iterator it = services.begin(); it != services.end(); ++it) {
+    if (GetServiceDescriptor(it->m_name, it->m_type) != NULL)
+      return false;
+  }
+
+  DeferredPlugin * plugin = new DeferredPlugin(*this, fileName);
+  for (ManifestServices::const_iterator it = services.begin(); it != services.end(); ++it) {
+    DeferredService * service;
+    PPluginServiceDescriptor * descriptor;
+    if (it->m_device) {
+      DeferredDevice * device = new DeferredDevice(*plugin, *it);
+      service = device;
+      descriptor = device;
+    }
+    else {
+      DeferredDescriptor<PPluginServiceDescriptor> * other = new DeferredDescriptor<PPluginServiceDescriptor>(*plugin, *it);
+      service = other;
+      descriptor = other;
+    }
+    plugin->m_services.push_back(service);
+    m_services.insert(ServiceMap::value_type(it->m_type, descriptor));
+  }
+  m_deferredPlugins.push_back(plugin);
+
+  PTRACE(4, "PLUGIN\tDeferred loading " << fileName << ", " << services.size() << " services from manifest");
+  return true;
+}
+
+
 PBoolean PPluginManager::LoadPlugin(const PString & fileName)
+{
+  return LoadPlugin(fileName, NULL, NULL);
+}
+
+
+bool PPluginManager::LoadPlugin(const PString & fileName, ManifestEntry * entry, DeferredPlugin * deferred)
 {
   PDynaLink *dll = new PDynaLink(fileName);
   if (!dll->IsLoaded()) {
@@ -194,13 +464,18 @@ PBoolean PPluginManager::LoadPlugin(const PString & fileName)
 
   else {
     PDynaLink::Function fn;
-    if (!dll->GetFunction("PWLibPlugin_GetAPIVersion", fn))
+    if (!dll->GetFunction("PWLibPlugin_GetAPIVersion", fn)) {
       PTRACE(2, "PLUGIN\t" << fileName << " is not a PWLib plugin");
+      if (entry != NULL)
+        entry->m_version = ManifestEntry::NotPlugin;
+    }
 
     else {
       unsigned (*GetAPIVersion)() = (unsigned (*)())fn;
       int version = (*GetAPIVersion)();
       PTRACE(5, "PLUGIN\t" << fileName << " API version " << version);
+      if (entry != NULL)
+        entry->m_version = version;
       switch (version) {
         case 0 : // old-style service plugins, and old-style codec plugins
           {
@@ -209,7 +484,22 @@ PBoolean PPluginManager::LoadPlugin(const PString & fileName)
               PTRACE(2, "PLUGIN\t" << fileName << " has no registration-trigger function");
             else {
               void (*triggerRegister)(PPluginManager *) = (void (*)(PPluginManager *))fn;
+
+              // Only services registered by this thread, while triggered, come from this plugin
+              bool tracking = entry != NULL || deferred != NULL;
+              if (tracking) {
+                PWaitAndSignal mutex(m_servicesMutex);
+                LoadingContext & context = m_loadingThreads[PThread::GetCurrentThreadId()];
+                context.m_recording = entry;
+                context.m_deferred = deferred;
+              }
+
               (*triggerRegister)(this);
+
+              if (tracking) {
+                PWaitAndSignal mutex(m_servicesMutex);
+                m_loadingThreads.erase(PThread::GetCurrentThreadId());
+              }
               PTRACE(4, "PLUGIN\t" << fileName << " has been triggered");
             }
           }
@@ -269,6 +559,20 @@ PStringArray PPluginManager::GetPluginsProviding(const PString & serviceType, bo
 }
 
 
+PPluginManager::ServiceList PPluginManager::GetServiceList(const PString & serviceType) const
+{
+  /* Descriptors are called after this returns, and the lock released, as a
+     stand in may need to load its deferred plugin. Descriptors are not
+     deleted until OnShutdown() so the pointers remain valid. */
+  PWaitAndSignal mutex(m_servicesMutex);
+
+  ServiceList result;
+  for (ServiceMap::const_iterator it = m_services.find(serviceType); it != m_services.end() && it->first == serviceType; ++it)
+    result.push_back(it->second);
+  return result;
+}
+
+
 const PPluginServiceDescriptor * PPluginManager::GetServiceDescriptor(const PString & serviceName,
                                                                       const PString & serviceType) const
 {
@@ -286,8 +590,6 @@ PObject * PPluginManager::CreatePlugin(const PString & serviceName,
                                        const PString & serviceType,
                                        P_INT_PTR userData) const
 {
-  PWaitAndSignal mutex(m_servicesMutex);
-
   {
     // If have tab character, then have explicit driver name in device
     PINDEX tab = serviceName.Find(PPluginServiceDescriptor::SeparatorChar);
@@ -296,9 +598,10 @@ PObject * PPluginManager::CreatePlugin(const PString & serviceName,
       return descriptor->CreateInstance(userData);
   }
 
-  for (ServiceMap::const_iterator it = m_services.find(serviceType); it != m_services.end() && it->first == serviceType; ++it) {
-    if (it->second->ValidateServiceName(serviceName, userData))
-      return it->second->CreateInstance(userData);
+  ServiceList services = GetServiceList(serviceType);
+  for (ServiceList::const_iterator it = services.begin(); it != services.end(); ++it) {
+    if ((*it)->ValidateServiceName(serviceName, userData))
+      return (*it)->CreateInstance(userData);
   }
 
   return NULL;
@@ -310,8 +613,6 @@ PStringArray PPluginManager::GetPluginDeviceNames(const PString & serviceName,
                                                   P_INT_PTR userData,
                                                   const char * const * prioritisedDrivers) const
 {
-  PWaitAndSignal mutex(m_servicesMutex);
-
   if (!serviceName.IsEmpty() && serviceName.Find('*') == P_MAX_INDEX) {
     const PPluginDeviceDescriptor * descriptor = dynamic_cast<const PPluginDeviceDescriptor *>(GetServiceDescriptor(serviceName, serviceType));
     return descriptor != NULL ? descriptor->GetDeviceNames(userData) : PStringArray();
@@ -322,8 +623,9 @@ PStringArray PPluginManager::GetPluginDeviceNames(const PString & serviceName,
 
   // First we run through all of the drivers and their lists of devices and
   // use the dictionary to assure all names are unique
-  for (ServiceMap::const_iterator it = m_services.find(serviceType); it != m_services.end() && it->first == serviceType; ++it) {
-    const PPluginDeviceDescriptor * descriptor = dynamic_cast<const PPluginDeviceDescriptor *>(it->second);
+  ServiceList services = GetServiceList(serviceType);
+  for (ServiceList::const_iterator it = services.begin(); it != services.end(); ++it) {
+    const PPluginDeviceDescriptor * descriptor = dynamic_cast<const PPluginDeviceDescriptor *>(*it);
     if (descriptor != NULL) {
       PCaselessString driver = descriptor->GetServiceName();
       PStringArray devices = descriptor->GetDeviceNames(userData);
@@ -378,9 +680,9 @@ PBoolean PPluginManager::GetPluginsDeviceCapabilities(const PString & serviceTyp
     return false;
 
   if (serviceName.IsEmpty() || serviceName == "*") {
-    PWaitAndSignal mutex(m_servicesMutex);
-    for (ServiceMap::const_iterator it = m_services.find(serviceType); it != m_services.end() && it->first == serviceType; ++it) {
-      const PPluginDeviceDescriptor * desc = dynamic_cast<const PPluginDeviceDescriptor *>(it->second);
+    ServiceList services = GetServiceList(serviceType);
+    for (ServiceList::const_iterator it = services.begin(); it != services.end(); ++it) {
+      const PPluginDeviceDescriptor * desc = dynamic_cast<const PPluginDeviceDescriptor *>(*it);
       if (desc != NULL && desc->ValidateDeviceName(deviceName, 0))
         return desc->GetDeviceCapabilities(deviceName,capabilities);
     }
@@ -406,18 +708,150 @@ bool PPluginManager::RegisterService(const char * name)
 
   PWaitAndSignal mutex(m_servicesMutex);
 
+  LoadingThreads::const_iterator loading = m_loadingThreads.find(PThread::GetCurrentThreadId());
+  const LoadingContext * context = loading != m_loadingThreads.end() ? &loading->second : NULL;
+
   // first, check if it something didn't already register that name and type
-  if (GetServiceDescriptor(descriptor->GetServiceName(), descriptor->GetServiceType()) != NULL) {
-    PTRACE(3, "PLUGIN\tDuplicate \"" << name << '"');
-    return false;
+  PString serviceType = descriptor->GetServiceType();
+  PString serviceName = descriptor->GetServiceName();
+  for (ServiceMap::iterator it = m_services.find(serviceType); it != m_services.end() && it->first == serviceType; ++it) {
+    if (serviceName != it->second->GetServiceName())
+      continue;
+
+    // Unless it is the stand in for this service from the deferred plugin this thread is loading
+    const DeferredService * deferred = dynamic_cast<const DeferredService *>(it->second);
+    if (deferred == NULL || context == NULL || &deferred->m_plugin != context->m_deferred) {
+      PTRACE(3, "PLUGIN\tDuplicate \"" << name << '"');
+      return false;
+    }
+
+    // Swapped into m_services by DeferredPlugin::Load() when the load completes
+    deferred->m_real = descriptor;
+    return true;
   }
 
-  m_services.insert(ServiceMap::value_type(descriptor->GetServiceType(), descriptor));
+  m_services.insert(ServiceMap::value_type(serviceType, descriptor));
+
+  if (context != NULL && context->m_recording != NULL) {
+    ManifestService service;
+    service.m_type = serviceType;
+    service.m_name = serviceName;
+    service.m_friendlyName = descriptor->GetFriendlyName();
+    service.m_device = dynamic_cast<const PPluginDeviceDescriptor *>(descriptor) != NULL;
+    context->m_recording->m_services.push_back(service);
+  }
 
   return true;
 }
 
 
+void PPluginManager::SetManifestFile(const PFilePath & path)
+{
+  PWaitAndSignal mutex(m_manifestMutex);
+
+  if (m_manifestFile == path)
+    return;
+
+  m_manifestFile = path;
+  m_manifest.clear();
+  m_manifestRead = false;
+  m_manifestChanged = false;
+}
+
+
+void PPluginManager::ReadManifest()
+{
+  // Called with m_manifestMutex locked
+  if (m_manifestRead)
+    return;
+
+  m_manifestRead = true;
+
+  PTextFile file;
+  if (!file.Open(m_manifestFile, PFile::ReadOnly)) {
+    PTRACE(4, "PLUGIN\tNo manifest " << m_manifestFile << ", all plugins will be loaded");
+    return;
+  }
+
+  PString line;
+  if (!file.ReadLine(line) || line != ManifestHeader) {
+    PTRACE(2, "PLUGIN\tIgnoring manifest " << m_manifestFile << ", unknown format");
+    return;
+  }
+
+  /* Each plugin is a line of "size<tab>modified<tab>version<tab>path" followed
+     by a line of "<tab>type<tab>name<tab>friendly<tab>device" per service. */
+  ManifestEntry * entry = NULL;
+  while (file.ReadLine(line)) {
+    if (line[0] == '\t') {
+      PStringArray fields = line.Mid(1).Tokenise('\t', false);
+      if (entry != NULL && fields.GetSize() == 4) {
+        ManifestService service;
+        service.m_type = fields[0];
+        service.m_name = fields[1];
+        service.m_friendlyName = fields[2];
+        service.m_device = fields[3] == "1";
+        entry->m_services.push_back(service);
+      }
+      continue;
+    }
+
+    PStringArray fields = line.Tokenise('\t', false);
+    if (fields.GetSize() == 4) {
+      entry = &m_manifest[fields[3]];
+      entry->m_size = fields[0].AsUnsigned64();
+      entry->m_modified = fields[1].AsInteger64();
+      entry->m_version = fields[2].AsInteger();
+    }
+    else
+      entry = NULL;
+  }
+
+  PTRACE(3, "PLUGIN\tRead " << m_manifest.size() << " plugins from manifest " << m_manifestFile);
+}
+
+
+void PPluginManager::WriteManifest()
+{
+  // Called with m_manifestMutex locked
+  if (!m_manifestChanged || m_manifestFile.IsEmpty())
+    return;
+
+  // Drop plugins which have gone away
+  for (Manifest::iterator it = m_manifest.begin(); it != m_manifest.end(); ) {
+    if (PFile::Exists(it->first))
+      ++it;
+    else
+      m_manifest.erase(it++);
+  }
+
+  // Write to a temporary and rename, so a concurrent reader never sees a partial file
+  PFilePath tempName = m_manifestFile + ".tmp";
+  PTextFile file;
+  if (!file.Open(tempName, PFile::WriteOnly)) {
+    PTRACE(2, "PLUGIN\tCould not write manifest " << tempName << ": " << file.GetErrorText());
+    return;
+  }
+
+  file << ManifestHeader << '\n';
+  for (Manifest::const_iterator it = m_manifest.begin(); it != m_manifest.end(); ++it) {
+    const ManifestEntry & entry = it->second;
+    file << entry.m_size << '\t' << entry.m_modified << '\t' << entry.m_version << '\t' << it->first << '\n';
+    for (ManifestServices::const_iterator svc = entry.m_services.begin(); svc != entry.m_services.end(); ++svc)
+      file << '\t' << svc->m_type << '\t' << svc->m_name << '\t' << svc->m_friendlyName << '\t' << svc->m_device << '\n';
+  }
+
+  if (!file.Close() || !PFile::Move(tempName, m_manifestFile, true)) {
+    PTRACE(2, "PLUGIN\tCould not write manifest " << m_manifestFile);
+    PFile::Remove(tempName);
+    return;
+  }
+
+  m_manifestChanged = false;
+  PTRACE(3, "PLUGIN\tWritten " << m_manifest.size() << " plugins to manifest " << m_manifestFile);
+}
+
+
 void PPluginManager::OnShutdown()
 {
   PWaitAndSignal mutex(m_pluginsMutex);
@@ -429,7 +863,12 @@ void PPluginManager::OnShutdown()
   m_notifiers.RemoveAll();
   m_notifiersMutex.Signal();
 
+  m_servicesMutex.Wait();
   m_services.clear();
+  for (size_t i = 0; i < m_deferredPlugins.size(); ++i)
+    delete m_deferredPlugins[i];
+  m_deferredPlugins.clear();
+  m_servicesMutex.Signal();
 
   m_plugins.RemoveAll();
 }
@@ -522,6 +961,12 @@ void PluginLoaderStartup::OnStartup()
     pluginMgr.SetDirectories(env);
   }
 
+  if (pluginMgr.GetManifestFile().IsEmpty()) {
+    const char * env = ::getenv(P_PTLIB_PLUGIN_MANIFEST_ENV_VAR);
+    if (env != NULL && *env != '\0')
+      pluginMgr.SetManifestFile(env);
+  }
+
   // load the plugin module managers
   PFactory<PPluginModuleManager>::KeyList_T keyList = PFactory<PPluginModuleManager>::GetKeyList();
   for (PFactory<PPluginModuleManager>::KeyList_T::const_iterator it = keyList.begin(); it != keyList.end(); ++it)
@@ -39,8 +39,7 @@
 /////////////////////////////////////////////////////////////////////////////
 
 PSafeObject::PSafeObject()
-  : m_safeReferenceCount(0)
-  , m_safelyBeingRemoved(false)
+  : m_safeState(0)
   , m_safeMutexCreated(true)
   , m_safeInUseMutex(NULL)
 {
@@ -49,8 +48,7 @@ PSafeObject::PSafeObject()
 
 PSafeObject::PSafeObject(const PSafeObject & other)
   : PObject(other)
-  , m_safeReferenceCount(0)
-  , m_safelyBeingRemoved(false)
+  , m_safeState(0)
   , m_safeMutexCreated(true)
   , m_safeInUseMutex(NULL)
 {
@@ -58,20 +56,17 @@ PSafeObject::PSafeObject(const PSafeObject & other)
 
 
 PSafeObject::PSafeObject(PSafeObject * indirectLock)
-  : m_safeReferenceCount(0)
-  , m_safelyBeingRemoved(false)
+  : m_safeState(0)
   , m_safeMutexCreated(false)
+  , m_safeInUseMutex(NULL)
 {
   if (PAssert(indirectLock != NULL, PNullPointerReference))
-    m_safeInUseMutex = &indirectLock->InternalGetMutex();
-  else
-    m_safeInUseMutex = NULL;
+    m_safeInUseMutex.store(&indirectLock->InternalGetMutex());
 }
 
 
 PSafeObject::PSafeObject(PReadWriteMutex & mutex)
-  : m_safeReferenceCount(0)
-  , m_safelyBeingRemoved(false)
+  : m_safeState(0)
   , m_safeMutexCreated(false)
   , m_safeInUseMutex(&mutex)
 {
@@ -81,20 +76,23 @@ PSafeObject::PSafeObject(PReadWriteMutex & mutex)
 PSafeObject::~PSafeObject()
 {
   if (m_safeMutexCreated)
-    delete m_safeInUseMutex;
+    delete m_safeInUseMutex.load();
 }
 
 
 PBoolean PSafeObject::SafeReference()
 {
-#if PTRACING
   unsigned count = 0;
-  {
-    PWaitAndSignal mutex(m_safetyMutex);
-    if (!m_safelyBeingRemoved)
-      count = ++m_safeReferenceCount;
+  unsigned state = m_safeState.load();
+  while ((state&SafeRemovedFlag) == 0) {
+    if (m_safeState.compare_exchange_strong(state, state+1)) {
+      count = (state&SafeReferenceMask)+1;
+      break;
+    }
+    state = m_safeState.load();
   }
 
+#if PTRACING
   unsigned level = count == 0  || m_traceContextIdentifier == 1234567890 ? 3 : 7;
   if (PTrace::CanTrace(level)) {
     ostream & trace = PTRACE_BEGIN(level);
@@ -108,61 +106,57 @@ PBoolean PSafeObject::SafeReference()
     }
     trace << PTrace::End;
   }
-  return count > 0;
-#else
-  PWaitAndSignal mutex(m_safetyMutex);
-  if (m_safelyBeingRemoved)
-    return false;
-  ++m_safeReferenceCount;
-  return true;
 #endif
+  return count > 0;
 }
 
 
 PBoolean PSafeObject::SafeDereference()
 {
-  bool mayBeDeleted = false;
-
-  m_safetyMutex.Wait();
-  if (PAssert(m_safeReferenceCount > 0, PLogicError)) {
-    m_safeReferenceCount--;
-    mayBeDeleted = m_safeReferenceCount == 0 && !m_safelyBeingRemoved;
-  }
 #if PTRACING
-  unsigned count = m_safeReferenceCount;
   unsigned level = m_traceContextIdentifier == 1234567890 ? 3 : 7;
 #endif
-  m_safetyMutex.Signal();
 
-  PTRACE(level, GetClass() << ' ' << (void *)this << " decremented reference count to " << count);
+  unsigned state = m_safeState.load();
+  for (;;) {
+    if (!PAssert((state&SafeReferenceMask) > 0, PLogicError))
+      return false;
+    if (m_safeState.compare_exchange_strong(state, state-1))
+      break;
+    state = m_safeState.load();
+  }
+
+  PTRACE(level, GetClass() << ' ' << (void *)this << " decremented reference count to " << ((state-1)&SafeReferenceMask));
 
   // At this point the object could be deleted in another trhead, do not use it anymore!
-  return mayBeDeleted;
+  return state == 1; // Count now zero and not removed
 }
 
 
 PReadWriteMutex & PSafeObject::InternalGetMutex() const
 {
+  PReadWriteMutex * mutex = m_safeInUseMutex.load();
+  if (mutex != NULL)
+    return *mutex;
+
   PWaitAndSignal lock(m_safetyMutex);
-  if (m_safeInUseMutex == NULL)
-    const_cast<PSafeObject *>(this)->m_safeInUseMutex = new PReadWriteMutex(typeid(*this).name());
-  return *m_safeInUseMutex;
+  if ((mutex = m_safeInUseMutex.load()) == NULL) {
+    mutex = new PReadWriteMutex(typeid(*this).name());
+    m_safeInUseMutex.store(mutex);
+  }
+  return *mutex;
 }
 
 
 bool PSafeObject::InternalLockReadOnly(const PDebugLocation * location) const
 {
   PTRACE(m_traceContextIdentifier == 1234567890 ? 3 : 7, "Waiting read ("<<(void *)this<<")");
-  m_safetyMutex.Wait();
 
-  if (m_safelyBeingRemoved) {
-    m_safetyMutex.Signal();
+  if (IsSafelyBeingRemoved()) {
     PTRACE(6, "Being removed while waiting read ("<<(void *)this<<")");
     return false;
   }
 
-  m_safetyMutex.Signal();
-
   InternalGetMutex().StartRead(location);
   PTRACE(m_traceContextIdentifier == 1234567890 ? 3 : 7, "Locked read ("<<(void *)this<<")");
   return true;
@@ -179,16 +173,12 @@ void PSafeObject::InternalUnlockReadOnly(const PDebugLocation * location) const
 bool PSafeObject::InternalLockReadWrite(const PDebugLocation * location) const
 {
   PTRACE(m_traceContextIdentifier == 1234567890 ? 3 : 7, "Waiting readWrite ("<<(void *)this<<")");
-  m_safetyMutex.Wait();
 
-  if (m_safelyBeingRemoved) {
-    m_safetyMutex.Signal();
+  if (IsSafelyBeingRemoved()) {
     PTRACE(6, "Being removed while waiting readWrite ("<<(void *)this<<")");
     return false;
   }
 
-  m_safetyMutex.Signal();
-
   InternalGetMutex().StartWrite(location);
   PTRACE(m_traceContextIdentifier == 1234567890 ? 3 : 7, "Locked readWrite ("<<(void *)this<<")");
   return true;
@@ -204,16 +194,23 @@ void PSafeObject::InternalUnlockReadWrite(const PDebugLocation * location) const
 
 void PSafeObject::SafeRemove()
 {
-  m_safetyMutex.Wait();
-  m_safelyBeingRemoved = true;
-  m_safetyMutex.Signal();
+  unsigned state = m_safeState.load();
+  while (!m_safeState.compare_exchange_strong(state, state|SafeRemovedFlag))
+    state = m_safeState.load();
+}
+
+
+void PSafeObject::InternalClearSafelyBeingRemoved()
+{
+  unsigned state = m_safeState.load();
+  while (!m_safeState.compare_exchange_strong(state, state&~SafeRemovedFlag))
+    state = m_safeState.load();
 }
 
 
 PBoolean PSafeObject::SafelyCanBeDeleted() const
 {
-  PWaitAndSignal mutex(m_safetyMutex);
-  return m_safelyBeingRemoved && m_safeReferenceCount == 0;
+  return m_safeState.load() == SafeRemovedFlag;
 }
 
 
@@ -290,7 +287,7 @@ PSafeCollection::~PSafeCollection()
     else {
       // If anything still has a PSafePtr .. "detach" it from the collection so
       // will be deleted whan that PSafePtr finally goes out of scope.
-      i->m_safelyBeingRemoved = false;
+      i->InternalClearSafelyBeingRemoved();
     }
   }
 
@@ -303,7 +303,7 @@ class PIPCacheKey : public PObject
       { return new PIPCacheKey(*this); }
 
     PINDEX HashFunction() const
-      { return (addr[1] + addr[2] + addr[3])%41; }
+      { return (addr[0] << 24) | (addr[1] << 16) | (addr[2] << 8) | addr[3]; }
 
   private:
     PIPSocket::Address addr;
@@ -1389,13 +1389,28 @@ bool PIPSocket::InternalListen(const Address & bindAddr,
     return false;
   }
 
-  int reuseAddr = reuse == CanReuseAddress ? 1 : 0;
+  int reuseAddr = reuse != AddressIsExclusive ? 1 : 0;
   if (!SetOption(SO_REUSEADDR, reuseAddr)) {
     PTRACE(4, "SetOption(SO_REUSEADDR," << reuseAddr << ") failed: " << GetErrorText());
     os_close();
     return false;
   }
 
+  if (reuse == CanReusePort) {
+#ifdef SO_REUSEPORT
+    if (!SetOption(SO_REUSEPORT, 1)) {
+      PTRACE(4, "SetOption(SO_REUSEPORT) failed: " << GetErrorText());
+      os_close();
+      return false;
+    }
+#else
+    PTRACE(4, "SO_REUSEPORT not supported on this platform");
+    SetErrorValues(Unavailable, EINVAL);
+    os_close();
+    return false;
+#endif
+  }
+
 #if P_HAS_IPV6 && defined(IPV6_V6ONLY)
   if (bindAddr.GetVersion() == 6) {
     if (!SetOption(IPV6_V6ONLY, reuseAddr, IPPROTO_IPV6)) {
@@ -2436,6 +2451,153 @@ bool PIPDatagramSocket::InternalReadFrom(Slice * slices, size_t sliceCount, PIPS
 }
 
 
+#if defined(P_LINUX) && defined(MSG_WAITFORONE)
+  #define P_HAS_RECVMMSG 1
+#endif
+
+bool PIPDatagramSocket::ReadFromBatch(Datagram * datagrams, PINDEX maxCount, PINDEX & count)
+{
+  count = 0;
+  SetLastReadCount(0);
+
+  if (CheckNotOpen())
+    return false;
+
+  if (datagrams == NULL || maxCount <= 0)
+    return SetErrorValues(BadParameter, EINVAL, LastReadError);
+
+#if P_HAS_RECVMMSG
+  std::vector<mmsghdr> msgs(maxCount);
+  std::vector<iovec> iov(maxCount);
+  std::vector<sockaddr_storage> addrs(maxCount);
+  for (PINDEX i = 0; i < maxCount; ++i) {
+    iov[i].iov_base = datagrams[i].m_buffer;
+    iov[i].iov_len = datagrams[i].m_length;
+    memset(&msgs[i], 0, sizeof(mmsghdr));
+    msgs[i].msg_hdr.msg_name = &addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  do {
+    // MSG_WAITFORONE makes it non-blocking after the first datagram
+    PPROFILE_SYSTEM(
+      int result = ::recvmmsg(os_handle, &msgs[0], maxCount, MSG_WAITFORONE, NULL);
+    );
+    if (ConvertOSError(result, LastReadError)) {
+      PINDEX total = 0;
+      for (int i = 0; i < result; ++i) {
+        Datagram & datagram = datagrams[i];
+        datagram.m_ipAndPort = PIPSocketAddressAndPort((sockaddr *)&addrs[i], msgs[i].msg_hdr.msg_namelen);
+        datagram.m_lastCount = msgs[i].msg_len;
+        datagram.m_truncated = (msgs[i].msg_hdr.msg_flags&MSG_TRUNC) != 0;
+        total += datagram.m_lastCount;
+      }
+      count = result;
+      SetLastReadCount(total);
+      return count > 0;
+    }
+  } while (GetErrorNumber(LastReadError) == EWOULDBLOCK && PXSetIOBlock(PXReadBlock, readTimeout));
+
+  return false;
+#else
+  // Block, with timeout, for the first, then take only what is already waiting
+  PTimeInterval oldTimeout = GetReadTimeout();
+  PINDEX total = 0;
+  while (count < maxCount) {
+    Datagram & datagram = datagrams[count];
+    Slice slice(datagram.m_buffer, datagram.m_length);
+    if (!InternalReadFrom(&slice, 1, datagram.m_ipAndPort)) {
+      datagram.m_truncated = GetErrorCode(LastReadError) == BufferTooSmall;
+      if (!datagram.m_truncated)
+        break;
+    }
+    datagram.m_lastCount = GetLastReadCount();
+    total += datagram.m_lastCount;
+    ++count;
+    SetReadTimeout(0);
+  }
+  SetReadTimeout(oldTimeout);
+  SetLastReadCount(total);
+
+  if (count == 0)
+    return false;
+
+  SetErrorValues(NoError, 0, LastReadError);
+  return true;
+#endif
+}
+
+
+bool PIPDatagramSocket::WriteToBatch(Datagram * datagrams, PINDEX maxCount, PINDEX & count)
+{
+  count = 0;
+  SetLastWriteCount(0);
+
+  if (CheckNotOpen())
+    return false;
+
+  if (datagrams == NULL || maxCount <= 0)
+    return SetErrorValues(BadParameter, EINVAL, LastWriteError);
+
+  for (PINDEX i = 0; i < maxCount; ++i) {
+    if (!datagrams[i].m_ipAndPort.IsValid())
+      return SetErrorValues(BadParameter, EINVAL, LastWriteError);
+    datagrams[i].m_lastCount = 0;
+  }
+
+#if P_HAS_RECVMMSG
+  std::vector<mmsghdr> msgs(maxCount);
+  std::vector<iovec> iov(maxCount);
+  std::vector<sockaddr_storage> addrs(maxCount);
+  for (PINDEX i = 0; i < maxCount; ++i) {
+    sockaddr_wrapper sa(datagrams[i].m_ipAndPort);
+    memcpy(&addrs[i], (sockaddr *)sa, sa.GetSize());
+    iov[i].iov_base = datagrams[i].m_buffer;
+    iov[i].iov_len = datagrams[i].m_length;
+    memset(&msgs[i], 0, sizeof(mmsghdr));
+    msgs[i].msg_hdr.msg_name = &addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sa.GetSize();
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  PINDEX total = 0;
+  while (count < maxCount) {
+    PPROFILE_SYSTEM(
+      int result = ::sendmmsg(os_handle, &msgs[count], maxCount - count, 0);
+    );
+    if (ConvertOSError(result, LastWriteError)) {
+      for (int i = 0; i < result; ++i, ++count) {
+        datagrams[count].m_lastCount = msgs[count].msg_len;
+        total += msgs[count].msg_len;
+      }
+      continue;
+    }
+
+    if (GetErrorNumber(LastWriteError) != EWOULDBLOCK || !PXSetIOBlock(PXWriteBlock, writeTimeout))
+      break;
+  }
+  SetLastWriteCount(total);
+  return count == maxCount;
+#else
+  PINDEX total = 0;
+  while (count < maxCount) {
+    Datagram & datagram = datagrams[count];
+    Slice slice(datagram.m_buffer, datagram.m_length);
+    if (!InternalWriteTo(&slice, 1, datagram.m_ipAndPort))
+      break;
+    datagram.m_lastCount = GetLastWriteCount();
+    total += datagram.m_lastCount;
+    ++count;
+  }
+  SetLastWriteCount(total);
+  return count == maxCount;
+#endif
+}
+
+
 bool PIPDatagramSocket::WriteTo(const void * buf, PINDEX len, const Address & addr, WORD port)
 {
   PIPSocketAddressAndPort ap(addr, port);
@@ -2649,6 +2811,16 @@ bool PUDPSocket::InternalReadFrom(Slice * slices, size_t sliceCount, PIPSocketAd
 }
 
 
+bool PUDPSocket::ReadFromBatch(Datagram * datagrams, PINDEX maxCount, PINDEX & count)
+{
+  if (!PIPDatagramSocket::ReadFromBatch(datagrams, maxCount, count))
+    return false;
+
+  InternalSetLastReceiveAddress(datagrams[count-1].m_ipAndPort);
+  return true;
+}
+
+
 PBoolean PUDPSocket::Read(void * buf, PINDEX len)
 {
   PIPSocketAddressAndPort dummy;
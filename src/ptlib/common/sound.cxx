@@ -1129,48 +1129,417 @@ PBoolean PSoundChannelNull::Read(void * buf, PINDEX len)
 
 ///////////////////////////////////////////////////////////////////////////
 
-static void MergeSampleValues(const short * & srcSample,
-                              PINDEX & srcCount,
-                              unsigned srcChannels,
-                              short * & dstSample,
-                              PINDEX & dstCount,
-                              unsigned dstChannels)
-{
-  if (dstChannels == srcChannels) {
-    PINDEX bytes = dstChannels*sizeof(short);
-    memcpy(dstSample, srcSample, bytes);
-    srcSample += srcChannels;
-    srcCount += srcChannels*sizeof(short);
-    dstSample += dstChannels;
-    dstCount += bytes;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define P_RESAMPLER_SSE2 1
+  #include <emmintrin.h>
+#endif
+
+/* Coefficients are Q15 fixed point, the cut off is always below the input
+   Nyquist frequency so no tap reaches 1.0 and all fit in a short. The sum
+   of the magnitudes of a phase's taps is up to about 2.4 though, so a full
+   scale input whose signs follow the taps would overflow a 32 bit sum.
+   Each pair of products is halved before accumulating to prevent that. */
+#define P_RESAMPLER_SHIFT 15
+
+static unsigned const MaxFilterPhases = 1024;
+static unsigned const ChunkFrames = 256;
+
+
+struct PPCMResampler::FilterBank
+{
+  unsigned m_interpolation; // L, output samples per M input samples
+  unsigned m_decimation;    // M
+  unsigned m_phases;        // Phases in bank, equal to L unless too big
+  unsigned m_taps;          // Multiple of 8 for SIMD
+  unsigned m_stepWhole;     // M / L
+  unsigned m_stepFraction;  // M % L
+  std::vector<short> m_coefficients;
+
+  static double BesselI0(double x)
+  {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50 && term > sum*1e-12; ++k) {
+      double t = x/(2*k);
+      term *= t*t;
+      sum += term;
+    }
+    return sum;
   }
 
-  else if (srcChannels == 1) {
-    for (unsigned c = 0; c < dstChannels; ++c)
-      *dstSample++ = *srcSample;
-    srcSample++;
-    srcCount += sizeof(short);
-    dstCount += dstChannels*sizeof(short);
+  FilterBank(unsigned interpolation, unsigned decimation, Quality quality)
+    : m_interpolation(interpolation)
+    , m_decimation(decimation)
+    , m_phases(std::min(interpolation, MaxFilterPhases))
+    , m_stepWhole(decimation/interpolation)
+    , m_stepFraction(decimation%interpolation)
+  {
+    static const struct {
+      unsigned m_zeroCrossings;
+      double   m_rollOff;
+      double   m_beta;
+    } Params[] = {
+      {  8, 0.85,  6.0 },
+      { 16, 0.90,  8.0 },
+      { 32, 0.94, 10.0 }
+    };
+
+    // Cut off relative to input Nyquist, lower when decimating to prevent aliasing
+    double cutoff = Params[quality].m_rollOff;
+    if (decimation > interpolation)
+      cutoff = cutoff*interpolation/decimation;
+
+    m_taps = ((unsigned)ceil(2*Params[quality].m_zeroCrossings/cutoff) + 7) & ~7;
+    double halfTaps = m_taps/2;
+    double centre = halfTaps - 1;
+    double i0Beta = BesselI0(Params[quality].m_beta);
+
+    m_coefficients.resize(m_phases*m_taps);
+    std::vector<double> h(m_taps);
+    for (unsigned phase = 0; phase < m_phases; ++phase) {
+      double offset = (double)phase/m_phases;
+      double sum = 0;
+      for (unsigned k = 0; k < m_taps; ++k) {
+        double d = k - centre - offset;
+        double x = M_PI*cutoff*d;
+        double sinc = fabs(x) < 1e-9 ? 1 : sin(x)/x;
+        double r = d/halfTaps;
+        double window = fabs(r) < 1 ? BesselI0(Params[quality].m_beta*sqrt(1 - r*r))/i0Beta : 0;
+        sum += h[k] = sinc*window;
+      }
+
+      // Normalise to unity gain, then fix rounding error on largest tap so DC is exact
+      short * coeff = &m_coefficients[phase*m_taps];
+      int total = 0;
+      unsigned largest = 0;
+      for (unsigned k = 0; k < m_taps; ++k) {
+        coeff[k] = (short)floor(h[k]/sum*(1 << P_RESAMPLER_SHIFT) + 0.5);
+        total += coeff[k];
+        if (abs(coeff[k]) > abs(coeff[largest]))
+          largest = k;
+      }
+      coeff[largest] = (short)(coeff[largest] + (1 << P_RESAMPLER_SHIFT) - total);
+
+      PInt64 magnitude = 0;
+      for (unsigned k = 0; k < m_taps; ++k)
+        magnitude += abs(coeff[k]);
+      PAssert(magnitude*-SHRT_MIN/2 <= INT_MAX, "Resampler filter may overflow");
+    }
+
+    PTRACE(4, NULL, PTraceModule(), "Created resampler filter bank: "
+           "L=" << interpolation << " M=" << decimation << " phases=" << m_phases << " taps=" << m_taps);
   }
 
-  else if (dstChannels == 1) {
-    int sum = 0;
-    for (unsigned c = 0; c < srcChannels; ++c)
-      sum += *srcSample++;
-    srcCount += srcChannels*sizeof(short);
-    *dstSample++ = (short)(sum/dstChannels);
-    dstCount += sizeof(short);
+  const short * GetCoefficients(unsigned phase) const
+  {
+    if (m_phases < m_interpolation)
+      phase = (unsigned)((PUInt64)phase*m_phases/m_interpolation);
+    return &m_coefficients[phase*m_taps];
   }
 
-  else {
-    // Complicated ones, we cheat mightily and make it all mono
+  static const FilterBank * Get(unsigned interpolation, unsigned decimation, Quality quality)
+  {
+    static struct Cache : std::map<PUInt64, FilterBank *>
+    {
+      PDECLARE_MUTEX(m_mutex);
+      ~Cache()
+      {
+        for (iterator it = begin(); it != end(); ++it)
+          delete it->second;
+      }
+    } s_cache;
+
+    PUInt64 key = ((PUInt64)interpolation << 34) | ((PUInt64)decimation << 2) | quality;
+
+    PWaitAndSignal lock(s_cache.m_mutex);
+    Cache::iterator it = s_cache.find(key);
+    if (it == s_cache.end())
+      it = s_cache.insert(make_pair(key, new FilterBank(interpolation, decimation, quality))).first;
+    return it->second;
+  }
+};
+
+
+static __inline short FilterSample(const short * samples, const short * coeff, unsigned taps)
+{
+#if P_RESAMPLER_SSE2
+  __m128i acc = _mm_setzero_si128();
+  for (unsigned k = 0; k < taps; k += 8)
+    acc = _mm_add_epi32(acc, _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *)(samples + k)),
+                                                           _mm_loadu_si128((const __m128i *)(coeff + k))), 1));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+  int sum = _mm_cvtsi128_si32(acc);
+#else
+  int sum = 0;
+  for (unsigned k = 0; k < taps; k += 2)
+    sum += (samples[k]*coeff[k] + samples[k+1]*coeff[k+1]) >> 1;
+#endif
+
+  sum = (sum + (1 << (P_RESAMPLER_SHIFT-2))) >> (P_RESAMPLER_SHIFT-1);
+  return (short)(sum > SHRT_MAX ? SHRT_MAX : sum < SHRT_MIN ? SHRT_MIN : sum);
+}
+
+
+PPCMResampler::PPCMResampler(unsigned srcRate,
+                             unsigned srcChannels,
+                             unsigned dstRate,
+                             unsigned dstChannels,
+                             Quality quality)
+  : m_filter(NULL)
+{
+  Open(srcRate, srcChannels, dstRate, dstChannels, quality);
+}
+
+
+PPCMResampler::~PPCMResampler()
+{
+}
+
+
+bool PPCMResampler::Open(unsigned srcRate,
+                         unsigned srcChannels,
+                         unsigned dstRate,
+                         unsigned dstChannels,
+                         Quality quality)
+{
+  m_srcRate = srcRate;
+  m_srcChannels = srcChannels;
+  m_dstRate = dstRate;
+  m_dstChannels = dstChannels;
+  m_quality = quality;
+  m_filter = NULL;
+  m_history.clear();
+
+  if (srcRate == 0 || srcChannels == 0 || dstRate == 0 || dstChannels == 0) {
+    m_srcRate = m_dstRate = 0;
+    return false;
+  }
+
+  // Filter on the smaller number of channels, mixing everything else to mono
+  m_workChannels = srcChannels == dstChannels ? srcChannels : 1;
+
+  if (srcRate != dstRate) {
+    unsigned a = srcRate, b = dstRate;
+    while (b != 0) {
+      unsigned t = a % b;
+      a = b;
+      b = t;
+    }
+    m_filter = FilterBank::Get(dstRate/a, srcRate/a, quality);
+    m_history.resize(m_workChannels);
+    for (unsigned c = 0; c < m_workChannels; ++c)
+      m_history[c].resize(2*m_filter->m_taps + ChunkFrames);
+    m_mixBuffer.resize(m_workChannels*ChunkFrames);
+  }
+
+  Reset();
+  return true;
+}
+
+
+void PPCMResampler::Reset()
+{
+  m_phase = 0;
+  m_start = 0;
+  m_count = 0;
+  m_flushLimit = P_MAX_INDEX;
+
+  if (m_filter != NULL) {
+    // Prime with zeros, so first output sample lines up with first input sample
+    m_count = m_filter->m_taps/2 - 1;
+    for (unsigned c = 0; c < m_workChannels; ++c)
+      memset(&m_history[c][0], 0, m_count*sizeof(short));
+  }
+}
+
+
+unsigned PPCMResampler::GetFilterTaps() const
+{
+  return m_filter != NULL ? m_filter->m_taps : 0;
+}
+
+
+void PPCMResampler::ProduceSamples(short * dstPtr, PINDEX & dstFrames, PINDEX dstMax, PINDEX limit)
+{
+  const unsigned taps = m_filter->m_taps;
+  const bool direct = m_workChannels == m_dstChannels;
+
+  while (dstFrames < dstMax && m_start + (PINDEX)taps <= m_count && m_start < limit) {
+    short * out = direct ? dstPtr + dstFrames*m_dstChannels : &m_mixBuffer[0];
+    PINDEX frames = 0;
+    PINDEX maxFrames = direct ? dstMax - dstFrames : std::min(dstMax - dstFrames, (PINDEX)ChunkFrames);
+
+    do {
+      const short * coeff = m_filter->GetCoefficients(m_phase);
+      for (unsigned c = 0; c < m_workChannels; ++c)
+        *out++ = FilterSample(&m_history[c][m_start], coeff, taps);
+      ++frames;
+
+      m_start += m_filter->m_stepWhole;
+      m_phase += m_filter->m_stepFraction;
+      if (m_phase >= m_filter->m_interpolation) {
+        m_phase -= m_filter->m_interpolation;
+        ++m_start;
+      }
+    } while (frames < maxFrames && m_start + (PINDEX)taps <= m_count && m_start < limit);
+
+    if (!direct)
+      MixChannels(&m_mixBuffer[0], m_workChannels, dstPtr + dstFrames*m_dstChannels, m_dstChannels, frames);
+    dstFrames += frames;
+  }
+}
+
+
+bool PPCMResampler::Convert(const short * srcPtr, PINDEX & srcSize, short * dstPtr, PINDEX & dstSize)
+{
+  if (m_srcRate == 0) {
+    srcSize = dstSize = 0;
+    return false;
+  }
+
+  PINDEX srcFrames = srcSize/(m_srcChannels*sizeof(short));
+  PINDEX dstMax = dstSize/(m_dstChannels*sizeof(short));
+
+  if (m_filter == NULL) {
+    PINDEX frames = std::min(srcFrames, dstMax);
+    MixChannels(srcPtr, m_srcChannels, dstPtr, m_dstChannels, frames);
+    srcSize = frames*m_srcChannels*sizeof(short);
+    dstSize = frames*m_dstChannels*sizeof(short);
+    return frames == srcFrames;
+  }
+
+  // Abandon incomplete Flush(), this is a new stream
+  if (m_flushLimit != P_MAX_INDEX)
+    Reset();
+
+  PINDEX srcUsed = 0;
+  PINDEX dstFrames = 0;
+  for (;;) {
+    ProduceSamples(dstPtr, dstFrames, dstMax, P_MAX_INDEX);
+    if (dstFrames >= dstMax || srcUsed >= srcFrames)
+      break;
+
+    // Discard history no longer needed by the filter
+    PINDEX discard = std::min(m_start, m_count);
+    if (discard > 0) {
+      for (unsigned c = 0; c < m_workChannels; ++c)
+        memmove(&m_history[c][0], &m_history[c][discard], (m_count - discard)*sizeof(short));
+      m_start -= discard;
+      m_count -= discard;
+    }
+
+    PINDEX frames = std::min(srcFrames - srcUsed, std::min((PINDEX)ChunkFrames, (PINDEX)m_history[0].size() - m_count));
+    const short * src = srcPtr + srcUsed*m_srcChannels;
+    if (m_workChannels == 1)
+      MixChannels(src, m_srcChannels, &m_history[0][m_count], 1, frames);
+    else {
+      for (unsigned c = 0; c < m_workChannels; ++c) {
+        short * dst = &m_history[c][m_count];
+        const short * ptr = src + c;
+        for (PINDEX i = 0; i < frames; ++i, ptr += m_srcChannels)
+          dst[i] = *ptr;
+      }
+    }
+    m_count += frames;
+    srcUsed += frames;
+  }
+
+  srcSize = srcUsed*m_srcChannels*sizeof(short);
+  dstSize = dstFrames*m_dstChannels*sizeof(short);
+  return srcUsed == srcFrames;
+}
+
+
+bool PPCMResampler::Flush(short * dstPtr, PINDEX & dstSize)
+{
+  if (m_filter == NULL) {
+    dstSize = 0;
+    return m_srcRate != 0;
+  }
+
+  /* Pad with zeros for the filter look ahead, but only produce output for
+     input positions that were actually supplied. */
+  if (m_flushLimit == P_MAX_INDEX) {
+    PINDEX centre = m_filter->m_taps/2 - 1;
+    PINDEX discard = std::min(m_start, m_count);
+    m_flushLimit = m_count > centre + discard ? m_count - centre - discard : 0;
+    for (unsigned c = 0; c < m_workChannels; ++c) {
+      std::vector<short> & history = m_history[c];
+      memmove(&history[0], &history[discard], (m_count - discard)*sizeof(short));
+      memset(&history[m_count - discard], 0, (m_filter->m_taps/2)*sizeof(short));
+    }
+    m_start -= discard;
+    m_count += m_filter->m_taps/2 - discard;
+  }
+
+  PINDEX dstFrames = 0;
+  ProduceSamples(dstPtr, dstFrames, dstSize/(m_dstChannels*sizeof(short)), m_flushLimit);
+  dstSize = dstFrames*m_dstChannels*sizeof(short);
+
+  if (m_start < m_flushLimit)
+    return false;
+
+  Reset();
+  return true;
+}
+
+
+void PPCMResampler::MixChannels(const short * srcPtr, unsigned srcChannels, short * dstPtr, unsigned dstChannels, PINDEX frames)
+{
+  if (srcChannels == dstChannels) {
+    if (srcPtr != dstPtr)
+      memmove(dstPtr, srcPtr, frames*srcChannels*sizeof(short));
+    return;
+  }
+
+  PINDEX i = 0;
+
+  if (srcChannels == 1) {
+#if P_RESAMPLER_SSE2
+    if (dstChannels == 2) {
+      for (; i + 8 <= frames; i += 8) {
+        __m128i mono = _mm_loadu_si128((const __m128i *)(srcPtr + i));
+        _mm_storeu_si128((__m128i *)(dstPtr + i*2),     _mm_unpacklo_epi16(mono, mono));
+        _mm_storeu_si128((__m128i *)(dstPtr + i*2 + 8), _mm_unpackhi_epi16(mono, mono));
+      }
+    }
+#endif
+    for (; i < frames; ++i) {
+      short sample = srcPtr[i];
+      for (unsigned c = 0; c < dstChannels; ++c)
+        dstPtr[i*dstChannels + c] = sample;
+    }
+    return;
+  }
+
+  if (dstChannels == 1) {
+#if P_RESAMPLER_SSE2
+    if (srcChannels == 2) {
+      const __m128i ones = _mm_set1_epi16(1);
+      for (; i + 8 <= frames; i += 8) {
+        __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *)(srcPtr + i*2)),     ones), 1);
+        __m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i *)(srcPtr + i*2 + 8)), ones), 1);
+        _mm_storeu_si128((__m128i *)(dstPtr + i), _mm_packs_epi32(lo, hi));
+      }
+    }
+#endif
+    for (; i < frames; ++i) {
+      int sum = 0;
+      for (unsigned c = 0; c < srcChannels; ++c)
+        sum += srcPtr[i*srcChannels + c];
+      dstPtr[i] = (short)(srcChannels == 2 ? (sum >> 1) : (sum/(int)srcChannels));
+    }
+    return;
+  }
+
+  // Complicated ones, we cheat and make it all mono
+  for (; i < frames; ++i) {
     int sum = 0;
-    for (unsigned c = 0; c < dstChannels; ++c)
-      sum += *srcSample++;
     for (unsigned c = 0; c < srcChannels; ++c)
-      *dstSample++ = (short)(sum/dstChannels);
-    srcCount += srcChannels*sizeof(short);
-    dstCount += srcChannels*sizeof(short);
+      sum += srcPtr[i*srcChannels + c];
+    short sample = (short)(sum/(int)srcChannels);
+    for (unsigned c = 0; c < dstChannels; ++c)
+      dstPtr[i*dstChannels + c] = sample;
   }
 }
 
@@ -1191,65 +1560,23 @@ bool PSound::ConvertPCM(const short * srcPtr,
     return srcSize <= dstSize;
   }
 
-  PINDEX srcCount = 0;
-  PINDEX dstCount = 0;
-
-  /* Reduce size by one "sample", makes sure we don't overflow on last copy
-     in case the input/output buffers are not exact multiples of the sample */
-  srcSize -= srcChannels*sizeof(short);
-  dstSize -= dstChannels*sizeof(short);
-
-  // Variable Duty Cycle algorithm
-  if (srcRate < dstRate) {
-    // Have less samples than we want, so we need to interpolate
-    unsigned iDutyCycle = dstRate - srcRate;
-    while (srcCount <= srcSize && dstCount <= dstSize) {
-      iDutyCycle += srcRate;
-      if (iDutyCycle >= dstRate) {
-        iDutyCycle -= dstRate;
-        MergeSampleValues(srcPtr, srcCount, srcChannels, dstPtr, dstCount, dstChannels);
-      }
-      else {
-        const short * tempPtr = srcPtr;
-        PINDEX tempCount = srcCount;
-        MergeSampleValues(tempPtr, tempCount, srcChannels, dstPtr, dstCount, dstChannels);
-      }
-    }
-  }
-  else if (srcRate > dstRate) {
-    // File has more samples than we want, so we need to throw some away
-    size_t sumsSize = srcChannels*sizeof(int);
-    int * sums = (int *)alloca(sumsSize);
-
-    unsigned iDutyCycle = 0;
-    while (srcCount <= srcSize && dstCount <= dstSize) {
-      memset(sums, 0, sumsSize);
-      unsigned count = 0;
-      do {
-        for (unsigned c = 0; c < srcChannels; ++c)
-          sums[c] += *srcPtr++;
-        ++count;
-        iDutyCycle += dstRate;
-      } while (iDutyCycle < srcRate);
-      iDutyCycle -= srcRate;
-
-      const short * avg = (const short *)alloca(srcChannels*sizeof(short));
-      for (unsigned c = 0; c < srcChannels; ++c)
-        const_cast<short *>(avg)[c] = (short)(sums[c]/count);
-      PINDEX tempCount = 0;
-      MergeSampleValues(avg, tempCount, srcChannels, dstPtr, dstCount, dstChannels);
-      srcCount += count*tempCount;
-    }
-  }
-  else {
-    while (srcCount <= srcSize && dstCount <= dstSize)
-      MergeSampleValues(srcPtr, srcCount, srcChannels, dstPtr, dstCount, dstChannels);
-  }
+  PPCMResampler resampler(srcRate, srcChannels, dstRate, dstChannels);
 
-  srcSize = srcCount;
-  dstSize = dstCount;
-  return srcCount > srcSize && dstCount <= dstSize;
-}
+  /* Only use as much of the source as will fit in the destination, so the
+     whole of it can be flushed through the filter in one go. */
+  PINDEX srcFrames = srcSize/(srcChannels*sizeof(short));
+  PINDEX dstFrames = dstSize/(dstChannels*sizeof(short));
+  PINDEX maxFrames = (PINDEX)((PUInt64)dstFrames*srcRate/dstRate);
+  bool all = srcFrames <= maxFrames;
+  if (!all)
+    srcSize = maxFrames*srcChannels*sizeof(short);
 
+  PINDEX converted = dstSize;
+  resampler.Convert(srcPtr, srcSize, dstPtr, converted);
+  PINDEX flushed = dstSize - converted;
+  resampler.Flush(dstPtr + converted/sizeof(short), flushed);
+  dstSize = converted + flushed;
+  return all;
+}
     
 ///////////////////////////////////////////////////////////////////////////
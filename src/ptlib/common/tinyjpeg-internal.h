@@ -40,6 +40,10 @@
 
 #define SANITY_CHECK 1
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TINYJPEG_SSE2 1
+#endif
+
 struct jdec_private;
 
 #define HUFFMAN_HASH_NBITS 9
@@ -73,6 +77,7 @@ struct component
 #else
   uint16_t *Q_table;   /* Pointer to the quantisation table to use */
 #endif
+  int16_t *IQ_table;		/* Quantisation table for the integer IDCT */
   struct huffman_table *AC_table;
   struct huffman_table *DC_table;
   short int previous_DC;	/* Previous DC coefficient */
@@ -84,6 +89,7 @@ struct component
 
 
 typedef void (*decode_MCU_fct) (struct jdec_private *priv);
+typedef void (*idct_fct) (struct component *compptr, uint8_t *output_buf, int stride);
 typedef void (*convert_colorspace_fct) (struct jdec_private *priv);
 
 struct jdec_private
@@ -106,6 +112,7 @@ struct jdec_private
 #else
   uint16_t Q_tables[COMPONENTS][64];   /* quantization tables */
 #endif
+  int16_t IQ_tables[COMPONENTS][64];		/* quantization tables for integer IDCT */
   struct huffman_table HTDC[HUFFMAN_TABLES];	/* DC huffman tables   */
   struct huffman_table HTAC[HUFFMAN_TABLES];	/* AC huffman tables   */
   int default_huffman_table_initialized;
@@ -113,17 +120,34 @@ struct jdec_private
   int restarts_to_go;				/* MCUs left in this restart interval */
   int last_rst_marker_seen;			/* Rst marker is incremented each time */
 
+  /* Start of the data for each restart interval, for parallel decoding */
+  const unsigned char **segments;
+  unsigned int segment_count, segments_allocated;
+
+  idct_fct idct;				/* IDCT selected by flags */
+
   /* Temp space used after the IDCT to store each components */
   uint8_t Y[64*4], Cr[64], Cb[64];
 
   jmp_buf jump_state;
   /* Internal Pointer use for colorspace conversion, do not modify it !!! */
   uint8_t *plane[COMPONENTS];
+  unsigned int plane_width;			/* Width in pixels of the lines plane[] points into */
+
+  /* An MCU that extends past the right edge of the image is decoded here */
+  uint8_t partial_mcu[COMPONENTS][16*16*3];
+
+  /* Last error found while decoding */
+  char error_string[256];
 
 };
 
-#define IDCT tinyjpeg_idct_float
+#define IDCT priv->idct
 void tinyjpeg_idct_float (struct component *compptr, uint8_t *output_buf, int stride);
+void tinyjpeg_idct_int (struct component *compptr, uint8_t *output_buf, int stride);
+#if TINYJPEG_SSE2
+void tinyjpeg_idct_int_sse2 (struct component *compptr, uint8_t *output_buf, int stride);
+#endif
 
 #endif
 
@@ -91,8 +91,8 @@ enum std_markers {
 #endif
 
 #define error(fmt, ...) do { \
-   snprintf(error_string, sizeof(error_string), fmt, ## __VA_ARGS__); \
-   trace("%s", error_string); \
+   snprintf(priv->error_string, sizeof(priv->error_string), fmt, ## __VA_ARGS__); \
+   trace("%s", priv->error_string); \
    return -1; \
 } while(0)
 
@@ -129,9 +129,6 @@ static void print_next_16bytes(int offset, const unsigned char *stream)
 
 #endif
 
-/* Global variable to return the last error found while deconding */
-static char error_string[256];
-
 static const unsigned char zigzag[64] = 
 {
    0,  1,  5,  6, 14, 15, 27, 28,
@@ -558,7 +555,7 @@ static void YCrCB_to_YUV420P_1x1(struct jdec_private *priv)
   for (i=0; i<8; i++)
    {
      memcpy(p, y, 8);
-     p+=priv->width;
+     p+=priv->plane_width;
      y+=8;
    }
 
@@ -569,7 +566,7 @@ static void YCrCB_to_YUV420P_1x1(struct jdec_private *priv)
      for (j=0; j<8; j+=2, s+=2)
        *p++ = *s;
      s += 8; /* Skip one line */
-     p += priv->width/2 - 4;
+     p += priv->plane_width/2 - 4;
    }
 
   p = priv->plane[2];
@@ -579,7 +576,7 @@ static void YCrCB_to_YUV420P_1x1(struct jdec_private *priv)
      for (j=0; j<8; j+=2, s+=2)
        *p++ = *s;
      s += 8; /* Skip one line */
-     p += priv->width/2 - 4;
+     p += priv->plane_width/2 - 4;
    }
 }
 
@@ -600,7 +597,7 @@ static void YCrCB_to_YUV420P_2x1(struct jdec_private *priv)
   for (i=0; i<8; i++)
    {
      memcpy(p, y1, 16);
-     p += priv->width;
+     p += priv->plane_width;
      y1 += 16;
    }
 
@@ -610,7 +607,7 @@ static void YCrCB_to_YUV420P_2x1(struct jdec_private *priv)
    {
      memcpy(p, s, 8);
      s += 16; /* Skip one line */
-     p += priv->width/2;
+     p += priv->plane_width/2;
    }
 
   p = priv->plane[2];
@@ -619,7 +616,7 @@ static void YCrCB_to_YUV420P_2x1(struct jdec_private *priv)
    {
      memcpy(p, s, 8);
      s += 16; /* Skip one line */
-     p += priv->width/2;
+     p += priv->plane_width/2;
    }
 }
 
@@ -643,7 +640,7 @@ static void YCrCB_to_YUV420P_1x2(struct jdec_private *priv)
   for (i=0; i<16; i++)
    {
      memcpy(p, y, 8);
-     p+=priv->width;
+     p+=priv->plane_width;
      y+=8;
    }
 
@@ -653,7 +650,7 @@ static void YCrCB_to_YUV420P_1x2(struct jdec_private *priv)
    {
      for (j=0; j<8; j+=2, s+=2)
        *p++ = *s;
-     p += priv->width/2 - 4;
+     p += priv->plane_width/2 - 4;
    }
 
   p = priv->plane[2];
@@ -662,7 +659,7 @@ static void YCrCB_to_YUV420P_1x2(struct jdec_private *priv)
    {
      for (j=0; j<8; j+=2, s+=2)
        *p++ = *s;
-     p += priv->width/2 - 4;
+     p += priv->plane_width/2 - 4;
    }
 }
 
@@ -685,7 +682,7 @@ static void YCrCB_to_YUV420P_2x2(struct jdec_private *priv)
   for (i=0; i<16; i++)
    {
      memcpy(p, y1, 16);
-     p += priv->width;
+     p += priv->plane_width;
      y1 += 16;
    }
 
@@ -695,7 +692,7 @@ static void YCrCB_to_YUV420P_2x2(struct jdec_private *priv)
    {
      memcpy(p, s, 8);
      s += 8;
-     p += priv->width/2;
+     p += priv->plane_width/2;
    }
 
   p = priv->plane[2];
@@ -704,7 +701,7 @@ static void YCrCB_to_YUV420P_2x2(struct jdec_private *priv)
    {
      memcpy(p, s, 8);
      s += 8;
-     p += priv->width/2;
+     p += priv->plane_width/2;
    }
 }
 
@@ -729,7 +726,7 @@ static void YCrCB_to_RGB24_1x1(struct jdec_private *priv)
   Y = priv->Y;
   Cb = priv->Cb;
   Cr = priv->Cr;
-  offset_to_next_row = priv->width*3 - 8*3;
+  offset_to_next_row = priv->plane_width*3 - 8*3;
   for (i=0; i<8; i++) {
 
     for (j=0; j<8; j++) {
@@ -784,7 +781,7 @@ static void YCrCB_to_BGR24_1x1(struct jdec_private *priv)
   Y = priv->Y;
   Cb = priv->Cb;
   Cr = priv->Cr;
-  offset_to_next_row = priv->width*3 - 8*3;
+  offset_to_next_row = priv->plane_width*3 - 8*3;
   for (i=0; i<8; i++) {
 
     for (j=0; j<8; j++) {
@@ -840,7 +837,7 @@ static void YCrCB_to_RGB24_2x1(struct jdec_private *priv)
   Y = priv->Y;
   Cb = priv->Cb;
   Cr = priv->Cr;
-  offset_to_next_row = priv->width*3 - 16*3;
+  offset_to_next_row = priv->plane_width*3 - 16*3;
   for (i=0; i<8; i++) {
 
     for (j=0; j<8; j++) {
@@ -903,7 +900,7 @@ static void YCrCB_to_BGR24_2x1(struct jdec_private *priv)
   Y = priv->Y;
   Cb = priv->Cb;
   Cr = priv->Cr;
-  offset_to_next_row = priv->width*3 - 16*3;
+  offset_to_next_row = priv->plane_width*3 - 16*3;
   for (i=0; i<8; i++) {
 
     for (j=0; j<8; j++) {
@@ -965,11 +962,11 @@ static void YCrCB_to_RGB24_1x2(struct jdec_private *priv)
 #define FIX(x)          ((int)((x) * (1UL<<SCALEBITS) + 0.5))
 
   p = priv->plane[0];
-  p2 = priv->plane[0] + priv->width*3;
+  p2 = priv->plane[0] + priv->plane_width*3;
   Y = priv->Y;
   Cb = priv->Cb;
   Cr = priv->Cr;
-  offset_to_next_row = 2*priv->width*3 - 8*3;
+  offset_to_next_row = 2*priv->plane_width*3 - 8*3;
   for (i=0; i<8; i++) {
 
     for (j=0; j<8; j++) {
@@ -1032,11 +1029,11 @@ static void YCrCB_to_BGR24_1x2(struct jdec_private *priv)
 #define FIX(x)          ((int)((x) * (1UL<<SCALEBITS) + 0.5))
 
   p = priv->plane[0];
-  p2 = priv->plane[0] + priv->width*3;
+  p2 = priv->plane[0] + priv->plane_width*3;
   Y = priv->Y;
   Cb = priv->Cb;
   Cr = priv->Cr;
-  offset_to_next_row = 2*priv->width*3 - 8*3;
+  offset_to_next_row = 2*priv->plane_width*3 - 8*3;
   for (i=0; i<8; i++) {
 
     for (j=0; j<8; j++) {
@@ -1100,11 +1097,11 @@ static void YCrCB_to_RGB24_2x2(struct jdec_private *priv)
 #define FIX(x)          ((int)((x) * (1UL<<SCALEBITS) + 0.5))
 
   p = priv->plane[0];
-  p2 = priv->plane[0] + priv->width*3;
+  p2 = priv->plane[0] + priv->plane_width*3;
   Y = priv->Y;
   Cb = priv->Cb;
   Cr = priv->Cr;
-  offset_to_next_row = (priv->width*3*2) - 16*3;
+  offset_to_next_row = (priv->plane_width*3*2) - 16*3;
   for (i=0; i<8; i++) {
 
     for (j=0; j<8; j++) {
@@ -1183,11 +1180,11 @@ static void YCrCB_to_BGR24_2x2(struct jdec_private *priv)
 #define FIX(x)          ((int)((x) * (1UL<<SCALEBITS) + 0.5))
 
   p = priv->plane[0];
-  p2 = priv->plane[0] + priv->width*3;
+  p2 = priv->plane[0] + priv->plane_width*3;
   Y = priv->Y;
   Cb = priv->Cb;
   Cr = priv->Cr;
-  offset_to_next_row = (priv->width*3*2) - 16*3;
+  offset_to_next_row = (priv->plane_width*3*2) - 16*3;
   for (i=0; i<8; i++) {
 
     for (j=0; j<8; j++) {
@@ -1262,7 +1259,7 @@ static void YCrCB_to_Grey_1x1(struct jdec_private *priv)
 
   p = priv->plane[0];
   y = priv->Y;
-  offset_to_next_row = priv->width;
+  offset_to_next_row = priv->plane_width;
 
   for (i=0; i<8; i++) {
      memcpy(p, y, 8);
@@ -1289,7 +1286,7 @@ static void YCrCB_to_Grey_2x1(struct jdec_private *priv)
   for (i=0; i<8; i++) {
      memcpy(p, y, 16);
      y += 16;
-     p += priv->width;
+     p += priv->plane_width;
   }
 }
 
@@ -1314,7 +1311,7 @@ static void YCrCB_to_Grey_1x2(struct jdec_private *priv)
   for (i=0; i<16; i++) {
      memcpy(p, y, 8);
      y += 8;
-     p += priv->width;
+     p += priv->plane_width;
   }
 }
 
@@ -1338,7 +1335,7 @@ static void YCrCB_to_Grey_2x2(struct jdec_private *priv)
   for (i=0; i<16; i++) {
      memcpy(p, y, 16);
      y += 16;
-     p += priv->width;
+     p += priv->plane_width;
   }
 }
 
@@ -1597,6 +1594,16 @@ static void build_quantization_table(uint16_t *qtable, const unsigned char *ref_
 
 }
 
+static void build_integer_quantization_table(int16_t *qtable, const unsigned char *ref_table)
+{
+  /* The integer IDCT does the scaling itself, so use the coefficients as is */
+  int i;
+  const unsigned char *zz = zigzag;
+
+  for (i=0; i<64; i++)
+    *qtable++ = ref_table[*zz++];
+}
+
 static int parse_DQT(struct jdec_private *priv, const unsigned char *stream)
 {
   int qi;
@@ -1622,6 +1629,7 @@ static int parse_DQT(struct jdec_private *priv, const unsigned char *stream)
 #endif
      table = priv->Q_tables[qi];
      build_quantization_table(table, stream);
+     build_integer_quantization_table(priv->IQ_tables[qi], stream);
      stream += 64;
    }
   trace("< DQT marker\n");
@@ -1664,6 +1672,7 @@ static int parse_SOF(struct jdec_private *priv, const unsigned char *stream)
      c->Vfactor = sampling_factor&0xf;
      c->Hfactor = sampling_factor>>4;
      c->Q_table = priv->Q_tables[Q_table];
+     c->IQ_table = priv->IQ_tables[Q_table];
      trace("Component:%d  factor:%dx%d  Quantization table:%d\n",
 	 cid, c->Hfactor, c->Hfactor, Q_table );
 
@@ -1951,6 +1960,7 @@ void tinyjpeg_free(struct jdec_private *priv)
        free(priv->components[i]);
      priv->components[i] = NULL;
   }
+  free((void *)priv->segments);
   free(priv);
 }
 
@@ -1971,6 +1981,8 @@ int tinyjpeg_parse_header(struct jdec_private *priv, const unsigned char *buf, u
   priv->stream_begin = buf+2;
   priv->stream_length = size-2;
   priv->stream_end = priv->stream_begin + priv->stream_length;
+  priv->restart_interval = 0;
+  priv->segment_count = 0;
 
   ret = parse_JFIF(priv, priv->stream_begin);
 
@@ -2019,147 +2031,367 @@ static const convert_colorspace_fct convert_colorspace_grey[4] = {
    YCrCB_to_Grey_2x2,
 };
 
-/**
- * Decode and convert the jpeg image into @pixfmt@ image
- *
- * Note: components will be automaticaly allocated if no memory is attached.
+/*
+ * Layout of the decoded image in the output components, for a pixel format
+ * and the sampling factors of the jpeg.
  */
-int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
+struct decode_layout
 {
-  unsigned int x, y, xstride_by_mcu, ystride_by_mcu;
-  unsigned int bytes_per_blocklines[3], bytes_per_mcu[3];
   decode_MCU_fct decode_MCU;
-  const decode_MCU_fct *decode_mcu_table;
-  const convert_colorspace_fct *colorspace_array_conv;
   convert_colorspace_fct convert_to_pixfmt;
+  unsigned int ncomponents;
+  unsigned int xstride_by_mcu, ystride_by_mcu;
+  unsigned int mcus_per_row, mcu_rows;
+  unsigned int bytes_per_line[3], lines_per_mcu[3], bytes_per_mcu[3];
+};
 
-  if (setjmp(priv->jump_state))
-    return -1;
+static void get_mcu_size(struct jdec_private *priv, unsigned int *xstride_by_mcu, unsigned int *ystride_by_mcu, int *sampling)
+{
+  *xstride_by_mcu = *ystride_by_mcu = 8;
+  if ((priv->component_infos[cY].Hfactor | priv->component_infos[cY].Vfactor) == 1) {
+     *sampling = 0;
+     trace("Use decode 1x1 sampling\n");
+  } else if (priv->component_infos[cY].Hfactor == 1) {
+     *sampling = 1;
+     *ystride_by_mcu = 16;
+     trace("Use decode 1x2 sampling (not supported)\n");
+  } else if (priv->component_infos[cY].Vfactor == 2) {
+     *sampling = 3;
+     *xstride_by_mcu = 16;
+     *ystride_by_mcu = 16;
+     trace("Use decode 2x2 sampling\n");
+  } else {
+     *sampling = 2;
+     *xstride_by_mcu = 16;
+     trace("Use decode 2x1 sampling\n");
+  }
+}
+
+static void select_idct(struct jdec_private *priv)
+{
+#ifndef P_MEDIALIB
+  if (priv->flags & TINYJPEG_FLAGS_FLOAT_IDCT)
+    priv->idct = tinyjpeg_idct_float;
+#if TINYJPEG_SSE2
+  else if ((priv->flags & TINYJPEG_FLAGS_NO_SIMD) == 0)
+    priv->idct = tinyjpeg_idct_int_sse2;
+#endif
+  else
+    priv->idct = tinyjpeg_idct_int;
+#else
+  priv->idct = tinyjpeg_idct_float;
+#endif
+}
 
-  /* To keep gcc happy initialize some array */
-  bytes_per_mcu[1] = 0;
-  bytes_per_mcu[2] = 0;
-  bytes_per_blocklines[1] = 0;
-  bytes_per_blocklines[2] = 0;
+static int setup_decode(struct jdec_private *priv, int pixfmt, int allocate, struct decode_layout *layout)
+{
+  const decode_MCU_fct *decode_mcu_table;
+  const convert_colorspace_fct *colorspace_array_conv;
+  unsigned int c, chroma_shift = 0;
+  int sampling;
+
+  memset(layout, 0, sizeof(*layout));
 
   decode_mcu_table = decode_mcu_3comp_table;
   switch (pixfmt) {
      case TINYJPEG_FMT_YUV420P:
        colorspace_array_conv = convert_colorspace_yuv420p;
-       if (priv->components[0] == NULL)
-	 priv->components[0] = (uint8_t *)malloc(priv->width * priv->height);
-       if (priv->components[1] == NULL)
-	 priv->components[1] = (uint8_t *)malloc(priv->width * priv->height/4);
-       if (priv->components[2] == NULL)
-	 priv->components[2] = (uint8_t *)malloc(priv->width * priv->height/4);
-       bytes_per_blocklines[0] = priv->width;
-       bytes_per_blocklines[1] = priv->width/4;
-       bytes_per_blocklines[2] = priv->width/4;
-       bytes_per_mcu[0] = 8;
-       bytes_per_mcu[1] = 4;
-       bytes_per_mcu[2] = 4;
+       if (allocate) {
+	 if (priv->components[0] == NULL)
+	   priv->components[0] = (uint8_t *)malloc(priv->width * priv->height);
+	 if (priv->components[1] == NULL)
+	   priv->components[1] = (uint8_t *)malloc(priv->width * priv->height/4);
+	 if (priv->components[2] == NULL)
+	   priv->components[2] = (uint8_t *)malloc(priv->width * priv->height/4);
+       }
+       layout->ncomponents = 3;
+       layout->bytes_per_line[0] = priv->width;
+       layout->bytes_per_line[1] = priv->width/2;
+       layout->bytes_per_line[2] = priv->width/2;
+       layout->bytes_per_mcu[0] = 8;
+       layout->bytes_per_mcu[1] = 4;
+       layout->bytes_per_mcu[2] = 4;
+       chroma_shift = 1;
        break;
 
      case TINYJPEG_FMT_RGB24:
        colorspace_array_conv = convert_colorspace_rgb24;
-       if (priv->components[0] == NULL)
+       if (allocate && priv->components[0] == NULL)
 	 priv->components[0] = (uint8_t *)malloc(priv->width * priv->height * 3);
-       bytes_per_blocklines[0] = priv->width * 3;
-       bytes_per_mcu[0] = 3*8;
+       layout->ncomponents = 1;
+       layout->bytes_per_line[0] = priv->width * 3;
+       layout->bytes_per_mcu[0] = 3*8;
        break;
 
      case TINYJPEG_FMT_BGR24:
        colorspace_array_conv = convert_colorspace_bgr24;
-       if (priv->components[0] == NULL)
+       if (allocate && priv->components[0] == NULL)
 	 priv->components[0] = (uint8_t *)malloc(priv->width * priv->height * 3);
-       bytes_per_blocklines[0] = priv->width * 3;
-       bytes_per_mcu[0] = 3*8;
+       layout->ncomponents = 1;
+       layout->bytes_per_line[0] = priv->width * 3;
+       layout->bytes_per_mcu[0] = 3*8;
        break;
 
      case TINYJPEG_FMT_GREY:
        decode_mcu_table = decode_mcu_1comp_table;
        colorspace_array_conv = convert_colorspace_grey;
-       if (priv->components[0] == NULL)
+       if (allocate && priv->components[0] == NULL)
 	 priv->components[0] = (uint8_t *)malloc(priv->width * priv->height);
-       bytes_per_blocklines[0] = priv->width;
-       bytes_per_mcu[0] = 8;
+       layout->ncomponents = 1;
+       layout->bytes_per_line[0] = priv->width;
+       layout->bytes_per_mcu[0] = 8;
        break;
 
      default:
-       trace("Bad pixel format\n");
-       return -1;
+       error("Bad pixel format\n");
   }
 
-  xstride_by_mcu = ystride_by_mcu = 8;
-  if ((priv->component_infos[cY].Hfactor | priv->component_infos[cY].Vfactor) == 1) {
-     decode_MCU = decode_mcu_table[0];
-     convert_to_pixfmt = colorspace_array_conv[0];
-     trace("Use decode 1x1 sampling\n");
-  } else if (priv->component_infos[cY].Hfactor == 1) {
-     decode_MCU = decode_mcu_table[1];
-     convert_to_pixfmt = colorspace_array_conv[1];
-     ystride_by_mcu = 16;
-     trace("Use decode 1x2 sampling (not supported)\n");
-  } else if (priv->component_infos[cY].Vfactor == 2) {
-     decode_MCU = decode_mcu_table[3];
-     convert_to_pixfmt = colorspace_array_conv[3];
-     xstride_by_mcu = 16;
-     ystride_by_mcu = 16;
-     trace("Use decode 2x2 sampling\n");
-  } else {
-     decode_MCU = decode_mcu_table[2];
-     convert_to_pixfmt = colorspace_array_conv[2];
-     xstride_by_mcu = 16;
-     trace("Use decode 2x1 sampling\n");
+  for (c=0; c<layout->ncomponents; c++) {
+     if (priv->components[c] == NULL)
+       error("No memory for component %u\n", c);
   }
 
-  resync(priv);
+  get_mcu_size(priv, &layout->xstride_by_mcu, &layout->ystride_by_mcu, &sampling);
+  layout->decode_MCU = decode_mcu_table[sampling];
+  layout->convert_to_pixfmt = colorspace_array_conv[sampling];
+
+  layout->mcus_per_row = (priv->width + layout->xstride_by_mcu - 1) / layout->xstride_by_mcu;
+  layout->mcu_rows = (priv->height + layout->ystride_by_mcu - 1) / layout->ystride_by_mcu;
 
   /* Don't forget to that block can be either 8 or 16 lines */
-  bytes_per_blocklines[0] *= ystride_by_mcu;
-  bytes_per_blocklines[1] *= ystride_by_mcu;
-  bytes_per_blocklines[2] *= ystride_by_mcu;
+  for (c=0; c<layout->ncomponents; c++) {
+     layout->lines_per_mcu[c] = layout->ystride_by_mcu >> (c > 0 ? chroma_shift : 0);
+     layout->bytes_per_mcu[c] *= layout->xstride_by_mcu/8;
+  }
+
+  select_idct(priv);
+  return 0;
+}
+
+/*
+ * Decode a range of macroblocks (size is 8x8, 8x16, or 16x16). Each MCU row
+ * is written directly to the components, except for the last one when the
+ * height is not a multiple of the MCU height, which is decoded into a
+ * temporary buffer and only the valid lines copied. Similarly, the last MCU
+ * of a row when the width is not a multiple of the MCU width is decoded into
+ * priv->partial_mcu and only the valid columns copied, so nothing is written
+ * outside the rows being decoded.
+ */
+static int decode_MCUs(struct jdec_private *priv, const struct decode_layout *layout,
+		       unsigned int first_mcu, unsigned int last_mcu)
+{
+  uint8_t *scratch[COMPONENTS] = { NULL, NULL, NULL };
+  uint8_t *plane[COMPONENTS];
+  unsigned int mcu, x, y, c, first_x, line, lines, length;
+  int partial_row = layout->mcu_rows * layout->ystride_by_mcu > priv->height &&
+		    last_mcu > (layout->mcu_rows - 1) * layout->mcus_per_row;
+  int partial_column = layout->mcus_per_row * layout->xstride_by_mcu > priv->width;
+
+  if (partial_row) {
+     for (c=0; c<layout->ncomponents; c++) {
+	scratch[c] = (uint8_t *)malloc(layout->bytes_per_line[c] * layout->lines_per_mcu[c]);
+	if (scratch[c] == NULL) {
+	   while (c-- > 0)
+	     free(scratch[c]);
+	   error("No memory for partial MCU row\n");
+	}
+     }
+  }
 
-  bytes_per_mcu[0] *= xstride_by_mcu/8;
-  bytes_per_mcu[1] *= xstride_by_mcu/8;
-  bytes_per_mcu[2] *= xstride_by_mcu/8;
+  if (setjmp(priv->jump_state)) {
+     for (c=0; c<layout->ncomponents; c++)
+       free(scratch[c]);
+     return -1;
+  }
+
+  priv->plane_width = priv->width;
 
-  /* Just the decode the image by macroblock (size is 8x8, 8x16, or 16x16) */
-  for (y=0; y < priv->height/ystride_by_mcu; y++)
+  mcu = first_mcu;
+  while (mcu < last_mcu)
    {
+     y = mcu / layout->mcus_per_row;
+     first_x = x = mcu % layout->mcus_per_row;
+     partial_row = (y+1) * layout->ystride_by_mcu > priv->height;
+
      //trace("Decoding row %d\n", y);
-     priv->plane[0] = priv->components[0] + (y * bytes_per_blocklines[0]);
-     priv->plane[1] = priv->components[1] + (y * bytes_per_blocklines[1]);
-     priv->plane[2] = priv->components[2] + (y * bytes_per_blocklines[2]);
-     for (x=0; x < priv->width; x+=xstride_by_mcu)
+     for (c=0; c<layout->ncomponents; c++) {
+	if (partial_row)
+	  priv->plane[c] = scratch[c];
+	else
+	  priv->plane[c] = priv->components[c] + y * layout->bytes_per_line[c] * layout->lines_per_mcu[c];
+	priv->plane[c] += x * layout->bytes_per_mcu[c];
+     }
+
+     for (; x < layout->mcus_per_row && mcu < last_mcu; x++, mcu++)
       {
-	decode_MCU(priv);
-	convert_to_pixfmt(priv);
-	priv->plane[0] += bytes_per_mcu[0];
-	priv->plane[1] += bytes_per_mcu[1];
-	priv->plane[2] += bytes_per_mcu[2];
+	layout->decode_MCU(priv);
+	if (partial_column && x == layout->mcus_per_row-1) {
+	   for (c=0; c<layout->ncomponents; c++) {
+	      plane[c] = priv->plane[c];
+	      priv->plane[c] = priv->partial_mcu[c];
+	   }
+	   priv->plane_width = layout->xstride_by_mcu;
+	   layout->convert_to_pixfmt(priv);
+	   priv->plane_width = priv->width;
+	   for (c=0; c<layout->ncomponents; c++) {
+	      length = layout->bytes_per_line[c] - x * layout->bytes_per_mcu[c];
+	      for (line=0; line<layout->lines_per_mcu[c]; line++)
+		memcpy(plane[c] + line * layout->bytes_per_line[c],
+		       priv->partial_mcu[c] + line * layout->bytes_per_mcu[c],
+		       length);
+	      priv->plane[c] = plane[c];
+	   }
+	}
+	else
+	  layout->convert_to_pixfmt(priv);
+	for (c=0; c<layout->ncomponents; c++)
+	  priv->plane[c] += layout->bytes_per_mcu[c];
 	if (priv->restarts_to_go>0)
 	 {
 	   priv->restarts_to_go--;
-	   if (priv->restarts_to_go == 0)
+	   if (priv->restarts_to_go == 0 && mcu+1 < last_mcu)
 	    {
 	      priv->stream -= (priv->nbits_in_reservoir/8);
 	      resync(priv);
 	      if (find_next_rst_marker(priv) < 0)
-		return -1;
+		longjmp(priv->jump_state, -EIO);
 	    }
 	 }
       }
+
+     if (partial_row) {
+	for (c=0; c<layout->ncomponents; c++) {
+	   lines = layout->lines_per_mcu[c] * (priv->height - y * layout->ystride_by_mcu) / layout->ystride_by_mcu;
+	   length = (x - first_x) * layout->bytes_per_mcu[c];
+	   if (length > layout->bytes_per_line[c] - first_x * layout->bytes_per_mcu[c])
+	     length = layout->bytes_per_line[c] - first_x * layout->bytes_per_mcu[c];
+	   for (line=0; line<lines; line++)
+	     memcpy(priv->components[c] + (y * layout->lines_per_mcu[c] + line) * layout->bytes_per_line[c] + first_x * layout->bytes_per_mcu[c],
+		    scratch[c] + line * layout->bytes_per_line[c] + first_x * layout->bytes_per_mcu[c],
+		    length);
+	}
+     }
    }
 
+  for (c=0; c<layout->ncomponents; c++)
+    free(scratch[c]);
   return 0;
 }
 
-const char *tinyjpeg_get_errorstring(struct jdec_private * /*priv*/)
+/**
+ * Decode and convert the jpeg image into @pixfmt@ image
+ *
+ * Note: components will be automaticaly allocated if no memory is attached.
+ */
+int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
+{
+  struct decode_layout layout;
+
+  if (setup_decode(priv, pixfmt, 1, &layout) < 0)
+    return -1;
+
+  resync(priv);
+
+  return decode_MCUs(priv, &layout, 0, layout.mcus_per_row * layout.mcu_rows);
+}
+
+/**
+ * Find the start of each restart interval in the stream.
+ *
+ * Returns the number of intervals that may be decoded independently by
+ * tinyjpeg_decode_segments(), one if there are no restart markers.
+ */
+int tinyjpeg_get_segments(struct jdec_private *priv)
+{
+  unsigned int xstride_by_mcu, ystride_by_mcu, total_mcus, expected, count;
+  const unsigned char *stream;
+  int sampling;
+
+  priv->segment_count = 0;
+  if (priv->restart_interval <= 0 || priv->stream == NULL)
+    return 1;
+
+  get_mcu_size(priv, &xstride_by_mcu, &ystride_by_mcu, &sampling);
+  total_mcus = ((priv->width + xstride_by_mcu - 1) / xstride_by_mcu) *
+	       ((priv->height + ystride_by_mcu - 1) / ystride_by_mcu);
+  expected = (total_mcus + priv->restart_interval - 1) / priv->restart_interval;
+
+  if (expected > priv->segments_allocated) {
+     const unsigned char **segments = (const unsigned char **)realloc((void *)priv->segments, expected * sizeof(*segments));
+     if (segments == NULL)
+       return 1;
+     priv->segments = segments;
+     priv->segments_allocated = expected;
+  }
+
+  /* Markers cannot occur in entropy coded data, 0xff is always stuffed */
+  count = 0;
+  priv->segments[count++] = priv->stream;
+  stream = priv->stream;
+  while (count < expected &&
+	 (stream = (const unsigned char *)memchr(stream, 0xff, priv->stream_end - stream)) != NULL &&
+	 ++stream < priv->stream_end)
+   {
+     if (*stream == RST + ((count-1) & 7))
+       priv->segments[count++] = ++stream;
+     else if ((*stream >= RST && *stream <= RST7) || *stream == EOI)
+       break;
+   }
+
+  if (count != expected) {
+     trace("Restart markers missing, found %u, expected %u\n", count, expected);
+     return 1;
+  }
+
+  priv->segment_count = count;
+  return count;
+}
+
+/**
+ * Decode a range of the restart intervals found by tinyjpeg_get_segments().
+ *
+ * The decoder state is copied, so this may be called from several threads
+ * at once, provided the ranges do not overlap and the components are set.
+ * For the same reason, the error string of @priv@ is not set on failure.
+ */
+int tinyjpeg_decode_segments(struct jdec_private *priv, int pixfmt, unsigned int first, unsigned int count)
+{
+  struct decode_layout layout;
+  struct jdec_private *local;
+  unsigned int first_mcu, last_mcu;
+  int ret;
+
+  if (first >= priv->segment_count)
+    return -1;
+  if (count > priv->segment_count - first)
+    count = priv->segment_count - first;
+
+  local = (struct jdec_private *)malloc(sizeof(*local));
+  if (local == NULL)
+    return -1;
+  memcpy(local, priv, sizeof(*local));
+
+  ret = setup_decode(local, pixfmt, 0, &layout);
+  if (ret == 0) {
+     local->stream = priv->segments[first];
+     resync(local);
+     local->last_rst_marker_seen = first & 7;
+
+     first_mcu = first * priv->restart_interval;
+     last_mcu = (first + count) * priv->restart_interval;
+     if (last_mcu > layout.mcus_per_row * layout.mcu_rows)
+       last_mcu = layout.mcus_per_row * layout.mcu_rows;
+
+     ret = decode_MCUs(local, &layout, first_mcu, last_mcu);
+  }
+
+  free(local);
+  return ret;
+}
+
+const char *tinyjpeg_get_errorstring(struct jdec_private *priv)
 {
-  /* FIXME: the error string must be store in the context */
-  //priv = priv;
-  return error_string;
+  return priv->error_string;
 }
 
 void tinyjpeg_get_size(struct jdec_private *priv, unsigned int *width, unsigned int *height)
@@ -43,6 +43,8 @@ struct jdec_private;
 
 /* Flags that can be set by any applications */
 #define TINYJPEG_FLAGS_MJPEG_TABLE	(1<<1)
+#define TINYJPEG_FLAGS_FLOAT_IDCT	(1<<2)	/* Use floating point IDCT rather than integer */
+#define TINYJPEG_FLAGS_NO_SIMD		(1<<3)	/* Do not use SIMD instructions */
 
 /* Format accepted in outout */
 enum tinyjpeg_fmt {
@@ -63,6 +65,15 @@ int tinyjpeg_get_components(struct jdec_private *priv, unsigned char **component
 int tinyjpeg_set_components(struct jdec_private *priv, unsigned char **components, unsigned int ncomponents);
 int tinyjpeg_set_flags(struct jdec_private *priv, int flags);
 
+/* Restart intervals (DRI marker) allow parts of the image to be decoded
+ * independently. tinyjpeg_get_segments() returns the number of intervals
+ * found after tinyjpeg_parse_header(), and tinyjpeg_decode_segments() may
+ * then be called concurrently for disjoint ranges of them. The components
+ * must have been set before doing so.
+ */
+int tinyjpeg_get_segments(struct jdec_private *priv);
+int tinyjpeg_decode_segments(struct jdec_private *priv, int pixel_format, unsigned int first, unsigned int count);
+
 #ifdef __cplusplus
 }
 #endif
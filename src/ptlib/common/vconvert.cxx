@@ -37,6 +37,8 @@
 #endif
 
 #include <ptlib/vconvert.h>
+#include <ptlib/pprocess.h>
+#include <ptclib/threadpool.h>
 
 #if P_TINY_JPEG
   #include "tinyjpeg.h"
@@ -89,6 +91,25 @@
 #endif
 
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define P_VCONVERT_SSE2 1
+  #include <emmintrin.h>
+  #if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+    #define P_VCONVERT_AVX2 1
+    #define P_VCONVERT_AVX2_FUNCTION __attribute__((target("avx2")))
+    #include <immintrin.h>
+  #elif defined(_MSC_VER) && _MSC_VER >= 1700
+    #define P_VCONVERT_AVX2 1
+    #define P_VCONVERT_AVX2_FUNCTION
+    #include <immintrin.h>
+    #include <intrin.h>
+  #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #define P_VCONVERT_NEON 1
+  #include <arm_neon.h>
+#endif
+
+
 #if _MSC_VER
   #pragma intrinsic(memcpy)
 #if P_64BIT
@@ -103,6 +124,36 @@
 #endif
 
 
+static PColourConverter::Acceleration DetectAcceleration()
+{
+#if P_VCONVERT_AVX2
+  #if defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      return PColourConverter::AVX2Acceleration;
+  #else
+    int info[4];
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6) { // OS saves YMM registers
+      __cpuidex(info, 7, 0);
+      if ((info[1] & (1 << 5)) != 0)
+        return PColourConverter::AVX2Acceleration;
+    }
+  #endif
+#endif
+#if P_VCONVERT_SSE2
+  return PColourConverter::SSE2Acceleration;
+#elif P_VCONVERT_NEON
+  return PColourConverter::NEONAcceleration;
+#else
+  return PColourConverter::NoAcceleration;
+#endif
+}
+
+static PColourConverter::Acceleration const BestAcceleration = DetectAcceleration();
+static PColourConverter::Acceleration CurrentAcceleration = BestAcceleration;
+
+
 class PStandardColourConverter : public PColourConverter
 {
     PCLASSINFO(PStandardColourConverter, PColourConverter);
@@ -142,6 +193,12 @@ class PStandardColourConverter : public PColourConverter
       PTRACE(2, "Cannot create FFMPEG scaler from " << srcFmt << " to " << dstFmt);
       return false;
     }
+
+    // If the acceleration has been set explicitly, only use our own code, so it can be tested.
+    bool CanUseFFMPEGForRGB(AVPixelFormat srcFmt, AVPixelFormat dstFmt, unsigned rgbIncrement, unsigned redOffset)
+    {
+      return CurrentAcceleration == BestAcceleration && CanUseFFMPEG(srcFmt, dstFmt, rgbIncrement, redOffset);
+    }
 #endif
 
     PStandardColourConverter(const PColourPair & colours)
@@ -468,6 +525,21 @@ PBoolean PColourConverter::ConvertInPlace(BYTE * frameBuffer,
 }
 
 
+typedef int FixedPoint; // Best to be native integer size
+#define ScaleBitShift 12
+static FixedPoint const HalfFixedScaling = 1 << (ScaleBitShift - 1);
+
+#define ROUND(x) ((x) + HalfFixedScaling)
+#define CLAMP(x) (BYTE)(((x) < 0 ? 0 : ((x) >= (255<<ScaleBitShift) ? 255 : ((x)>>ScaleBitShift))))
+
+#define FIX_FROM_FLOAT(x)    ((int) ((x) * (1UL<<ScaleBitShift) + 0.5))
+static FixedPoint const YUVtoR_Coeff  =  FIX_FROM_FLOAT(1.40200);
+static FixedPoint const YUVtoG_Coeff1 = -FIX_FROM_FLOAT(0.34414);
+static FixedPoint const YUVtoG_Coeff2 =  FIX_FROM_FLOAT(0.71414);
+static FixedPoint const YUVtoB_Coeff  =  FIX_FROM_FLOAT(1.77200);
+#undef FIX_FROM_FLOAT
+
+
 __inline BYTE RGBtoY(int r, int g, int b)
 {
   int y = 299*r + 587*g + 114*b;
@@ -495,6 +567,768 @@ void PColourConverter::RGBtoYUV(unsigned r, unsigned g, unsigned b,
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// SIMD versions of the inner loops of the most used standard converters.
+//
+// Each function converts as many pixels from the start of the row (or pair
+// of rows) as is convenient for the instruction set, and returns how many
+// that was. The caller completes the row with the original scalar code. All
+// of the fixed point arithmetic, including the integer divisions by 1000 in
+// RGBtoY() etc, is reproduced so the output is bit-exact with the scalar
+// code.
+//
+// The divisions are done as floor(floor(x/8)/125), and as floor(x/8) is less
+// than 2^15 for all values produced, x/125 == (x*33555)>>22 exactly.
+
+bool PColourConverter::SetAcceleration(Acceleration level)
+{
+  switch (level) {
+    case SSE2Acceleration :
+      if (BestAcceleration != SSE2Acceleration && BestAcceleration != AVX2Acceleration)
+        return false;
+      break;
+
+    case AVX2Acceleration :
+    case NEONAcceleration :
+      if (BestAcceleration != level)
+        return false;
+      break;
+
+    default :
+      break;
+  }
+
+  CurrentAcceleration = level;
+  PTRACE(4, NULL, PTraceModule(), "Acceleration set to " << level);
+  return true;
+}
+
+
+PColourConverter::Acceleration PColourConverter::GetAcceleration()
+{
+  return CurrentAcceleration;
+}
+
+
+static __inline uint32_t LoadUInt32(const BYTE * ptr)
+{
+  uint32_t value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+
+static __inline void StoreUInt32(BYTE * ptr, uint32_t value)
+{
+  memcpy(ptr, &value, sizeof(value));
+}
+
+
+#if P_VCONVERT_SSE2
+
+// Calculates (a*ca + b*cb + HalfFixedScaling) >> ScaleBitShift for eight 16 bit values
+static __inline __m128i YUVtoRGBDelta_SSE2(__m128i a, __m128i b, __m128i coeff)
+{
+  const __m128i round = _mm_set1_epi32(HalfFixedScaling);
+  __m128i lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), coeff), round), ScaleBitShift);
+  __m128i hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), coeff), round), ScaleBitShift);
+  return _mm_packs_epi32(lo, hi);
+}
+
+
+/* As the luminance has no fractional part CLAMP((y<<ScaleBitShift) + delta)
+   is the same as saturating y + (delta>>ScaleBitShift), so each output pixel
+   is just a 16 bit add. Sixteen pixels are output.
+ */
+static __inline void YUVtoRGBRow_SSE2(const BYTE * yPtr, BYTE * rgbPtr,
+                                      __m128i rdLo, __m128i rdHi,
+                                      __m128i gdLo, __m128i gdHi,
+                                      __m128i bdLo, __m128i bdHi,
+                                      unsigned rgbIncrement,
+                                      unsigned redOffset)
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  __m128i y = _mm_loadu_si128((const __m128i *)yPtr);
+  __m128i yLo = _mm_unpacklo_epi8(y, zero);
+  __m128i yHi = _mm_unpackhi_epi8(y, zero);
+
+  __m128i r = _mm_packus_epi16(_mm_add_epi16(yLo, rdLo), _mm_add_epi16(yHi, rdHi));
+  __m128i g = _mm_packus_epi16(_mm_add_epi16(yLo, gdLo), _mm_add_epi16(yHi, gdHi));
+  __m128i b = _mm_packus_epi16(_mm_add_epi16(yLo, bdLo), _mm_add_epi16(yHi, bdHi));
+
+  __m128i c0 = redOffset == 0 ? r : b;
+  __m128i c2 = redOffset == 0 ? b : r;
+
+  __m128i c01Lo = _mm_unpacklo_epi8(c0, g);
+  __m128i c01Hi = _mm_unpackhi_epi8(c0, g);
+  __m128i c2zLo = _mm_unpacklo_epi8(c2, zero);
+  __m128i c2zHi = _mm_unpackhi_epi8(c2, zero);
+
+  __m128i pixels[4] = {
+    _mm_unpacklo_epi16(c01Lo, c2zLo),
+    _mm_unpackhi_epi16(c01Lo, c2zLo),
+    _mm_unpacklo_epi16(c01Hi, c2zHi),
+    _mm_unpackhi_epi16(c01Hi, c2zHi)
+  };
+
+  if (rgbIncrement == 4) {
+    for (int i = 0; i < 4; ++i)
+      _mm_storeu_si128((__m128i *)(rgbPtr + i*16), pixels[i]);
+  }
+  else {
+    // Squeeze the zero byte out of each pair of pixels in a 64 bit half, then
+    // overlapping stores, so two bytes past the last pixel get written.
+    const __m128i mask0 = _mm_set_epi32(0,      0x00ffffff, 0,      0x00ffffff);
+    const __m128i mask1 = _mm_set_epi32(0xffff, (int)0xff000000, 0xffff, (int)0xff000000);
+    for (int i = 0; i < 4; ++i) {
+      __m128i packed = _mm_or_si128(_mm_and_si128(pixels[i], mask0),
+                                    _mm_and_si128(_mm_srli_epi64(pixels[i], 8), mask1));
+      _mm_storel_epi64((__m128i *)(rgbPtr + i*12), packed);
+      _mm_storel_epi64((__m128i *)(rgbPtr + i*12 + 6), _mm_srli_si128(packed, 8));
+    }
+  }
+}
+
+
+static unsigned YUV420PtoRGB_SSE2(const BYTE * y0, const BYTE * y1, const BYTE * u, const BYTE * v,
+                                  BYTE * rgb0, BYTE * rgb1, unsigned width,
+                                  unsigned rgbIncrement, unsigned redOffset)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bias = _mm_set1_epi16(128);
+  const __m128i coeffR = _mm_setr_epi16(YUVtoR_Coeff, 0, YUVtoR_Coeff, 0, YUVtoR_Coeff, 0, YUVtoR_Coeff, 0);
+  const __m128i coeffG = _mm_setr_epi16(YUVtoG_Coeff1, -YUVtoG_Coeff2, YUVtoG_Coeff1, -YUVtoG_Coeff2,
+                                        YUVtoG_Coeff1, -YUVtoG_Coeff2, YUVtoG_Coeff1, -YUVtoG_Coeff2);
+  const __m128i coeffB = _mm_setr_epi16(YUVtoB_Coeff, 0, YUVtoB_Coeff, 0, YUVtoB_Coeff, 0, YUVtoB_Coeff, 0);
+
+  // 24 bit output writes two bytes past the block, so need one more pixel
+  unsigned extra = rgbIncrement == 4 ? 0 : 1;
+
+  unsigned x;
+  for (x = 0; x + 16 + extra <= width; x += 16) {
+    __m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + x/2)), zero), bias);
+    __m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + x/2)), zero), bias);
+
+    // The RGB value without luminance, same as YUV420PtoRGB_PIXEL_UV, duplicated for adjacent pixels
+    __m128i rd = YUVtoRGBDelta_SSE2(cr, zero, coeffR);
+    __m128i gd = YUVtoRGBDelta_SSE2(cb, cr,   coeffG);
+    __m128i bd = YUVtoRGBDelta_SSE2(cb, zero, coeffB);
+    __m128i rdLo = _mm_unpacklo_epi16(rd, rd), rdHi = _mm_unpackhi_epi16(rd, rd);
+    __m128i gdLo = _mm_unpacklo_epi16(gd, gd), gdHi = _mm_unpackhi_epi16(gd, gd);
+    __m128i bdLo = _mm_unpacklo_epi16(bd, bd), bdHi = _mm_unpackhi_epi16(bd, bd);
+
+    YUVtoRGBRow_SSE2(y0 + x, rgb0 + x*rgbIncrement, rdLo, rdHi, gdLo, gdHi, bdLo, bdHi, rgbIncrement, redOffset);
+    YUVtoRGBRow_SSE2(y1 + x, rgb1 + x*rgbIncrement, rdLo, rdHi, gdLo, gdHi, bdLo, bdHi, rgbIncrement, redOffset);
+  }
+
+  return x;
+}
+
+
+static __inline __m128i LoadRGB_SSE2(const BYTE * rgb, unsigned rgbIncrement)
+{
+  if (rgbIncrement == 4)
+    return _mm_loadu_si128((const __m128i *)rgb);
+
+  // Four 24 bit pixels, loaded as 32 bits so fourth byte is from next pixel
+  return _mm_setr_epi32(LoadUInt32(rgb), LoadUInt32(rgb+3), LoadUInt32(rgb+6), LoadUInt32(rgb+9));
+}
+
+
+static __inline void SplitRGB_SSE2(__m128i pixels, unsigned redOffset, __m128i & r, __m128i & g, __m128i & b)
+{
+  const __m128i mask = _mm_set1_epi32(0xff);
+  __m128i c0 = _mm_and_si128(pixels, mask);
+  __m128i c2 = _mm_and_si128(_mm_srli_epi32(pixels, 16), mask);
+  g = _mm_and_si128(_mm_srli_epi32(pixels, 8), mask);
+  r = redOffset == 0 ? c0 : c2;
+  b = redOffset == 0 ? c2 : c0;
+}
+
+
+// Calculates r*cr + g*cg + b*cb for four 32 bit values, each less than 256
+static __inline __m128i RGBWeightedSum_SSE2(__m128i r, __m128i g, __m128i b, __m128i coeffRG, __m128i coeffB)
+{
+  return _mm_add_epi32(_mm_madd_epi16(_mm_or_si128(r, _mm_slli_epi32(g, 16)), coeffRG), _mm_madd_epi16(b, coeffB));
+}
+
+
+// Divides x by 125 for eight unsigned 16 bit values less than 2^15
+static __inline __m128i DivideBy125_SSE2(__m128i x)
+{
+  return _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_set1_epi16((short)33555)), 6);
+}
+
+
+static __inline __m128i RGBtoY_SSE2(__m128i r, __m128i g, __m128i b)
+{
+  // Returns the value in RGBtoY() divided by 8
+  return _mm_srli_epi32(RGBWeightedSum_SSE2(r, g, b, _mm_setr_epi16(299, 587, 299, 587, 299, 587, 299, 587), _mm_set1_epi32(114)), 3);
+}
+
+
+static unsigned RGBtoYUV420P_SSE2(const BYTE * rgb0, const BYTE * rgb1,
+                                  BYTE * y0, BYTE * y1, BYTE * u, BYTE * v,
+                                  unsigned width, unsigned rgbIncrement, unsigned redOffset)
+{
+  const __m128i ones = _mm_set1_epi16(1);
+  const __m128i coeffU = _mm_setr_epi16(-147, -289, -147, -289, -147, -289, -147, -289);
+  const __m128i coeffV = _mm_setr_epi16( 615, -515,  615, -515,  615, -515,  615, -515);
+  const __m128i coeffUb = _mm_set1_epi32(436);
+  const __m128i coeffVb = _mm_set1_epi32((unsigned short)-100);
+  const __m128i lowLimit = _mm_set1_epi32(-127000);
+
+  // 24 bit input reads one byte past the block, so need one more pixel
+  unsigned extra = rgbIncrement == 4 ? 0 : 1;
+
+  unsigned x;
+  for (x = 0; x + 8 + extra <= width; x += 8) {
+    __m128i r0a, g0a, b0a, r0b, g0b, b0b, r1a, g1a, b1a, r1b, g1b, b1b;
+    SplitRGB_SSE2(LoadRGB_SSE2(rgb0 + x*rgbIncrement,     rgbIncrement), redOffset, r0a, g0a, b0a);
+    SplitRGB_SSE2(LoadRGB_SSE2(rgb0 + (x+4)*rgbIncrement, rgbIncrement), redOffset, r0b, g0b, b0b);
+    SplitRGB_SSE2(LoadRGB_SSE2(rgb1 + x*rgbIncrement,     rgbIncrement), redOffset, r1a, g1a, b1a);
+    SplitRGB_SSE2(LoadRGB_SSE2(rgb1 + (x+4)*rgbIncrement, rgbIncrement), redOffset, r1b, g1b, b1b);
+
+    __m128i y = DivideBy125_SSE2(_mm_packs_epi32(RGBtoY_SSE2(r0a, g0a, b0a), RGBtoY_SSE2(r0b, g0b, b0b)));
+    _mm_storel_epi64((__m128i *)(y0 + x), _mm_packus_epi16(y, y));
+    y = DivideBy125_SSE2(_mm_packs_epi32(RGBtoY_SSE2(r1a, g1a, b1a), RGBtoY_SSE2(r1b, g1b, b1b)));
+    _mm_storel_epi64((__m128i *)(y1 + x), _mm_packus_epi16(y, y));
+
+    // Average of each 2x2 block, adding pairs of 16 bit values with the multiply/add
+    __m128i r = _mm_srli_epi32(_mm_madd_epi16(_mm_add_epi16(_mm_packs_epi32(r0a, r0b), _mm_packs_epi32(r1a, r1b)), ones), 2);
+    __m128i g = _mm_srli_epi32(_mm_madd_epi16(_mm_add_epi16(_mm_packs_epi32(g0a, g0b), _mm_packs_epi32(g1a, g1b)), ones), 2);
+    __m128i b = _mm_srli_epi32(_mm_madd_epi16(_mm_add_epi16(_mm_packs_epi32(b0a, b0b), _mm_packs_epi32(b1a, b1b)), ones), 2);
+
+    __m128i uSum = RGBWeightedSum_SSE2(r, g, b, coeffU, coeffUb);
+    __m128i vSum = RGBWeightedSum_SSE2(r, g, b, coeffV, coeffVb);
+
+    // Signed division truncates towards zero, so divide the magnitude
+    __m128i uSign = _mm_srai_epi32(uSum, 31);
+    __m128i vSign = _mm_srai_epi32(vSum, 31);
+    __m128i uAbs = _mm_srli_epi32(_mm_sub_epi32(_mm_xor_si128(uSum, uSign), uSign), 3);
+    __m128i vAbs = _mm_srli_epi32(_mm_sub_epi32(_mm_xor_si128(vSum, vSign), vSign), 3);
+    __m128i sign = _mm_packs_epi32(uSign, vSign);
+    __m128i uv = DivideBy125_SSE2(_mm_packs_epi32(uAbs, vAbs));
+    uv = _mm_add_epi16(_mm_sub_epi16(_mm_xor_si128(uv, sign), sign), _mm_set1_epi16(128));
+
+    // Upper clamp is done by the saturation, but lower is not quite
+    uv = _mm_andnot_si128(_mm_packs_epi32(_mm_cmplt_epi32(uSum, lowLimit), _mm_cmplt_epi32(vSum, lowLimit)), uv);
+    uv = _mm_packus_epi16(uv, uv);
+    StoreUInt32(u + x/2, _mm_cvtsi128_si32(uv));
+    StoreUInt32(v + x/2, _mm_cvtsi128_si32(_mm_srli_si128(uv, 4)));
+  }
+
+  return x;
+}
+
+
+static unsigned YUV422toYUV420P_SSE2(const BYTE * src0, const BYTE * src1,
+                                     BYTE * y0, BYTE * y1, BYTE * u, BYTE * v,
+                                     unsigned width, bool uyvy)
+{
+  const __m128i mask = _mm_set1_epi16(0xff);
+  const __m128i zero = _mm_setzero_si128();
+
+  unsigned x;
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src0 + x*2));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src0 + x*2 + 16));
+    __m128i lumA, lumB, chromaA, chromaB;
+    if (uyvy) {
+      lumA = _mm_srli_epi16(a, 8);
+      lumB = _mm_srli_epi16(b, 8);
+      chromaA = _mm_and_si128(a, mask);
+      chromaB = _mm_and_si128(b, mask);
+    }
+    else {
+      lumA = _mm_and_si128(a, mask);
+      lumB = _mm_and_si128(b, mask);
+      chromaA = _mm_srli_epi16(a, 8);
+      chromaB = _mm_srli_epi16(b, 8);
+    }
+    _mm_storeu_si128((__m128i *)(y0 + x), _mm_packus_epi16(lumA, lumB));
+
+    __m128i chroma = _mm_packus_epi16(chromaA, chromaB); // U0 V0 U1 V1 ...
+    _mm_storel_epi64((__m128i *)(u + x/2), _mm_packus_epi16(_mm_and_si128(chroma, mask), zero));
+    _mm_storel_epi64((__m128i *)(v + x/2), _mm_packus_epi16(_mm_srli_epi16(chroma, 8), zero));
+
+    // Second line discards the chroma
+    a = _mm_loadu_si128((const __m128i *)(src1 + x*2));
+    b = _mm_loadu_si128((const __m128i *)(src1 + x*2 + 16));
+    if (uyvy) {
+      lumA = _mm_srli_epi16(a, 8);
+      lumB = _mm_srli_epi16(b, 8);
+    }
+    else {
+      lumA = _mm_and_si128(a, mask);
+      lumB = _mm_and_si128(b, mask);
+    }
+    _mm_storeu_si128((__m128i *)(y1 + x), _mm_packus_epi16(lumA, lumB));
+  }
+
+  return x;
+}
+
+
+static unsigned SwapRedAndBlue_SSE2(const BYTE * src, BYTE * dst, unsigned width, unsigned srcIncrement, unsigned dstIncrement)
+{
+  if (srcIncrement != 4 || dstIncrement != 4)
+    return 0;
+
+  // Note the scalar code does not touch the fourth byte in the destination
+  const __m128i greenMask = _mm_set1_epi32(0x0000ff00);
+  const __m128i lowMask = _mm_set1_epi32(0x000000ff);
+  const __m128i fourthMask = _mm_set1_epi32((int)0xff000000);
+
+  unsigned x;
+  for (x = 0; x + 4 <= width; x += 4) {
+    __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x*4));
+    __m128i fourth = _mm_and_si128(_mm_loadu_si128((const __m128i *)(dst + x*4)), fourthMask);
+    __m128i swapped = _mm_or_si128(_mm_or_si128(_mm_and_si128(pixels, greenMask), fourth),
+                                   _mm_or_si128(_mm_and_si128(_mm_srli_epi32(pixels, 16), lowMask),
+                                                _mm_slli_epi32(_mm_and_si128(pixels, lowMask), 16)));
+    _mm_storeu_si128((__m128i *)(dst + x*4), swapped);
+  }
+
+  return x;
+}
+
+#endif // P_VCONVERT_SSE2
+
+
+#if P_VCONVERT_AVX2
+
+P_VCONVERT_AVX2_FUNCTION
+static __inline __m256i YUVtoRGBDelta_AVX2(__m256i a, __m256i b, __m256i coeff)
+{
+  // See YUVtoRGBDelta_SSE2, the unpack and pack are both within 128 bit lanes, so order is preserved
+  const __m256i round = _mm256_set1_epi32(HalfFixedScaling);
+  __m256i lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), coeff), round), ScaleBitShift);
+  __m256i hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), coeff), round), ScaleBitShift);
+  return _mm256_packs_epi32(lo, hi);
+}
+
+
+P_VCONVERT_AVX2_FUNCTION
+static __inline void YUVtoRGBRow_AVX2(const BYTE * yPtr, BYTE * rgbPtr,
+                                      __m256i rdLo, __m256i rdHi,
+                                      __m256i gdLo, __m256i gdHi,
+                                      __m256i bdLo, __m256i bdHi,
+                                      unsigned rgbIncrement,
+                                      unsigned redOffset)
+{
+  const __m256i zero = _mm256_setzero_si256();
+
+  // The in-lane unpack of the luminance matches the in-lane unpack of the
+  // chroma deltas, and the pack reverses it, so r/g/b are in pixel order.
+  __m256i y = _mm256_loadu_si256((const __m256i *)yPtr);
+  __m256i yLo = _mm256_unpacklo_epi8(y, zero);
+  __m256i yHi = _mm256_unpackhi_epi8(y, zero);
+
+  __m256i r = _mm256_packus_epi16(_mm256_add_epi16(yLo, rdLo), _mm256_add_epi16(yHi, rdHi));
+  __m256i g = _mm256_packus_epi16(_mm256_add_epi16(yLo, gdLo), _mm256_add_epi16(yHi, gdHi));
+  __m256i b = _mm256_packus_epi16(_mm256_add_epi16(yLo, bdLo), _mm256_add_epi16(yHi, bdHi));
+
+  __m256i c0 = redOffset == 0 ? r : b;
+  __m256i c2 = redOffset == 0 ? b : r;
+
+  __m256i c01Lo = _mm256_unpacklo_epi8(c0, g);
+  __m256i c01Hi = _mm256_unpackhi_epi8(c0, g);
+  __m256i c2zLo = _mm256_unpacklo_epi8(c2, zero);
+  __m256i c2zHi = _mm256_unpackhi_epi8(c2, zero);
+
+  // Pixels 0-3|16-19, 4-7|20-23, 8-11|24-27, 12-15|28-31
+  __m256i p0 = _mm256_unpacklo_epi16(c01Lo, c2zLo);
+  __m256i p1 = _mm256_unpackhi_epi16(c01Lo, c2zLo);
+  __m256i p2 = _mm256_unpacklo_epi16(c01Hi, c2zHi);
+  __m256i p3 = _mm256_unpackhi_epi16(c01Hi, c2zHi);
+
+  __m256i pixels[4] = {
+    _mm256_permute2x128_si256(p0, p1, 0x20),
+    _mm256_permute2x128_si256(p2, p3, 0x20),
+    _mm256_permute2x128_si256(p0, p1, 0x31),
+    _mm256_permute2x128_si256(p2, p3, 0x31)
+  };
+
+  if (rgbIncrement == 4) {
+    for (int i = 0; i < 4; ++i)
+      _mm256_storeu_si256((__m256i *)(rgbPtr + i*32), pixels[i]);
+  }
+  else {
+    // Squeeze out the zero bytes, then overlapping stores, so four bytes past the last pixel get written.
+    const __m256i squeeze = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                             0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    for (int i = 0; i < 4; ++i) {
+      __m256i packed = _mm256_shuffle_epi8(pixels[i], squeeze);
+      _mm_storeu_si128((__m128i *)(rgbPtr + i*24), _mm256_castsi256_si128(packed));
+      _mm_storeu_si128((__m128i *)(rgbPtr + i*24 + 12), _mm256_extracti128_si256(packed, 1));
+    }
+  }
+}
+
+
+P_VCONVERT_AVX2_FUNCTION
+static unsigned YUV420PtoRGB_AVX2(const BYTE * y0, const BYTE * y1, const BYTE * u, const BYTE * v,
+                                  BYTE * rgb0, BYTE * rgb1, unsigned width,
+                                  unsigned rgbIncrement, unsigned redOffset)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i bias = _mm256_set1_epi16(128);
+  const __m256i coeffR = _mm256_set1_epi32(YUVtoR_Coeff);
+  const __m256i coeffG = _mm256_set1_epi32((int)(((unsigned)-YUVtoG_Coeff2 << 16) | ((unsigned)YUVtoG_Coeff1 & 0xffff)));
+  const __m256i coeffB = _mm256_set1_epi32(YUVtoB_Coeff);
+
+  // 24 bit output writes four bytes past the block, so need two more pixels
+  unsigned extra = rgbIncrement == 4 ? 0 : 2;
+
+  unsigned x;
+  for (x = 0; x + 32 + extra <= width; x += 32) {
+    __m256i cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(u + x/2))), bias);
+    __m256i cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(v + x/2))), bias);
+
+    __m256i rd = YUVtoRGBDelta_AVX2(cr, zero, coeffR);
+    __m256i gd = YUVtoRGBDelta_AVX2(cb, cr,   coeffG);
+    __m256i bd = YUVtoRGBDelta_AVX2(cb, zero, coeffB);
+    __m256i rdLo = _mm256_unpacklo_epi16(rd, rd), rdHi = _mm256_unpackhi_epi16(rd, rd);
+    __m256i gdLo = _mm256_unpacklo_epi16(gd, gd), gdHi = _mm256_unpackhi_epi16(gd, gd);
+    __m256i bdLo = _mm256_unpacklo_epi16(bd, bd), bdHi = _mm256_unpackhi_epi16(bd, bd);
+
+    YUVtoRGBRow_AVX2(y0 + x, rgb0 + x*rgbIncrement, rdLo, rdHi, gdLo, gdHi, bdLo, bdHi, rgbIncrement, redOffset);
+    YUVtoRGBRow_AVX2(y1 + x, rgb1 + x*rgbIncrement, rdLo, rdHi, gdLo, gdHi, bdLo, bdHi, rgbIncrement, redOffset);
+  }
+
+  return x + YUV420PtoRGB_SSE2(y0 + x, y1 + x, u + x/2, v + x/2,
+                               rgb0 + x*rgbIncrement, rgb1 + x*rgbIncrement,
+                               width - x, rgbIncrement, redOffset);
+}
+
+
+P_VCONVERT_AVX2_FUNCTION
+static unsigned SwapRedAndBlue_AVX2(const BYTE * src, BYTE * dst, unsigned width, unsigned srcIncrement, unsigned dstIncrement)
+{
+  if (srcIncrement != dstIncrement)
+    return 0;
+
+  unsigned x = 0;
+  if (srcIncrement == 4) {
+    // Fourth byte taken from the destination, see SwapRedAndBlue_SSE2
+    const __m256i swap = _mm256_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1,
+                                          2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+    const __m256i fourthMask = _mm256_set1_epi32((int)0xff000000);
+    for (; x + 8 <= width; x += 8) {
+      __m256i pixels = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + x*4)), swap);
+      __m256i fourth = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(dst + x*4)), fourthMask);
+      _mm256_storeu_si256((__m256i *)(dst + x*4), _mm256_or_si256(pixels, fourth));
+    }
+    return x + SwapRedAndBlue_SSE2(src + x*4, dst + x*4, width - x, 4, 4);
+  }
+
+  if (srcIncrement == 3) {
+    /* Four pixels at a time, 16 bytes are read and written with the last
+       four bytes unchanged. They are then overwritten by the next iteration,
+       or by the scalar code, so two extra pixels must be in the row. */
+    const __m128i swap = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15);
+    for (; x + 6 <= width; x += 4)
+      _mm_storeu_si128((__m128i *)(dst + x*3), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + x*3)), swap));
+  }
+
+  return x;
+}
+
+#endif // P_VCONVERT_AVX2
+
+
+#if P_VCONVERT_NEON
+
+// Calculates (a*ca + b*cb + HalfFixedScaling) >> ScaleBitShift for eight 16 bit values
+static __inline int16x8_t YUVtoRGBDelta_NEON(int16x8_t a, int16_t ca, int16x8_t b, int16_t cb)
+{
+  const int32x4_t round = vdupq_n_s32(HalfFixedScaling);
+  int32x4_t lo = vmlal_n_s16(vmull_n_s16(vget_low_s16(a), ca), vget_low_s16(b), cb);
+  int32x4_t hi = vmlal_n_s16(vmull_n_s16(vget_high_s16(a), ca), vget_high_s16(b), cb);
+  lo = vshrq_n_s32(vaddq_s32(lo, round), ScaleBitShift);
+  hi = vshrq_n_s32(vaddq_s32(hi, round), ScaleBitShift);
+  return vcombine_s16(vmovn_s32(lo), vmovn_s32(hi));
+}
+
+
+// See YUVtoRGBRow_SSE2
+static __inline void YUVtoRGBRow_NEON(const BYTE * yPtr, BYTE * rgbPtr,
+                                      int16x8x2_t rd, int16x8x2_t gd, int16x8x2_t bd,
+                                      unsigned rgbIncrement, unsigned redOffset)
+{
+  uint8x16_t y = vld1q_u8(yPtr);
+  int16x8_t yLo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y)));
+  int16x8_t yHi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y)));
+
+  uint8x16_t r = vcombine_u8(vqmovun_s16(vaddq_s16(yLo, rd.val[0])), vqmovun_s16(vaddq_s16(yHi, rd.val[1])));
+  uint8x16_t g = vcombine_u8(vqmovun_s16(vaddq_s16(yLo, gd.val[0])), vqmovun_s16(vaddq_s16(yHi, gd.val[1])));
+  uint8x16_t b = vcombine_u8(vqmovun_s16(vaddq_s16(yLo, bd.val[0])), vqmovun_s16(vaddq_s16(yHi, bd.val[1])));
+
+  if (rgbIncrement == 4) {
+    uint8x16x4_t pixels;
+    pixels.val[redOffset] = r;
+    pixels.val[1] = g;
+    pixels.val[2-redOffset] = b;
+    pixels.val[3] = vdupq_n_u8(0);
+    vst4q_u8(rgbPtr, pixels);
+  }
+  else {
+    uint8x16x3_t pixels;
+    pixels.val[redOffset] = r;
+    pixels.val[1] = g;
+    pixels.val[2-redOffset] = b;
+    vst3q_u8(rgbPtr, pixels);
+  }
+}
+
+
+static unsigned YUV420PtoRGB_NEON(const BYTE * y0, const BYTE * y1, const BYTE * u, const BYTE * v,
+                                  BYTE * rgb0, BYTE * rgb1, unsigned width,
+                                  unsigned rgbIncrement, unsigned redOffset)
+{
+  const int16x8_t bias = vdupq_n_s16(128);
+  const int16x8_t zero = vdupq_n_s16(0);
+
+  unsigned x;
+  for (x = 0; x + 16 <= width; x += 16) {
+    int16x8_t cb = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + x/2))), bias);
+    int16x8_t cr = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + x/2))), bias);
+
+    int16x8_t r = YUVtoRGBDelta_NEON(cr, YUVtoR_Coeff, zero, 0);
+    int16x8_t g = YUVtoRGBDelta_NEON(cb, YUVtoG_Coeff1, cr, -YUVtoG_Coeff2);
+    int16x8_t b = YUVtoRGBDelta_NEON(cb, YUVtoB_Coeff, zero, 0);
+    int16x8x2_t rd = vzipq_s16(r, r);
+    int16x8x2_t gd = vzipq_s16(g, g);
+    int16x8x2_t bd = vzipq_s16(b, b);
+
+    YUVtoRGBRow_NEON(y0 + x, rgb0 + x*rgbIncrement, rd, gd, bd, rgbIncrement, redOffset);
+    YUVtoRGBRow_NEON(y1 + x, rgb1 + x*rgbIncrement, rd, gd, bd, rgbIncrement, redOffset);
+  }
+
+  return x;
+}
+
+
+// Divides x by 125 for eight unsigned 16 bit values less than 2^15
+static __inline uint16x8_t DivideBy125_NEON(uint16x8_t x)
+{
+  uint32x4_t lo = vshrq_n_u32(vmull_n_u16(vget_low_u16(x), 33555), 22);
+  uint32x4_t hi = vshrq_n_u32(vmull_n_u16(vget_high_u16(x), 33555), 22);
+  return vcombine_u16(vmovn_u32(lo), vmovn_u32(hi));
+}
+
+
+static __inline uint8x8_t RGBtoY_NEON(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+  uint16x8_t r16 = vmovl_u8(r);
+  uint16x8_t g16 = vmovl_u8(g);
+  uint16x8_t b16 = vmovl_u8(b);
+  uint32x4_t lo = vmlal_n_u16(vmlal_n_u16(vmull_n_u16(vget_low_u16(r16), 299), vget_low_u16(g16), 587), vget_low_u16(b16), 114);
+  uint32x4_t hi = vmlal_n_u16(vmlal_n_u16(vmull_n_u16(vget_high_u16(r16), 299), vget_high_u16(g16), 587), vget_high_u16(b16), 114);
+  return vmovn_u16(DivideBy125_NEON(vcombine_u16(vshrn_n_u32(lo, 3), vshrn_n_u32(hi, 3))));
+}
+
+
+static unsigned RGBtoYUV420P_NEON(const BYTE * rgb0, const BYTE * rgb1,
+                                  BYTE * y0, BYTE * y1, BYTE * u, BYTE * v,
+                                  unsigned width, unsigned rgbIncrement, unsigned redOffset)
+{
+  const int32x4_t lowLimit = vdupq_n_s32(-127000);
+
+  unsigned x;
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint8x8_t r0, g0, b0, r1, g1, b1;
+    if (rgbIncrement == 4) {
+      uint8x8x4_t p0 = vld4_u8(rgb0 + x*4);
+      uint8x8x4_t p1 = vld4_u8(rgb1 + x*4);
+      r0 = p0.val[redOffset]; g0 = p0.val[1]; b0 = p0.val[2-redOffset];
+      r1 = p1.val[redOffset]; g1 = p1.val[1]; b1 = p1.val[2-redOffset];
+    }
+    else {
+      uint8x8x3_t p0 = vld3_u8(rgb0 + x*3);
+      uint8x8x3_t p1 = vld3_u8(rgb1 + x*3);
+      r0 = p0.val[redOffset]; g0 = p0.val[1]; b0 = p0.val[2-redOffset];
+      r1 = p1.val[redOffset]; g1 = p1.val[1]; b1 = p1.val[2-redOffset];
+    }
+
+    vst1_u8(y0 + x, RGBtoY_NEON(r0, g0, b0));
+    vst1_u8(y1 + x, RGBtoY_NEON(r1, g1, b1));
+
+    // Average of each 2x2 block
+    int32x4_t r = vreinterpretq_s32_u32(vshrq_n_u32(vpaddlq_u16(vaddl_u8(r0, r1)), 2));
+    int32x4_t g = vreinterpretq_s32_u32(vshrq_n_u32(vpaddlq_u16(vaddl_u8(g0, g1)), 2));
+    int32x4_t b = vreinterpretq_s32_u32(vshrq_n_u32(vpaddlq_u16(vaddl_u8(b0, b1)), 2));
+
+    int32x4_t uSum = vmlaq_n_s32(vmlaq_n_s32(vmulq_n_s32(r, -147), g, -289), b,  436);
+    int32x4_t vSum = vmlaq_n_s32(vmlaq_n_s32(vmulq_n_s32(r,  615), g, -515), b, -100);
+
+    // See RGBtoYUV420P_SSE2
+    uint16x8_t uvAbs = vcombine_u16(vshrn_n_u32(vreinterpretq_u32_s32(vabsq_s32(uSum)), 3),
+                                    vshrn_n_u32(vreinterpretq_u32_s32(vabsq_s32(vSum)), 3));
+    int16x8_t sign = vcombine_s16(vmovn_s32(vshrq_n_s32(uSum, 31)), vmovn_s32(vshrq_n_s32(vSum, 31)));
+    int16x8_t uv = vreinterpretq_s16_u16(DivideBy125_NEON(uvAbs));
+    uv = vaddq_s16(vsubq_s16(veorq_s16(uv, sign), sign), vdupq_n_s16(128));
+    uint16x8_t low = vcombine_u16(vmovn_u32(vcltq_s32(uSum, lowLimit)), vmovn_u32(vcltq_s32(vSum, lowLimit)));
+    uv = vbicq_s16(uv, vreinterpretq_s16_u16(low));
+
+    BYTE result[8];
+    vst1_u8(result, vqmovun_s16(uv));
+    memcpy(u + x/2, result, 4);
+    memcpy(v + x/2, result+4, 4);
+  }
+
+  return x;
+}
+
+
+static unsigned YUV422toYUV420P_NEON(const BYTE * src0, const BYTE * src1,
+                                     BYTE * y0, BYTE * y1, BYTE * u, BYTE * v,
+                                     unsigned width, bool uyvy)
+{
+  unsigned lum0  = uyvy ? 1 : 0;
+  unsigned lum1  = uyvy ? 3 : 2;
+  unsigned cb    = uyvy ? 0 : 1;
+  unsigned cr    = uyvy ? 2 : 3;
+
+  unsigned x;
+  for (x = 0; x + 32 <= width; x += 32) {
+    uint8x16x4_t pixels = vld4q_u8(src0 + x*2);
+    uint8x16x2_t lum;
+    lum.val[0] = pixels.val[lum0];
+    lum.val[1] = pixels.val[lum1];
+    vst2q_u8(y0 + x, lum);
+    vst1q_u8(u + x/2, pixels.val[cb]);
+    vst1q_u8(v + x/2, pixels.val[cr]);
+
+    // Second line discards the chroma
+    pixels = vld4q_u8(src1 + x*2);
+    lum.val[0] = pixels.val[lum0];
+    lum.val[1] = pixels.val[lum1];
+    vst2q_u8(y1 + x, lum);
+  }
+
+  return x;
+}
+
+
+static unsigned SwapRedAndBlue_NEON(const BYTE * src, BYTE * dst, unsigned width, unsigned srcIncrement, unsigned dstIncrement)
+{
+  if (srcIncrement != dstIncrement)
+    return 0;
+
+  unsigned x = 0;
+  if (srcIncrement == 4) {
+    for (; x + 16 <= width; x += 16) {
+      uint8x16x4_t pixels = vld4q_u8(src + x*4);
+      uint8x16_t temp = pixels.val[0];
+      pixels.val[0] = pixels.val[2];
+      pixels.val[2] = temp;
+      pixels.val[3] = vld4q_u8(dst + x*4).val[3]; // Scalar code does not touch fourth byte
+      vst4q_u8(dst + x*4, pixels);
+    }
+  }
+  else if (srcIncrement == 3) {
+    for (; x + 16 <= width; x += 16) {
+      uint8x16x3_t pixels = vld3q_u8(src + x*3);
+      uint8x16_t temp = pixels.val[0];
+      pixels.val[0] = pixels.val[2];
+      pixels.val[2] = temp;
+      vst3q_u8(dst + x*3, pixels);
+    }
+  }
+
+  return x;
+}
+
+#endif // P_VCONVERT_NEON
+
+
+static unsigned YUV420PtoRGB_SIMD(const BYTE * y0, const BYTE * y1, const BYTE * u, const BYTE * v,
+                                  BYTE * rgb0, BYTE * rgb1, unsigned width,
+                                  unsigned rgbIncrement, unsigned redOffset)
+{
+  switch (CurrentAcceleration) {
+#if P_VCONVERT_AVX2
+    case PColourConverter::AVX2Acceleration :
+      return YUV420PtoRGB_AVX2(y0, y1, u, v, rgb0, rgb1, width, rgbIncrement, redOffset);
+#endif
+#if P_VCONVERT_SSE2
+    case PColourConverter::SSE2Acceleration :
+      return YUV420PtoRGB_SSE2(y0, y1, u, v, rgb0, rgb1, width, rgbIncrement, redOffset);
+#endif
+#if P_VCONVERT_NEON
+    case PColourConverter::NEONAcceleration :
+      return YUV420PtoRGB_NEON(y0, y1, u, v, rgb0, rgb1, width, rgbIncrement, redOffset);
+#endif
+    default :
+      return 0;
+  }
+}
+
+
+static unsigned RGBtoYUV420P_SIMD(const BYTE * rgb0, const BYTE * rgb1,
+                                  BYTE * y0, BYTE * y1, BYTE * u, BYTE * v,
+                                  unsigned width, unsigned rgbIncrement, unsigned redOffset)
+{
+  switch (CurrentAcceleration) {
+#if P_VCONVERT_SSE2
+    case PColourConverter::AVX2Acceleration :
+    case PColourConverter::SSE2Acceleration :
+      return RGBtoYUV420P_SSE2(rgb0, rgb1, y0, y1, u, v, width, rgbIncrement, redOffset);
+#endif
+#if P_VCONVERT_NEON
+    case PColourConverter::NEONAcceleration :
+      return RGBtoYUV420P_NEON(rgb0, rgb1, y0, y1, u, v, width, rgbIncrement, redOffset);
+#endif
+    default :
+      return 0;
+  }
+}
+
+
+static unsigned YUV422toYUV420P_SIMD(const BYTE * src0, const BYTE * src1,
+                                     BYTE * y0, BYTE * y1, BYTE * u, BYTE * v,
+                                     unsigned width, bool uyvy)
+{
+  switch (CurrentAcceleration) {
+#if P_VCONVERT_SSE2
+    case PColourConverter::AVX2Acceleration :
+    case PColourConverter::SSE2Acceleration :
+      return YUV422toYUV420P_SSE2(src0, src1, y0, y1, u, v, width, uyvy);
+#endif
+#if P_VCONVERT_NEON
+    case PColourConverter::NEONAcceleration :
+      return YUV422toYUV420P_NEON(src0, src1, y0, y1, u, v, width, uyvy);
+#endif
+    default :
+      return 0;
+  }
+}
+
+
+static unsigned SwapRedAndBlue_SIMD(const BYTE * src, BYTE * dst, unsigned width, unsigned srcIncrement, unsigned dstIncrement)
+{
+  switch (CurrentAcceleration) {
+#if P_VCONVERT_AVX2
+    case PColourConverter::AVX2Acceleration :
+      return SwapRedAndBlue_AVX2(src, dst, width, srcIncrement, dstIncrement);
+#endif
+#if P_VCONVERT_SSE2
+    case PColourConverter::SSE2Acceleration :
+      return SwapRedAndBlue_SSE2(src, dst, width, srcIncrement, dstIncrement);
+#endif
+#if P_VCONVERT_NEON
+    case PColourConverter::NEONAcceleration :
+      return SwapRedAndBlue_NEON(src, dst, width, srcIncrement, dstIncrement);
+#endif
+    default :
+      return 0;
+  }
+}
+
+
 class PRasterDutyCycle
 {
   public:
@@ -759,6 +1593,371 @@ static void CropYUV420P(const BYTE * srcPtr, unsigned srcWidth, unsigned srcHeig
 PRAGMA_OPTIMISE_DEFAULT()
 
 
+// The smooth scaler is a separable filter. Each output row is produced by
+// first scaling the source vertically into a temporary row of 16 bit values,
+// which is then scaled horizontally. When growing each output pixel is the
+// bilinear interpolation of the two nearest source pixels, when shrinking it
+// is the area weighted average of all the source pixels it covers, so no
+// source pixels are simply dropped.
+//
+// The weights for each output pixel sum to 2^14. The vertical pass keeps five
+// bits of fraction, so the horizontal pass shifts down by 19 bits. The SIMD
+// code does identical integer arithmetic, so is bit exact with the scalar.
+
+class PSmoothScaleFilter
+{
+  public:
+    enum {
+      WeightBits = 14,
+      WeightOne = 1 << WeightBits,
+      TempBits = 5,
+      Group = 4 // Output pixels whose weights are interleaved
+    };
+
+    PSmoothScaleFilter(unsigned srcSize, unsigned dstSize);
+
+    // Always an even number of taps
+    unsigned GetTaps() const { return m_taps; }
+
+    // First source pixel used by output pixel
+    unsigned GetStart(unsigned dst) const { return m_start[dst]; }
+
+    // Weights are stored as pairs of taps for Group adjacent output pixels
+    const short * GetWeights(unsigned dst, unsigned tap) const { return &m_weights[WeightIndex(dst, tap)]; }
+    int GetWeight(unsigned dst, unsigned tap) const { return m_weights[WeightIndex(dst, tap)]; }
+
+  protected:
+    unsigned WeightIndex(unsigned dst, unsigned tap) const
+    {
+      return (((dst/Group)*(m_taps/2) + tap/2)*Group + dst%Group)*2 + tap%2;
+    }
+
+    unsigned              m_taps;
+    std::vector<unsigned> m_start;
+    std::vector<short>    m_weights;
+};
+
+
+PSmoothScaleFilter::PSmoothScaleFilter(unsigned srcSize, unsigned dstSize)
+{
+  double scale = (double)srcSize/dstSize;
+
+  /* When shrinking an output pixel covers "scale" source pixels, which may
+     straddle one extra pixel at each end, rounded up to a pair of taps. */
+  m_taps = scale <= 1 ? 2 : (((srcSize + dstSize - 1)/dstSize + 2) & ~1);
+
+  unsigned groups = (dstSize + Group - 1)/Group;
+  m_start.resize(groups*Group, 0);
+  m_weights.resize(groups*Group*m_taps, 0);
+
+  std::vector<int> weights(m_taps);
+  for (unsigned dst = 0; dst < dstSize; ++dst) {
+    std::fill(weights.begin(), weights.end(), 0);
+
+    unsigned first;
+    if (scale <= 1) {
+      double centre = std::max((dst + 0.5)*scale - 0.5, 0.0);
+      first = (unsigned)centre;
+      if (first >= srcSize-1) {
+        first = srcSize-1;
+        weights[0] = WeightOne;
+      }
+      else {
+        weights[1] = (int)((centre - first)*WeightOne + 0.5);
+        weights[0] = WeightOne - weights[1];
+      }
+    }
+    else {
+      double left = dst*scale;
+      double right = left + scale;
+      first = std::min((unsigned)left, srcSize-1);
+
+      int total = 0;
+      unsigned largest = 0;
+      for (unsigned tap = 0; tap < m_taps && first+tap < srcSize; ++tap) {
+        double overlap = std::min(right, first+tap+1.0) - std::max(left, (double)(first+tap));
+        if (overlap <= 0)
+          break;
+        weights[tap] = (int)(overlap/scale*WeightOne + 0.5);
+        total += weights[tap];
+        if (weights[tap] > weights[largest])
+          largest = tap;
+      }
+      weights[largest] += WeightOne - total;
+    }
+
+    // Move taps back so none go past the end of the source
+    unsigned start = srcSize > m_taps ? std::min(first, srcSize - m_taps) : 0;
+    unsigned shift = first - start;
+
+    m_start[dst] = start;
+    for (unsigned tap = 0; tap+shift < m_taps; ++tap)
+      m_weights[WeightIndex(dst, tap+shift)] = (short)weights[tap];
+  }
+}
+
+
+static void SmoothScaleVertical(const BYTE * const * rows, const int * weights, unsigned taps,
+                                unsigned width, short * temp)
+{
+  static const int Shift = PSmoothScaleFilter::WeightBits - PSmoothScaleFilter::TempBits;
+  static const int Round = 1 << (Shift - 1);
+  unsigned x = 0;
+
+#if P_VCONVERT_SSE2
+  if (CurrentAcceleration != PColourConverter::NoAcceleration) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(Round);
+    for (; x+8 <= width; x += 8) {
+      __m128i lo = round, hi = round;
+      for (unsigned tap = 0; tap < taps; tap += 2) {
+        __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[tap]+x)), zero);
+        __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[tap+1]+x)), zero);
+        __m128i w = _mm_set1_epi32((weights[tap+1] << 16) | (weights[tap] & 0xffff));
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+      }
+      _mm_storeu_si128((__m128i *)(temp+x), _mm_packs_epi32(_mm_srai_epi32(lo, Shift), _mm_srai_epi32(hi, Shift)));
+    }
+  }
+#endif
+
+  for (; x < width; ++x) {
+    int sum = Round;
+    for (unsigned tap = 0; tap < taps; ++tap)
+      sum += weights[tap]*rows[tap][x];
+    temp[x] = (short)(sum >> Shift);
+  }
+}
+
+
+static void SmoothScaleHorizontal(const PSmoothScaleFilter & filter, const short * temp, unsigned width, BYTE * dst)
+{
+  static const int Shift = PSmoothScaleFilter::WeightBits + PSmoothScaleFilter::TempBits;
+  static const int Round = 1 << (Shift - 1);
+  unsigned taps = filter.GetTaps();
+  unsigned x = 0;
+
+#if P_VCONVERT_SSE2
+  if (CurrentAcceleration != PColourConverter::NoAcceleration) {
+    const __m128i round = _mm_set1_epi32(Round);
+    for (; x+PSmoothScaleFilter::Group <= width; x += PSmoothScaleFilter::Group) {
+      const BYTE * t0 = (const BYTE *)(temp + filter.GetStart(x));
+      const BYTE * t1 = (const BYTE *)(temp + filter.GetStart(x+1));
+      const BYTE * t2 = (const BYTE *)(temp + filter.GetStart(x+2));
+      const BYTE * t3 = (const BYTE *)(temp + filter.GetStart(x+3));
+      __m128i sum = round;
+      for (unsigned tap = 0; tap < taps; tap += 2) {
+        unsigned offset = tap*sizeof(short);
+        __m128i t = _mm_setr_epi32(LoadUInt32(t0+offset), LoadUInt32(t1+offset), LoadUInt32(t2+offset), LoadUInt32(t3+offset));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(t, _mm_loadu_si128((const __m128i *)filter.GetWeights(x, tap))));
+      }
+      sum = _mm_packs_epi32(_mm_srai_epi32(sum, Shift), sum);
+      StoreUInt32(dst+x, _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+    }
+  }
+#endif
+
+  for (; x < width; ++x) {
+    const short * src = temp + filter.GetStart(x);
+    int sum = Round;
+    for (unsigned tap = 0; tap < taps; ++tap)
+      sum += filter.GetWeight(x, tap)*src[tap];
+    sum >>= Shift;
+    dst[x] = (BYTE)(sum < 0 ? 0 : sum > 255 ? 255 : sum);
+  }
+}
+
+
+static void SmoothScaleRows(const PSmoothScaleFilter & horizontal, const PSmoothScaleFilter & vertical,
+                            const BYTE * srcPtr, unsigned srcWidth, unsigned srcHeight, unsigned srcLineSpan,
+                            BYTE * dstPtr, unsigned dstWidth, int dstLineSpan,
+                            unsigned firstRow, unsigned lastRow)
+{
+  unsigned taps = vertical.GetTaps();
+  std::vector<const BYTE *> rows(taps);
+  std::vector<int> weights(taps);
+
+  // Padding at end has zero weight, but may still be read
+  std::vector<short> temp(srcWidth + horizontal.GetTaps());
+
+  for (unsigned y = firstRow; y < lastRow; ++y) {
+    unsigned start = vertical.GetStart(y);
+    for (unsigned tap = 0; tap < taps; ++tap) {
+      rows[tap] = srcPtr + std::min(start+tap, srcHeight-1)*srcLineSpan;
+      weights[tap] = vertical.GetWeight(y, tap);
+    }
+    SmoothScaleVertical(&rows[0], &weights[0], taps, srcWidth, &temp[0]);
+    SmoothScaleHorizontal(horizontal, &temp[0], dstWidth, dstPtr + (ptrdiff_t)y*dstLineSpan);
+  }
+}
+
+
+/* Unit of work for the converters that split a frame across several threads.
+   The Work() function is executed in a pool thread, and then m_done signalled. */
+struct PColourConverterWork
+{
+  PColourConverterWork(PSemaphore & done)
+    : m_done(done)
+  { }
+
+  virtual ~PColourConverterWork()
+  { }
+
+  virtual void Execute() = 0;
+
+  void Work()
+  {
+    Execute();
+    m_done.Signal();
+  }
+
+  PSemaphore & m_done;
+};
+
+
+class PColourConverterPool : public PProcessStartup
+{
+    PCLASSINFO(PColourConverterPool, PProcessStartup)
+  public:
+    PColourConverterPool()
+      : m_pool(NULL)
+      , m_shutdown(false)
+    { }
+
+    ~PColourConverterPool()
+    {
+      delete m_pool;
+    }
+
+    PFACTORY_GET_SINGLETON(PProcessStartupFactory, PColourConverterPool);
+
+    virtual void OnShutdown()
+    {
+      PWaitAndSignal lock(m_mutex);
+      delete m_pool;
+      m_pool = NULL;
+      m_shutdown = true;
+    }
+
+    /* Queue work for a pool thread, if the pool is no longer available, e.g.
+       during shut down, then the work is executed in the calling thread. */
+    void AddWork(PColourConverterWork * work, unsigned workers)
+    {
+      {
+        PWaitAndSignal lock(m_mutex);
+        if (!m_shutdown) {
+          if (m_pool == NULL)
+            m_pool = new PQueuedThreadPool<PColourConverterWork>(workers, 0, "Converter");
+          else if (m_pool->GetMaxWorkers() < workers)
+            m_pool->SetMaxWorkers(workers);
+
+          if (m_pool->AddWork(work))
+            return;
+        }
+      }
+
+      work->Work();
+      delete work;
+    }
+
+  protected:
+    PDECLARE_MUTEX(m_mutex);
+    PQueuedThreadPool<PColourConverterWork> * m_pool;
+    bool m_shutdown;
+};
+
+PFACTORY_CREATE_SINGLETON(PProcessStartupFactory, PColourConverterPool);
+
+
+struct PSmoothScaleSlice : PColourConverterWork
+{
+  PSmoothScaleSlice(const PSmoothScaleFilter & horizontal, const PSmoothScaleFilter & vertical,
+                    const BYTE * srcPtr, unsigned srcWidth, unsigned srcHeight, unsigned srcLineSpan,
+                    BYTE * dstPtr, unsigned dstWidth, int dstLineSpan,
+                    unsigned firstRow, unsigned lastRow, PSemaphore & done)
+    : PColourConverterWork(done)
+    , m_horizontal(horizontal)
+    , m_vertical(vertical)
+    , m_srcPtr(srcPtr)
+    , m_srcWidth(srcWidth)
+    , m_srcHeight(srcHeight)
+    , m_srcLineSpan(srcLineSpan)
+    , m_dstPtr(dstPtr)
+    , m_dstWidth(dstWidth)
+    , m_dstLineSpan(dstLineSpan)
+    , m_firstRow(firstRow)
+    , m_lastRow(lastRow)
+  { }
+
+  virtual void Execute()
+  {
+    SmoothScaleRows(m_horizontal, m_vertical, m_srcPtr, m_srcWidth, m_srcHeight, m_srcLineSpan,
+                    m_dstPtr, m_dstWidth, m_dstLineSpan, m_firstRow, m_lastRow);
+  }
+
+  const PSmoothScaleFilter & m_horizontal;
+  const PSmoothScaleFilter & m_vertical;
+  const BYTE * m_srcPtr;
+  unsigned     m_srcWidth;
+  unsigned     m_srcHeight;
+  unsigned     m_srcLineSpan;
+  BYTE       * m_dstPtr;
+  unsigned     m_dstWidth;
+  int          m_dstLineSpan;
+  unsigned     m_firstRow;
+  unsigned     m_lastRow;
+};
+
+
+static atomic<unsigned> ScalerThreads(1);
+static const unsigned MinimumRowsPerSlice = 64;
+
+
+void PColourConverter::SetScalerThreads(unsigned threads)
+{
+  ScalerThreads = std::max(threads, 1U);
+  PTRACE(4, NULL, PTraceModule(), "Smooth scaler threads set to " << threads);
+}
+
+
+unsigned PColourConverter::GetScalerThreads()
+{
+  return ScalerThreads;
+}
+
+
+static void SmoothScaleYUV420P(const BYTE * srcPtr, unsigned srcWidth, unsigned srcHeight, unsigned srcLineSpan,
+                                     BYTE * dstPtr, unsigned dstWidth, unsigned dstHeight, int      dstLineSpan)
+{
+  PSmoothScaleFilter horizontal(srcWidth, dstWidth);
+  PSmoothScaleFilter vertical(srcHeight, dstHeight);
+
+  unsigned slices = std::min((unsigned)ScalerThreads, dstHeight/MinimumRowsPerSlice);
+  if (slices <= 1) {
+    SmoothScaleRows(horizontal, vertical, srcPtr, srcWidth, srcHeight, srcLineSpan,
+                    dstPtr, dstWidth, dstLineSpan, 0, dstHeight);
+    return;
+  }
+
+  // Other threads do all but the first slice, which is done by this thread
+  PSemaphore done(0, slices);
+  for (unsigned slice = 1; slice < slices; ++slice) {
+    PColourConverterPool::GetInstance().AddWork(new PSmoothScaleSlice(horizontal, vertical,
+                                                                      srcPtr, srcWidth, srcHeight, srcLineSpan,
+                                                                      dstPtr, dstWidth, dstLineSpan,
+                                                                      dstHeight*slice/slices, dstHeight*(slice+1)/slices,
+                                                                      done), slices-1);
+  }
+
+  SmoothScaleRows(horizontal, vertical, srcPtr, srcWidth, srcHeight, srcLineSpan,
+                  dstPtr, dstWidth, dstLineSpan, 0, dstHeight/slices);
+
+  for (unsigned slice = 1; slice < slices; ++slice)
+    done.Wait();
+}
+
+
 static bool ValidateDimensions(unsigned srcFrameWidth, unsigned srcFrameHeight,
                                unsigned dstFrameWidth, unsigned dstFrameHeight,
                                PVideoFrameInfo::ResizeMode resizeMode,
@@ -801,7 +2000,9 @@ bool PColourConverter::CopyYUV420P(unsigned srcX, unsigned srcY, unsigned srcWid
     return true;
   }
 
-  if (resizeMode == PVideoFrameInfo::eScaleKeepAspect) {
+  if (resizeMode == PVideoFrameInfo::eScaleKeepAspect || resizeMode == PVideoFrameInfo::eScaleSmoothKeepAspect) {
+    PVideoFrameInfo::ResizeMode scaleMode = resizeMode == PVideoFrameInfo::eScaleKeepAspect
+                                                  ? PVideoFrameInfo::eScale : PVideoFrameInfo::eScaleSmooth;
 	unsigned srcWidthByDstHeight = srcWidth * dstHeight;
 	unsigned dstWidthBySrcHeight = dstWidth * srcHeight;
     if (srcWidthByDstHeight < dstWidthBySrcHeight) {
@@ -811,7 +2012,7 @@ bool PColourConverter::CopyYUV420P(unsigned srcX, unsigned srcY, unsigned srcWid
       FillYUV420P(dstX+dstWidth-ouputX, dstY, ouputX, dstHeight, dstFrameWidth, dstFrameHeight, dstYUV, 0, 0, 0);
       return CopyYUV420P(srcX, srcY, srcWidth, srcHeight, srcFrameWidth, srcFrameHeight, srcYUV,
                          dstX+ouputX, dstY, outputWidth, dstHeight, dstFrameWidth, dstFrameHeight, dstYUV,
-                         PVideoFrameInfo::eScale, verticalFlip, error);
+                         scaleMode, verticalFlip, error);
     }
     else if (srcWidthByDstHeight > dstWidthBySrcHeight) {
       unsigned outputHeight = (dstWidthBySrcHeight/srcWidth)&~1;
@@ -820,7 +2021,7 @@ bool PColourConverter::CopyYUV420P(unsigned srcX, unsigned srcY, unsigned srcWid
       FillYUV420P(dstX, dstY+dstHeight-outputY, dstWidth, outputY, dstFrameWidth, dstFrameHeight, dstYUV, 0, 0, 0);
       return CopyYUV420P(srcX, srcY, srcWidth, srcHeight, srcFrameWidth, srcFrameHeight, srcYUV,
                          dstX, dstY+outputY, dstWidth, outputHeight, dstFrameWidth, dstFrameHeight, dstYUV,
-                         PVideoFrameInfo::eScale, verticalFlip, error);
+                         scaleMode, verticalFlip, error);
     }
   }
 
@@ -868,9 +2069,12 @@ bool PColourConverter::CopyYUV420P(unsigned srcX, unsigned srcY, unsigned srcWid
 
 #if P_FFMPEG_SWSCALE
 
-  struct SwsContext * context = sws_getContext(srcWidth, srcHeight, AV_PIX_FMT_YUV420P,
-                                               dstWidth, dstHeight, AV_PIX_FMT_YUV420P,
-                                               SWS_BILINEAR, NULL, NULL, NULL);
+  // Smooth modes always use our own scaler, so results do not vary by platform
+  struct SwsContext * context = NULL;
+  if (resizeMode != PVideoFrameInfo::eScaleSmooth && resizeMode != PVideoFrameInfo::eScaleSmoothKeepAspect)
+    context = sws_getContext(srcWidth, srcHeight, AV_PIX_FMT_YUV420P,
+                             dstWidth, dstHeight, AV_PIX_FMT_YUV420P,
+                             SWS_BILINEAR, NULL, NULL, NULL);
   if (context != NULL) {
     const uint8_t* srcSlice[] = {
         ffmpeg_yuvptr(srcYUV, srcFrameWidth, srcFrameHeight, srcX, srcY, 0),
@@ -906,6 +2110,12 @@ bool PColourConverter::CopyYUV420P(unsigned srcX, unsigned srcY, unsigned srcWid
                      BYTE * dstPtr, unsigned dstWidth, unsigned dstHeight, int dstFrameWidth) = CropYUV420P;
 
   switch (resizeMode) {
+    case PVideoFrameInfo::eScaleSmooth :
+    case PVideoFrameInfo::eScaleSmoothKeepAspect :
+      if (srcWidth != dstWidth || srcHeight != dstHeight)
+        rowFunction = SmoothScaleYUV420P;
+      break;
+
     default : // Scaling options
       if (srcWidth > dstWidth)
         rowFunction = ShrinkBothYUV420P;
@@ -1288,7 +2498,7 @@ bool PStandardColourConverter::RGBtoYUV420P(const BYTE * srcFrameBuffer,
 
 #if P_FFMPEG_SWSCALE
 
-  if (CanUseFFMPEG(AV_PIX_FMT_NONE, AV_PIX_FMT_YUV420P, rgbIncrement, redOffset)) {
+  if (CanUseFFMPEGForRGB(AV_PIX_FMT_NONE, AV_PIX_FMT_YUV420P, rgbIncrement, redOffset)) {
     const uint8_t* srcSlice[] = { scanLinePtrRGB };
     const int srcStride[] = { scanLineSizeRGB };
 
@@ -1304,11 +2514,16 @@ bool PStandardColourConverter::RGBtoYUV420P(const BYTE * srcFrameBuffer,
   if (m_srcFrameWidth == scanLineSizeY && m_srcFrameHeight == planeHeight) {
     int RGBOffset[4] = { 0, (int)rgbIncrement, scanLineSizeRGB, scanLineSizeRGB+(int)rgbIncrement };
     unsigned YUVOffset[4] = { 0, 1, scanLineSizeY, scanLineSizeY + 1 };
-    scanLineSizeRGB *= 2;
-    rgbIncrement *= 2;
     for (unsigned y = 0; y < m_srcFrameHeight; y += 2) {
       const BYTE * pixelPtrRGB = scanLinePtrRGB;
-      for (unsigned x = 0; x < m_srcFrameWidth; x += 2) {
+      unsigned x = RGBtoYUV420P_SIMD(pixelPtrRGB, pixelPtrRGB + RGBOffset[2],
+                                     scanLinePtrY, scanLinePtrY + YUVOffset[2], scanLinePtrU, scanLinePtrV,
+                                     m_srcFrameWidth, rgbIncrement, redOffset);
+      pixelPtrRGB += rgbIncrement*x;
+      scanLinePtrY += x;
+      scanLinePtrU += x/2;
+      scanLinePtrV += x/2;
+      for (; x < m_srcFrameWidth; x += 2) {
         unsigned rSum = 0, gSum = 0, bSum = 0;
         for (unsigned p = 0; p < 4; ++p) {
           unsigned r = pixelPtrRGB[RGBOffset[p] +  redOffset];
@@ -1324,11 +2539,11 @@ bool PStandardColourConverter::RGBtoYUV420P(const BYTE * srcFrameBuffer,
         bSum /= 4;
         *scanLinePtrU++ = RGBtoU(rSum, gSum, bSum);
         *scanLinePtrV++ = RGBtoV(rSum, gSum, bSum);
-        pixelPtrRGB += rgbIncrement;
+        pixelPtrRGB += rgbIncrement*2;
         scanLinePtrY += 2;
       }
       scanLinePtrY += m_srcFrameWidth;
-      scanLinePtrRGB += scanLineSizeRGB;
+      scanLinePtrRGB += scanLineSizeRGB*2;
     }
   }
   else {
@@ -1450,15 +2665,26 @@ void  PStandardColourConverter::YUY2toYUV420PSameSize(const BYTE *yuy2, BYTE *yu
 
   for (h=0; h<m_srcFrameHeight; h+=2) {
 
+     unsigned simd = YUV422toYUV420P_SIMD(s, s + m_srcFrameWidth*2, y, y + m_srcFrameWidth, u, v,
+                                          m_srcFrameWidth, false);
+     s += simd*2;
+     y += simd;
+     u += simd/2;
+     v += simd/2;
+
      /* Copy the first line keeping all information */
-     for (x=0; x<m_srcFrameWidth; x+=2) {
+     for (x=simd; x<m_srcFrameWidth; x+=2) {
         *y++ = *s++;
         *u++ = *s++;
         *y++ = *s++;
         *v++ = *s++;
      }
+
+     s += simd*2;
+     y += simd;
+
      /* Copy the second line discarding u and v information */
-     for (x=0; x<m_srcFrameWidth; x+=2) {
+     for (x=simd; x<m_srcFrameWidth; x+=2) {
         *y++ = *s++;
         s++;
         *y++ = *s++;
@@ -1967,20 +3193,6 @@ bool PStandardColourConverter::SBGGR8toRGB(const BYTE * src,
 }
 
 
-typedef int FixedPoint; // Best to be native integer size
-#define ScaleBitShift 12
-static FixedPoint const HalfFixedScaling = 1 << (ScaleBitShift - 1);
-
-#define ROUND(x) ((x) + HalfFixedScaling)
-#define CLAMP(x) (BYTE)(((x) < 0 ? 0 : ((x) >= (255<<ScaleBitShift) ? 255 : ((x)>>ScaleBitShift))))
-
-#define FIX_FROM_FLOAT(x)    ((int) ((x) * (1UL<<ScaleBitShift) + 0.5))
-static FixedPoint const YUVtoR_Coeff  =  FIX_FROM_FLOAT(1.40200);
-static FixedPoint const YUVtoG_Coeff1 = -FIX_FROM_FLOAT(0.34414);
-static FixedPoint const YUVtoG_Coeff2 =  FIX_FROM_FLOAT(0.71414);
-static FixedPoint const YUVtoB_Coeff  =  FIX_FROM_FLOAT(1.77200);
-#undef FIX_FROM_FLOAT
-
 /* 
  * Please note when converting colorspace from YUV to RGB.
  * Not all YUV have the same colorspace. 
@@ -2075,7 +3287,9 @@ bool PStandardColourConverter::YUV420PtoRGB(const BYTE * srcFrameBuffer,
 
 #if P_FFMPEG_SWSCALE
 
-  if (CanUseFFMPEG(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE, rgbIncrement, redOffset)) {
+  // Our own SIMD code is faster than swscale for same size, and bit-exact with the scalar code
+  bool ownSIMD = CurrentAcceleration != NoAcceleration && m_srcFrameWidth == m_dstFrameWidth && m_srcFrameHeight == m_dstFrameHeight;
+  if (!ownSIMD && CanUseFFMPEGForRGB(AV_PIX_FMT_YUV420P, AV_PIX_FMT_NONE, rgbIncrement, redOffset)) {
     const uint8_t* srcSlice[] = { scanLinePtrY, scanLinePtrU, scanLinePtrV };
     const int srcStride[] = { (int)planeWidth, (int)planeWidth/2, (int)planeWidth/2 };
 
@@ -2092,9 +3306,9 @@ bool PStandardColourConverter::YUV420PtoRGB(const BYTE * srcFrameBuffer,
   unsigned dstPixpos[4];
 
   if (m_verticalFlip) {
-    scanLinePtrRGB -= scanLineSizeRGB; // We do two scan lines at a time
-    dstPixpos[0] = (unsigned)scanLineSizeRGB;
-    dstPixpos[1] =  (unsigned)scanLineSizeRGB+rgbIncrement;
+    scanLinePtrRGB += scanLineSizeRGB; // We do two scan lines at a time
+    dstPixpos[0] = (unsigned)-scanLineSizeRGB;
+    dstPixpos[1] = (unsigned)-scanLineSizeRGB+rgbIncrement;
     dstPixpos[2] = 0;
     dstPixpos[3] = rgbIncrement;
   }
@@ -2127,7 +3341,14 @@ bool PStandardColourConverter::YUV420PtoRGB(const BYTE * srcFrameBuffer,
   if (m_srcFrameWidth == m_dstFrameWidth && m_srcFrameHeight == m_dstFrameHeight) {
     for (unsigned y = 0; y < m_srcFrameHeight; y += 2) {
       BYTE * pixelRGB = scanLinePtrRGB;
-      for (unsigned x = 0; x < m_srcFrameWidth; x += 2) {
+      unsigned x = YUV420PtoRGB_SIMD(scanLinePtrY, scanLinePtrY + srcPixpos[2], scanLinePtrU, scanLinePtrV,
+                                     pixelRGB + dstPixpos[0], pixelRGB + dstPixpos[2],
+                                     m_srcFrameWidth, rgbIncrement, redOffset);
+      pixelRGB += rgbIncrement*x;
+      scanLinePtrY += x;
+      scanLinePtrU += x/2;
+      scanLinePtrV += x/2;
+      for (; x < m_srcFrameWidth; x += 2) {
         unsigned pixels = x < m_srcFrameWidth-1 ? 4 : 2;
         YUV420PtoRGB_PIXEL_UV(scanLinePtrU, scanLinePtrV);
         for (unsigned p = 0; p < pixels; p++) {
@@ -2355,7 +3576,11 @@ static void SwapRedAndBlueRow(const BYTE * srcRowPtr,
                               unsigned srcIncrement,
                               unsigned dstIncrement)
 {
-  for (unsigned x = 0; x < width; x++) {
+  unsigned x = SwapRedAndBlue_SIMD(srcRowPtr, dstRowPtr, width, srcIncrement, dstIncrement);
+  srcRowPtr += srcIncrement*x;
+  dstRowPtr += dstIncrement*x;
+
+  for (; x < width; x++) {
     BYTE temp = srcRowPtr[0]; // Do it this way in case src and dst are same buffer
     dstRowPtr[0] = srcRowPtr[2];
     dstRowPtr[1] = srcRowPtr[1];
@@ -2851,15 +4076,26 @@ void  PStandardColourConverter::UYVY422toYUV420PSameSize(const BYTE *uyvy, BYTE
 
   for (h=0; h<m_srcFrameHeight; h+=2) {
 
+     unsigned simd = YUV422toYUV420P_SIMD(s, s + m_srcFrameWidth*2, y, y + m_srcFrameWidth, u, v,
+                                          m_srcFrameWidth, true);
+     s += simd*2;
+     y += simd;
+     u += simd/2;
+     v += simd/2;
+
      /* Copy the first line keeping all information */
-     for (x=0; x<m_srcFrameWidth; x+=2) {
+     for (x=simd; x<m_srcFrameWidth; x+=2) {
         *u++ = *s++;
         *y++ = *s++;
         *v++ = *s++;
         *y++ = *s++;
      }
+
+     s += simd*2;
+     y += simd;
+
      /* Copy the second line discarding u and v information */
-     for (x=0; x<m_srcFrameWidth; x+=2) {
+     for (x=simd; x<m_srcFrameWidth; x+=2) {
         s++;
         *y++ = *s++;
         s++;
@@ -3101,6 +4337,9 @@ PRAGMA_OPTIMISE_DEFAULT()
 
 #if P_JPEG_DECODER
 
+static atomic<unsigned> DecoderThreads(1);
+
+
 struct PJPEGConverter::Context
 {
 #if P_TINY_JPEG
@@ -3128,8 +4367,12 @@ struct PJPEGConverter::Context
 
   ~Context()
   {
-    if (m_decoder != NULL)
-      free(m_decoder);
+    if (m_decoder != NULL) {
+      // Components are always our buffers, so do not let tinyjpeg free them
+      unsigned char * none[3] = { NULL, NULL, NULL };
+      tinyjpeg_set_components(m_decoder, none, 3);
+      tinyjpeg_free(m_decoder);
+    }
     PTRACE(4, NULL, "JPEG", "TinyJpeg decoder destroyed");
   }
 
@@ -3164,8 +4407,10 @@ struct PJPEGConverter::Context
     }
  
     tinyjpeg_set_components(m_decoder, components, componentCount);
+    tinyjpeg_set_flags(m_decoder, TINYJPEG_FLAGS_MJPEG_TABLE |
+                       (PColourConverter::GetAcceleration() == PColourConverter::NoAcceleration ? TINYJPEG_FLAGS_NO_SIMD : 0));
 
-    if (tinyjpeg_decode(m_decoder, m_colourSpace) >= 0)
+    if ((DecoderThreads > 1 ? DecodeSegments() : tinyjpeg_decode(m_decoder, m_colourSpace)) >= 0)
       return true;
 
     PTRACE(2, NULL, "JPEG", "Decode error: " << tinyjpeg_get_errorstring(m_decoder));
@@ -3173,6 +4418,60 @@ struct PJPEGConverter::Context
   }
 
 
+  struct Segments : PColourConverterWork
+  {
+    Segments(jdec_private * decoder, int colourSpace, unsigned first, unsigned count, atomic<bool> & failed, PSemaphore & done)
+      : PColourConverterWork(done)
+      , m_decoder(decoder)
+      , m_colourSpace(colourSpace)
+      , m_first(first)
+      , m_count(count)
+      , m_failed(failed)
+    { }
+
+    virtual void Execute()
+    {
+      if (tinyjpeg_decode_segments(m_decoder, m_colourSpace, m_first, m_count) < 0)
+        m_failed = true;
+    }
+
+    jdec_private * m_decoder;
+    int            m_colourSpace;
+    unsigned       m_first;
+    unsigned       m_count;
+    atomic<bool> & m_failed;
+  };
+
+
+  int DecodeSegments()
+  {
+    int segments = tinyjpeg_get_segments(m_decoder);
+    if (segments <= 1)
+      return tinyjpeg_decode(m_decoder, m_colourSpace);
+
+    unsigned slices = std::min((unsigned)DecoderThreads, (unsigned)segments);
+
+    // Other threads do all but the first slice, which is done by this thread
+    atomic<bool> failed(false);
+    PSemaphore done(0, slices);
+    for (unsigned slice = 1; slice < slices; ++slice) {
+      unsigned first = segments*slice/slices;
+      PColourConverterPool::GetInstance().AddWork(new Segments(m_decoder, m_colourSpace,
+                                                               first, segments*(slice+1)/slices - first,
+                                                               failed, done), slices-1);
+    }
+
+    if (tinyjpeg_decode_segments(m_decoder, m_colourSpace, 0, segments/slices) < 0)
+      failed = true;
+
+    for (unsigned slice = 1; slice < slices; ++slice)
+      done.Wait();
+
+    // Slices do not report errors, so decode again to get the error string
+    return failed ? tinyjpeg_decode(m_decoder, m_colourSpace) : 0;
+  }
+
+
 #elif P_LIBJPEG
 
   typedef J_COLOR_SPACE ColourSpace;
@@ -3188,9 +4487,11 @@ struct PJPEGConverter::Context
   jpeg_error_mgr         m_error_mgr;
   jpeg_decompress_struct m_decoder;
   PBYTEArray             m_scan_line;
+  bool                   m_rawData;
 
 
   Context()
+    : m_rawData(false)
   {
     m_decoder.err = jpeg_std_error(&m_error_mgr);
     jpeg_create_decompress(&m_decoder);
@@ -3235,11 +4536,25 @@ struct PJPEGConverter::Context
     if (jpeg_read_header(&m_decoder, TRUE) == JPEG_HEADER_OK) {
       m_decoder.out_color_space = m_colourSpace;
       m_decoder.dct_method = JDCT_IFAST;
+
+      /* For the usual 4:2:0 MJPEG from cameras, read the planes directly
+         rather than upsample the chroma to interleaved YCbCr and back. */
+      m_rawData = m_colourSpace == JCS_YCbCr &&
+                  m_decoder.jpeg_color_space == JCS_YCbCr &&
+                  m_decoder.num_components == 3 &&
+                  m_decoder.comp_info[0].h_samp_factor == 2 &&
+                  m_decoder.comp_info[0].v_samp_factor == 2 &&
+                  m_decoder.comp_info[1].h_samp_factor == 1 &&
+                  m_decoder.comp_info[1].v_samp_factor == 1 &&
+                  m_decoder.comp_info[2].h_samp_factor == 1 &&
+                  m_decoder.comp_info[2].v_samp_factor == 1 &&
+                  (m_decoder.image_width % 16) == 0 &&
+                  (m_decoder.image_height % 2) == 0;
+      m_decoder.raw_data_out = m_rawData;
+
       if (jpeg_start_decompress(&m_decoder)) {
-        if (width > m_decoder.output_width)
-          width = m_decoder.output_width;
-        if (height > m_decoder.output_height)
-          height = m_decoder.output_height;
+        width = m_decoder.output_width;
+        height = m_decoder.output_height;
         return true;
       }
     }
@@ -3249,8 +4564,40 @@ struct PJPEGConverter::Context
   }
 
 
+  bool FinishRaw(BYTE * dstFrameBuffer, unsigned width, unsigned height)
+  {
+    // Rows past the bottom of the image, in the last MCU, go to a scratch line
+    BYTE * scratch = m_scan_line.GetPointer(width);
+    BYTE * planes[3] = { dstFrameBuffer, dstFrameBuffer + width*height, dstFrameBuffer + width*height*5/4 };
+    JSAMPROW rows[3][2*DCTSIZE];
+    JSAMPARRAY data[3] = { rows[0], rows[1], rows[2] };
+
+    while (m_decoder.output_scanline < m_decoder.output_height) {
+      unsigned line = m_decoder.output_scanline;
+      for (unsigned i = 0; i < 2*DCTSIZE; ++i)
+        rows[0][i] = line+i < height ? planes[0] + (line+i)*width : scratch;
+      for (unsigned i = 0; i < DCTSIZE; ++i) {
+        unsigned chromaLine = line/2+i;
+        rows[1][i] = chromaLine < height/2 ? planes[1] + chromaLine*width/2 : scratch;
+        rows[2][i] = chromaLine < height/2 ? planes[2] + chromaLine*width/2 : scratch;
+      }
+
+      if (jpeg_read_raw_data(&m_decoder, data, 2*DCTSIZE) == 0) {
+        Error();
+        return false;
+      }
+    }
+
+    jpeg_finish_decompress(&m_decoder);
+    return true;
+  }
+
+
   bool Finish(BYTE * dstFrameBuffer, unsigned width, unsigned height)
   {
+    if (m_rawData)
+      return FinishRaw(dstFrameBuffer, width, height);
+
     JSAMPROW row, y, u, v;
     row = y = u = v = dstFrameBuffer;
 
@@ -3284,10 +4631,11 @@ struct PJPEGConverter::Context
           break;
 
         case JCS_YCbCr :
-          if (m_decoder.output_scanline < height) {
+          // Note output_scanline has already been incremented past this row
+          if (m_decoder.output_scanline <= height) {
             for (JDIMENSION x = 0; x < width; ++x) {
               *y++ = row[0];
-              if (((m_decoder.output_scanline|x) & 1) == 0) {
+              if ((((m_decoder.output_scanline-1)|x) & 1) == 0) {
                 *u++ = row[1];
                 *v++ = row[2];
               }
@@ -3510,6 +4858,19 @@ PBoolean PJPEGConverter::Convert(const BYTE * srcFrameBuffer, BYTE * dstFrameBuf
 }
 
 
+void PJPEGConverter::SetDecoderThreads(unsigned threads)
+{
+  DecoderThreads = std::max(threads, 1U);
+  PTRACE(4, NULL, "JPEG", "Decoder threads set to " << threads);
+}
+
+
+unsigned PJPEGConverter::GetDecoderThreads()
+{
+  return DecoderThreads;
+}
+
+
 bool PJPEGConverter::Load(const PFilePath & filename, PBYTEArray & dstFrameBuffer)
 {
   PFile file;
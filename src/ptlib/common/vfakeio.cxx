@@ -1664,31 +1664,35 @@ bool PVideoInputDevice_FakeVideo::InternalGetFrameData(BYTE * destFrame, PINDEX
 
   m_grabCount++;
 
+  // Draw into our own frame store if converting, so the converter outputs
+  // directly into the caller's buffer, avoiding an intermediate copy.
+  BYTE * frame = m_converter != NULL ? m_frameStore.GetPointer(m_videoFrameSize) : destFrame;
+
   // Make sure are NUM_PATTERNS cases here.
   switch(m_channelNumber){       
      case eMovingBlocks : 
-       GrabMovingBlocksTestFrame(destFrame);
+       GrabMovingBlocksTestFrame(frame);
        break;
      case eMovingLine : 
-       GrabMovingLineTestFrame(destFrame);
+       GrabMovingLineTestFrame(frame);
        break;
      case eBouncingBoxes :
-       GrabBouncingBoxes(destFrame);
+       GrabBouncingBoxes(frame);
        break;
      case eSolidColour :
-       GrabSolidColour(destFrame);
+       GrabSolidColour(frame);
        break;
      case eOriginalMovingBlocks :
-       GrabOriginalMovingBlocksFrame(destFrame);
+       GrabOriginalMovingBlocksFrame(frame);
        break;
      case eText :
-       GrabTextVideoFrame(destFrame);
+       GrabTextVideoFrame(frame);
        break;
      case eNTSCTest :
-       GrabNTSCTestFrame(destFrame);
+       GrabNTSCTestFrame(frame);
        break;
      case eBlack :
-       FillRect(destFrame, 0, 0, m_frameWidth, m_frameHeight, 0, 0, 0);
+       FillRect(frame, 0, 0, m_frameWidth, m_frameHeight, 0, 0, 0);
        break;
      default :
        PAssertAlways(PLogicError);
@@ -1698,7 +1702,7 @@ bool PVideoInputDevice_FakeVideo::InternalGetFrameData(BYTE * destFrame, PINDEX
   if (m_converter == NULL)
     bytesReturned = m_videoFrameSize;
   else {
-    if (!m_converter->ConvertInPlace(destFrame, &bytesReturned))
+    if (!m_converter->Convert(frame, destFrame, &bytesReturned))
       return false;
   }
 
@@ -143,6 +143,10 @@ ostream & operator<<(ostream & strm, PVideoFrameInfo::ResizeMode mode)
       return strm << "Cropped";
     case PVideoFrameInfo::eScaleKeepAspect :
       return strm << "Aspect";
+    case PVideoFrameInfo::eScaleSmooth :
+      return strm << "Smooth";
+    case PVideoFrameInfo::eScaleSmoothKeepAspect :
+      return strm << "SmoothAspect";
     default :
       return strm << "ResizeMode<" << (int)mode << '>';
   }
@@ -371,6 +375,10 @@ bool PVideoFrameInfo::Parse(const PString & str)
       { "scalekeepaspect", eScaleKeepAspect },
       { "keepaspect", eScaleKeepAspect },
       { "aspect",  eScaleKeepAspect },
+      { "smooth",  eScaleSmooth },
+      { "bilinear",eScaleSmooth },
+      { "smoothaspect", eScaleSmoothKeepAspect },
+      { "smoothkeepaspect", eScaleSmoothKeepAspect },
     };
 
     PCaselessString crop = str.Mid(resizeOffset+1);
@@ -476,6 +484,391 @@ PStringArray PVideoFrameInfo::GetSizeNames()
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// PVideoFrame
+
+struct PVideoFrame::Buffer
+{
+  Buffer(PVideoFramePool::Shared & pool, PINDEX capacity)
+    : m_references(1)
+    , m_pool(pool)
+    , m_capacity(capacity)
+    , m_data((BYTE *)malloc(capacity))
+  { }
+
+  ~Buffer()
+  {
+    free(m_data);
+  }
+
+  atomic<unsigned>          m_references;
+  PVideoFramePool::Shared & m_pool;
+  PINDEX                    m_capacity;
+  BYTE                    * m_data;
+};
+
+
+struct PVideoFramePool::Shared
+{
+  Shared(unsigned maxIdle)
+    : m_references(1)
+    , m_maxIdle(maxIdle)
+    , m_closed(false)
+    , m_inUse(0)
+    , m_allocated(0)
+    , m_reused(0)
+    , m_copied(0)
+  { }
+
+  ~Shared()
+  {
+    for (size_t i = 0; i < m_idle.size(); ++i)
+      delete m_idle[i];
+  }
+
+  PVideoFrame::Buffer * Get(PINDEX capacity)
+  {
+    PVideoFrame::Buffer * buffer = NULL;
+    {
+      PWaitAndSignal lock(m_mutex);
+
+      for (size_t i = 0; i < m_idle.size(); ++i) {
+        if (m_idle[i]->m_capacity >= capacity) {
+          buffer = m_idle[i];
+          m_idle[i] = m_idle.back();
+          m_idle.pop_back();
+          break;
+        }
+      }
+
+      if (buffer != NULL) {
+        buffer->m_references = 1;
+        ++m_reused;
+      }
+      else {
+        // Frame size has probably changed, so discard a stale buffer
+        if (!m_idle.empty()) {
+          delete m_idle.back();
+          m_idle.pop_back();
+        }
+        ++m_allocated;
+      }
+
+      ++m_inUse;
+      ++m_references;
+    }
+
+    return buffer != NULL ? buffer : new PVideoFrame::Buffer(*this, capacity);
+  }
+
+  void Put(PVideoFrame::Buffer * buffer)
+  {
+    {
+      PWaitAndSignal lock(m_mutex);
+      --m_inUse;
+      if (!m_closed && m_idle.size() < m_maxIdle)
+        m_idle.push_back(buffer);
+      else
+        delete buffer;
+    }
+    Dereference();
+  }
+
+  void Trim()
+  {
+    while (m_idle.size() > m_maxIdle) {
+      delete m_idle.back();
+      m_idle.pop_back();
+    }
+  }
+
+  void Dereference()
+  {
+    if (--m_references == 0)
+      delete this;
+  }
+
+  atomic<unsigned>                   m_references;
+  PDECLARE_MUTEX(                    m_mutex);
+  std::vector<PVideoFrame::Buffer *> m_idle;
+  unsigned                           m_maxIdle;
+  bool                               m_closed;
+  unsigned                           m_inUse;
+  uint64_t                           m_allocated;
+  uint64_t                           m_reused;
+  atomic<uint64_t>                   m_copied;
+};
+
+
+PVideoFrame::PVideoFrame()
+  : m_buffer(NULL)
+  , m_size(0)
+  , m_keyFrame(false)
+{
+}
+
+
+PVideoFrame::PVideoFrame(const PVideoFrame & other)
+  : PVideoFrameInfo(other)
+  , m_buffer(other.m_buffer)
+  , m_size(other.m_size)
+  , m_sampleTime(other.m_sampleTime)
+  , m_keyFrame(other.m_keyFrame)
+{
+  if (m_buffer != NULL)
+    ++m_buffer->m_references;
+}
+
+
+PVideoFrame & PVideoFrame::operator=(const PVideoFrame & other)
+{
+  if (this == &other)
+    return *this;
+
+  if (other.m_buffer != NULL)
+    ++other.m_buffer->m_references;
+  SetEmpty();
+
+  PVideoFrameInfo::operator=(other);
+  m_buffer = other.m_buffer;
+  m_size = other.m_size;
+  m_sampleTime = other.m_sampleTime;
+  m_keyFrame = other.m_keyFrame;
+  return *this;
+}
+
+
+PVideoFrame::~PVideoFrame()
+{
+  SetEmpty();
+}
+
+
+void PVideoFrame::PrintOn(ostream & strm) const
+{
+  PVideoFrameInfo::PrintOn(strm);
+  strm << ", " << m_size << " bytes";
+}
+
+
+void PVideoFrame::SetEmpty()
+{
+  if (m_buffer != NULL && --m_buffer->m_references == 0)
+    m_buffer->m_pool.Put(m_buffer);
+  m_buffer = NULL;
+  m_size = 0;
+}
+
+
+bool PVideoFrame::IsUnique() const
+{
+  return m_buffer != NULL && m_buffer->m_references == 1;
+}
+
+
+bool PVideoFrame::MakeUnique()
+{
+  if (m_buffer == NULL)
+    return false;
+
+  if (m_buffer->m_references == 1)
+    return true;
+
+  PVideoFramePool::Shared & pool = m_buffer->m_pool;
+  Buffer * buffer = pool.Get(m_buffer->m_capacity);
+  memcpy(buffer->m_data, m_buffer->m_data, m_size);
+  ++pool.m_copied;
+
+  PINDEX size = m_size;
+  SetEmpty();
+  m_buffer = buffer;
+  m_size = size;
+  return true;
+}
+
+
+const BYTE * PVideoFrame::GetPointer() const
+{
+  return m_buffer != NULL ? m_buffer->m_data : NULL;
+}
+
+
+BYTE * PVideoFrame::GetPointer()
+{
+  return m_buffer != NULL ? m_buffer->m_data : NULL;
+}
+
+
+bool PVideoFrame::SetSize(PINDEX size)
+{
+  if (size > GetCapacity())
+    return false;
+
+  m_size = size;
+  return true;
+}
+
+
+PINDEX PVideoFrame::GetCapacity() const
+{
+  return m_buffer != NULL ? m_buffer->m_capacity : 0;
+}
+
+
+unsigned PVideoFrame::CalculatePlanes(PINDEX offset[MaxPlanes], PINDEX stride[MaxPlanes]) const
+{
+  if (m_frameWidth == 0 || m_frameHeight == 0)
+    return 0;
+
+  // Planar formats have even dimensions due to UV resolution reduction
+  PINDEX evenWidth = (m_frameWidth+1)&~1;
+  PINDEX evenHeight = (m_frameHeight+1)&~1;
+
+  if (m_colourFormat == PTLIB_VIDEO_YUV420P) {
+    offset[0] = 0;
+    stride[0] = evenWidth;
+    offset[1] = evenWidth*evenHeight;
+    stride[1] = evenWidth/2;
+    offset[2] = offset[1] + stride[1]*evenHeight/2;
+    stride[2] = evenWidth/2;
+    return 3;
+  }
+
+  if (m_colourFormat == "YUV420B") {
+    offset[0] = 0;
+    stride[0] = evenWidth;
+    offset[1] = evenWidth*evenHeight;
+    stride[1] = evenWidth;
+    return 2;
+  }
+
+  PINDEX bytes = CalculateFrameBytes();
+  if (bytes == 0)
+    return 0;
+
+  offset[0] = 0;
+  stride[0] = bytes/m_frameHeight;
+  return 1;
+}
+
+
+unsigned PVideoFrame::GetPlaneCount() const
+{
+  PINDEX offset[MaxPlanes], stride[MaxPlanes];
+  return CalculatePlanes(offset, stride);
+}
+
+
+const BYTE * PVideoFrame::GetPlane(unsigned plane) const
+{
+  PINDEX offset[MaxPlanes], stride[MaxPlanes];
+  if (m_buffer == NULL || plane >= CalculatePlanes(offset, stride) || offset[plane] >= m_buffer->m_capacity)
+    return NULL;
+  return m_buffer->m_data + offset[plane];
+}
+
+
+BYTE * PVideoFrame::GetPlane(unsigned plane)
+{
+  return const_cast<BYTE *>(static_cast<const PVideoFrame *>(this)->GetPlane(plane));
+}
+
+
+PINDEX PVideoFrame::GetStride(unsigned plane) const
+{
+  PINDEX offset[MaxPlanes], stride[MaxPlanes];
+  return plane < CalculatePlanes(offset, stride) ? stride[plane] : 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PVideoFramePool
+
+PVideoFramePool::PVideoFramePool(unsigned maxIdle)
+  : m_shared(new Shared(maxIdle))
+{
+}
+
+
+PVideoFramePool::~PVideoFramePool()
+{
+  {
+    PWaitAndSignal lock(m_shared->m_mutex);
+    m_shared->m_closed = true;
+    m_shared->m_maxIdle = 0;
+    m_shared->Trim();
+  }
+  m_shared->Dereference();
+}
+
+
+bool PVideoFramePool::Allocate(PVideoFrame & frame, const PVideoFrameInfo & info, PINDEX bytes)
+{
+  if (bytes == 0 && (bytes = info.CalculateFrameBytes()) == 0) {
+    PTRACE(2, "Cannot allocate frame for " << info);
+    return false;
+  }
+
+  PVideoFrame::Buffer * buffer = m_shared->Get(bytes);
+
+  frame.SetEmpty();
+  frame.PVideoFrameInfo::operator=(info);
+  frame.m_buffer = buffer;
+  frame.m_size = bytes;
+  frame.m_sampleTime = 0;
+  frame.m_keyFrame = false;
+  return true;
+}
+
+
+void PVideoFramePool::SetMaxIdle(unsigned maxIdle)
+{
+  PWaitAndSignal lock(m_shared->m_mutex);
+  m_shared->m_maxIdle = maxIdle;
+  m_shared->Trim();
+}
+
+
+unsigned PVideoFramePool::GetMaxIdle() const
+{
+  PWaitAndSignal lock(m_shared->m_mutex);
+  return m_shared->m_maxIdle;
+}
+
+
+PVideoFramePool::Statistics::Statistics()
+  : m_allocated(0)
+  , m_reused(0)
+  , m_copied(0)
+  , m_idle(0)
+  , m_inUse(0)
+{
+}
+
+
+void PVideoFramePool::Statistics::PrintOn(ostream & strm) const
+{
+  strm << "allocated=" << m_allocated
+       << " reused=" << m_reused
+       << " copied=" << m_copied
+       << " idle=" << m_idle
+       << " in-use=" << m_inUse;
+}
+
+
+PVideoFramePool::Statistics PVideoFramePool::GetStatistics() const
+{
+  Statistics stats;
+  PWaitAndSignal lock(m_shared->m_mutex);
+  stats.m_allocated = m_shared->m_allocated;
+  stats.m_reused = m_shared->m_reused;
+  stats.m_copied = m_shared->m_copied;
+  stats.m_idle = m_shared->m_idle.size();
+  stats.m_inUse = m_shared->m_inUse;
+  return stats;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // PVideoDevice
 
@@ -1091,6 +1484,21 @@ bool PVideoOutputDevice::SetPosition(int, int)
 }
 
 
+bool PVideoOutputDevice::SetFrame(const PVideoFrame & frame, bool * keyFrameNeeded)
+{
+  if (frame.IsEmpty())
+    return false;
+
+  FrameData frameData;
+  frame.GetFrameSize(frameData.width, frameData.height);
+  frame.GetSarSize(frameData.sarWidth, frameData.sarHeight);
+  frameData.sampleTime = frame.GetSampleTime();
+  frameData.pixels = frame.GetPointer();
+  frameData.keyFrameNeeded = keyFrameNeeded;
+  return SetFrameData(frameData);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 // PVideoOutputDeviceRGB
 
@@ -1461,6 +1869,40 @@ PBoolean PVideoInputDevice::GetFrame(PBYTEArray & frame, unsigned & width, unsig
 }
 
 
+bool PVideoInputDevice::GetFrame(PVideoFrame & frame, bool & keyFrame, bool wait)
+{
+  PINDEX size = GetMaxFrameBytes();
+  if (size == 0) {
+    PTRACE(2, "Frame size in bytes not available on " << *this);
+    return false;
+  }
+
+  unsigned width, height;
+  GetFrameSize(width, height);
+  PVideoFrameInfo info(width, height, GetColourFormat(), GetFrameRate(), GetResizeMode());
+  info.SetFrameSar(GetSarWidth(), GetSarHeight());
+  if (!m_framePool.Allocate(frame, info, size))
+    return false;
+
+  PINDEX returned = 0;
+  if (!InternalGetFrameData(frame.GetPointer(), returned, keyFrame, wait)) {
+    frame.SetEmpty();
+    return false;
+  }
+
+  frame.SetSize(returned);
+  frame.SetKeyFrame(keyFrame);
+  return true;
+}
+
+
+bool PVideoInputDevice::GetFrame(PVideoFrame & frame)
+{
+  bool keyFrame = true;
+  return GetFrame(frame, keyFrame, true);
+}
+
+
 PBoolean PVideoInputDevice::GetFrameData(BYTE * buffer, PINDEX * bytesReturned, bool & keyFrame)
 {
   PINDEX dummy;
@@ -447,11 +447,11 @@ int PServiceProcess::InternalMain(void * arg)
 
   // Set thread ID for the process back to this thread, mostly for destruction logging
   m_threadMutex.Wait();
-  m_activeThreads.erase(m_threadId);
+  InternalRemoveThread(this);
   m_uniqueId = m_threadId = GetCurrentThreadId();
   m_threadHandle.Detach();
   m_threadHandle = GetCurrentThread();
-  m_activeThreads[m_threadId] = this;
+  InternalAddThread(this);
   m_threadMutex.Signal();
 
   m_controlWindow = NULL; // This stops the logging direct to Window, but not to file
@@ -1024,7 +1024,7 @@ void PServiceProcess::ThreadEntry()
 {
   m_threadMutex.Wait();
   m_uniqueId = m_threadId = ::GetCurrentThreadId();
-  m_activeThreads[m_threadId] = this;
+  InternalAddThread(this);
   m_threadMutex.Signal();
 
   Startup();
@@ -263,33 +263,40 @@ PChannel::Errors PSocket::Select(SelectList & read,
 
 #if P_HAS_POLL
 
-  size_t pfdSize = sizeof(::pollfd)*(read.GetSize() + write.GetSize() + except.GetSize() + 1);
-  ::pollfd * pfd = (::pollfd *)alloca(pfdSize);
-  memset(pfd, 0, pfdSize);
+  /* Each list entry gets its own pollfd, in list order, even if the same
+     handle is in more than one list. poll() allows this, and it means the
+     results can be matched up directly afterwards, rather than searching
+     for the handle, which is O(n^2) for large lists. Large lists go on the
+     heap rather than the stack. */
+  PINDEX pfdCount = read.GetSize() + write.GetSize() + except.GetSize() + 1;
+  std::vector< ::pollfd> pfdHeap;
+  ::pollfd * pfd;
+  if (pfdCount <= 64)
+    pfd = (::pollfd *)alloca(sizeof(::pollfd)*pfdCount);
+  else {
+    pfdHeap.resize(pfdCount);
+    pfd = &pfdHeap[0];
+  }
+  memset(pfd, 0, sizeof(::pollfd)*pfdCount);
 
 #if P_PTHREADS
-  PINDEX count = 1;
+  static const PINDEX FirstSocketIndex = 1;
   pfd[0].fd = unblockPipe;
   pfd[0].events = POLLIN;
 #else
-  PIDNEX count = 0;
+  static const PINDEX FirstSocketIndex = 0;
 #endif
+  PINDEX count = FirstSocketIndex;
 
   for (i = 0; i < 3; i++) {
     for (SelectList::iterator it = list[i]->begin(); it != list[i]->end(); it++) {
       if (firstSocket == NULL)
         firstSocket = &*it;
 
-      int h = it->GetHandle();
-      for (j = 0; j < count; ++j) {
-        if (pfd[j].fd == h)
-          break;
-      }
-      if (j == count)
-        pfd[count++].fd = h;
-
       static int const EventBit[3] = { POLLIN | POLLNVAL, POLLOUT | POLLNVAL, POLLERR | POLLNVAL };
-      pfd[j].events |= EventBit[i];
+      pfd[count].fd = it->GetHandle();
+      pfd[count].events = EventBit[i];
+      ++count;
 
 #if P_PTHREADS
       PSocket & socket = *it;
@@ -322,6 +329,7 @@ PChannel::Errors PSocket::Select(SelectList & read,
   else
     lastError = firstSocket->GetErrorCode();
 
+  j = FirstSocketIndex;
   for (i = 0; i < 3; i++) {
     SelectList::iterator it = list[i]->begin();
     while (it != list[i]->end()) {
@@ -338,17 +346,12 @@ PChannel::Errors PSocket::Select(SelectList & read,
           lastError = Interrupted;
           ++it;
         }
-        else {
-          for (j = 0; j < count; ++j) {
-            if (pfd[j].fd == h)
-              break;
-          }
-          if (j < count && pfd[j].revents != 0)
-            ++it;
-          else
-            list[i]->erase(it++);
-        }
+        else if (pfd[j].revents != 0)
+          ++it;
+        else
+          list[i]->erase(it++);
       }
+      ++j;
     }
   }
 
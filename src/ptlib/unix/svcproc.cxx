@@ -657,6 +657,11 @@ void PServiceProcess::AsynchronousRunTimeSignal(int signal, PProcessIdentifier s
         couldNotWrite = "";
     }
 
+#if PTRACING
+    // Get out anything the background trace writer has not yet done
+    PTrace::Flush();
+#endif
+
     PSystemLog log(PSystemLog::Fatal);
     log << "Caught " << sigmsg << " (" << GetRunTimeSignalName(signal) << "),"
            " thread-id=" << PThread::GetIdentifiersAsString(tid, uid) << ","
@@ -444,11 +444,11 @@ bool PThread::PX_kill(PThreadIdentifier tid, PUniqueThreadIdentifier uid, int si
   if (!PProcess::IsInitialised())
     return false;
 
-  PProcess & process = PProcess::Current();
   {
-    PWaitAndSignal mutex(process.m_threadMutex);
-    PProcess::ThreadMap::iterator it = process.m_activeThreads.find(tid);
-    if (it == process.m_activeThreads.end() || (uid != 0 && it->second->GetUniqueIdentifier() != uid))
+    PProcess::ThreadShard & shard = PProcess::Current().GetThreadShard(tid);
+    PWaitAndSignal mutex(shard.m_mutex);
+    PProcess::ThreadMap::iterator it = shard.m_threads.find(tid);
+    if (it == shard.m_threads.end() || (uid != 0 && it->second->GetUniqueIdentifier() != uid))
       return false;
   }
 